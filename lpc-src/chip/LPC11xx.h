@@ -156,7 +156,7 @@ typedef struct
   __IO	uint32_t WDTOSCCTRL;		// Watchdog oscillator control
   __IO	uint32_t IRCCTRL;		// IRC control
 	uint32_t RESERVED1[1];
-  __I	uint32_t SYSRSTSTAT;		// System reset status register
+  __IO	uint32_t SYSRSTSTAT;		// System reset status register, write 1s to clear
 	uint32_t RESERVED2[3];
   __IO	uint32_t SYSPLLCLKSEL;		// System PLL clock source select
   __IO	uint32_t SYSPLLCLKUEN;		// System PLL clock source update enable
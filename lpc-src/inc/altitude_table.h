@@ -0,0 +1,46 @@
+/* Made by make -C tools tables from src/altitude.c */
+
+#ifndef ALTITUDE_TABLE_H
+#define ALTITUDE_TABLE_H
+
+#define ALTITUDE_TABLE_SIZE	128
+
+static const uint32_t altitude_table_pressure[ALTITUDE_TABLE_SIZE] = {
+  110000, 104099, 98514, 93229, 88227, 83494, 79014, 74775,
+  70763, 66967, 63374, 59974, 56757, 53712, 50830, 48103,
+  45522, 43080, 40769, 38582, 36512, 34553, 32699, 30945,
+  29285, 27714, 26227, 24820, 23488, 22228, 21036, 19907,
+  18839, 17828, 16872, 15967, 15110, 14299, 13532, 12806,
+  12119, 11469, 10854, 10271, 9720, 9199, 8705, 8238,
+  7796, 7378, 6982, 6608, 6253, 5918, 5600, 5300,
+  5015, 4746, 4492, 4251, 4023, 3807, 3603, 3409,
+  3226, 3053, 2890, 2735, 2588, 2449, 2318, 2193,
+  2076, 1964, 1859, 1759, 1665, 1575, 1491, 1411,
+  1335, 1264, 1196, 1132, 1071, 1013, 959, 908,
+  859, 813, 769, 728, 689, 652, 617, 584,
+  553, 523, 495, 468, 443, 419, 397, 376,
+  355, 336, 318, 301, 285, 270, 255, 242,
+  229, 216, 205, 194, 183, 174, 164, 155,
+  147, 139, 132, 125, 118, 112, 106, 100,
+};
+
+static const int32_t altitude_table_decimetres[ALTITUDE_TABLE_SIZE] = {
+  -6982, -2284, 2367, 6969, 11525, 16033, 20495, 24911,
+  29282, 33607, 37888, 42125, 46318, 50467, 54575, 58640,
+  62663, 66644, 70584, 74483, 78343, 82163, 85944, 89684,
+  93387, 97051, 100678, 104266, 107820, 111336, 114844, 118355,
+  121865, 125377, 128886, 132397, 135910, 139424, 142935, 146448,
+  149961, 153474, 156986, 160505, 164019, 167531, 171050, 174566,
+  178082, 181597, 185116, 188627, 192150, 195663, 199188, 202703,
+  206237, 209768, 213297, 216841, 220389, 223948, 227506, 231088,
+  234665, 238244, 241813, 245405, 249011, 252621, 256222, 259859,
+  263463, 267114, 270738, 274391, 278026, 281710, 285350, 289019,
+  292708, 296357, 300055, 303739, 307456, 311198, 314887, 318573,
+  322322, 326055, 329846, 333597, 337383, 341197, 345027, 348860,
+  352681, 356607, 360498, 364483, 368401, 372395, 376281, 380214,
+  384393, 388412, 392453, 396504, 400551, 404574, 408848, 412779,
+  416945, 421376, 425358, 429578, 434066, 437961, 442554, 446955,
+  451107, 455511, 459596, 463923, 468521, 472704, 477131, 481817,
+};
+
+#endif /* ALTITUDE_TABLE_H */
@@ -0,0 +1,76 @@
+/*
+ * Switches the core between a slow and a fast clock
+ * Copyright (C) 2014  richard
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef CLOCK_H
+#define CLOCK_H
+
+#include "LPC11xx.h"
+
+/**
+ * The speeds the core can run at. Slow is the IRC with the crystal and
+ * PLL powered down, for sleeping through. Fast is the crystal through
+ * the PLL, for building frames and writing the SD card.
+ *
+ * SSP1 is a slave to the IMU, and a slave's clock has to be at least
+ * 12 times the bus clock, so slow can't go much below 12MHz.
+ */
+#define CLOCK_SLOW		0
+#define CLOCK_FAST		1
+
+#define CLOCK_IRC_HZ		12000000
+#define CLOCK_XTAL_HZ		12000000
+#define CLOCK_SLOW_DIV		1	/* SYSAHBCLKDIV */
+#define CLOCK_PLL_MUL		4	/* 48MHz */
+#define CLOCK_PLL_PSEL		1	/* P = 2, FCCO = 192MHz */
+
+#define CLOCK_SLOW_HZ		(CLOCK_IRC_HZ / CLOCK_SLOW_DIV)
+#define CLOCK_FAST_HZ		(CLOCK_XTAL_HZ * CLOCK_PLL_MUL)
+
+/**
+ * Peripherals that are timed from the core clock register to be told
+ * when it changes, and set themselves up again from SystemCoreClock.
+ * They're called with interrupts disabled.
+ */
+#define CLOCK_LISTENERS		8
+
+typedef void (*clock_listener)(void);
+
+/**
+ * The SYSCON registers clock_syscon() changes
+ */
+#define CLOCK_AHB		0	/* SYSAHBCLKCTRL */
+#define CLOCK_POWER		1	/* PDRUNCFG */
+
+/**
+ * How many fast clock cycles there are to each cycle now
+ */
+extern volatile uint8_t clock_multiple;
+
+void clock_init(void);
+void clock_register(clock_listener listener);
+void clock_set(uint8_t speed);
+uint8_t clock_speed(void);
+void clock_syscon(uint8_t reg, uint32_t set, uint32_t clear);
+
+#endif /* CLOCK_H */
@@ -0,0 +1,67 @@
+/*
+ * Control logic for the cutdown, heater and GSM
+ * Copyright (C) 2014  richard
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef CONTROL_H
+#define CONTROL_H
+
+#include "LPC11xx.h"
+#include "bmp085.h"
+#include "estimator.h"
+
+/**
+ * The SysTick rate, which the cutdown timer counts down at
+ */
+#define SYSTICK_HZ		1000
+/**
+ * The number of minutes until the cutdown system activates
+ * MAX = 2^32/(60*SYSTICK_HZ) ~= 71000
+ */
+#define CUTDOWN_TIME		180
+/**
+ * The mBed is powered on below the given barometric altitude in
+ * meters
+ */
+#define GSM_ON_BELOW_ALTITUDE	1000
+/**
+ * The altitude ceiling at which cutdown will occour (in meters)
+ */
+#define CUTDOWN_CEILING		40000
+/**
+ * The minimum barometric altitude in meters at which the balloon must
+ * be for cutdown to occour.
+ */
+#define MIN_CUTDOWN_ALTITUDE	1000
+/**
+ * The threshold temperature for the heater to activate in °C
+ */
+#define HEATER_THRESHOLD	-30
+
+void control_gsm(double altitude);
+void control_cutdown(uint32_t ticks, double altitude);
+void control_heater(double internal_temperature);
+
+double control_update(struct estimator* e, struct barometer* b,
+		      uint32_t ticks_until_cutdown);
+
+#endif /* CONTROL_H */
@@ -0,0 +1,93 @@
+/*
+ * Delta compressed telemetry frames
+ * Copyright (C) 2014  richard
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef DELTA_H
+#define DELTA_H
+
+#include "frame.h"
+
+/**
+ * Compressed binary frames. Every DELTA_KEY_PERIOD frames there's a
+ * keyframe with every field, and in between a delta frame with only
+ * the fields that differ from the last keyframe. Deltas are from the
+ * keyframe rather than the frame before, so losing a delta frame
+ * doesn't lose any others.
+ *
+ * Key:   'K' | each field
+ * Delta: 'D' | keyframe's sentence_id & 0xFF | bitmap | changed fields
+ *
+ * Integer fields are zigzag varints, of the value in a keyframe and of
+ * the difference in a delta. Text is null terminated. The bitmap has a
+ * bit for each field, first field in the low bit of the first byte.
+ * Only the fields for where are sent, and fields that aren't sent in
+ * the frame's phase are zero unless where has FRAME_EVERY_PHASE.
+ */
+#define DELTA_KEY		'K'
+#define DELTA_DELTA		'D'
+#define DELTA_KEY_PERIOD	10
+
+/**
+ * Longest a varint can be for each type. Differences are taken as 32
+ * bits, so a 16 bit field can change by up to 65535 and an 8 bit one
+ * by 255, which zigzag to 3 and 2 bytes.
+ */
+#define DELTA_SIZE_frame_text	(FRAME_TEXT_MAX + 1)
+#define DELTA_SIZE_frame_time	5
+#define DELTA_SIZE_int32_t	5
+#define DELTA_SIZE_uint32_t	5
+#define DELTA_SIZE_int16_t	3
+#define DELTA_SIZE_uint16_t	3
+#define DELTA_SIZE_uint8_t	2
+
+/**
+ * Longest a frame can be, a delta frame with every field changed
+ */
+#define DELTA_FIELD(name, type, scale, precision, where, phases, description) \
+  1 +
+#define DELTA_FIELD_SIZE(name, type, scale, precision, where, phases, description) \
+  DELTA_SIZE_##type +
+enum delta_max {
+  DELTA_MAX = 2 + (FRAME_FIELDS(DELTA_FIELD) 7) / 8 + FRAME_FIELDS(DELTA_FIELD_SIZE) 0
+};
+#undef DELTA_FIELD
+#undef DELTA_FIELD_SIZE
+
+struct delta_encoder {
+  struct frame key;
+  uint8_t period, since_key, where;
+};
+struct delta_decoder {
+  struct frame key;
+  uint8_t have_key, where;
+};
+
+void delta_encoder_init(struct delta_encoder* e, uint8_t period, uint8_t where);
+int delta_encode(struct delta_encoder* e, const struct frame* f,
+		 uint8_t* data, int size);
+
+void delta_decoder_init(struct delta_decoder* d, uint8_t where);
+int delta_decode(struct delta_decoder* d, const uint8_t* data, int size,
+		 struct frame* f);
+
+#endif /* DELTA_H */
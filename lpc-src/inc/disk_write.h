@@ -25,6 +25,11 @@
 #ifndef DISK_WRTIE_H
 #define DISK_WRITE_H
 
+#include "sd.h"
+
 int disk_write_next_block(const uint8_t *buffer, uint32_t length);
+int disk_write_next_block_parts(const struct disk_part* parts, uint32_t count);
+uint32_t disk_write_head(void);
+void disk_write_resume(uint32_t block);
 
 #endif /* DISK_WRITE_H */
@@ -0,0 +1,64 @@
+/*
+ * Barometric altitude estimator
+ * Copyright (C) 2014  richard
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef ESTIMATOR_H
+#define ESTIMATOR_H
+
+#include "LPC11xx.h"
+#include "bmp085.h"
+#include "gps.h"
+
+/**
+ * Altitude and vertical rate from the barometer, in fixed point.
+ *
+ * An alpha-beta filter over the barometric altitude. Readings too far
+ * from where the filter expects to be are thrown away, so one bad
+ * sample can't move the altitude that drives the cutdown. GPS altitude
+ * corrects the barometer's offset from the standard atmosphere while
+ * it's available.
+ */
+struct estimator {
+  int32_t altitude;		/* Barometric, mm */
+  int32_t rate;			/* mm/s, positive up */
+  int32_t spread;		/* Mean size of a residual, mm */
+  int32_t bias;			/* GPS minus barometric, mm */
+  int32_t max_altitude;		/* mm */
+  uint32_t since_accepted;	/* ms */
+  uint32_t rejected;		/* Readings thrown away */
+  uint8_t settled;		/* Readings in a row at start-up */
+  uint8_t rejects;		/* Readings thrown away in a row */
+  uint8_t falling;		/* Samples in a row that look like descent */
+  uint8_t have_bias;
+  uint8_t burst;
+};
+
+void estimator_init(struct estimator* e);
+void estimator_update(struct estimator* e, struct barometer* b, uint32_t dt);
+void estimator_gps(struct estimator* e, struct gps_data* gd);
+
+int estimator_valid(struct estimator* e);
+int32_t estimator_altitude(struct estimator* e);
+int32_t estimator_rate(struct estimator* e);
+
+#endif /* ESTIMATOR_H */
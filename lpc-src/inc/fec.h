@@ -0,0 +1,69 @@
+/*
+ * Forward error correction for the downlink
+ * Copyright (C) 2014  richard
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef FEC_H
+#define FEC_H
+
+#include "LPC11xx.h"
+
+/**
+ * A packet is a sync word, the message length three times over, then
+ * the message after a rate 1/2, K=7 convolutional code (the CCSDS
+ * polynomials, 171 and 133 octal) and a block interleaver.
+ *
+ * +---------------+------------+----------------------------------+
+ * | 1A CF FC 1D   | len x 3    | coded and interleaved message    |
+ * +---------------+------------+----------------------------------+
+ *
+ * The coder starts from zero and is flushed with six zero bits, so
+ * there are 2 * (8 * len + 6) coded bits. Those are padded with zeros
+ * to a multiple of FEC_ROWS, written into FEC_ROWS rows and sent a
+ * column at a time, so a burst of up to FEC_ROWS bits on the air hits
+ * coded bits a whole row apart.
+ */
+#define FEC_SYNC		{ 0x1A, 0xCF, 0xFC, 0x1D }
+#define FEC_SYNC_SIZE		4
+#define FEC_HEADER_SIZE		(FEC_SYNC_SIZE + 3)
+#define FEC_K			7
+#define FEC_POLY_A		0x79
+#define FEC_POLY_B		0x5B
+#define FEC_ROWS		16
+#define FEC_MAX_MESSAGE		255
+
+#define FEC_CODED_BITS(len)	(2U * ((8U * (len)) + (FEC_K - 1)))
+#define FEC_SENT_BITS(len)						\
+  (((FEC_CODED_BITS(len) + FEC_ROWS - 1) / FEC_ROWS) * FEC_ROWS)
+#define FEC_PACKET_SIZE(len)	(FEC_HEADER_SIZE + (FEC_SENT_BITS(len) / 8))
+
+/**
+ * The two coded bits for each seven bit window of the message, oldest
+ * bit in the MSB. Bit 0 is from FEC_POLY_A, bit 1 from FEC_POLY_B.
+ */
+extern const uint8_t fec_table[1 << FEC_K];
+
+uint8_t fec_packet_byte(const uint8_t* message, uint32_t length, uint32_t index);
+uint32_t fec_encode(const uint8_t* message, uint32_t length,
+		    uint8_t* packet, uint32_t size);
+
+#endif /* FEC_H */
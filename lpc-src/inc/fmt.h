@@ -0,0 +1,44 @@
+/*
+ * Numbers to and from text without stdio
+ * Copyright (C) 2014  richard
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef FMT_H
+#define FMT_H
+
+#include "LPC11xx.h"
+
+/**
+ * Numbers to and from text without stdio, which with its float support
+ * is most of the flash. Writers return the position after what they've
+ * written and don't null terminate. Readers take what sscanf would for
+ * %d or %x with a width, or the whole number if width is 0, and return
+ * the position after it or NULL if there wasn't a number there.
+ */
+char* fmt_unsigned(char* p, uint32_t u, int precision);
+char* fmt_signed(char* p, int32_t v, int32_t divisor, int precision);
+char* fmt_hex(char* p, uint32_t v, int digits);
+
+const char* fmt_parse_int(const char* p, int width, int* value);
+const char* fmt_parse_hex(const char* p, int width, unsigned* value);
+
+#endif /* FMT_H */
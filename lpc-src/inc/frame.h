@@ -0,0 +1,177 @@
+/*
+ * Telemetry frame schema
+ * Copyright (C) 2014  richard
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef FRAME_H
+#define FRAME_H
+
+#include <stdint.h>
+
+/**
+ * Flight phases, which phase.c works out. Each field is only sent in
+ * some of them.
+ */
+enum flight_phase {
+  PHASE_GROUND,
+  PHASE_ASCENT,
+  PHASE_FLOAT,
+  PHASE_DESCENT,
+  PHASE_LANDED,
+  PHASES
+};
+#define FRAME_GROUND		(1 << PHASE_GROUND)
+#define FRAME_ASCENT		(1 << PHASE_ASCENT)
+#define FRAME_FLOAT		(1 << PHASE_FLOAT)
+#define FRAME_DESCENT		(1 << PHASE_DESCENT)
+#define FRAME_LANDED		(1 << PHASE_LANDED)
+#define FRAME_FLYING		(FRAME_ASCENT | FRAME_FLOAT | FRAME_DESCENT)
+#define FRAME_ALWAYS		((1 << PHASES) - 1)
+
+/**
+ * Every field of a frame, in the order they're sent. This table is the
+ * only place the order is written down: the encoders and decoders in
+ * protocol.c and delta.c and the tables in Communication-Protocol.md
+ * (tools/framedoc) are all made from it.
+ *
+ * X(name, type, scale, precision, where, phases, description)
+ *
+ * name		The member of struct frame.
+ * type		What the member is. Integer fields hold the value times
+ *		scale, and are that many bytes in a binary frame.
+ *		frame_text is a short string and frame_time seconds since
+ *		midnight, which is hh:mm:ss in text.
+ * scale	Counts per unit.
+ * precision	Decimal places in text. scale has to be a multiple of
+ *		10^precision.
+ * where	FRAME_RADIO for the sentence we send, which goes on the
+ *		SD card too, or FRAME_SD for the extra fields that only go
+ *		on the SD card, after the sentence.
+ * phases	The flight phases the field is sent in. The phase field
+ *		has to come before any field that isn't sent in every
+ *		phase, so decoders know which are there.
+ */
+#define FRAME_FIELDS(X)							\
+  X(callsign,		frame_text, 1,	     0, FRAME_RADIO, FRAME_ALWAYS, "Callsign") \
+  X(sentence_id,	uint32_t,   1,	     0, FRAME_RADIO, FRAME_ALWAYS, "Sentence ID (Increments)") \
+  X(time,		frame_time, 1,	     0, FRAME_RADIO, FRAME_ALWAYS, "Time of Day (from GPS)") \
+  X(phase,		uint8_t,    1,	     0, FRAME_RADIO, FRAME_ALWAYS, "Flight Phase (0 ground, 1 ascent, 2 float, 3 descent, 4 landed)") \
+  X(latitude,		int32_t,    1000000, 6, FRAME_RADIO, FRAME_ALWAYS, "GPS Latitude (Decimal Degrees)") \
+  X(longitude,		int32_t,    1000000, 6, FRAME_RADIO, FRAME_ALWAYS, "GPS Longitude (Decimal Degrees)") \
+  X(gps_altitude,	int32_t,    1,	     0, FRAME_RADIO, FRAME_ALWAYS, "GPS Altitude (Meters)") \
+  X(satellites,		uint8_t,    1,	     0, FRAME_RADIO, FRAME_ALWAYS, "GPS Satellites in View") \
+  X(altitude,		int32_t,    10,	     1, FRAME_RADIO, FRAME_FLYING, "Altitude (Meters, filtered barometric corrected by GPS)") \
+  X(ascent_rate,	int32_t,    1000,    1, FRAME_RADIO, FRAME_FLYING, "Ascent Rate (Meters per Second)") \
+  X(external_temperature, int16_t,  10,	     1, FRAME_RADIO, FRAME_ASCENT | FRAME_FLOAT, "External Temperature (from TMP102)") \
+  X(internal_temperature, int16_t,  10,	     1, FRAME_RADIO, FRAME_ALWAYS & ~FRAME_DESCENT, "Internal Temperature (from Barometer)") \
+  X(accel_x,		int16_t,    1,	     0, FRAME_RADIO, FRAME_FLOAT, "Acceleration X") \
+  X(accel_y,		int16_t,    1,	     0, FRAME_RADIO, FRAME_FLOAT, "Acceleration Y") \
+  X(accel_z,		int16_t,    1,	     0, FRAME_RADIO, FRAME_FLOAT, "Acceleration Z") \
+  X(cutdown_minutes,	int16_t,    1,	     0, FRAME_RADIO, FRAME_ASCENT | FRAME_FLOAT, "Minutes until Cutdown") \
+  X(cutdown_voltage,	uint16_t,   1000,    1, FRAME_RADIO, FRAME_GROUND | FRAME_ASCENT | FRAME_FLOAT, "Battery on Cutdown Line (Volts)") \
+  X(battery_charge,	uint8_t,    1,	     0, FRAME_RADIO, FRAME_GROUND | FRAME_FLOAT | FRAME_LANDED, "Main Battery Charge Left (%, counted)") \
+  X(sleep_percentage,	uint8_t,    1,	     0, FRAME_RADIO, FRAME_GROUND | FRAME_FLOAT | FRAME_LANDED, "Time Asleep (%)") \
+  X(landing_seconds,	uint16_t,   1,	     0, FRAME_RADIO, FRAME_DESCENT, "Seconds until Landing (predicted)") \
+  X(landing_latitude,	int32_t,    1000000, 6, FRAME_RADIO, FRAME_DESCENT, "Landing Latitude (predicted)") \
+  X(landing_longitude,	int32_t,    1000000, 6, FRAME_RADIO, FRAME_DESCENT, "Landing Longitude (predicted)") \
+  X(gyro_x,		int16_t,    1,	     0, FRAME_SD,    FRAME_ALWAYS, "Gyroscope X") \
+  X(gyro_y,		int16_t,    1,	     0, FRAME_SD,    FRAME_ALWAYS, "Gyroscope Y") \
+  X(gyro_z,		int16_t,    1,	     0, FRAME_SD,    FRAME_ALWAYS, "Gyroscope Z") \
+  X(magneto_x,		int16_t,    1,	     0, FRAME_SD,    FRAME_ALWAYS, "Magnetometer X") \
+  X(magneto_y,		int16_t,    1,	     0, FRAME_SD,    FRAME_ALWAYS, "Magnetometer Y") \
+  X(magneto_z,		int16_t,    1,	     0, FRAME_SD,    FRAME_ALWAYS, "Magnetometer Z") \
+  X(ticks_active,	uint32_t,   1,	     0, FRAME_SD,    FRAME_ALWAYS, "Ticks Active") \
+  X(ticks_asleep,	uint32_t,   1,	     0, FRAME_SD,    FRAME_ALWAYS, "Ticks Asleep") \
+  X(ticks_deep_sleep,	uint32_t,   1,	     0, FRAME_SD,    FRAME_ALWAYS, "Ticks in Deep-sleep") \
+  X(battery_voltage,	uint16_t,   1000,    2, FRAME_SD,    FRAME_ALWAYS, "Main Battery (Volts, mean)") \
+  X(battery_min,	uint16_t,   1000,    2, FRAME_SD,    FRAME_ALWAYS, "Main Battery (Volts, lowest)") \
+  X(battery_max,	uint16_t,   1000,    2, FRAME_SD,    FRAME_ALWAYS, "Main Battery (Volts, highest)") \
+  X(cutdown_min,	uint16_t,   1000,    2, FRAME_SD,    FRAME_ALWAYS, "Battery on Cutdown Line (Volts, lowest)") \
+  X(heater_current,	uint16_t,   1,	     0, FRAME_SD,    FRAME_ALWAYS, "Heater Current (mA, mean)") \
+  X(heater_max,		uint16_t,   1,	     0, FRAME_SD,    FRAME_ALWAYS, "Heater Current (mA, highest)") \
+  X(charge_used,	uint16_t,   1,	     0, FRAME_SD,    FRAME_ALWAYS, "Main Battery Charge Used (mAh)") \
+  X(stack_peak,		uint16_t,   1,	     0, FRAME_SD,    FRAME_ALWAYS, "Stack Used (bytes, most so far)") \
+  X(pool_peak,		uint8_t,    1,	     0, FRAME_SD,    FRAME_ALWAYS, "Pool Blocks Used (most so far)") \
+  X(resets,		uint8_t,    1,	     0, FRAME_SD,    FRAME_ALWAYS, "Warm Resets (since power on)") \
+  X(reset_cause,	uint8_t,    1,	     0, FRAME_SD,    FRAME_ALWAYS, "Last Reset Cause (SYSRSTSTAT)")
+
+#define FRAME_RADIO		1
+#define FRAME_SD		2
+/**
+ * Or'd into where, every field whatever the phase. The SD card keeps
+ * everything.
+ */
+#define FRAME_EVERY_PHASE	4
+/**
+ * Or'd into where, only the fields that aren't sent in the frame's
+ * phase. The SD card has these after the sentence.
+ */
+#define FRAME_OTHER_PHASES	8
+
+#define FRAME_TEXT_MAX		15
+typedef char frame_text[FRAME_TEXT_MAX + 1];
+typedef uint32_t frame_time;
+
+/**
+ * Longest a field can be in text, and in a binary frame
+ */
+#define FRAME_FIELD_MAX		(FRAME_TEXT_MAX + 1)
+
+#define FRAME_MEMBER(name, type, scale, precision, where, phases, description) \
+  type name;
+struct frame {
+  FRAME_FIELDS(FRAME_MEMBER)
+};
+#undef FRAME_MEMBER
+
+/**
+ * Sets a field from a value in its units, rounded
+ */
+#define FRAME_SCALE(name, type, scale, precision, where, phases, description) \
+  FRAME_SCALE_##name = scale,
+enum frame_scale {
+  FRAME_FIELDS(FRAME_SCALE)
+};
+#undef FRAME_SCALE
+
+#define FRAME_SET(f, name, value)					\
+  ((f)->name = ((value) * FRAME_SCALE_##name) + (((value) < 0) ? -0.5 : 0.5))
+
+/**
+ * The fields for where, and the frame's phase unless where has
+ * FRAME_EVERY_PHASE, separated by commas. The text forms return
+ * the number of characters written, not including the terminating
+ * null, or 0 if it doesn't fit. The decoders take the fields up to
+ * end, and return 0 on success.
+ */
+int frame_encode_text(char* string, int size, const struct frame* f, int where);
+int frame_decode_text(const char* string, const char* end, struct frame* f,
+		      int where);
+
+/**
+ * The fields for any of where, little endian. Returns the number of
+ * bytes, or 0 if it doesn't fit. frame_unpack() returns 0 on success.
+ */
+int frame_pack(uint8_t* data, int size, const struct frame* f, int where);
+int frame_unpack(const uint8_t* data, int size, struct frame* f, int where);
+
+#endif /* FRAME_H */
@@ -25,6 +25,26 @@
 #ifndef GPS_H
 #define GPS_H
 
+#include "ubx.h"
+
+/**
+ * A u-blox receiver instead of the EM406, configured over UBX at boot
+ * and sending NAV-PVT instead of NMEA - Uncomment to enable
+ */
+/*#define GPS_UBX*/
+/**
+ * Its baud rate, which is the receiver's default, and how many fixes
+ * a second it makes, 1 to 5. Power save mode only works at 1Hz.
+ */
+#define GPS_UBX_BAUD		9600
+#define GPS_UBX_RATE_HZ		1
+/*#define GPS_UBX_POWER_SAVE*/
+/**
+ * The receiver's taken to have reset and lost its configuration after
+ * this many calls to gps_poll() without a NAV-PVT
+ */
+#define GPS_UBX_TIMEOUT		5
+
 /**
  * GPS data structure
  */
@@ -40,6 +60,8 @@ struct gps_time {
 };
 
 int process_gps_frame(char* frame);
+void process_ubx_message(const struct ubx_parser* p);
+void gps_poll(void);
 
 void get_gps_data(struct gps_data* data);
 void get_gps_time(struct gps_time* time);
@@ -40,8 +40,6 @@
 #define I2CSTATE_SLA_NACK   0x103
 #define I2CSTATE_ARB_LOSS   0x104
 
-#define FAST_MODE_PLUS      0
-
 #define I2C_BUFSIZE         64
 #define MAX_TIMEOUT         0x0000FFFF
 
@@ -85,16 +83,40 @@
 
    I2CBitFrequency = I2CPCLK / (I2CSCLH + I2CSCLL)
 
-   Standard Mode   (100KHz) = CFG_CPU_CCLK / 200000
-   Fast Mode       (400KHz) = CFG_CPU_CCLK / 800000
-   Fast- Mode Plus (1MHz)   = CFG_CPU_CCLK / 2000000       */
-
-#define CFG_CPU_CCLK      24000000 // 24 MHz
-
-#define I2SCLH_SCLH       CFG_CPU_CCLK / 200000  /* Fast Mode I2C SCL Duty Cycle High (400KHz)*/
-#define I2SCLL_SCLL       CFG_CPU_CCLK / 200000  /* Fast Mode I2C SCL Duty Cycle Low (400KHz) */
-#define I2SCLH_HS_SCLH    CFG_CPU_CCLK / 2000000  /* Fast Plus I2C SCL Duty Cycle High Reg */
-#define I2SCLL_HS_SCLL    CFG_CPU_CCLK / 2000000  /* Fast Plus I2C SCL Duty Cycle Low Reg */
+   They're worked out from SystemCoreClock for the speed chosen with
+   i2c_set_speed(), and again whenever the core clock changes. Fast
+   mode and Fast-mode Plus need SCL low for longer than it's high, so
+   they get 60% low. Fast-mode Plus also needs the pins' I2CMODE set,
+   and every device on the bus to support it - the TMP102 doesn't. */
+
+#define I2C_SPEED_STANDARD  0   /* 100kHz */
+#define I2C_SPEED_FAST      1   /* 400kHz */
+#define I2C_SPEED_FAST_PLUS 2   /* 1MHz */
+
+#define I2C_SPEED           I2C_SPEED_FAST  /* From i2c_init() */
+
+/* Bus recovery. A slave that lost track part way through a byte, say
+   over a reset, can hold SDA low for ever. SCL's clocked by hand at
+   I2C_RECOVER_HZ until it lets go, up to a byte and its ACK, and then
+   there's a STOP. */
+
+#define I2C_RECOVER_HZ      100000
+#define I2C_RECOVER_CLOCKS  9
+#define I2C_SCL_PIN         4   /* PIO0_4 */
+#define I2C_SDA_PIN         5   /* PIO0_5 */
+
+/* A transfer to or from the registers of one device, starting at reg.
+   A list of them goes out as one transaction, with a repeated START
+   between each, and reads go straight to each buffer. Writes are at
+   most I2C_BUFSIZE - 2 bytes. */
+
+struct i2c_transfer {
+  uint8_t address;                /* With the read bit clear */
+  uint8_t reg;
+  uint8_t write;                  /* Otherwise read */
+  uint8_t length;
+  uint8_t* buffer;
+};
 
 extern volatile uint8_t I2CMasterBuffer[I2C_BUFSIZE];    // Master Mode
 extern volatile uint8_t I2CSlaveBuffer[I2C_BUFSIZE];     // Master Mode
@@ -102,6 +124,18 @@ extern volatile uint32_t I2CReadLength, I2CWriteLength;
 
 extern void i2c_init(void);
 extern uint32_t i2c_engine(void);
+extern uint32_t i2c_transfer(const struct i2c_transfer* list, uint8_t count);
+extern uint32_t i2c_start_transfer(const struct i2c_transfer* list,
+                                   uint8_t count);
+extern uint32_t i2c_wait(void);
+extern uint32_t i2c_read(uint8_t address, uint8_t reg, uint8_t* buffer,
+                         uint8_t length);
+extern uint32_t i2c_write(uint8_t address, uint8_t reg, uint8_t* buffer,
+                          uint8_t length);
+extern void i2c_set_speed(uint8_t speed);
+extern uint8_t i2c_recover(void);
+extern void i2c_clock_enable(void);
+extern void i2c_clock_disable(void);
 
 #endif /* end __I2C_H */
 /****************************************************************************
@@ -0,0 +1,58 @@
+/*
+ * Puts the processor to sleep when there's nothing to do
+ * Copyright (C) 2014  richard
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef IDLE_H
+#define IDLE_H
+
+#include "LPC11xx.h"
+
+/**
+ * The modes the processor can be in
+ */
+enum idle_mode {
+  IDLE_ACTIVE = 0,
+  IDLE_SLEEP,
+  IDLE_DEEP_SLEEP,
+  IDLE_MODES
+};
+/**
+ * Time spent in each mode, in SysTick ticks. Deep-sleep stops the
+ * SysTick, so that entry counts wake-ups instead.
+ */
+struct idle_residency {
+  uint32_t ticks[IDLE_MODES];
+};
+
+/**
+ * Returns non-zero if the main loop has work to do.
+ */
+typedef int (*idle_runnable_func) (void);
+
+void idle_sleep(idle_runnable_func runnable, enum idle_mode mode);
+void idle_tick(void);
+void idle_enable_deep_sleep(uint32_t start_logic_pins);
+void get_idle_residency(struct idle_residency* residency);
+int idle_percentage(struct idle_residency* now, struct idle_residency* then);
+
+#endif /* IDLE_H */
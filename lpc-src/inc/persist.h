@@ -0,0 +1,70 @@
+/*
+ * Flight state kept across resets
+ * Copyright (C) 2014  richard
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef PERSIST_H
+#define PERSIST_H
+
+#include "LPC11xx.h"
+#include "phase.h"
+
+/**
+ * Flight state that survives a reset. It lives in .noinit, which the
+ * startup code doesn't clear, and a CRC over it tells whether what's
+ * there after a reset can be trusted. A power-on reset always starts
+ * again from scratch.
+ *
+ * The main loop copies its state in with persist_save() once a pass,
+ * so what comes back is at most a pass old.
+ */
+#define PERSIST_MAGIC		0x48414221	/* "HAB!" */
+#define PERSIST_HISTORY		8
+
+/**
+ * SYSRSTSTAT bits
+ */
+#define PERSIST_RESET_POR	(1 << 0)
+#define PERSIST_RESET_EXT	(1 << 1)
+#define PERSIST_RESET_WDT	(1 << 2)
+#define PERSIST_RESET_BOD	(1 << 3)
+#define PERSIST_RESET_SYS	(1 << 4)
+
+struct persist {
+  uint32_t magic;
+  uint32_t ticks_until_cutdown;
+  uint32_t sentence_id;
+  uint32_t next_block;		/* The SD card's log head */
+  uint32_t charge_used;		/* mA seconds from the main battery */
+  uint16_t card_unit;		/* The card's block addressing, 0 if there's no card */
+  uint8_t resets;		/* Since power on, saturates */
+  uint8_t history[PERSIST_HISTORY]; /* SYSRSTSTAT at each reset, newest first */
+  struct phase phase;		/* Includes the last fix */
+  uint16_t crc;
+};
+
+extern struct persist persist;
+
+uint8_t persist_boot(void);
+void persist_save(void);
+
+#endif /* PERSIST_H */
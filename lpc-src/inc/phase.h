@@ -0,0 +1,73 @@
+/*
+ * Flight phase from the altitude and vertical rate
+ * Copyright (C) 2014  richard
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef PHASE_H
+#define PHASE_H
+
+#include "LPC11xx.h"
+#include "estimator.h"
+#include "gps.h"
+#include "frame.h"
+
+/**
+ * Seconds from the start of one sentence to the start of the next in
+ * each phase. 0 sends them back to back. Fields that aren't wanted in
+ * a phase are left out too, see FRAME_FIELDS in frame.h.
+ */
+#define PHASE_GROUND_INTERVAL	30
+#define PHASE_ASCENT_INTERVAL	0
+#define PHASE_FLOAT_INTERVAL	20
+#define PHASE_DESCENT_INTERVAL	0
+#define PHASE_LANDED_INTERVAL	60
+
+/**
+ * Which phase we're in, worked out from the estimator's altitude and
+ * rate, or from the GPS when the barometer can't be trusted. A phase
+ * only changes once the next one has held for a while, so a gust
+ * doesn't switch the frame layout back and forth.
+ */
+struct phase {
+  uint8_t phase;		/* enum flight_phase */
+  uint8_t candidate;		/* The phase we might be changing to */
+  uint8_t have_ground;
+  uint8_t have_fix;
+  uint32_t dwell;		/* How long the candidate has held, ms */
+  int32_t ground;		/* Launch altitude, mm */
+  int32_t altitude;		/* mm */
+  int32_t rate;			/* mm/s, positive up */
+  int32_t latitude, longitude;	/* Last fix, degrees x 1000000 */
+  int32_t gps_altitude;		/* Last fix, mm */
+  int32_t gps_rate;		/* From the fixes, mm/s */
+  int32_t drift_latitude;	/* From the fixes, degrees x 1000000 x 256 / s */
+  int32_t drift_longitude;
+  uint32_t since_fix;		/* ms */
+};
+
+void phase_init(struct phase* p);
+int phase_update(struct phase* p, struct estimator* e, struct gps_data* gd,
+		 uint32_t dt);
+void phase_fill_frame(struct phase* p, struct frame* f);
+uint32_t phase_interval(uint8_t phase);
+
+#endif /* PHASE_H */
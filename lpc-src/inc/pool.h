@@ -0,0 +1,56 @@
+/*
+ * Fixed size blocks from a shared arena
+ * Copyright (C) 2014  richard
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef POOL_H
+#define POOL_H
+
+#include "LPC11xx.h"
+
+/**
+ * Fixed size blocks from one arena, for the buffers that are only
+ * needed while something's coming in. A receiver takes a block at the
+ * start of a frame and gives it back once the frame's been handled.
+ *
+ * A block holds the longest NMEA sentence (82 characters) or IMU frame
+ * (98 characters) with room to spare. There's one for the GPS and one
+ * for the IMU, which is the most that have been seen in use at once,
+ * and a spare.
+ */
+#define POOL_BLOCK_SIZE		128
+#define POOL_BLOCKS		3
+
+/**
+ * How full the pool's been
+ */
+struct pool_stats {
+  uint8_t in_use;
+  uint8_t peak;			/* The most in use at once */
+  uint16_t failures;		/* Allocations that found the pool empty */
+};
+
+void* pool_alloc(void);
+void pool_free(void* block);
+void pool_get_stats(struct pool_stats* stats);
+
+#endif /* POOL_H */
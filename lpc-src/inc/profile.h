@@ -0,0 +1,150 @@
+/*
+ * Lightweight cycle-count profiling using the SysTick
+ * Copyright (C) 2014  richard
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include "LPC11xx.h"
+
+/**
+ * Profiling compiled out - Uncomment to save the RAM and cycles
+ */
+/*#define PROFILE_DISABLED*/
+
+/**
+ * The sections of code we time. Add new sections to the end, and to
+ * the names below, so old logs still decode.
+ */
+enum profile_section {
+  PROFILE_BAROMETER = 0,
+  PROFILE_TEMPERATURE,
+  PROFILE_FRAME,
+  PROFILE_CRC,
+  PROFILE_SD,
+  PROFILE_ISR_SYSTICK,
+  PROFILE_ISR_UART,
+  PROFILE_ISR_SSP1,
+  PROFILE_ISR_I2C,
+  PROFILE_ISR_ADC,
+  PROFILE_ESTIMATOR,
+  PROFILE_ISR_RTTY,
+  PROFILE_SECTIONS
+};
+#define PROFILE_SECTION_NAMES {			\
+    "barometer", "temperature", "frame", "crc", "sd",	\
+    "isr_systick", "isr_uart", "isr_ssp1", "isr_i2c", "isr_adc",	\
+    "estimator", "isr_rtty" }
+
+/**
+ * Log2 histogram of section durations in fast clock cycles (see
+ * clock.h), whatever speed the core was at. Bin 0
+ * holds everything under 2^(PROFILE_BIN_SHIFT+1) cycles, the last bin
+ * holds everything that doesn't fit anywhere else.
+ */
+#define PROFILE_BINS		16
+#define PROFILE_BIN_SHIFT	6
+
+struct profile_histogram {
+  uint32_t count;
+  uint32_t max;
+  uint16_t bins[PROFILE_BINS];
+};
+
+/**
+ * Layout of a profile record on the SD card, all little-endian
+ *
+ * +--------+-------------+--------------+-----------------+----------------+
+ * | "PROF" | ticks (u32) | reload (u32) | fast clock (u32)| histograms ... |
+ * +--------+-------------+--------------+-----------------+----------------+
+ *
+ * followed by PROFILE_SECTIONS histograms laid out as count (u32),
+ * max (u32) and PROFILE_BINS x u16 bins.
+ */
+#define PROFILE_MAGIC		"PROF"
+#define PROFILE_HEADER_SIZE	16
+#define PROFILE_RECORD_SIZE	(4 + 4 + (2 * PROFILE_BINS))
+#define PROFILE_DUMP_SIZE	(PROFILE_HEADER_SIZE +			\
+				 (PROFILE_SECTIONS * PROFILE_RECORD_SIZE))
+
+/**
+ * The stages of a boot, each timestamped as it finishes. Add new
+ * stages to the end, and to the names below.
+ */
+enum profile_boot_stage {
+  PROFILE_BOOT_INTERFACES = 0,	/* I2C, SPI, UART and ADC */
+  PROFILE_BOOT_SENSORS,		/* Barometer calibration, estimator */
+  PROFILE_BOOT_WATCHDOG,
+  PROFILE_BOOT_FRAME,		/* The first sentence built */
+  PROFILE_BOOT_RTTY,		/* and handed to the radio */
+  PROFILE_BOOT_SD,		/* The SD card up, or given up on */
+  PROFILE_BOOT_STAGES
+};
+#define PROFILE_BOOT_NAMES {					\
+    "interfaces", "sensors", "watchdog", "frame", "rtty", "sd" }
+
+/**
+ * Layout of the boot record, written once after each reset
+ *
+ * +--------+-----------------+----------------------------------------+
+ * | "BOOT" | fast clock (u32)| PROFILE_BOOT_STAGES timestamps (u32)   |
+ * +--------+-----------------+----------------------------------------+
+ *
+ * The timestamps are in fast clock cycles since the SysTick started,
+ * which is straight after the clocks are set up.
+ */
+#define PROFILE_BOOT_MAGIC	"BOOT"
+#define PROFILE_BOOT_SIZE	(4 + 4 + (4 * PROFILE_BOOT_STAGES))
+
+extern uint32_t profile_boot[PROFILE_BOOT_STAGES];
+
+/**
+ * On a little-endian core the histograms are laid out in memory the
+ * same as on the SD card, so they can be written straight after a
+ * header from profile_dump_header()
+ */
+extern struct profile_histogram profile_histograms[PROFILE_SECTIONS];
+
+#ifndef PROFILE_DISABLED
+
+#define PROFILE_START(t)	uint32_t t = profile_now()
+#define PROFILE_END(s, t)	profile_record(s, t)
+#define PROFILE_BOOT(s)		profile_boot[s] = profile_now()
+
+#else
+
+#define PROFILE_START(t)
+#define PROFILE_END(s, t)
+#define PROFILE_BOOT(s)
+
+#endif
+
+uint32_t profile_now(void);
+void profile_tick(void);
+void profile_record(enum profile_section section, uint32_t start);
+void profile_add(enum profile_section section, uint32_t cycles);
+int profile_dump_header(uint8_t* header);
+int profile_dump(uint8_t* buffer, int length);
+int profile_boot_dump(uint8_t* buffer);
+
+#endif /* PROFILE_H */
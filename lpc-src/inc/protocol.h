@@ -28,14 +28,41 @@
 #include "bmp085.h"
 #include "gps.h"
 #include "imu.h"
+#include "idle.h"
+#include "frame.h"
 
 #define CALLSIGN        "BUSEDS1"
 
+/**
+ * Characters a frame can be built from. ITA2 has no '*', so Baudot
+ * frames put a '#' before the checksum instead.
+ */
+enum frame_charset {
+  FRAME_ASCII,
+  FRAME_BAUDOT
+};
+
+uint16_t crc_xmodem_update(uint16_t crc, uint8_t data);
+void communications_frame_charset(enum frame_charset charset);
+uint32_t communications_next_id(void);
+void communications_resume_id(uint32_t id);
+void fill_communications_frame(struct frame* f, struct gps_time* gt,
+			       struct barometer* b, struct gps_data* gd,
+			       double altitude, double ascent_rate,
+			       double temperature,
+			       struct imu_raw* ir,
+			       int cutdown_minutes, float cutdown_voltage,
+			       int sleep_percentage);
+int communications_frame_text(char* string, int string_size, const struct frame* f,
+			      int where);
 int build_communications_frame(char* string, int string_size, struct gps_time* gt,
 			     struct barometer* b, struct gps_data* gd,
-			     double altitude, double temperature,
+			     double altitude, double ascent_rate,
+			     double temperature,
 			     struct imu_raw* ir,
-			     int cutdown_minutes, float cutdown_voltage);
-int communications_frame_add_extra(char* string, int string_length, struct imu_raw* ir);
+			     int cutdown_minutes, float cutdown_voltage,
+			     int sleep_percentage);
+int communications_frame_add_extra(char* string, int string_length, struct frame* f,
+				   struct imu_raw* ir, struct idle_residency* residency);
 
 #endif /* PROTOCOL_H */
@@ -1,5 +1,5 @@
 /*
- * Reads the ADC pin, used to monitor cutdown voltage
+ * Watches the batteries and the heater current with the ADC
  * Copyright (C) 2013  Richard Meadows
  *
  * Permission is hereby granted, free of charge, to any person obtaining
@@ -26,10 +26,56 @@
 #define PWRMON_H
 
 #include "LPC11xx.h"
+#include "frame.h"
 
-typedef void (*pwrmon_done_func) (uint16_t adc_value);
+/**
+ * The ADC scans these in burst mode, every PWRMON_SCAN_TICKS SysTick
+ * ticks, and PWRMON_OVERSAMPLE scans add up to a sample. Each pass of
+ * the main loop takes the lowest, highest and mean sample since the
+ * last one.
+ */
+#define PWRMON_CUTDOWN		0	/* AD3, P1[2], the cutdown battery */
+#define PWRMON_BATTERY		1	/* AD6, P1[10], the main battery */
+#define PWRMON_HEATER		2	/* AD7, P1[11], the heater's current sense */
+#define PWRMON_CHANNELS		3
+
+#define PWRMON_SCAN_TICKS	10
+#define PWRMON_OVERSAMPLE	16
+#define PWRMON_SAMPLE_TICKS	(PWRMON_SCAN_TICKS * PWRMON_OVERSAMPLE)
+/**
+ * A sample at 3.3V, and what that is on each channel. The batteries
+ * are through dividers and the current sense gives 1V/A.
+ */
+#define PWRMON_FULL_SCALE	(1024 * PWRMON_OVERSAMPLE)
+#define PWRMON_CUTDOWN_MV	6600	/* Divide-by-two */
+#define PWRMON_BATTERY_MV	9900	/* Divide-by-three */
+#define PWRMON_HEATER_MA	3300
+/**
+ * The charge used is counted from the heater's current and an
+ * estimate of the rest, which isn't measured. A power-on reset takes
+ * the battery to be full.
+ */
+#define PWRMON_BOARD_MA		120
+#define PWRMON_CAPACITY_MAH	3000	/* Four lithium AAs */
+
+/**
+ * Samples since the last pwrmon_period()
+ */
+struct pwrmon_period {
+  uint16_t min[PWRMON_CHANNELS];
+  uint16_t max[PWRMON_CHANNELS];
+  uint32_t sum[PWRMON_CHANNELS];
+  uint16_t samples;
+};
 
-void pwrmon_start(pwrmon_done_func _callback);
 void pwrmon_init(void);
+void pwrmon_resume(uint32_t charge_used);
+void pwrmon_tick(void);
+void pwrmon_sample(const uint16_t* sample);
+void pwrmon_period(struct pwrmon_period* p);
+uint32_t pwrmon_mean(const struct pwrmon_period* p, uint8_t channel);
+uint32_t pwrmon_charge_used(void);
+uint8_t pwrmon_charge(void);
+void pwrmon_fill_frame(const struct pwrmon_period* p, struct frame* f);
 
 #endif /* PWRMON_H */
@@ -25,8 +25,76 @@
 #ifndef RTTY_H
 #define RTTY_H
 
+#include "LPC11xx.h"
+
+/**
+ * Strings are rendered into a bitstream when they're set, so the bit
+ * clock interrupt only has to shift out the next bit. Uncomment to
+ * render each character as it's sent instead, which saves 416 bytes of
+ * RAM.
+ */
+/*#define RTTY_PRERENDER_DISABLED*/
+
+/**
+ * Frames are built straight into a slot the RTTY owns, so they aren't
+ * copied on the way out: rtty_acquire() hands out a slot that isn't
+ * being sent and rtty_commit() sends what was built in it. There's
+ * always one free. A prerendered string is finished with its slot once
+ * it's committed, otherwise there are two so the next frame can be
+ * built while one's sent.
+ *
+ * A slot holds the longest sentence with the SD card's extra fields
+ * after it, or a delta frame.
+ */
+#define RTTY_SLOT_SIZE		0x120
+#ifndef RTTY_PRERENDER_DISABLED
+#define RTTY_SLOTS		1
+#else
+#define RTTY_SLOTS		2
+#endif
+
+/**
+ * Stop bits, in half bits
+ */
+#define RTTY_STOP_1		2
+#define RTTY_STOP_1_5		3
+#define RTTY_STOP_2		4
+
+/**
+ * ITA2 shift states. Strings start in neither so the first character
+ * that needs a shift gets one.
+ */
+#define RTTY_ITA2_LETTERS	0
+#define RTTY_ITA2_FIGURES	1
+#define RTTY_ITA2_UNSHIFTED	2
+
+/**
+ * Baud rate and framing. Five data bits sends ITA2.
+ */
+struct rtty_format {
+  uint16_t baud;		/* 50, 75, 100, 300 or 600 */
+  uint8_t data_bits;		/* 5, 7 or 8 */
+  uint8_t stop_halves;		/* RTTY_STOP_x */
+};
+
+/**
+ * Makes byte index of what's sent from a committed string, so a packet
+ * that's longer than the string doesn't have to be built anywhere.
+ * fec_packet_byte() is one.
+ */
+typedef uint8_t (*rtty_coder)(const uint8_t* string, uint32_t length,
+			      uint32_t index);
+
+int rtty_set_format(uint32_t baud, uint8_t data_bits, uint8_t stop_halves);
+void rtty_get_format(struct rtty_format* format);
+int rtty_set_preamble(uint8_t bits);
+uint8_t rtty_ita2_encode(char c, uint8_t* shift, uint8_t* codes);
+char rtty_ita2_decode(uint8_t code, uint8_t* shift);
 int rtty_active(void);
-int rtty_set_string(char* string, uint32_t length);
+char* rtty_acquire(void);
+int rtty_commit(const char* string, uint32_t length, rtty_coder coder,
+		uint32_t coded_length);
+int rtty_set_string(const char* string, uint32_t length);
 void rtty_tick(void);
 
 #endif /* RTTY_H */
@@ -23,11 +23,23 @@
 #ifndef SD_H
 #define SD_H
 
+/**
+ * One piece of a block that's gathered from several buffers
+ */
+struct disk_part {
+  const uint8_t* buffer;
+  uint32_t length;
+};
+
 int initialise_card();
 int initialise_card_v1();
 int initialise_card_v2();
 int disk_initialize();
+int resume_card(int unit);
+int card_unit(void);
 int disk_write(const uint8_t *buffer, uint32_t length, uint64_t block_number);
+int disk_write_parts(const struct disk_part* parts, uint32_t count,
+		     uint64_t block_number);
 int disk_read(uint8_t *buffer, uint32_t length, uint64_t block_number);
 int disk_status();
 int disk_sync();
@@ -87,5 +87,7 @@
 uint8_t sd_spi_xfer(uint8_t data);
 void sd_spi_init(void);
 void sd_spi_frequency(uint32_t frequency);
+void sd_spi_clock_enable(void);
+void sd_spi_clock_disable(void);
 
 #endif /* SD_SPI_H */
@@ -25,6 +25,21 @@
 #ifndef TMP102_H
 #define TMP102_H
 
-double get_temperature(void);
+#include "LPC11xx.h"
+
+/**
+ * Thermometer data structure
+ */
+struct thermometer {
+  double temperature;
+  uint32_t ticks; // When the conversion started, SysTick ticks
+  int valid; // 1 = valid, 0 = invalid
+};
+
+void init_thermometer(uint32_t now);
+void thermometer_update(uint32_t now);
+struct thermometer* get_thermometer(void);
+double get_temperature(uint32_t now);
+double tmp102_decode(uint8_t msb, uint8_t lsb);
 
 #endif /* TMP102_H */
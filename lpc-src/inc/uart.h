@@ -26,7 +26,10 @@
 #define UART_H
 
 #include "LPC11xx.h"
+#include "ubx.h"
 
 void uart_init(void);
+void uart_send_ubx(const struct ubx_message* list, uint8_t count);
+uint8_t uart_sending(void);
 
 #endif /* UART_H */
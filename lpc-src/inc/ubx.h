@@ -0,0 +1,127 @@
+/*
+ * The u-blox binary protocol
+ * Copyright (C) 2014  richard
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef UBX_H
+#define UBX_H
+
+#include "LPC11xx.h"
+
+/**
+ * A UBX message is two sync bytes, the class, the ID, a little endian
+ * length and the payload, followed by an 8 bit Fletcher checksum of
+ * everything from the class to the end of the payload.
+ */
+#define UBX_SYNC_1		0xB5
+#define UBX_SYNC_2		0x62
+#define UBX_FRAME_SIZE(length)	((length) + 8)
+
+#define UBX_NAV			0x01
+#define UBX_NAV_PVT		0x07
+#define UBX_ACK			0x05
+#define UBX_ACK_NAK		0x00
+#define UBX_ACK_ACK		0x01
+#define UBX_CFG			0x06
+#define UBX_CFG_PRT		0x00
+#define UBX_CFG_MSG		0x01
+#define UBX_CFG_RATE		0x08
+#define UBX_CFG_RXM		0x11
+#define UBX_CFG_NAV5		0x24
+#define UBX_NMEA		0xF0
+
+/**
+ * NAV-PVT, as far as we read it. It's 84 bytes from a u-blox 7 and 92
+ * from an 8, the same up to here.
+ */
+#define UBX_PVT_HOUR		8
+#define UBX_PVT_MIN		9
+#define UBX_PVT_SEC		10
+#define UBX_PVT_VALID		11	/* Bit 1, validTime */
+#define UBX_PVT_FIX_TYPE	20	/* 3 for 3D, 4 with dead reckoning */
+#define UBX_PVT_FLAGS		21	/* Bit 0, gnssFixOK */
+#define UBX_PVT_NUM_SV		23
+#define UBX_PVT_LON		24	/* Degrees x 1e7 */
+#define UBX_PVT_LAT		28
+#define UBX_PVT_HEIGHT		32	/* Above the ellipsoid, mm */
+#define UBX_PVT_HMSL		36	/* Above sea level, mm */
+#define UBX_PVT_LENGTH		92
+
+#define UBX_PVT_VALID_TIME	(1 << 1)
+#define UBX_PVT_FIX_OK		(1 << 0)
+
+/**
+ * The parser keeps this much of each payload and only checksums the
+ * rest, so it needs no buffer from the pool. Anything longer than
+ * UBX_MAX_LENGTH is taken as a corrupt length and dropped, so a bad
+ * byte can't make it skip more than that.
+ */
+#define UBX_PAYLOAD_KEPT	40
+#define UBX_MAX_LENGTH		100
+
+/**
+ * For writing payloads as byte arrays
+ */
+#define UBX_U16(v)		((v) & 0xFF), (((v) >> 8) & 0xFF)
+#define UBX_U32(v)		UBX_U16(v), UBX_U16((v) >> 16)
+
+struct ubx_message {
+  uint8_t cls, id;
+  uint16_t length;
+  const uint8_t* payload;
+};
+
+/**
+ * Takes a byte at a time, from an interrupt
+ */
+struct ubx_parser {
+  uint8_t state;
+  uint8_t cls, id;
+  uint8_t ck_a, ck_b;
+  uint16_t length, index;
+  uint8_t payload[UBX_PAYLOAD_KEPT];
+  uint32_t good, bad;		/* Checksums */
+};
+
+/**
+ * Gives a list of messages a byte at a time, for a transmit interrupt
+ */
+struct ubx_writer {
+  const struct ubx_message* list;
+  uint8_t count;
+  uint16_t index;
+  uint8_t ck_a, ck_b;
+};
+
+void ubx_parser_init(struct ubx_parser* p);
+uint8_t ubx_parse(struct ubx_parser* p, uint8_t c);
+
+void ubx_writer_init(struct ubx_writer* w, const struct ubx_message* list,
+		     uint8_t count);
+int ubx_writer_next(struct ubx_writer* w);
+
+uint16_t ubx_u16(const uint8_t* p);
+uint32_t ubx_u32(const uint8_t* p);
+void ubx_put_u16(uint8_t* p, uint16_t v);
+void ubx_put_u32(uint8_t* p, uint32_t v);
+
+#endif /* UBX_H */
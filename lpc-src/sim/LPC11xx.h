@@ -0,0 +1,677 @@
+/*
+ * Register layer for running the firmware on the host
+ * Copyright (C) 2014  richard
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * Stands in for chip/LPC11xx.h when the firmware is built for the
+ * simulator. The register structures have the same layout and names,
+ * but every register is a sim_reg. Reads and writes are passed to the
+ * simulator, which hands them to the model of the peripheral they
+ * belong to. Each access also moves simulated time forward.
+ *
+ * The firmware is compiled as C++ so this can work.
+ */
+
+#ifndef LPC11xx_H
+#define LPC11xx_H
+
+#include <stdint.h>
+
+#ifndef __cplusplus
+#error "The simulator builds the firmware as C++"
+#endif
+
+/**
+ * A memory-mapped register
+ */
+class sim_reg;
+
+uint32_t sim_read(sim_reg* reg);
+void sim_write(sim_reg* reg, uint32_t value);
+
+class sim_reg {
+ public:
+  operator uint32_t() const { return sim_read(const_cast<sim_reg*>(this)); }
+
+  sim_reg& operator=(uint32_t value) { sim_write(this, value); return *this; }
+  sim_reg& operator=(const sim_reg& reg) { return *this = (uint32_t)reg; }
+  sim_reg& operator|=(uint32_t value) { return *this = (uint32_t)*this | value; }
+  sim_reg& operator&=(uint32_t value) { return *this = (uint32_t)*this & value; }
+  sim_reg& operator^=(uint32_t value) { return *this = (uint32_t)*this ^ value; }
+
+  /**
+   * The stored value. Only the simulator should touch this directly.
+   */
+  uint32_t value;
+};
+
+/**
+ * ==========================================================================
+ * ---------- Interrupt Number Definition -----------------------------------
+ * ==========================================================================
+ */
+
+typedef enum IRQn
+{
+  NonMaskableInt_IRQn           = -14,
+  HardFault_IRQn                = -13,
+  SVCall_IRQn                   = -5,
+  PendSV_IRQn                   = -2,
+  SysTick_IRQn                  = -1,
+
+  WAKEUP0_IRQn                  = 0,
+  WAKEUP1_IRQn                  = 1,
+  WAKEUP2_IRQn                  = 2,
+  WAKEUP3_IRQn                  = 3,
+  WAKEUP4_IRQn                  = 4,
+  WAKEUP5_IRQn                  = 5,
+  WAKEUP6_IRQn                  = 6,
+  WAKEUP7_IRQn                  = 7,
+  WAKEUP8_IRQn                  = 8,
+  WAKEUP9_IRQn                  = 9,
+  WAKEUP10_IRQn                 = 10,
+  WAKEUP11_IRQn                 = 11,
+  WAKEUP12_IRQn                 = 12,
+  CAN_IRQn                      = 13,
+  SSP1_IRQn                     = 14,
+  I2C_IRQn                      = 15,
+  TIMER_16_0_IRQn               = 16,
+  TIMER_16_1_IRQn               = 17,
+  TIMER_32_0_IRQn               = 18,
+  TIMER_32_1_IRQn               = 19,
+  SSP0_IRQn                     = 20,
+  UART_IRQn                     = 21,
+  ADC_IRQn                      = 24,
+  WDT_IRQn                      = 25,
+  BOD_IRQn                      = 26,
+  PIOINT3_IRQn                  = 28,
+  PIOINT2_IRQn                  = 29,
+  PIOINT1_IRQn                  = 30,
+  PIOINT0_IRQn                  = 31,
+} IRQn_Type;
+
+#define __NVIC_PRIO_BITS          2
+
+/**
+ * ==========================================================================
+ * ---------- Core Peripherals ----------------------------------------------
+ * ==========================================================================
+ */
+
+typedef struct
+{
+  sim_reg CPUID;
+  sim_reg ICSR;
+  uint32_t RESERVED0;
+  sim_reg AIRCR;
+  sim_reg SCR;
+  sim_reg CCR;
+  uint32_t RESERVED1;
+  sim_reg SHP[2];
+  sim_reg SHCSR;
+} SCB_Type;
+
+/* The masks are unsigned rather than UL, which is 64 bits on the host */
+#define SCB_ICSR_PENDSTSET_Pos		26
+#define SCB_ICSR_PENDSTSET_Msk		(1U << SCB_ICSR_PENDSTSET_Pos)
+#define SCB_SCR_SEVONPEND_Pos		4
+#define SCB_SCR_SEVONPEND_Msk		(1U << SCB_SCR_SEVONPEND_Pos)
+#define SCB_SCR_SLEEPDEEP_Pos		2
+#define SCB_SCR_SLEEPDEEP_Msk		(1U << SCB_SCR_SLEEPDEEP_Pos)
+#define SCB_SCR_SLEEPONEXIT_Pos		1
+#define SCB_SCR_SLEEPONEXIT_Msk		(1U << SCB_SCR_SLEEPONEXIT_Pos)
+
+typedef struct
+{
+  sim_reg CTRL;
+  sim_reg LOAD;
+  sim_reg VAL;
+  sim_reg CALIB;
+} SysTick_Type;
+
+#define SysTick_CTRL_COUNTFLAG_Pos	16
+#define SysTick_CTRL_COUNTFLAG_Msk	(1U << SysTick_CTRL_COUNTFLAG_Pos)
+#define SysTick_CTRL_CLKSOURCE_Pos	2
+#define SysTick_CTRL_CLKSOURCE_Msk	(1U << SysTick_CTRL_CLKSOURCE_Pos)
+#define SysTick_CTRL_TICKINT_Pos	1
+#define SysTick_CTRL_TICKINT_Msk	(1U << SysTick_CTRL_TICKINT_Pos)
+#define SysTick_CTRL_ENABLE_Pos		0
+#define SysTick_CTRL_ENABLE_Msk		(1U << SysTick_CTRL_ENABLE_Pos)
+#define SysTick_LOAD_RELOAD_Pos		0
+#define SysTick_LOAD_RELOAD_Msk		(0xFFFFFFU << SysTick_LOAD_RELOAD_Pos)
+#define SysTick_VAL_CURRENT_Pos		0
+#define SysTick_VAL_CURRENT_Msk		(0xFFFFFFU << SysTick_VAL_CURRENT_Pos)
+
+extern SCB_Type sim_scb;
+extern SysTick_Type sim_systick;
+
+#define SCB		(&sim_scb)
+#define SysTick		(&sim_systick)
+
+/**
+ * The NVIC is modelled directly rather than through its registers
+ */
+void NVIC_EnableIRQ(IRQn_Type IRQn);
+void NVIC_DisableIRQ(IRQn_Type IRQn);
+uint32_t NVIC_GetPendingIRQ(IRQn_Type IRQn);
+void NVIC_SetPendingIRQ(IRQn_Type IRQn);
+void NVIC_ClearPendingIRQ(IRQn_Type IRQn);
+void NVIC_SetPriority(IRQn_Type IRQn, uint32_t priority);
+uint32_t NVIC_GetPriority(IRQn_Type IRQn);
+void NVIC_SystemReset(void);
+uint32_t SysTick_Config(uint32_t ticks);
+
+/**
+ * Simulated time, see sim.h. Declared here so __NOP() can be inline;
+ * busy-wait loops spend most of their time in it.
+ */
+extern uint64_t sim_time;
+extern uint64_t sim_next_event;
+extern uint32_t sim_cycle_time;
+
+void sim_service(void);
+
+/**
+ * Instructions
+ */
+void __enable_irq(void);
+void __disable_irq(void);
+uint32_t __get_PRIMASK(void);
+void __WFI(void);
+void __WFE(void);
+static inline void __NOP(void) {
+  /* Charged as a whole iteration of the loop around it */
+  sim_time += 4 * sim_cycle_time;
+  if (sim_time >= sim_next_event) {
+    sim_service();
+  }
+}
+static inline void __DSB(void) {}
+static inline void __ISB(void) {}
+static inline void __DMB(void) {}
+
+/**
+ * The firmware runs on the host's stack, so stack.c paints and measures
+ * this stand-in instead, which nothing uses
+ */
+#define SIM_STACK_WORDS		64
+extern uint32_t sim_stack[SIM_STACK_WORDS];
+#define STACK_BOTTOM		(&sim_stack[0])
+#define STACK_TOP		(&sim_stack[SIM_STACK_WORDS])
+#define STACK_POINTER()		STACK_TOP
+
+/**
+ * system_LPC11xx.h
+ */
+extern uint32_t SystemCoreClock;
+void SystemInit(void);
+void SystemCoreClockUpdate(void);
+
+/**
+ * ==========================================================================
+ * ---------- Device Specific Peripherals -----------------------------------
+ * ==========================================================================
+ */
+
+/*------------- system control block (SYSCON) ----------------------------*/
+typedef struct
+{
+  sim_reg SYSMEMREMAP;		// System memory remap
+  sim_reg PRESETCTRL;		// Peripheral reset control
+  sim_reg SYSPLLCTRL;		// System PLL control
+  sim_reg SYSPLLSTAT;		// System PLL status
+	uint32_t RESERVED0[4];
+  sim_reg SYSOSCCTRL;		// System oscillator control
+  sim_reg WDTOSCCTRL;		// Watchdog oscillator control
+  sim_reg IRCCTRL;		// IRC control
+	uint32_t RESERVED1[1];
+  sim_reg SYSRSTSTAT;		// System reset status register
+	uint32_t RESERVED2[3];
+  sim_reg SYSPLLCLKSEL;		// System PLL clock source select
+  sim_reg SYSPLLCLKUEN;		// System PLL clock source update enable
+	uint32_t RESERVED3[10];
+  sim_reg MAINCLKSEL;		// Main clock source select
+  sim_reg MAINCLKUEN;		// Main clock source update enable
+  sim_reg SYSAHBCLKDIV;		// System AHB clock divider
+	uint32_t RESERVED4[1];
+  sim_reg SYSAHBCLKCTRL;		// System AHB clock control
+	uint32_t RESERVED5[4];
+  sim_reg SSP0CLKDIV;		// SPI0 clock divider
+  sim_reg UARTCLKDIV;		// UART clock divder
+  sim_reg SSP1CLKDIV;		// SPI1 clock divder
+	uint32_t RESERVED6[12];
+  sim_reg WDTCLKSEL;		// WDT clock source select
+  sim_reg WDTCLKUEN;		// WDT clock source update enable
+  sim_reg WDTCLKDIV;		// WDT clock divider
+	uint32_t RESERVED7[1];
+  sim_reg CLKOUTCLKSEL;		// CLKOUT clock source select
+  sim_reg CLKOUTUEN;		// CLKOUT clock source update enable
+  sim_reg CLKOUTCLKDIV;		// CLKOUT clock divider
+	uint32_t RESERVED8[5];
+  sim_reg PIOPORCAP0;		// POR captured PIO status 0
+  sim_reg PIOPORCAP1;		// POR captured PIO status 1
+	uint32_t RESERVED9[18];
+  sim_reg BODCTRL;		// BOD control
+  sim_reg SYSTCKCAL;		// System tick counter calibration
+	uint32_t RESERVED10[42];
+  sim_reg STARTAPRP0;		// Start logic edge control register 0
+  sim_reg STARTERP0;		// Start logic signal enable register 0
+  sim_reg STARTRSRP0CLR;		// Start logic reset register 0
+  sim_reg STARTSRP0;		// Start logic status register 0
+	uint32_t RESERVED11[8];
+  sim_reg PDSLEEPCFG;		// Power-down states in Deep-sleep mode
+  sim_reg PDAWAKECFG;		// Power-down states after wake-up from
+  sim_reg PDRUNCFG;		// Power-down configuration register
+	uint32_t RESERVED12[110];
+  sim_reg DEVICE_ID;		// Device ID
+} LPC_SYSCON_TypeDef;
+
+/*------------- PMU (PMU) ----------------------------*/
+typedef struct
+{
+  sim_reg PCON;		// Power control register
+  sim_reg GPREG0;		// General purpose register 0
+  sim_reg GPREG1;		// General purpose register 1
+  sim_reg GPREG2;		// General purpose register 2
+  sim_reg GPREG3;		// General purpose register 3
+  sim_reg GPREG4;		// General purpose register 4
+} LPC_PMU_TypeDef;
+
+/*------------- I/O configuration (IOCON) ----------------------------*/
+typedef struct
+{
+  sim_reg PIO2_6;		// I/O configuration for pin PIO2_6
+	uint32_t RESERVED0[1];
+  sim_reg PIO2_0;		// I/O configuration for pin
+  sim_reg RESET_PIO0_0;		// I/O configuration for pin RESET/PIO0_0 0xD0
+  sim_reg PIO0_1;		// I/O configuration for pin
+  sim_reg PIO1_8;		// I/O configuration for pin
+	uint32_t RESERVED1[1];
+  sim_reg PIO0_2;		// I/O configuration for pin
+  sim_reg PIO2_7;		// I/O configuration for pin PIO2_7
+  sim_reg PIO2_8;		// I/O configuration for pin PIO2_8
+  sim_reg PIO2_1;		// I/O configuration for pin
+  sim_reg PIO0_3;		// I/O configuration for pin PIO0_3
+  sim_reg PIO0_4;		// I/O configuration for pin PIO0_4/SCL
+  sim_reg PIO0_5;		// I/O configuration for pin PIO0_5/SDA
+  sim_reg PIO1_9;		// I/O configuration for pin
+  sim_reg PIO3_4;		// I/O configuration for pin PIO3_4
+  sim_reg PIO2_4;		// I/O configuration for pin PIO2_4
+  sim_reg PIO2_5;		// I/O configuration for pin PIO2_5
+  sim_reg PIO3_5;		// I/O configuration for pin PIO3_5
+  sim_reg PIO0_6;		// I/O configuration for pin PIO0_6/SCK0
+  sim_reg PIO0_7;		// I/O configuration for pin PIO0_7/CTS
+  sim_reg PIO2_9;		// I/O configuration for pin PIO2_9
+  sim_reg PIO2_10;		// I/O configuration for pin PIO2_10
+  sim_reg PIO2_2;		// I/O configuration for pin
+  sim_reg PIO0_8;		// I/O configuration for pin
+  sim_reg PIO0_9;		// I/O configuration for pin
+  sim_reg SWCLK_PIO0_10;		// I/O configuration for pin
+  sim_reg PIO1_10;		// I/O configuration for pin
+  sim_reg PIO2_11;		// I/O configuration for pin PIO2_11/SCK0 0xD0
+  sim_reg R_PIO0_11;		// I/O configuration for pin
+  sim_reg R_PIO1_0;		// I/O configuration for pin
+  sim_reg R_PIO1_1;		// I/O configuration for pin
+  sim_reg R_PIO1_2;		// I/O configuration for pin
+  sim_reg PIO3_0;		// I/O configuration for pin PIO3_0/DTR
+  sim_reg PIO3_1;		// I/O configuration for pin PIO3_1/DSR
+  sim_reg PIO2_3;		// I/O configuration for pin
+  sim_reg SWDIO_PIO1_3;		// I/O configuration for pin
+  sim_reg PIO1_4;		// I/O configuration for pin
+  sim_reg PIO1_11;		// I/O configuration for pin PIO1_11/AD7
+  sim_reg PIO3_2;		// I/O configuration for pin PIO3_2/DCD
+  sim_reg PIO1_5;		// I/O configuration for pin
+  sim_reg PIO1_6;		// I/O configuration for pin
+  sim_reg PIO1_7;		// I/O configuration for pin
+  sim_reg PIO3_3;		// I/O configuration for pin PIO3_3/RI
+  sim_reg SCK_LOC;		// SCK pin location select register
+  sim_reg DSR_LOC;		// DSR pin location select register
+  sim_reg DCD_LOC;		// DCD pin location select register
+  sim_reg RI_LOC;		// RI pin location register
+} LPC_IOCON_TypeDef;
+
+/*------------- GPIO (GPIO) ----------------------------*/
+typedef struct
+{
+  sim_reg MASKED_ACCESS[4095]; // Port n data address masking register
+  sim_reg DATA; // Port n data register, MASKED_ACCESS[4095]
+	uint32_t RESERVED1[4096];
+  sim_reg DIR;		// Data direction register for port n
+  sim_reg IS;		// Interrupt sense register for port n
+  sim_reg IBE;		// Interrupt both edges register for port n
+  sim_reg IEV;		// Interrupt event register for port n
+  sim_reg IE;		// Interrupt mask register for port n
+  sim_reg RIS;		// Raw interrupt status register for port n
+  sim_reg MIS;		// Masked interrupt status register for port n
+  sim_reg IC;		// Interrupt clear register for port n
+} LPC_GPIO_TypeDef;
+
+/*------------- UART (UART) ----------------------------*/
+typedef struct
+{
+  union {
+    sim_reg RBR;		// Receiver Buffer Register
+    sim_reg THR;		// Transmit Holding Register
+    sim_reg DLL;		// Divisor Latch LSB
+  };
+  union {
+    sim_reg DLM;		// Divisor Latch MSB
+    sim_reg IER;		// Interrupt Enable Register
+  };
+  union {
+    sim_reg IIR;		// Interrupt ID Register
+    sim_reg FCR;		// FIFO Control Register
+  };
+  sim_reg LCR;		// Line Control Register
+  sim_reg MCR;		// Modem control register
+  sim_reg LSR;		// Line Status Register
+  sim_reg MSR;		// Modem status register
+  sim_reg SCR;		// Scratch Pad Register
+  sim_reg ACR;		// Auto-baud Control Register
+	uint32_t RESERVED0[1];
+  sim_reg FDR;		// Fractional Divider Register
+	uint32_t RESERVED1[1];
+  sim_reg TER;		// Transmit Enable Register
+	uint32_t RESERVED2[6];
+  sim_reg RS485CTRL;		// RS-485/EIA-485 Control
+  sim_reg RS485ADR;		// RS-485/EIA-485 address match
+} LPC_UART_TypeDef;
+
+/*------------- SPI0 (SPI0) ----------------------------*/
+typedef struct
+{
+  sim_reg CR0;		// Control Register 0
+  sim_reg CR1;		// Control Register 1
+  sim_reg DR;		// Data Register
+  sim_reg SR;		// Status Register
+  sim_reg CPSR;		// Clock Prescale Register
+  sim_reg IMSC;		// Interrupt Mask Set and Clear Register
+  sim_reg RIS;		// Raw Interrupt Status Register
+  sim_reg MIS;		// Masked Interrupt Status Register
+  sim_reg ICR;		// SSPICR Interrupt Clear Register
+} LPC_SPI0_TypeDef;
+
+/*------------- SPI1 (SPI1) ----------------------------*/
+typedef struct
+{
+  sim_reg CR0;		// Control Register 0
+  sim_reg CR1;		// Control Register 1
+  sim_reg DR;		// Data Register
+  sim_reg SR;		// Status Register
+  sim_reg CPSR;		// Clock Prescale Register
+  sim_reg IMSC;		// Interrupt Mask Set and Clear Register
+  sim_reg RIS;		// Raw Interrupt Status Register
+  sim_reg MIS;		// Masked Interrupt Status Register
+  sim_reg ICR;		// SSPICR Interrupt Clear Register
+} LPC_SPI1_TypeDef;
+
+/*------------- I2C (I2C) ----------------------------*/
+typedef struct
+{
+  sim_reg CONSET;		// I2C Control Set Register
+  sim_reg STAT;		// I2C Status Register
+  sim_reg DAT;		// I2C Data Register
+  sim_reg ADR0;		// I2C Slave Address Register 0
+  sim_reg SCLH;		// SCH Duty Cycle Register High Half Word
+  sim_reg SCLL;		// SCL Duty Cycle Register Low Half Word
+  sim_reg CONCLR;		// I2C Control Clear Register
+  sim_reg MMCTRL;		// Monitor mode control register
+  sim_reg ADR1;          // I2C Slave Address Register 1
+  sim_reg ADR2;          // I2C Slave Address Register 2
+  sim_reg ADR3;          // I2C Slave Address Register 3
+  sim_reg DATA_BUFFER;   // Data buffer register
+  sim_reg MASK0;         // I2C Slave address mask register 0
+  sim_reg MASK1;         // I2C Slave address mask register 1
+  sim_reg MASK2;         // I2C Slave address mask register 2
+  sim_reg MASK3;         // I2C Slave address mask register 3
+} LPC_I2C_TypeDef;
+
+/*------------- CCAN (CCAN) ----------------------------*/
+typedef struct
+{
+  sim_reg CNTL;		// CAN control
+  sim_reg STAT;		// Status register
+  sim_reg EC;		// Error counter
+  sim_reg BT;		// Bit timing register
+  sim_reg INT;		// Interrupt register
+  sim_reg TEST;		// Test register
+  sim_reg BRPE;		// Baud rate prescaler extension register
+	uint32_t RESERVED0[1];
+  sim_reg IF1_CMDREQ;		// Message interface 1 command request
+  sim_reg IF1_CMDMSK;		// Message interface 1 command mask
+  sim_reg IF1_MSK1;		// Message interface 1 mask 1
+  sim_reg IF1_MSK2;		// Message interface 1 mask 2
+  sim_reg IF1_ARB1;		// Message interface 1 arbitration 1
+  sim_reg IF1_ARB2;		// Message interface 1 arbitration 2
+  sim_reg IF1_MCTRL;		// Message interface 1 message control
+  sim_reg IF1_DA1;		// Message interface 1 data A1
+  sim_reg IF1_DA2;		// Message interface 1 data A2
+  sim_reg IF1_DB1;		// Message interface 1 data B1
+  sim_reg IF1_DB2;		// Message interface 1 data B2
+	uint32_t RESERVED1[13];
+  sim_reg IF2_CMDREQ;		// Message interface 2 command request
+  sim_reg IF2_CMDMSK;		// Message interface 2 command mask
+  sim_reg IF2_MSK1;		// Message interface 2 mask 1
+  sim_reg IF2_MSK2;		// Message interface 2 mask 2
+  sim_reg IF2_ARB1;		// Message interface 2 arbitration 1
+  sim_reg IF2_ARB2;		// Message interface 2 arbitration 2
+  sim_reg IF2_MCTRL;		// Message interface 2 message control
+  sim_reg IF2_DA1;		// Message interface 2 data A1
+  sim_reg IF2_DA2;		// Message interface 2 data A2
+  sim_reg IF2_DB1;		// Message interface 2 data B1
+  sim_reg IF2_DB2;		// Message interface 2 data B2
+	uint32_t RESERVED2[21];
+  sim_reg TXREQ1;		// Transmission request 1
+  sim_reg TXREQ2;		// Transmission request 2
+	uint32_t RESERVED3[6];
+  sim_reg ND1;		// New data 1
+  sim_reg ND2;		// New data 2
+	uint32_t RESERVED4[6];
+  sim_reg IR1;		// Interrupt pending 1
+  sim_reg IR2;		// Interrupt pending 2
+	uint32_t RESERVED5[6];
+  sim_reg MSGV1;		// Message valid 1
+  sim_reg MSGV2;		// Message valid 2
+	uint32_t RESERVED6[6];
+  sim_reg CLKDIV;		// Can clock divider register
+} LPC_CCAN_TypeDef;
+
+/*------------- 16-bit counter/timer 0 CT16B0 (CT16B0) ----------------------------*/
+typedef struct
+{
+  sim_reg IR;		// Interrupt Register
+  sim_reg TCR;		// Timer Control Register
+  sim_reg TC;		// Timer Counter
+  sim_reg PR;		// Prescale Register
+  sim_reg PC;		// Prescale Counter
+  sim_reg MCR;		// Match Control Register
+  sim_reg MR0;		// Match Register 0
+  sim_reg MR1;		// Match Register 1
+  sim_reg MR2;		// Match Register 2
+  sim_reg MR3;		// Match Register 3
+  sim_reg CCR;		// Capture Control Register
+  sim_reg CR0;		// Capture Register 0
+	uint32_t RESERVED0[3];
+  sim_reg EMR;		// External Match Register
+	uint32_t RESERVED1[12];
+  sim_reg CTCR;		// Count Control Register
+  sim_reg PWMC;		// PWM Control Register
+} LPC_CT16B0_TypeDef;
+
+/*------------- 16-bit counter/timer 1 CT16B1 (CT16B1) ----------------------------*/
+typedef struct
+{
+  sim_reg IR;		// Interrupt Register
+  sim_reg TCR;		// Timer Control Register
+  sim_reg TC;		// Timer Counter
+  sim_reg PR;		// Prescale Register
+  sim_reg PC;		// Prescale Counter
+  sim_reg MCR;		// Match Control Register
+  sim_reg MR0;		// Match Register 0
+  sim_reg MR1;		// Match Register 1
+  sim_reg MR2;		// Match Register 2
+  sim_reg MR3;		// Match Register 3
+  sim_reg CCR;		// Capture Control Register
+  sim_reg CR0;		// Capture Register 0
+	uint32_t RESERVED0[3];
+  sim_reg EMR;		// External Match Register
+	uint32_t RESERVED1[12];
+  sim_reg CTCR;		// Count Control Register
+  sim_reg PWMC;		// PWM Control Register
+} LPC_CT16B1_TypeDef;
+
+/*------------- 32-bit counter/timer 0 CT32B0 (CT32B0) ----------------------------*/
+typedef struct
+{
+  sim_reg IR;		// Interrupt Register
+  sim_reg TCR;		// Timer Control Register
+  sim_reg TC;		// Timer Counter
+  sim_reg PR;		// Prescale Register
+  sim_reg PC;		// Prescale Counter
+  sim_reg MCR;		// Match Control Register
+  sim_reg MR0;		// Match Register 0
+  sim_reg MR1;		// Match Register 1
+  sim_reg MR2;		// Match Register 2
+  sim_reg MR3;		// Match Register 3
+  sim_reg CCR;		// Capture Control Register
+  sim_reg CR0;		// Capture Register 0
+	uint32_t RESERVED0[3];
+  sim_reg EMR;		// External Match Register
+	uint32_t RESERVED1[12];
+  sim_reg CTCR;		// Count Control Register
+  sim_reg PWMC;		// PWM Control Register
+} LPC_CT32B0_TypeDef;
+
+/*------------- 32-bit counter/timer 1 CT32B1 (CT32B1) ----------------------------*/
+typedef struct
+{
+  sim_reg IR;		// Interrupt Register
+  sim_reg TCR;		// Timer Control Register
+  sim_reg TC;		// Timer Counter
+  sim_reg PR;		// Prescale Register
+  sim_reg PC;		// Prescale Counter
+  sim_reg MCR;		// Match Control Register
+  sim_reg MR0;		// Match Register 0
+  sim_reg MR1;		// Match Register 1
+  sim_reg MR2;		// Match Register 2
+  sim_reg MR3;		// Match Register 3
+  sim_reg CCR;		// Capture Control Register
+  sim_reg CR0;		// Capture Register 0
+	uint32_t RESERVED0[3];
+  sim_reg EMR;		// External Match Register
+	uint32_t RESERVED1[12];
+  sim_reg CTCR;		// Count Control Register
+  sim_reg PWMC;		// PWM Control Register
+} LPC_CT32B1_TypeDef;
+
+/*------------- Watchdog timer (WDT) ----------------------------*/
+typedef struct
+{
+  sim_reg MOD;		// Watchdog mode register
+  sim_reg TC;		// Watchdog timer constant register
+  sim_reg FEED;		// Watchdog feed sequence register
+  sim_reg TV;		// Watchdog timer value register
+	uint32_t RESERVED0[1];
+  sim_reg WARNINT;		// Watchdog Warning Interrupt compare value
+  sim_reg WINDOW;		// Watchdog Window compare value
+} LPC_WDT_TypeDef;
+
+/*------------- SysTick timer (SYSTICK) ----------------------------*/
+typedef struct
+{
+	uint32_t RESERVED0[4];
+  sim_reg CSR;		// System Timer Control and status register
+  sim_reg RVR;		// System Timer Reload value register
+  sim_reg CVR;		// System Timer Current value register
+  sim_reg CALIB;		// System Timer Calibration value register
+} LPC_SYSTICK_TypeDef;
+
+/*------------- ADC (ADC) ----------------------------*/
+typedef struct
+{
+  sim_reg CR;		// A/D Control Register
+  sim_reg GDR;		// A/D Global Data Register
+	uint32_t RESERVED0[1];
+  sim_reg INTEN;		// A/D Interrupt Enable Register
+  sim_reg DR[8];		// A/D Channel Data Registers
+  sim_reg STAT;		// A/D Status Register
+} LPC_ADC_TypeDef;
+
+/*------------- FMC (FMC) ----------------------------*/
+typedef struct
+{
+	uint32_t RESERVED0[4];
+  sim_reg FLASHCFG;		// Flash configuration, not in the CMSIS header
+	uint32_t RESERVED4[3];
+  sim_reg START;		// Signature start address register
+  sim_reg STOP;		// Signature stop-address register
+	uint32_t RESERVED1[1];
+  sim_reg W0;		// Word 0
+  sim_reg W1;		// Word 1
+  sim_reg W2;		// Word 2
+  sim_reg W3;		// Word 3
+	uint32_t RESERVED2[1001];
+  sim_reg TAT;		// Signature generation status register
+	uint32_t RESERVED3[1];
+  sim_reg TATCLR;		// Signature generation status clear
+} LPC_FMC_TypeDef;
+
+extern LPC_SYSCON_TypeDef	sim_syscon;
+extern LPC_PMU_TypeDef		sim_pmu;
+extern LPC_IOCON_TypeDef	sim_iocon;
+extern LPC_GPIO_TypeDef		sim_gpio[4];
+extern LPC_UART_TypeDef		sim_uart;
+extern LPC_SPI0_TypeDef		sim_spi0;
+extern LPC_SPI1_TypeDef		sim_spi1;
+extern LPC_I2C_TypeDef		sim_i2c;
+extern LPC_CCAN_TypeDef		sim_ccan;
+extern LPC_CT16B0_TypeDef	sim_ct16b0;
+extern LPC_CT16B1_TypeDef	sim_ct16b1;
+extern LPC_CT32B0_TypeDef	sim_ct32b0;
+extern LPC_CT32B1_TypeDef	sim_ct32b1;
+extern LPC_WDT_TypeDef		sim_wdt;
+extern LPC_ADC_TypeDef		sim_adc;
+extern LPC_FMC_TypeDef		sim_fmc;
+
+#define LPC_SYSCON	(&sim_syscon)
+#define LPC_PMU		(&sim_pmu)
+#define LPC_IOCON	(&sim_iocon)
+#define LPC_GPIO0	(&sim_gpio[0])
+#define LPC_GPIO1	(&sim_gpio[1])
+#define LPC_GPIO2	(&sim_gpio[2])
+#define LPC_GPIO3	(&sim_gpio[3])
+#define LPC_UART	(&sim_uart)
+#define LPC_SPI0	(&sim_spi0)
+#define LPC_SPI1	(&sim_spi1)
+#define LPC_I2C		(&sim_i2c)
+#define LPC_CCAN	(&sim_ccan)
+#define LPC_CT16B0	(&sim_ct16b0)
+#define LPC_CT16B1	(&sim_ct16b1)
+#define LPC_CT32B0	(&sim_ct32b0)
+#define LPC_CT32B1	(&sim_ct32b1)
+#define LPC_WDT		(&sim_wdt)
+#define LPC_ADC		(&sim_adc)
+#define LPC_FMC		(&sim_fmc)
+#define LPC_FLASHCFG	(sim_fmc.FLASHCFG)
+
+#endif  /* LPC11xx_H */
@@ -0,0 +1,191 @@
+/*
+ * ADC model for the simulator
+ * Copyright (C) 2014  richard
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * The ADC. AD3 watches the cutdown battery through a divide-by-two,
+ * AD6 the main battery through a divide-by-three and AD7 the heater's
+ * current sense at 1V/A. Each conversion has a little noise on it.
+ */
+
+#include "sim.h"
+#include "flight.h"
+
+#define ADC_CHANNELS	8
+#define ADC_VREF	3.3
+#define ADC_PD		(1 << 4)	/* PDRUNCFG */
+/**
+ * ADC clocks for one 10-bit conversion
+ */
+#define ADC_CLOCKS	11
+
+#define ADC_NOISE	2	/* Counts either way */
+
+#define CR_BURST	(1 << 16)
+#define CR_START_NOW	(1 << 24)
+#define DR_OVERRUN	(1UL << 30)
+#define DR_DONE		(1UL << 31)
+#define STAT_ADINT	(1 << 16)
+
+class sim_adc_model : public sim_peripheral {
+ public:
+  sim_adc_model() : sim_peripheral("ADC", &sim_adc, sizeof(sim_adc), ADC_IRQn, 13),
+		    channel(-1), conversions(0), bursts(0), unpowered(0),
+		    noise(1) {
+    sim_adc.INTEN.value = 0x100;
+  }
+
+  uint32_t read(sim_reg* reg) {
+    uint32_t value = reg->value;
+    int n = reg - sim_adc.DR;
+
+    if (n >= 0 && n < ADC_CHANNELS) {
+      /* Reading the result clears its flags */
+      reg->value &= ~(DR_DONE | DR_OVERRUN);
+      update();
+    } else if (reg == &sim_adc.GDR) {
+      reg->value &= ~(DR_DONE | DR_OVERRUN);
+    } else if (reg == &sim_adc.STAT) {
+      value = stat();
+    }
+
+    return value;
+  }
+  void write(sim_reg* reg, uint32_t value) {
+    if (reg == &sim_adc.STAT || reg == &sim_adc.GDR ||
+	(reg >= sim_adc.DR && reg < sim_adc.DR + ADC_CHANNELS)) {
+      return; /* Read only */
+    }
+    reg->value = value;
+
+    if (reg == &sim_adc.CR && (value & CR_BURST)) {
+      if (channel < 0) {
+	bursts++;
+	start();
+      }
+    } else if (reg == &sim_adc.CR && (value & CR_START_NOW)) {
+      start();
+    }
+    update();
+  }
+
+  void event(void) {
+    const struct flight_state* f = flight_now();
+    uint32_t result, *dr;
+    double volts;
+
+    if (channel < 0) return;
+
+    if (sim_syscon.PDRUNCFG.value & ADC_PD) {
+      channel = -1; /* Powered down part way through */
+      return;
+    }
+
+    switch (channel) {
+      case 3: volts = f->cutdown_voltage / 2; break;
+      case 6: volts = f->battery_voltage / 3; break;
+      case 7: volts = f->heater_current / 1000; break;
+      default: volts = 0; break;
+    }
+    noise = noise * 1103515245 + 12345;
+    result = (uint32_t)(volts / ADC_VREF * 1023 + 0.5);
+    result += (int)((noise >> 16) % (2 * ADC_NOISE + 1)) - ADC_NOISE;
+    if ((int32_t)result < 0) result = 0;
+    if (result > 1023) result = 1023;
+
+    dr = &sim_adc.DR[channel].value;
+    *dr = (*dr & DR_DONE ? DR_OVERRUN : 0) | DR_DONE | (result << 6) |
+      ((uint32_t)channel << 24);
+    sim_adc.GDR.value = *dr;
+
+    conversions++;
+
+    /* A burst goes on to the next channel until it's stopped, and
+       START goes back to 0 once it's done */
+    if (sim_adc.CR.value & CR_BURST) {
+      next();
+    } else {
+      sim_adc.CR.value &= ~(7 << 24);
+      channel = -1;
+    }
+    update();
+  }
+
+  void summary(void) {
+    printf("ADC: %u conversions, %u bursts", conversions, bursts);
+    if (unpowered) printf(", %u started while powered down", unpowered);
+    printf("\n");
+  }
+
+ private:
+  void start(void) {
+    if (sim_syscon.PDRUNCFG.value & ADC_PD) {
+      unpowered++;
+      return;
+    }
+
+    channel = -1;
+    next();
+  }
+  /**
+   * The next selected channel after this one
+   */
+  void next(void) {
+    uint32_t cr = sim_adc.CR.value;
+    uint64_t adc_clock = sim_cycle_time * (((cr >> 8) & 0xFF) + 1);
+
+    for (int i = 1; i <= ADC_CHANNELS; i++) {
+      int n = (channel + i + ADC_CHANNELS) % ADC_CHANNELS;
+      if (cr & (1 << n)) {
+	channel = n;
+	schedule(sim_time + ADC_CLOCKS * adc_clock);
+	return;
+      }
+    }
+    channel = -1;
+  }
+  uint32_t stat(void) {
+    uint32_t s = 0;
+
+    for (int i = 0; i < ADC_CHANNELS; i++) {
+      if (sim_adc.DR[i].value & DR_DONE) s |= 1 << i;
+      if (sim_adc.DR[i].value & DR_OVERRUN) s |= 1 << (8 + i);
+    }
+    if ((s & 0xFF) & sim_adc.INTEN.value) s |= STAT_ADINT;
+    if ((sim_adc.INTEN.value & 0x100) && (sim_adc.GDR.value & DR_DONE)) {
+      s |= STAT_ADINT;
+    }
+    return s;
+  }
+  void update(void) {
+    set_irq(stat() & STAT_ADINT);
+  }
+
+  int channel;
+  uint32_t conversions, bursts, unpowered;
+  uint32_t noise;
+};
+
+void sim_adc_init(void) {
+  new sim_adc_model();
+}
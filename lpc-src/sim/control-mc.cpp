@@ -0,0 +1,568 @@
+/*
+ * Monte Carlo harness for the control logic
+ * Copyright (C) 2014  richard
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * Runs the firmware's control logic (src/control.c) against thousands
+ * of randomised flights and reports how often it cuts down when it
+ * shouldn't, cuts down late, and how hard the heater works.
+ *
+ * control.c and altitude.c are built exactly as they are for the
+ * simulator. The only hardware they touch is the GPIO for the cutdown,
+ * heater and mBed, so this file provides just enough of a register
+ * layer for that and feeds them barometer readings it makes up.
+ *
+ * Each flight is generated from its own seed, so any flight can be
+ * replayed on its own with -r whatever the number of jobs.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <getopt.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <vector>
+#include "LPC11xx.h"
+#include "control.h"
+#include "flight.h"
+#include "isa.h"
+
+/**
+ * A cutdown this long after it was due is late
+ */
+#define MC_LATE			10	/* s */
+/**
+ * A cutdown this close below the ceiling is early, not false. Near the
+ * ceiling a pascal is about 25m.
+ */
+#define MC_EARLY		500	/* m */
+/**
+ * Flights that haven't landed stop here
+ */
+#define MC_MAX_DURATION		(4 * 3600)
+/**
+ * The GSM isn't wrong inside this band around its switching altitude
+ */
+#define MC_GSM_BAND		200	/* m */
+/**
+ * The GPS gives up above this altitude
+ */
+#define MC_GPS_CEILING		18000	/* m */
+
+/**
+ **************************
+ Registers
+ *************************/
+
+LPC_GPIO_TypeDef sim_gpio[4];
+
+static LPC_GPIO_TypeDef* gpio_port(sim_reg* reg, unsigned* index) {
+  for (int port = 0; port < 4; port++) {
+    *index = reg - sim_gpio[port].MASKED_ACCESS;
+    if (*index < 4096) return &sim_gpio[port];
+  }
+  return NULL;
+}
+uint32_t sim_read(sim_reg* reg) {
+  unsigned index;
+  LPC_GPIO_TypeDef* gpio = gpio_port(reg, &index);
+
+  return gpio ? gpio->DATA.value & index : reg->value;
+}
+void sim_write(sim_reg* reg, uint32_t value) {
+  unsigned index;
+  LPC_GPIO_TypeDef* gpio = gpio_port(reg, &index);
+
+  if (gpio) {
+    gpio->DATA.value = (gpio->DATA.value & ~index) | (value & index);
+  } else {
+    reg->value = value;
+  }
+}
+/**
+ * Returns non-zero if an output is driven high
+ */
+static int pin_on(int port, int pin) {
+  return (sim_gpio[port].DIR.value & sim_gpio[port].DATA.value) & (1UL << pin);
+}
+
+/**
+ **************************
+ Random Numbers
+ *************************/
+
+/**
+ * xorshift64*, seeded through splitmix64 so neighbouring seeds give
+ * unrelated sequences
+ */
+struct mc_random { uint64_t state; };
+
+static void mc_seed(struct mc_random* r, uint64_t seed) {
+  uint64_t z = seed + 0x9E3779B97F4A7C15ULL;
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+  r->state = (z ^ (z >> 31)) | 1;
+}
+static double mc_uniform(struct mc_random* r) {
+  r->state ^= r->state >> 12;
+  r->state ^= r->state << 25;
+  r->state ^= r->state >> 27;
+  return ((r->state * 0x2545F4914F6CDD1DULL) >> 11) * (1.0 / 9007199254740992.0);
+}
+static double mc_range(struct mc_random* r, double lo, double hi) {
+  return lo + (hi - lo) * mc_uniform(r);
+}
+static double mc_gaussian(struct mc_random* r, double sigma) {
+  double u = mc_uniform(r), v = mc_uniform(r);
+  return sigma * sqrt(-2 * log(u + 1e-300)) * cos(2 * M_PI * v);
+}
+
+/**
+ **************************
+ Flights
+ *************************/
+
+/**
+ * A recorded altitude profile, if we have one
+ */
+struct profile_point { double time, altitude; };
+static std::vector<profile_point> profile;
+
+static double profile_altitude(double time) {
+  if (time <= profile.front().time) return profile.front().altitude;
+
+  for (size_t i = 1; i < profile.size(); i++) {
+    if (time < profile[i].time) {
+      const profile_point& a = profile[i-1];
+      const profile_point& b = profile[i];
+      return a.altitude + (b.altitude - a.altitude) *
+	(time - a.time) / (b.time - a.time);
+    }
+  }
+  return profile.back().altitude;
+}
+
+/**
+ * What one flight looks like
+ */
+struct mc_flight {
+  double ascent_rate;		/* m/s */
+  double descent_rate;		/* m/s at sea level */
+  double burst_altitude;	/* m, or 0 to float */
+  double float_altitude;	/* m */
+  double box_warmer;		/* °C */
+  double noise;			/* Pa rms */
+  double dropout;		/* Chance a reading fails */
+  double spike;			/* Chance a reading is garbage */
+  double weather;		/* Pressure over the standard atmosphere's */
+  double gps_outage;		/* Chance of no GPS fix */
+};
+
+static void mc_make_flight(struct mc_random* r, struct mc_flight* f) {
+  double kind = mc_uniform(r);
+
+  f->ascent_rate = mc_range(r, 3.5, 6.5);
+  f->descent_rate = mc_range(r, 4.0, 7.0);
+  f->float_altitude = 0;
+
+  if (kind < 0.75) {		/* Bursts below the ceiling */
+    f->burst_altitude = mc_range(r, 24000, 38000);
+  } else if (kind < 0.9) {	/* Would carry on past it */
+    f->burst_altitude = mc_range(r, CUTDOWN_CEILING + 500, 46000);
+  } else {			/* Floats until the timer */
+    f->burst_altitude = 0;
+    f->float_altitude = mc_range(r, 15000, 35000);
+  }
+
+  f->box_warmer = mc_range(r, 10, FLIGHT_BOX_WARMER + 5);
+  f->noise = mc_range(r, 2, 12);
+  f->dropout = mc_range(r, 0, 0.05);
+  f->spike = (mc_uniform(r) < 0.5) ? mc_range(r, 0, 0.002) : 0;
+  f->weather = mc_range(r, 0.97, 1.03);
+  f->gps_outage = mc_range(r, 0, 0.5);
+}
+
+/**
+ * What happened
+ */
+struct mc_result {
+  uint32_t index;
+  int32_t cut_due;		/* s, or -1 */
+  int32_t cut_at;		/* s, or -1 */
+  float cut_altitude;		/* m */
+  uint32_t duration;		/* s */
+  uint32_t heater_on;		/* s */
+  uint32_t gsm_wrong;		/* s */
+  uint32_t burst_at;		/* s, or 0 */
+  uint32_t burst_seen;		/* s, or 0 */
+  uint32_t estimated;		/* s */
+  double error_squared;		/* m^2, summed */
+  float max_altitude;		/* m */
+};
+
+/**
+ * Flies one flight, a second at a time, and returns what the control
+ * logic did. With a trace file it prints every second.
+ */
+static void mc_fly(uint32_t index, uint64_t seed, struct mc_result* result,
+		   FILE* trace) {
+  struct mc_random r;
+  struct mc_flight f;
+  struct barometer b;
+  struct gps_data gd;
+  struct estimator e;
+  double altitude = 0, pressure, outside, box, t = 0;
+  int descending = 0;
+  uint32_t second;
+
+  mc_seed(&r, seed ^ ((uint64_t)index << 32));
+  mc_make_flight(&r, &f);
+  estimator_init(&e);
+  memset(&gd, 0, sizeof(gd));
+  for (int port = 0; port < 4; port++) {
+    sim_gpio[port].DIR.value = sim_gpio[port].DATA.value = 0;
+  }
+
+  memset(result, 0, sizeof(*result));
+  result->index = index;
+  result->cut_due = result->cut_at = -1;
+
+  if (!profile.empty()) altitude = profile_altitude(0);
+  isa(altitude, &pressure, &outside);
+  box = outside + f.box_warmer;
+
+  if (trace) {
+    fprintf(trace, "# flight %u: ascent %.1fm/s, %s %.0fm, noise %.0fPa, "
+	    "dropout %.3f, spikes %.4f, weather %.3f, gps outage %.2f\n",
+	    index, f.ascent_rate, f.burst_altitude ? "burst" : "float",
+	    f.burst_altitude ? f.burst_altitude : f.float_altitude,
+	    f.noise, f.dropout, f.spike, f.weather, f.gps_outage);
+    fprintf(trace, "# time,altitude,reading,gps,estimate,rate,burst,"
+	    "cutdown,heater,gsm,box\n");
+  }
+
+  for (second = 0; second < MC_MAX_DURATION; second++, t += 1) {
+    uint32_t timer = (second < CUTDOWN_TIME * 60) ?
+      (CUTDOWN_TIME * 60 - second) * SYSTICK_HZ : 0;
+    double reading;
+
+    /* Where we are */
+    if (!profile.empty()) {
+      altitude = profile_altitude(t);
+      if (t > profile.back().time) break;
+    } else if (descending) {
+      double p0, t0;
+      isa(0, &p0, &t0);
+      altitude -= f.descent_rate * sqrt(p0 / pressure);
+      if (altitude <= 0) break;
+    } else if (f.burst_altitude && altitude >= f.burst_altitude) {
+      descending = 1;
+      result->burst_at = second;
+    } else if (!f.burst_altitude && altitude >= f.float_altitude) {
+      altitude = f.float_altitude + mc_gaussian(&r, 20);
+    } else {
+      altitude += f.ascent_rate;
+    }
+    isa(altitude, &pressure, &outside);
+    if (altitude > result->max_altitude) result->max_altitude = altitude;
+
+    /* When the control logic should cut us down */
+    if (result->cut_due < 0 &&
+	(altitude > CUTDOWN_CEILING ||
+	 (timer == 0 && altitude > MIN_CUTDOWN_ALTITUDE))) {
+      result->cut_due = second;
+    }
+
+    /* The box warms towards where it's going */
+    box += ((outside + f.box_warmer +
+	     (pin_on(3, 4) ? FLIGHT_HEATER_WARMER : 0)) - box) /
+      FLIGHT_BOX_TIME_CONSTANT;
+
+    /* What the barometer says */
+    reading = (pressure * f.weather) + mc_gaussian(&r, f.noise);
+    if (mc_uniform(&r) < f.spike) reading = mc_range(&r, 300, 110000);
+    b.valid = (mc_uniform(&r) >= f.dropout);
+    b.pressure = (int32_t)reading;
+    b.temperature = round(box * 10) / 10;
+
+    /* And the GPS */
+    if (altitude < MC_GPS_CEILING && mc_uniform(&r) >= f.gps_outage) {
+      gd.altitude = (int)(altitude + mc_gaussian(&r, 10));
+      gd.satellites = 8;
+      gd.lat = 51.5; gd.lon = -2.6;
+    } else {
+      memset(&gd, 0, sizeof(gd));
+    }
+
+    estimator_update(&e, &b, 1000);
+    estimator_gps(&e, &gd);
+    double estimate = control_update(&e, &b, timer);
+
+    if (estimate != -1) {
+      result->estimated++;
+      result->error_squared += (estimate - altitude) * (estimate - altitude);
+    }
+    if (e.burst && !result->burst_seen) result->burst_seen = second;
+
+    /* What it did */
+    if (pin_on(3, 5) && result->cut_at < 0) {
+      result->cut_at = second;
+      result->cut_altitude = altitude;
+      if (profile.empty()) descending = 1;
+    }
+    if (pin_on(3, 4)) result->heater_on++;
+    if ((pin_on(1, 9) && altitude > GSM_ON_BELOW_ALTITUDE + MC_GSM_BAND) ||
+	(!pin_on(1, 9) && altitude < GSM_ON_BELOW_ALTITUDE - MC_GSM_BAND)) {
+      result->gsm_wrong++;
+    }
+
+    if (trace) {
+      fprintf(trace, "%u,%.0f,%d,%d,%.0f,%.1f,%d,%d,%d,%d,%.1f\n", second,
+	      altitude, b.valid ? b.pressure : -1, gd.altitude, estimate,
+	      estimator_rate(&e) / 1000.0, e.burst, !!pin_on(3, 5),
+	      !!pin_on(3, 4), !!pin_on(1, 9), box);
+    }
+  }
+
+  result->duration = second;
+}
+
+/**
+ **************************
+ Results
+ *************************/
+
+static int compare_double(const void* a, const void* b) {
+  double x = *(const double*)a, y = *(const double*)b;
+  return (x > y) - (x < y);
+}
+
+static void mc_report(std::vector<mc_result>& results, uint64_t seed, int jobs,
+		      double host) {
+  uint32_t due = 0, cut = 0, false_cuts = 0, early = 0, late = 0, missed = 0;
+  double early_by = 0;
+  uint32_t bursts = 0, bursts_seen = 0, false_bursts = 0;
+  uint64_t gsm_wrong = 0, flown = 0, estimated = 0, burst_lag = 0;
+  double error_squared = 0;
+  std::vector<double> duty;
+  std::vector<uint32_t> bad;
+
+  for (size_t i = 0; i < results.size(); i++) {
+    const mc_result& r = results[i];
+    int is_bad = 0;
+
+    if (r.cut_due >= 0) due++;
+    if (r.cut_at >= 0) cut++;
+
+    if (r.cut_at >= 0 && (r.cut_due < 0 || r.cut_at < r.cut_due)) {
+      if (r.cut_altitude >= CUTDOWN_CEILING - MC_EARLY) {
+	early++;
+	early_by += CUTDOWN_CEILING - r.cut_altitude;
+      } else {
+	false_cuts++; is_bad = 1;
+      }
+    } else if (r.cut_due >= 0 && r.cut_at < 0) {
+      missed++; is_bad = 1;
+    } else if (r.cut_due >= 0 && r.cut_at > r.cut_due + MC_LATE) {
+      late++; is_bad = 1;
+    }
+
+    duty.push_back(r.duration ? 100.0 * r.heater_on / r.duration : 0);
+    gsm_wrong += r.gsm_wrong;
+    flown += r.duration;
+    estimated += r.estimated;
+    error_squared += r.error_squared;
+
+    if (r.burst_at) {
+      bursts++;
+      if (r.burst_seen >= r.burst_at) {
+	bursts_seen++;
+	burst_lag += r.burst_seen - r.burst_at;
+      }
+    }
+    if (r.burst_seen && r.burst_seen < (uint32_t)r.cut_at &&
+	(!r.burst_at || r.burst_seen < r.burst_at)) {
+      false_bursts++; is_bad = 1;
+    }
+    if (is_bad) bad.push_back(r.index);
+  }
+  qsort(&duty[0], duty.size(), sizeof(double), compare_double);
+
+  double mean = 0;
+  for (size_t i = 0; i < duty.size(); i++) mean += duty[i];
+  mean /= duty.size();
+
+  printf("%zu flights from seed %llu on %d jobs in %.2fs\n\n", results.size(),
+	 (unsigned long long)seed, jobs, host);
+  printf("Cutdown: due on %u flights, fired on %u\n", due, cut);
+  printf("  false    %6u  %5.2f%%\n", false_cuts,
+	 100.0 * false_cuts / results.size());
+  printf("  early    %6u  %5.2f%%  (%.0fm below the ceiling on average)\n",
+	 early, 100.0 * early / results.size(), early ? early_by / early : 0);
+  printf("  late     %6u  %5.2f%%  (more than %ds after it was due)\n", late,
+	 100.0 * late / results.size(), MC_LATE);
+  printf("  missed   %6u  %5.2f%%\n", missed, 100.0 * missed / results.size());
+  printf("Heater duty: mean %.1f%%, 95th percentile %.1f%%, max %.1f%%\n",
+	 mean, duty[(duty.size() * 95) / 100], duty.back());
+  printf("GSM in the wrong state %.2f%% of the time\n",
+	 flown ? 100.0 * gsm_wrong / flown : 0);
+  printf("Altitude: valid %.2f%% of the time, %.0fm rms error\n",
+	 flown ? 100.0 * estimated / flown : 0,
+	 estimated ? sqrt(error_squared / estimated) : 0);
+  printf("Burst: %u of %u seen, %.1fs late on average, %u seen falsely\n",
+	 bursts_seen, bursts, bursts_seen ? (double)burst_lag / bursts_seen : 0,
+	 false_bursts);
+
+  if (!bad.empty()) {
+    printf("\nFlights to look at (replay with -r):");
+    for (size_t i = 0; i < bad.size() && i < 20; i++) printf(" %u", bad[i]);
+    if (bad.size() > 20) printf(" ...");
+    printf("\n");
+  }
+}
+
+/**
+ **************************
+ Entry Point
+ *************************/
+
+static void usage(const char* name) {
+  fprintf(stderr,
+	  "Usage: %s [options]\n"
+	  "  -n, --flights N     How many flights to fly (default 1000)\n"
+	  "  -j, --jobs N        How many to fly at once (default one per core)\n"
+	  "  -s, --seed N        Seed for the random flights (default 1)\n"
+	  "  -f, --flight FILE   Fly a recorded profile, lines of 'seconds,metres'\n"
+	  "  -r, --replay N      Fly flight N alone and print every second\n", name);
+}
+
+static void load_profile(const char* filename) {
+  FILE* f = fopen(filename, "r");
+  profile_point point;
+
+  if (!f) {
+    perror(filename);
+    exit(1);
+  }
+  while (fscanf(f, " %lf , %lf", &point.time, &point.altitude) == 2) {
+    profile.push_back(point);
+  }
+  fclose(f);
+
+  if (profile.size() < 2) {
+    fprintf(stderr, "%s: need at least two 'seconds,metres' lines\n", filename);
+    exit(1);
+  }
+}
+
+int main(int argc, char** argv) {
+  static const struct option options[] = {
+    { "flights",	required_argument,	NULL, 'n' },
+    { "jobs",		required_argument,	NULL, 'j' },
+    { "seed",		required_argument,	NULL, 's' },
+    { "flight",		required_argument,	NULL, 'f' },
+    { "replay",		required_argument,	NULL, 'r' },
+    { "help",		no_argument,		NULL, 'h' },
+    { NULL, 0, NULL, 0 }
+  };
+  long flights = 1000, replay = -1;
+  int jobs = sysconf(_SC_NPROCESSORS_ONLN);
+  uint64_t seed = 1;
+  struct timespec host_start, host_end;
+  int c;
+
+  while ((c = getopt_long(argc, argv, "n:j:s:f:r:h", options, NULL)) != -1) {
+    switch (c) {
+      case 'n': flights = atol(optarg); break;
+      case 'j': jobs = atoi(optarg); break;
+      case 's': seed = strtoull(optarg, NULL, 0); break;
+      case 'f': load_profile(optarg); break;
+      case 'r': replay = atol(optarg); break;
+      default: usage(argv[0]); return 1;
+    }
+  }
+  if (flights <= 0 || jobs <= 0) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  if (replay >= 0) {
+    struct mc_result result;
+    mc_fly(replay, seed, &result, stdout);
+    return 0;
+  }
+
+  if (jobs > flights) jobs = flights;
+  clock_gettime(CLOCK_MONOTONIC, &host_start);
+
+  /* Each job flies every jobs'th flight and sends back the results */
+  std::vector<int> pipes(jobs);
+  for (int job = 0; job < jobs; job++) {
+    int fd[2];
+
+    if (pipe(fd) < 0) {
+      perror("pipe");
+      return 1;
+    }
+    pid_t pid = fork();
+    if (pid < 0) {
+      perror("fork");
+      return 1;
+    }
+    if (pid == 0) {
+      FILE* out = fdopen(fd[1], "w");
+      close(fd[0]);
+      for (long i = job; i < flights; i += jobs) {
+	struct mc_result result;
+	mc_fly(i, seed, &result, NULL);
+	fwrite(&result, sizeof(result), 1, out);
+      }
+      fclose(out);
+      _exit(0);
+    }
+    close(fd[1]);
+    pipes[job] = fd[0];
+  }
+
+  std::vector<mc_result> results(flights);
+  for (int job = 0; job < jobs; job++) {
+    FILE* in = fdopen(pipes[job], "r");
+    struct mc_result result;
+
+    while (fread(&result, sizeof(result), 1, in) == 1) {
+      results[result.index] = result;
+    }
+    fclose(in);
+  }
+  while (wait(NULL) > 0);
+
+  clock_gettime(CLOCK_MONOTONIC, &host_end);
+  mc_report(results, seed, jobs,
+	    (host_end.tv_sec - host_start.tv_sec) +
+	    (host_end.tv_nsec - host_start.tv_nsec) / 1e9);
+
+  return 0;
+}
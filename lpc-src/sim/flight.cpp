@@ -0,0 +1,189 @@
+/*
+ * Flight model for the simulator
+ * Copyright (C) 2014  richard
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <math.h>
+#include <vector>
+#include "sim.h"
+#include "flight.h"
+#include "isa.h"
+
+/**
+ * Pins the flight responds to
+ */
+#define CUTDOWN_PORT	3
+#define CUTDOWN_PIN	5
+#define HEATER_PORT	3
+#define HEATER_PIN	4
+
+/**
+ * The cutdown battery, and how far it sags while burning the wire
+ */
+#define CUTDOWN_BATTERY		6.0	/* V */
+#define CUTDOWN_SAG		1.5	/* V */
+
+#define STEP			0.5	/* s */
+
+static struct flight_state state;
+static double state_time = 0;
+static double max_altitude = 0;
+static double burst_time = -1, landing_time = -1;
+
+/**
+ * An altitude profile, if we have one
+ */
+struct profile_point { double time, altitude; };
+static std::vector<profile_point> profile;
+
+static double profile_altitude(double time) {
+  size_t i;
+
+  if (time <= profile.front().time) return profile.front().altitude;
+
+  for (i = 1; i < profile.size(); i++) {
+    if (time < profile[i].time) {
+      const profile_point& a = profile[i-1];
+      const profile_point& b = profile[i];
+      return a.altitude + (b.altitude - a.altitude) *
+	(time - a.time) / (b.time - a.time);
+    }
+  }
+
+  return profile.back().altitude;
+}
+
+/**
+ * Moves the flight on by dt seconds
+ */
+static void step(double dt) {
+  double pressure0, temperature0;
+
+  if (!profile.empty()) {
+    double altitude = profile_altitude(state_time + dt);
+    state.climb = (altitude - state.altitude) / dt;
+    state.altitude = altitude;
+  } else if (!state.landed) {
+    if (burst_time < 0 && (state.altitude >= FLIGHT_BURST_ALTITUDE ||
+			   sim_pin_level(CUTDOWN_PORT, CUTDOWN_PIN))) {
+      burst_time = state_time;
+      sim_log("flight: %s at %.0fm", state.altitude >= FLIGHT_BURST_ALTITUDE ?
+	      "burst" : "cut down", state.altitude);
+    }
+
+    if (burst_time < 0) {
+      state.climb = FLIGHT_ASCENT_RATE;
+    } else {
+      /* Falls faster where the air is thin */
+      isa(0, &pressure0, &temperature0);
+      state.climb = -FLIGHT_DESCENT_RATE * sqrt(pressure0 / state.pressure);
+    }
+
+    state.altitude += state.climb * dt;
+    if (state.altitude <= 0) {
+      state.altitude = 0; state.climb = 0; state.landed = 1;
+      landing_time = state_time;
+      sim_log("flight: landed");
+    }
+  }
+
+  if (state.altitude > max_altitude) max_altitude = state.altitude;
+
+  isa(state.altitude, &state.pressure, &state.temperature);
+
+  /* Drift with the wind while we're up */
+  if (!state.landed) {
+    state.lat += FLIGHT_WIND_NORTH * dt / 111320;
+    state.lon += FLIGHT_WIND_EAST * dt / (111320 * cos(state.lat * M_PI / 180));
+  }
+
+  /* The box */
+  double target = state.temperature + FLIGHT_BOX_WARMER +
+    (sim_pin_level(HEATER_PORT, HEATER_PIN) ? FLIGHT_HEATER_WARMER : 0);
+  state.internal_temperature += (target - state.internal_temperature) *
+    (dt / FLIGHT_BOX_TIME_CONSTANT);
+
+  state.cutdown_voltage = CUTDOWN_BATTERY -
+    (sim_pin_level(CUTDOWN_PORT, CUTDOWN_PIN) ? CUTDOWN_SAG : 0);
+
+  /* The main battery */
+  state.heater_current =
+    sim_pin_level(HEATER_PORT, HEATER_PIN) ? FLIGHT_HEATER_MA : 0;
+  state.charge_used += (FLIGHT_BOARD_MA + state.heater_current) * dt / 3600;
+  state.battery_voltage = FLIGHT_BATTERY_FULL -
+    (FLIGHT_BATTERY_FULL - FLIGHT_BATTERY_EMPTY) *
+    state.charge_used / FLIGHT_BATTERY_MAH -
+    (state.heater_current ? FLIGHT_BATTERY_SAG : 0);
+
+  state_time += dt;
+}
+
+void flight_init(const char* filename) {
+  if (filename) {
+    FILE* f = fopen(filename, "r");
+    profile_point point;
+
+    if (!f) {
+      perror(filename);
+      exit(1);
+    }
+    while (fscanf(f, " %lf , %lf", &point.time, &point.altitude) == 2) {
+      profile.push_back(point);
+    }
+    fclose(f);
+
+    if (profile.size() < 2) {
+      fprintf(stderr, "%s: need at least two 'seconds,metres' lines\n", filename);
+      exit(1);
+    }
+    state.altitude = profile.front().altitude;
+  }
+
+  state.lat = FLIGHT_LAUNCH_LAT;
+  state.lon = FLIGHT_LAUNCH_LON;
+  isa(state.altitude, &state.pressure, &state.temperature);
+  state.internal_temperature = state.temperature + FLIGHT_BOX_WARMER;
+  state.cutdown_voltage = CUTDOWN_BATTERY;
+  state.battery_voltage = FLIGHT_BATTERY_FULL;
+}
+
+const struct flight_state* flight_now(void) {
+  double now = sim_seconds();
+
+  while (state_time + STEP <= now) {
+    step(STEP);
+  }
+
+  return &state;
+}
+
+void flight_summary(void) {
+  flight_now();
+
+  printf("Flight: max altitude %.0fm", max_altitude);
+  if (burst_time >= 0) printf(", came down at %.0fs", burst_time);
+  if (landing_time >= 0) printf(", landed at %.0fs", landing_time);
+  printf("\n");
+  printf("Flight: %.0fmAh used from the main battery, %.2fV left\n",
+	 state.charge_used, state.battery_voltage);
+}
@@ -0,0 +1,79 @@
+/*
+ * Flight model for the simulator
+ * Copyright (C) 2014  richard
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef FLIGHT_H
+#define FLIGHT_H
+
+/**
+ * The world the firmware flies through. Without a profile the balloon
+ * climbs at FLIGHT_ASCENT_RATE until it bursts or the cutdown fires,
+ * then falls under its parachute until it lands.
+ */
+#define FLIGHT_ASCENT_RATE	5.0	/* m/s */
+#define FLIGHT_DESCENT_RATE	5.0	/* m/s at sea level */
+#define FLIGHT_BURST_ALTITUDE	32000	/* m */
+#define FLIGHT_LAUNCH_LAT	51.8218
+#define FLIGHT_LAUNCH_LON	-0.0127
+#define FLIGHT_WIND_EAST	8.0	/* m/s */
+#define FLIGHT_WIND_NORTH	-3.0	/* m/s */
+/**
+ * The box sits this far above the outside temperature, the heater
+ * adds more. It gets there with a time constant of a few minutes.
+ */
+#define FLIGHT_BOX_WARMER		25.0	/* °C */
+#define FLIGHT_HEATER_WARMER		15.0	/* °C */
+#define FLIGHT_BOX_TIME_CONSTANT	300.0	/* s */
+/**
+ * The main battery runs down from full at the board's current and the
+ * heater's, and sags while the heater's on
+ */
+#define FLIGHT_BATTERY_FULL	6.0	/* V */
+#define FLIGHT_BATTERY_EMPTY	4.0	/* V */
+#define FLIGHT_BATTERY_MAH	3000.0
+#define FLIGHT_BATTERY_SAG	0.3	/* V */
+#define FLIGHT_BOARD_MA		120.0
+#define FLIGHT_HEATER_MA	800.0
+
+struct flight_state {
+  double altitude;		/* m */
+  double climb;			/* m/s */
+  double pressure;		/* Pa */
+  double temperature;		/* Outside, °C */
+  double internal_temperature;	/* Inside the box, °C */
+  double lat, lon;		/* Degrees */
+  double cutdown_voltage;	/* V */
+  double battery_voltage;	/* V */
+  double heater_current;	/* mA */
+  double charge_used;		/* mAh */
+  int landed;
+};
+
+void flight_init(const char* profile);
+/**
+ * Returns the state of the flight at the current simulated time
+ */
+const struct flight_state* flight_now(void);
+void flight_summary(void);
+
+#endif /* FLIGHT_H */
@@ -0,0 +1,419 @@
+/*
+ * GPIO model for the simulator
+ * Copyright (C) 2014  richard
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * GPIO ports, the pins we watch and an RTTY receiver on P0[7].
+ */
+
+#include <stdlib.h>
+#include <math.h>
+#include <vector>
+#include <map>
+#include <string>
+#include "sim.h"
+#include "rtty.h"
+
+#define PORTS		4
+#define PINS		12
+
+/**
+ * Pins a model's holding low
+ */
+static uint32_t held_low[PORTS];
+
+/**
+ * A pin that isn't driven reads high, all the pull-ups are on at reset,
+ * unless something else on it is pulling it low
+ */
+static int pin_level(LPC_GPIO_TypeDef* gpio, int pin) {
+  if (held_low[gpio - sim_gpio] & (1UL << pin)) {
+    return 0;
+  }
+  if (gpio->DIR.value & (1UL << pin)) {
+    return (gpio->DATA.value >> pin) & 1;
+  }
+  return 1;
+}
+
+static std::vector<sim_pin_watcher*> watchers[PORTS][PINS];
+
+void sim_watch_pin(int port, int pin, sim_pin_watcher* watcher) {
+  watchers[port][pin].push_back(watcher);
+}
+int sim_pin_level(int port, int pin) {
+  return pin_level(&sim_gpio[port], pin);
+}
+void sim_pin_hold_low(int port, int pin, int low) {
+  if (low) {
+    held_low[port] |= 1UL << pin;
+  } else {
+    held_low[port] &= ~(1UL << pin);
+  }
+}
+
+class sim_gpio_model : public sim_peripheral {
+ public:
+  sim_gpio_model(const char* name, int port) :
+    sim_peripheral(name, &sim_gpio[port], sizeof(sim_gpio[port]), -1, 6),
+    port(port), gpio(&sim_gpio[port]) {}
+
+  uint32_t read(sim_reg* reg) {
+    unsigned index = reg - gpio->MASKED_ACCESS;
+
+    if (index < 4096) {
+      return levels() & index;
+    } else if (reg == &gpio->DATA) {
+      return levels();
+    }
+    return reg->value;
+  }
+  void write(sim_reg* reg, uint32_t value) {
+    unsigned index = reg - gpio->MASKED_ACCESS;
+    uint32_t before = levels();
+
+    if (index < 4096) {
+      gpio->DATA.value = (gpio->DATA.value & ~index) | (value & index);
+    } else if (reg == &gpio->IC || reg == &gpio->RIS || reg == &gpio->MIS) {
+      /* Pin interrupts aren't modelled */
+    } else {
+      reg->value = value;
+    }
+
+    notify(before, levels());
+  }
+
+ private:
+  uint32_t levels(void) {
+    uint32_t l = 0;
+    for (int pin = 0; pin < PINS; pin++) {
+      l |= pin_level(gpio, pin) << pin;
+    }
+    return l;
+  }
+  void notify(uint32_t before, uint32_t after) {
+    uint32_t changed = before ^ after;
+
+    for (int pin = 0; changed; pin++, changed >>= 1) {
+      if (changed & 1) {
+	for (size_t i = 0; i < watchers[port][pin].size(); i++) {
+	  watchers[port][pin][i]->pin_changed(port, pin, (after >> pin) & 1);
+	}
+      }
+    }
+  }
+
+  int port;
+  LPC_GPIO_TypeDef* gpio;
+};
+
+/**
+ * Logs the outputs that matter and adds up how long they're on for.
+ * A pin's only on when it's driven high, the pull-up doesn't count.
+ */
+class sim_pin_monitor : public sim_pin_watcher {
+ public:
+  sim_pin_monitor(const char* name, int port, int pin) :
+    name(name), on(0), on_since(0), on_time(0), switches(0) {
+    sim_watch_pin(port, pin, this);
+  }
+
+  void pin_changed(int port, int pin, int level) {
+    int driven = level && (sim_gpio[port].DIR.value & (1UL << pin));
+
+    if (driven == on) return;
+    on = driven;
+
+    if (on) {
+      on_since = sim_time;
+    } else {
+      on_time += sim_time - on_since;
+    }
+    switches++;
+    sim_log("%s %s", name, on ? "on" : "off");
+  }
+  void summary(void) {
+    uint64_t total = on_time + (on ? sim_time - on_since : 0);
+
+    printf("%s: on for %.1fs, switched %u times\n", name,
+	   (double)total / SIM_TICK_HZ, switches);
+  }
+
+  const char* name;
+  int on;
+  uint64_t on_since;
+  uint64_t on_time;
+  uint32_t switches;
+};
+
+/**
+ * Receives the RTTY on P0[7] like a terminal unit would: waits for a
+ * start bit and samples the middle of each bit after it. One stop bit
+ * is enough to receive 1.5 or 2. Five data bits are ITA2, decoded
+ * with the firmware's own table.
+ *
+ * It follows the firmware's baud rate changes by watching for the
+ * shortest time between edges, which is one bit.
+ *
+ * Each sentence's flight phase is the fourth field, and the summary
+ * has how often sentences started in each phase and how long they were.
+ *
+ * Every edge within a character should fall on a whole number of half
+ * bits from the last, and the summary has how far off they were for
+ * each core clock the firmware ran at. A start bit can come at any
+ * time after the line's been idle, so it isn't measured.
+ */
+#define RTTY_PORT	0
+#define RTTY_PIN	7
+#define RTTY_EDGES	32
+#define RTTY_PHASES	5
+#define RTTY_EDGE_HALVES 24	/* 8N2 is 22 */
+
+static const char* rtty_phase_names[RTTY_PHASES] = {
+  "ground", "ascent", "float", "descent", "landed"
+};
+
+class sim_rtty_receiver : public sim_peripheral, public sim_pin_watcher {
+ public:
+  sim_rtty_receiver() : sim_peripheral("RTTY", NULL, 0), bit(-1),
+			last_edge(0), edge(0), shift(RTTY_ITA2_LETTERS),
+			baud(sim_options.rtty_baud),
+			characters(0), framing_errors(0), baud_changes(0),
+			line_start(0), last_phase(-1), last_start(0),
+			first_bit(SIM_NEVER) {
+    bit_time = SIM_TICK_HZ / baud;
+    for (int i = 0; i < RTTY_EDGES; i++) edges[i] = SIM_NEVER;
+    for (int i = 0; i < RTTY_PHASES; i++) {
+      sentences[i] = intervals[i] = 0;
+      interval_time[i] = 0; sentence_characters[i] = 0;
+    }
+
+    if (sim_options.rtty_file) {
+      out = fopen(sim_options.rtty_file, "w");
+      if (!out) {
+	perror(sim_options.rtty_file);
+	exit(1);
+      }
+    } else {
+      out = stdout;
+    }
+    sim_watch_pin(RTTY_PORT, RTTY_PIN, this);
+  }
+
+  void pin_changed(int port, int pin, int level) {
+    (void)port; (void)pin;
+
+    edges[edge++ % RTTY_EDGES] = sim_time - last_edge;
+    if (bit >= 0) check_edge(sim_time - last_edge);
+    last_edge = sim_time;
+
+    if (bit < 0 && level == 0) { /* Start bit */
+      if (first_bit == SIM_NEVER) first_bit = sim_time;
+      follow_baud();
+      bit = 0; byte = 0;
+      schedule(sim_time + (bit_time / 2));
+    }
+  }
+  void event(void) {
+    int level = sim_pin_level(RTTY_PORT, RTTY_PIN);
+
+    if (bit == 0) {
+      if (level) { bit = -1; return; } /* Just a glitch */
+    } else if (bit <= sim_options.rtty_data_bits) {
+      byte |= level << (bit - 1);
+    } else {
+      if (level) {
+	if (sim_options.rtty_data_bits == 5) {
+	  char c = rtty_ita2_decode(byte, &shift);
+	  if (c) received(c);
+	} else {
+	  received(byte);
+	}
+	characters++;
+      } else {
+	framing_errors++;
+      }
+      bit = -1;
+      return;
+    }
+
+    bit++;
+    schedule(sim_time + bit_time);
+  }
+  void summary(void) {
+    if (out != stdout) fclose(out);
+    printf("RTTY: %u characters received, %u framing errors, "
+	   "%u baud rate changes, finished at %d baud\n",
+	   characters, framing_errors, baud_changes, baud);
+    if (first_bit != SIM_NEVER) {
+      printf("RTTY: first start bit %.1fms after reset\n",
+	     1000.0 * first_bit / SIM_TICK_HZ);
+    }
+    for (int i = 0; i < RTTY_PHASES; i++) {
+      if (!sentences[i]) continue;
+      printf("RTTY %-8s %5u sentences, %5.1f characters, ", rtty_phase_names[i],
+	     sentences[i], (double)sentence_characters[i] / sentences[i]);
+      if (intervals[i]) {
+	printf("one every %.1fs\n", (double)interval_time[i] / intervals[i] / SIM_TICK_HZ);
+      } else {
+	printf("only one\n");
+      }
+    }
+    for (std::map<uint32_t, edge_stats>::iterator i = timing.begin();
+	 i != timing.end(); ++i) {
+      printf("RTTY at %uHz: %u edges, %.3f%% of a bit off on average, "
+	     "%.3f%% at worst\n", i->first, i->second.edges,
+	     100 * i->second.total / i->second.edges, 100 * i->second.worst);
+    }
+  }
+
+ private:
+  /**
+   * Writes out a character, and counts the sentences by phase
+   */
+  void received(char c) {
+    fputc(c, out);
+
+    if (line.empty()) line_start = sim_time;
+    if (c != '\n') {
+      line += c;
+      return;
+    }
+
+    int phase = -1;
+    if (line.compare(0, 2, "$$") == 0) {
+      size_t comma = 0;
+      for (int i = 0; i < 3 && comma != std::string::npos; i++) {
+	comma = line.find(',', comma + 1);
+      }
+      if (comma != std::string::npos) phase = atoi(line.c_str() + comma + 1);
+    }
+    if (phase >= 0 && phase < RTTY_PHASES) {
+      sentences[phase]++;
+      sentence_characters[phase] += line.size() + 1;
+      if (phase == last_phase) {
+	intervals[phase]++;
+	interval_time[phase] += line_start - last_start;
+      }
+      last_phase = phase;
+      last_start = line_start;
+    }
+    line.clear();
+  }
+
+  /**
+   * Measures how far the time since the last edge is from a whole
+   * number of half bits, as a fraction of a bit
+   */
+  void check_edge(uint64_t interval) {
+    double half = (double)bit_time / 2;
+    double halves = floor(interval / half + 0.5);
+
+    if (halves < 1 || halves > RTTY_EDGE_HALVES) return;
+
+    double off = fabs(interval - (halves * half)) / bit_time;
+    edge_stats& s = timing[sim_core_clock()];
+    s.edges++;
+    s.total += off;
+    if (off > s.worst) s.worst = off;
+  }
+
+  /**
+   * Snaps the shortest recent time between edges to a baud rate
+   */
+  void follow_baud(void) {
+    static const int rates[] = { 50, 75, 100, 300, 600 };
+    uint64_t shortest = SIM_NEVER;
+
+    for (int i = 0; i < RTTY_EDGES; i++) {
+      if (edges[i] < shortest) shortest = edges[i];
+    }
+    if (shortest == SIM_NEVER || shortest == 0) return;
+
+    double measured = (double)SIM_TICK_HZ / shortest;
+    for (size_t i = 0; i < sizeof(rates) / sizeof(rates[0]); i++) {
+      if (fabs(measured - rates[i]) < rates[i] * 0.1 && rates[i] != baud) {
+	sim_log("RTTY now %d baud", rates[i]);
+	baud = rates[i];
+	bit_time = SIM_TICK_HZ / baud;
+	baud_changes++;
+      }
+    }
+  }
+
+  struct edge_stats {
+    edge_stats() : edges(0), total(0), worst(0) {}
+    uint32_t edges;
+    double total, worst;
+  };
+
+  FILE* out;
+  std::map<uint32_t, edge_stats> timing;
+  uint64_t bit_time;
+  int bit;
+  uint8_t byte;
+  uint64_t last_edge;
+  uint64_t edges[RTTY_EDGES];
+  uint32_t edge;
+  uint8_t shift;
+  int baud;
+  uint32_t characters;
+  uint32_t framing_errors;
+  uint32_t baud_changes;
+  std::string line;
+  uint64_t line_start;
+  int last_phase;
+  uint64_t last_start;
+  uint64_t first_bit;
+  uint32_t sentences[RTTY_PHASES], intervals[RTTY_PHASES];
+  uint64_t interval_time[RTTY_PHASES], sentence_characters[RTTY_PHASES];
+};
+
+/**
+ * Reports the pins at the end
+ */
+class sim_pin_summary : public sim_peripheral {
+ public:
+  sim_pin_summary() : sim_peripheral("Pins", NULL, 0),
+		      cutdown("cutdown", 3, 5), heater("heater", 3, 4),
+		      mbed("mbed", 1, 9) {}
+
+  void summary(void) {
+    cutdown.summary();
+    heater.summary();
+    mbed.summary();
+  }
+
+ private:
+  sim_pin_monitor cutdown, heater, mbed;
+};
+
+void sim_gpio_init(void) {
+  static const char* names[PORTS] = { "GPIO0", "GPIO1", "GPIO2", "GPIO3" };
+
+  for (int port = 0; port < PORTS; port++) {
+    new sim_gpio_model(names[port], port);
+  }
+  new sim_pin_summary();
+  new sim_rtty_receiver();
+}
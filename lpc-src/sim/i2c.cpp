@@ -0,0 +1,554 @@
+/*
+ * I2C, BMP085 and TMP102 models for the simulator
+ * Copyright (C) 2014  richard
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * The I2C master, with the BMP085 barometer and TMP102 thermometer on
+ * the bus. Both report what the flight model says.
+ *
+ * With -k a slave loses track every so often and holds SDA low, which
+ * stops the master from starting until SCL's clocked by hand on P0[4]
+ * enough times for it to finish the byte it thought it was sending.
+ */
+
+#include <math.h>
+#include <string.h>
+#include "sim.h"
+#include "flight.h"
+
+#define CONSET_AA	(1 << 2)
+#define CONSET_SI	(1 << 3)
+#define CONSET_STO	(1 << 4)
+#define CONSET_STA	(1 << 5)
+#define CONSET_I2EN	(1 << 6)
+
+/**
+ * Master status codes
+ */
+#define STAT_START		0x08
+#define STAT_REPEATED_START	0x10
+#define STAT_SLAW_ACK		0x18
+#define STAT_SLAW_NACK		0x20
+#define STAT_DATA_ACK		0x28
+#define STAT_DATA_NACK		0x30
+#define STAT_SLAR_ACK		0x40
+#define STAT_SLAR_NACK		0x48
+#define STAT_READ_ACK		0x50
+#define STAT_READ_NACK		0x58
+#define STAT_IDLE		0xF8
+
+/**
+ * A slave on the bus
+ */
+class sim_i2c_device {
+ public:
+  sim_i2c_device(uint8_t address) : address(address) {}
+  virtual ~sim_i2c_device() {}
+
+  /**
+   * Addressed for a write or a read
+   */
+  virtual void start(int read) { (void)read; }
+  /**
+   * Returns non-zero to acknowledge
+   */
+  virtual int write(uint8_t data) { (void)data; return 1; }
+  virtual uint8_t read(void) { return 0xFF; }
+
+  uint8_t address;
+};
+
+/**
+ **************************
+ BMP085
+ *************************/
+
+/**
+ * A BMP085 with the calibration from the datasheet's worked example
+ */
+static const int16_t bmp_AC1 = 408, bmp_AC2 = -72, bmp_AC3 = -14383;
+static const uint16_t bmp_AC4 = 32741, bmp_AC5 = 32757, bmp_AC6 = 23153;
+static const int16_t bmp_B1 = 6190, bmp_B2 = 4, bmp_MB = -32768;
+static const int16_t bmp_MC = -8711, bmp_MD = 2868;
+
+#define BMP085_CALIBRATION	0xAA
+#define BMP085_CONTROL		0xF4
+#define BMP085_DATA		0xF6
+
+class sim_bmp085 : public sim_i2c_device {
+ public:
+  sim_bmp085() : sim_i2c_device(0xEE), conversions(0), pointer(0), first(0),
+		 ready(0) {
+    const int16_t cal[11] = { bmp_AC1, bmp_AC2, bmp_AC3, (int16_t)bmp_AC4,
+			      (int16_t)bmp_AC5, (int16_t)bmp_AC6, bmp_B1,
+			      bmp_B2, bmp_MB, bmp_MC, bmp_MD };
+
+    memset(regs, 0, sizeof(regs));
+    for (int i = 0; i < 11; i++) {
+      regs[BMP085_CALIBRATION + 2*i] = (uint16_t)cal[i] >> 8;
+      regs[BMP085_CALIBRATION + 2*i + 1] = cal[i] & 0xFF;
+    }
+    regs[0xD0] = 0x55; /* Chip ID */
+  }
+
+  void start(int read) {
+    first = !read;
+  }
+  int write(uint8_t data) {
+    if (first) {
+      pointer = data;
+      first = 0;
+    } else {
+      if (pointer == BMP085_CONTROL) convert(data);
+      regs[pointer++] = data;
+    }
+    return 1;
+  }
+  uint8_t read(void) {
+    if (pointer >= BMP085_DATA && pointer <= BMP085_DATA + 2 &&
+	sim_time < ready) {
+      return 0xFF; /* Still converting, the old result's gone */
+    }
+    return regs[pointer++];
+  }
+
+  uint32_t conversions;
+
+ private:
+  void convert(uint8_t command) {
+    static const double times[4] = { 0.0045, 0.0075, 0.0135, 0.0255 };
+    const struct flight_state* f = flight_now();
+    int32_t ut = find_ut(f->internal_temperature), result;
+
+    if (command == 0x2E) {
+      result = ut << 8;
+      ready = sim_time + sim_from_seconds(0.0045);
+    } else if ((command & 0x3F) == 0x34) {
+      int oss = command >> 6;
+      result = find_up(b5(ut), oss, f->pressure) << (8 - oss);
+      ready = sim_time + sim_from_seconds(times[oss]);
+    } else {
+      return;
+    }
+
+    regs[BMP085_DATA] = result >> 16;
+    regs[BMP085_DATA + 1] = result >> 8;
+    regs[BMP085_DATA + 2] = result;
+    conversions++;
+  }
+
+  /**
+   * The datasheet's algorithm, forwards
+   */
+  static int32_t b5(int32_t ut) {
+    int32_t x1 = ((ut - bmp_AC6) * bmp_AC5) >> 15;
+    int32_t x2 = (bmp_MC << 11) / (x1 + bmp_MD);
+    return x1 + x2;
+  }
+  static int32_t pressure(int32_t b5, int32_t up, int oss) {
+    int32_t b6 = b5 - 4000;
+    int32_t x1 = (bmp_B2 * ((b6 * b6) >> 12)) >> 11;
+    int32_t x2 = (bmp_AC2 * b6) >> 11;
+    int32_t x3 = x1 + x2;
+    int32_t b3 = ((((int32_t)bmp_AC1 * 4 + x3) << oss) + 2) >> 2;
+    x1 = (bmp_AC3 * b6) >> 13;
+    x2 = (bmp_B1 * ((b6 * b6) >> 12)) >> 16;
+    x3 = ((x1 + x2) + 2) >> 2;
+    uint32_t b4 = (bmp_AC4 * (uint32_t)(x3 + 32768)) >> 15;
+    uint32_t b7 = ((uint32_t)up - b3) * (50000 >> oss);
+    int32_t p = (b7 < 0x80000000) ? (b7 * 2) / b4 : (b7 / b4) * 2;
+
+    x1 = (p >> 8) * (p >> 8);
+    x1 = (x1 * 3038) >> 16;
+    x2 = (-7357 * p) >> 16;
+    return p + ((x1 + x2 + 3791) >> 4);
+  }
+  static int32_t b3(int32_t b5, int oss) {
+    int32_t b6 = b5 - 4000;
+    int32_t x3 = ((bmp_B2 * ((b6 * b6) >> 12)) >> 11) + ((bmp_AC2 * b6) >> 11);
+    return ((((int32_t)bmp_AC1 * 4 + x3) << oss) + 2) >> 2;
+  }
+
+  /**
+   * The raw readings that give these, found by bisection
+   */
+  static int32_t find_ut(double celsius) {
+    int32_t lo = 0, hi = 0xFFFF, target = lround(celsius * 10);
+
+    while (lo < hi) {
+      int32_t mid = (lo + hi) / 2;
+      if (((b5(mid) + 8) >> 4) < target) lo = mid + 1; else hi = mid;
+    }
+    return lo;
+  }
+  static int32_t find_up(int32_t b5, int oss, double pascals) {
+    int32_t lo = b3(b5, oss), hi = (1 << (16 + oss)) - 1;
+    int32_t target = lround(pascals);
+
+    if (lo < 0) lo = 0;
+    while (lo < hi) {
+      int32_t mid = (lo + hi) / 2;
+      if (pressure(b5, mid, oss) < target) lo = mid + 1; else hi = mid;
+    }
+    return lo;
+  }
+
+  uint8_t regs[0x100];
+  uint8_t pointer;
+  int first;
+  uint64_t ready;
+};
+
+/**
+ **************************
+ TMP102
+ *************************/
+
+#define TMP102_OS		0x8000
+#define TMP102_SD		0x0100
+#define TMP102_EM		0x0010
+
+/**
+ * Free running at 4Hz from power on. Shut down it holds the last
+ * conversion, and OS starts a one-shot that's there 26ms later.
+ */
+class sim_tmp102 : public sim_i2c_device {
+ public:
+  sim_tmp102() : sim_i2c_device(0x92), readings(0), one_shots(0),
+		 pointer(0), first(0), index(0), config(0x60A0), value(0),
+		 free_running(0), since(0), ready(0), latched(0),
+		 converting(0) {}
+
+  void start(int read) {
+    first = !read;
+    index = 0;
+    if (read && pointer == 0) {
+      value = temperature();
+      readings++;
+    } else if (read) {
+      value = (config & ~TMP102_OS) | (sim_time >= ready ? TMP102_OS : 0);
+    }
+  }
+  int write(uint8_t data) {
+    if (first) {
+      pointer = data & 3;
+      first = 0;
+    } else if (pointer == 1 && index++ == 0) {
+      mode((data << 8) | (config & 0xFF));
+    } else if (pointer == 1) {
+      config = (config & 0xFF00) | data;
+    }
+    return 1;
+  }
+  uint8_t read(void) {
+    return (index++ == 0) ? value >> 8 : value & 0xFF;
+  }
+
+  /**
+   * Conversions done, free running or not
+   */
+  double conversions(void) {
+    double running = free_running;
+
+    if (!(config & TMP102_SD)) running += sim_time - since;
+    return one_shots + running / sim_from_seconds(0.25);
+  }
+
+  uint32_t readings, one_shots;
+
+ private:
+  /**
+   * The first byte of the config register, with SD and OS
+   */
+  void mode(uint16_t next) {
+    if ((next & TMP102_SD) && !(config & TMP102_SD)) {
+      free_running += sim_time - since;
+      latched = flight_now()->temperature;
+    } else if (!(next & TMP102_SD) && (config & TMP102_SD)) {
+      since = sim_time;
+    }
+    if ((next & TMP102_SD) && (next & TMP102_OS) && sim_time >= ready) {
+      latch();
+      ready = sim_time + sim_from_seconds(0.026);
+      converting = flight_now()->temperature;
+      one_shots++;
+    }
+    config = (next & ~TMP102_OS) | 0x6000; /* R1 and R0 read 1 */
+  }
+  void latch(void) {
+    if (one_shots && sim_time >= ready) latched = converting;
+  }
+
+  /**
+   * The temperature register, 12 bits left justified or 13 with the
+   * last bit set
+   */
+  uint16_t temperature(void) {
+    double celsius;
+    int16_t t;
+
+    if (config & TMP102_SD) {
+      latch();
+      celsius = latched;
+    } else {
+      celsius = flight_now()->temperature;
+    }
+    t = lround(celsius / 0.0625);
+    return (config & TMP102_EM) ? (uint16_t)(t << 3) | 1 : (uint16_t)(t << 4);
+  }
+
+  uint8_t pointer;
+  int first;
+  int index;
+  uint16_t config, value;
+  uint64_t free_running, since, ready;
+  double latched, converting;
+};
+
+/**
+ **************************
+ Master
+ *************************/
+
+#define SCL_PORT		0
+#define SCL_PIN			4
+#define SDA_PORT		0
+#define SDA_PIN			5
+
+class sim_i2c_model : public sim_peripheral, public sim_pin_watcher {
+ public:
+  sim_i2c_model() : sim_peripheral("I2C", &sim_i2c, sizeof(sim_i2c), I2C_IRQn, 5),
+		    device(NULL), bus_busy(0), action(NONE), transfers(0),
+		    nacks(0), busy_time(0), fastest(0), stuck(0),
+		    stuck_clocks(0), stucks(0), recovered(0),
+		    recover_clocks(0), next_stuck(SIM_NEVER) {
+    sim_i2c.STAT.value = STAT_IDLE;
+    sim_i2c.SCLH.value = 4; sim_i2c.SCLL.value = 4;
+    devices[0] = &bmp085;
+    devices[1] = &tmp102;
+
+    if (sim_options.i2c_stuck > 0) {
+      next_stuck = sim_from_seconds(sim_options.i2c_stuck);
+    }
+    sim_watch_pin(SCL_PORT, SCL_PIN, this);
+  }
+
+  /**
+   * SCL clocked by hand lets a stuck slave finish its byte
+   */
+  void pin_changed(int port, int pin, int level) {
+    (void)port; (void)pin;
+
+    if (!stuck || !level) return;
+    recover_clocks++;
+    if (--stuck_clocks == 0) {
+      stuck = 0; recovered++;
+      sim_pin_hold_low(SDA_PORT, SDA_PIN, 0);
+      sim_log("I2C SDA released");
+    }
+  }
+
+  uint32_t read(sim_reg* reg) {
+    if (reg == &sim_i2c.CONCLR) return 0;
+    return reg->value;
+  }
+  /**
+   * Nothing changes while the bus is stuck, so a loop polling for a
+   * STOP has to be left to time out instead of skipping ahead
+   */
+  int pollable(sim_reg* reg) {
+    (void)reg;
+    return !stuck;
+  }
+  void write(sim_reg* reg, uint32_t value) {
+    uint32_t con = sim_i2c.CONSET.value;
+
+    if (reg == &sim_i2c.CONSET) {
+      sim_i2c.CONSET.value = con | (value & 0x7C);
+      if (!(con & CONSET_SI)) go(); /* Idle, or a STOP with nothing pending */
+    } else if (reg == &sim_i2c.CONCLR) {
+      sim_i2c.CONSET.value = con & ~(value & 0x6C);
+      if (value & CONSET_I2EN) {
+	/* Disabled, back to idle whatever it was doing */
+	sim_i2c.STAT.value = STAT_IDLE;
+	bus_busy = 0; device = NULL;
+	action = NONE;
+      } else if ((con & CONSET_SI) && (value & CONSET_SI)) {
+	go();
+      }
+    } else if (reg == &sim_i2c.STAT) {
+      /* Read only */
+    } else {
+      reg->value = value;
+    }
+
+    set_irq(sim_i2c.CONSET.value & CONSET_SI);
+  }
+
+  void event(void) {
+    uint32_t con = sim_i2c.CONSET.value;
+
+    switch (action) {
+      case STOP:
+	sim_i2c.CONSET.value = con & ~CONSET_STO;
+	sim_i2c.STAT.value = STAT_IDLE;
+	bus_busy = 0; device = NULL;
+	action = NONE;
+	if (con & CONSET_STA) go();
+	return;
+      case START:
+	sim_i2c.CONSET.value = con & ~CONSET_STA;
+	status(bus_busy ? STAT_REPEATED_START : STAT_START);
+	bus_busy = 1;
+	break;
+      case ADDRESS: {
+	uint8_t sla = sim_i2c.DAT.value;
+	device = find(sla & 0xFE);
+	if (device) device->start(sla & 1);
+	if (sla & 1) {
+	  status(device ? STAT_SLAR_ACK : STAT_SLAR_NACK);
+	} else {
+	  status(device ? STAT_SLAW_ACK : STAT_SLAW_NACK);
+	}
+	if (!device) nacks++;
+	break;
+      }
+      case WRITE:
+	status(device->write(sim_i2c.DAT.value) ? STAT_DATA_ACK : STAT_DATA_NACK);
+	transfers++;
+	break;
+      case READ:
+	sim_i2c.DAT.value = device->read();
+	status((con & CONSET_AA) ? STAT_READ_ACK : STAT_READ_NACK);
+	transfers++;
+	break;
+      default:
+	break;
+    }
+    action = NONE;
+  }
+
+  void summary(void) {
+    printf("I2C: %u bytes, %u unanswered addresses, %u BMP085 conversions,"
+	   " %u TMP102 readings\n", transfers, nacks, bmp085.conversions,
+	   tmp102.readings);
+    printf("I2C: TMP102 converted %.0f times, %u of them one-shots\n",
+	   tmp102.conversions(), tmp102.one_shots);
+    printf("I2C: bus busy for %.3fs, %.1fms a second, SCL up to %.0fkHz\n",
+	   (double)busy_time / SIM_TICK_HZ,
+	   1000.0 * busy_time / (sim_time ? sim_time : 1),
+	   fastest ? (double)SIM_TICK_HZ / fastest / 1000 : 0);
+    if (stucks) {
+      printf("I2C: SDA stuck low %u times, freed %u times with %u clocks\n",
+	     stucks, recovered, recover_clocks);
+    }
+  }
+
+ private:
+  enum { NONE, START, STOP, ADDRESS, WRITE, READ };
+
+  /**
+   * One SCL period
+   */
+  uint64_t bit_time(void) {
+    uint32_t sclh = sim_i2c.SCLH.value & 0xFFFF, scll = sim_i2c.SCLL.value & 0xFFFF;
+    return (uint64_t)(sclh + scll) * sim_cycle_time;
+  }
+
+  /**
+   * Works out what the firmware has asked for and when it'll be done
+   */
+  void go(void) {
+    uint32_t con = sim_i2c.CONSET.value;
+    uint32_t stat = sim_i2c.STAT.value;
+
+    if (!(con & CONSET_I2EN) || action != NONE) return;
+
+    if (!bus_busy && sim_time >= next_stuck && !stuck) {
+      /* A slave thinks it's part way through a read */
+      stuck = 1; stucks++;
+      stuck_clocks = 1 + (stucks % 8);
+      next_stuck = sim_time + sim_from_seconds(sim_options.i2c_stuck);
+      sim_pin_hold_low(SDA_PORT, SDA_PIN, 1);
+      sim_log("I2C SDA stuck low");
+    }
+    if (stuck) {
+      /* A START needs SDA high, and nothing else can happen */
+      return;
+    }
+
+    if (con & CONSET_STO) {
+      if (!bus_busy) {
+	/* Nothing to stop */
+	sim_i2c.CONSET.value = con & ~CONSET_STO;
+	return;
+      }
+      after(STOP, 1);
+    } else if (con & CONSET_STA) {
+      after(START, 1);
+    } else if (!bus_busy) {
+      return;
+    } else if (stat == STAT_START || stat == STAT_REPEATED_START) {
+      after(ADDRESS, 9);
+    } else if (stat == STAT_SLAW_ACK || stat == STAT_DATA_ACK) {
+      after(WRITE, 9);
+    } else if (stat == STAT_SLAR_ACK || stat == STAT_READ_ACK) {
+      after(READ, 9);
+    }
+  }
+  void after(int what, int bits) {
+    uint64_t bit = bit_time();
+
+    action = what;
+    schedule(sim_time + bits * bit);
+    busy_time += bits * bit;
+    if (!fastest || bit < fastest) fastest = bit;
+  }
+  void status(uint32_t stat) {
+    sim_i2c.STAT.value = stat;
+    sim_i2c.CONSET.value |= CONSET_SI;
+    set_irq(1);
+  }
+  sim_i2c_device* find(uint8_t address) {
+    for (int i = 0; i < 2; i++) {
+      if (devices[i]->address == address) return devices[i];
+    }
+    return NULL;
+  }
+
+  sim_bmp085 bmp085;
+  sim_tmp102 tmp102;
+  sim_i2c_device* devices[2];
+  sim_i2c_device* device;
+  int bus_busy;
+  int action;
+  uint32_t transfers, nacks;
+  uint64_t busy_time, fastest;
+  int stuck, stuck_clocks;
+  uint32_t stucks, recovered, recover_clocks;
+  uint64_t next_stuck;
+};
+
+void sim_i2c_init(void) {
+  new sim_i2c_model();
+}
@@ -0,0 +1,61 @@
+/*
+ * Standard atmosphere for the simulator
+ * Copyright (C) 2014  richard
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef ISA_H
+#define ISA_H
+
+#include <math.h>
+
+/**
+ * Volumetric mean radius of the Earth in m, as in altitude.c
+ */
+#define ISA_EARTH_RADIUS	6371000.0
+
+/**
+ * International Standard Atmosphere, up to 47km. Gives the pressure in
+ * Pa and the temperature in °C at a geometric altitude in m, which is
+ * what the flight and the GPS deal in.
+ */
+static inline void isa(double geometric, double* pressure, double* temperature) {
+  double altitude = (geometric * ISA_EARTH_RADIUS) / (ISA_EARTH_RADIUS + geometric);
+  double t;
+
+  if (altitude < 11000) {
+    t = 288.15 - 0.0065 * altitude;
+    *pressure = 101325 * pow(t / 288.15, 5.25588);
+  } else if (altitude < 20000) {
+    t = 216.65;
+    *pressure = 22632.1 * exp(-0.000157688 * (altitude - 11000));
+  } else if (altitude < 32000) {
+    t = 216.65 + 0.001 * (altitude - 20000);
+    *pressure = 5474.89 * pow(t / 216.65, -34.1632);
+  } else {
+    t = 228.65 + 0.0028 * (altitude - 32000);
+    *pressure = 868.019 * pow(t / 228.65, -12.2011);
+  }
+
+  *temperature = t - 273.15;
+}
+
+#endif /* ISA_H */
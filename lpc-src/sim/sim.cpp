@@ -0,0 +1,973 @@
+/*
+ * Host-side simulator for the firmware
+ * Copyright (C) 2014  richard
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * The core of the simulator: time, register dispatch, the NVIC and
+ * SysTick, the SYSCON clocks and the command line.
+ */
+
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <setjmp.h>
+#include <getopt.h>
+#include <time.h>
+#include "sim.h"
+#include "flight.h"
+
+/**
+ * An interrupt taken this many times without time moving on is
+ * probably a handler that doesn't clear its source
+ */
+#define SIM_IRQ_STORM		100000
+
+/**
+ **************************
+ Registers
+ *************************/
+
+LPC_SYSCON_TypeDef	sim_syscon;
+LPC_PMU_TypeDef		sim_pmu;
+LPC_IOCON_TypeDef	sim_iocon;
+LPC_GPIO_TypeDef	sim_gpio[4];
+LPC_UART_TypeDef	sim_uart;
+LPC_SPI0_TypeDef	sim_spi0;
+LPC_SPI1_TypeDef	sim_spi1;
+LPC_I2C_TypeDef		sim_i2c;
+LPC_CCAN_TypeDef	sim_ccan;
+LPC_CT16B0_TypeDef	sim_ct16b0;
+LPC_CT16B1_TypeDef	sim_ct16b1;
+LPC_CT32B0_TypeDef	sim_ct32b0;
+LPC_CT32B1_TypeDef	sim_ct32b1;
+LPC_WDT_TypeDef		sim_wdt;
+LPC_ADC_TypeDef		sim_adc;
+LPC_FMC_TypeDef		sim_fmc;
+SCB_Type		sim_scb;
+SysTick_Type		sim_systick;
+
+uint32_t SystemCoreClock = SIM_XTAL_HZ;
+
+/**
+ **************************
+ Time
+ *************************/
+
+uint64_t sim_time = 0;
+uint64_t sim_next_event = SIM_NEVER;
+uint32_t sim_cycle_time = SIM_TICK_HZ / SIM_IRC_HZ;
+
+uint64_t sim_end_time;
+uint64_t sim_sleep_time = 0;
+static jmp_buf sim_exit;
+
+/**
+ * See LPC11xx.h
+ */
+uint32_t sim_stack[SIM_STACK_WORDS];
+static int sim_exit_code = 0;
+static const char* sim_exit_reason = NULL;
+
+struct sim_options sim_options = {
+  10800, NULL, NULL, "sim-card.img", NULL, NULL, 50, 5, 0, 0, 0, 0
+};
+
+void sim_log(const char* format, ...) {
+  va_list args;
+
+  if (sim_options.quiet) return;
+
+  fprintf(stderr, "[%10.3f] ", sim_seconds());
+  va_start(args, format);
+  vfprintf(stderr, format, args);
+  va_end(args);
+  fprintf(stderr, "\n");
+}
+void sim_stop(int code, const char* reason) {
+  sim_exit_code = code;
+  sim_exit_reason = reason;
+  longjmp(sim_exit, 1);
+}
+
+/**
+ **************************
+ Peripherals
+ *************************/
+
+sim_peripheral* sim_peripherals = NULL;
+
+sim_peripheral::sim_peripheral(const char* name, void* base, size_t size,
+			       int irqn, int clock_bit) :
+  name(name), base((char*)base), size(size), irqn(irqn),
+  clock_bit(clock_bit), next_event(SIM_NEVER), gated_accesses(0) {
+  next = sim_peripherals;
+  sim_peripherals = this;
+}
+
+void sim_peripheral::schedule(uint64_t at) {
+  next_event = at;
+  if (at < sim_next_event) {
+    sim_next_event = at;
+  }
+}
+
+static uint32_t nvic_lines = 0;
+void sim_peripheral::set_irq(int level) {
+  if (irqn < 0) return;
+
+  if (level) {
+    nvic_lines |= (1UL << irqn);
+  } else {
+    nvic_lines &= ~(1UL << irqn);
+  }
+}
+int sim_peripheral::clocked(void) {
+  return (clock_bit < 0) || (sim_syscon.SYSAHBCLKCTRL.value & (1UL << clock_bit));
+}
+
+/**
+ * Registers nobody models. They keep whatever was written to them.
+ */
+static sim_peripheral sim_plain_pmu("PMU", &sim_pmu, sizeof(sim_pmu));
+static sim_peripheral sim_plain_iocon("IOCON", &sim_iocon, sizeof(sim_iocon), -1, 16);
+static sim_peripheral sim_plain_ccan("CAN", &sim_ccan, sizeof(sim_ccan), -1, 17);
+static sim_peripheral sim_plain_ct16b0("CT16B0", &sim_ct16b0, sizeof(sim_ct16b0), -1, 7);
+static sim_peripheral sim_plain_ct16b1("CT16B1", &sim_ct16b1, sizeof(sim_ct16b1), -1, 8);
+static sim_peripheral sim_plain_ct32b0("CT32B0", &sim_ct32b0, sizeof(sim_ct32b0), -1, 9);
+static sim_peripheral sim_plain_ct32b1("CT32B1", &sim_ct32b1, sizeof(sim_ct32b1), -1, 10);
+
+/**
+ * Processes everything that's due, then takes any interrupts.
+ */
+static void sim_check_irq(void);
+
+void sim_service(void) {
+  sim_peripheral* p;
+  int due;
+
+  if (sim_time >= sim_end_time) {
+    sim_time = sim_end_time;
+    sim_stop(0, NULL);
+  }
+
+  do {
+    due = 0;
+    for (p = sim_peripherals; p; p = p->next) {
+      if (p->next_event <= sim_time) {
+	p->next_event = SIM_NEVER;
+	p->event();
+	due = 1;
+      }
+    }
+  } while (due);
+
+  sim_next_event = sim_end_time;
+  for (p = sim_peripherals; p; p = p->next) {
+    if (p->next_event < sim_next_event) {
+      sim_next_event = p->next_event;
+    }
+  }
+
+  sim_check_irq();
+}
+
+/**
+ * Finds the model for a register. Most accesses go to the same
+ * peripheral as the one before, so that's checked first.
+ */
+static sim_peripheral* sim_find(sim_reg* reg) {
+  static sim_peripheral* last = NULL;
+  char* address = (char*)reg;
+  sim_peripheral* p;
+
+  if (last && address >= last->base && address < last->base + last->size) {
+    return last;
+  }
+  for (p = sim_peripherals; p; p = p->next) {
+    if (address >= p->base && address < p->base + p->size) {
+      return (last = p);
+    }
+  }
+
+  fprintf(stderr, "Access to unknown register %p\n", (void*)reg);
+  abort();
+}
+static void sim_check_clock(sim_peripheral* p) {
+  if (!p->clocked()) {
+    if (p->gated_accesses++ == 0) {
+      sim_log("%s accessed with its clock gated", p->name);
+    }
+  }
+}
+
+/**
+ * The register a busy-wait loop is polling. Reading the same thing
+ * back SIM_POLL_READS times in a row means nothing happens until the
+ * next event, so we skip straight to it. Code that just reads a
+ * register twice (profile_now() reads the SysTick LOAD twice) mustn't
+ * skip.
+ */
+#define SIM_POLL_READS	3
+
+static sim_reg* poll_reg = NULL;
+static uint32_t poll_value;
+static uint32_t poll_count;
+
+uint32_t sim_read(sim_reg* reg) {
+  sim_peripheral* p = sim_find(reg);
+  uint32_t value;
+
+  sim_check_clock(p);
+  value = p->read(reg);
+
+  if (reg == poll_reg && value == poll_value && p->pollable(reg)) {
+    if (++poll_count >= SIM_POLL_READS && sim_next_event > sim_time &&
+	sim_next_event != SIM_NEVER) {
+      sim_time = sim_next_event - 1;
+    }
+  } else {
+    poll_reg = reg; poll_value = value; poll_count = 1;
+  }
+
+  sim_advance(SIM_ACCESS_CYCLES * sim_cycle_time);
+  sim_check_irq();
+  return value;
+}
+void sim_write(sim_reg* reg, uint32_t value) {
+  sim_peripheral* p = sim_find(reg);
+
+  sim_check_clock(p);
+  p->write(reg, value);
+  poll_reg = NULL;
+
+  sim_advance(SIM_ACCESS_CYCLES * sim_cycle_time);
+  sim_check_irq();
+}
+
+/**
+ **************************
+ Clocks
+ *************************/
+
+/**
+ * The clock selections only take effect when their update enable
+ * register goes from 0 to 1, so we keep the ones in use here.
+ */
+static uint32_t active_mainclksel = 0;
+static uint32_t active_syspllclksel = 0;
+
+static uint32_t sim_pll_input(void) {
+  return (active_syspllclksel & 3) == 1 ? SIM_XTAL_HZ : SIM_IRC_HZ;
+}
+uint32_t sim_wdt_osc(void) {
+  static const uint32_t fclkana[16] = {
+    0, 500000, 800000, 1100000, 1400000, 1600000, 1800000, 2000000,
+    2200000, 2400000, 2600000, 2700000, 2900000, 3100000, 3200000, 3400000 };
+  uint32_t ctrl = sim_syscon.WDTOSCCTRL.value;
+
+  return fclkana[(ctrl >> 5) & 0xF] / (((ctrl & 0x1F) + 1) * 2);
+}
+uint32_t sim_core_clock(void) {
+  uint32_t main_clock, div = sim_syscon.SYSAHBCLKDIV.value & 0xFF;
+
+  switch (active_mainclksel & 3) {
+    case 0: main_clock = SIM_IRC_HZ; break;
+    case 1: main_clock = sim_pll_input(); break;
+    case 2: main_clock = sim_wdt_osc(); break;
+    default:
+      main_clock = ((sim_syscon.SYSPLLCTRL.value & 0x1F) + 1) * sim_pll_input();
+      break;
+  }
+
+  return div ? main_clock / div : 0;
+}
+uint64_t sim_pclk_time(uint32_t clkdiv) {
+  return (uint64_t)sim_cycle_time * (clkdiv & 0xFF);
+}
+
+static int sim_context(void);
+static void sim_systick_now(void);
+
+/**
+ * The SYSCON. Tracks the core clock and warns when the firmware picks
+ * one that doesn't divide into our tick.
+ *
+ * Interrupts turn the clocks and power of their own peripherals on and
+ * off too, so SYSAHBCLKCTRL and PDRUNCFG are watched for a read-modify-
+ * write that an interrupt got into the middle of. If the write puts
+ * back bits the interrupt changed, they're counted as lost. With -x
+ * the SysTick fires straight after every read of them from thread
+ * mode, so any that isn't done with interrupts off is caught.
+ */
+#define SIM_CONTEXTS	5	/* Four priorities and thread mode */
+
+struct sim_shared_reg {
+  sim_reg* reg;
+  uint32_t writes;
+  uint32_t seen[SIM_CONTEXTS];	/* writes when each context last read */
+  uint32_t was[SIM_CONTEXTS];	/* And what it read */
+};
+
+class sim_syscon_model : public sim_peripheral {
+ public:
+  sim_syscon_model() : sim_peripheral("SYSCON", &sim_syscon, sizeof(sim_syscon)) {
+    /* Reset values */
+    sim_syscon.SYSAHBCLKDIV.value	= 0x1;
+    sim_syscon.SYSAHBCLKCTRL.value	= 0x85F;
+    sim_syscon.PDRUNCFG.value		= 0xEDF0;
+    sim_syscon.PDSLEEPCFG.value		= 0xFFFF;
+    sim_syscon.PDAWAKECFG.value		= 0xEDF0;
+    sim_syscon.WDTOSCCTRL.value		= 0xA0;
+    sim_syscon.SYSPLLSTAT.value		= 0x1; /* Always locked */
+    sim_syscon.SYSRSTSTAT.value		= 0x1; /* Power-on reset */
+    sim_syscon.DEVICE_ID.value		= 0x00050080; /* LPC1115/303 */
+
+    memset(shared, 0, sizeof(shared));
+    shared[0].reg = &sim_syscon.SYSAHBCLKCTRL;
+    shared[1].reg = &sim_syscon.PDRUNCFG;
+    lost = 0;
+  }
+
+  uint32_t read(sim_reg* reg) {
+    sim_shared_reg* s = find_shared(reg);
+
+    if (s) {
+      s->seen[sim_context()] = s->writes;
+      s->was[sim_context()] = reg->value;
+      if (sim_options.interleave && sim_context() == SIM_CONTEXTS - 1) {
+	sim_systick_now();
+      }
+    }
+    return reg->value;
+  }
+  void write(sim_reg* reg, uint32_t value) {
+    uint32_t old = reg->value;
+    sim_shared_reg* s = find_shared(reg);
+
+    if (reg == &sim_syscon.SYSPLLSTAT || reg == &sim_syscon.DEVICE_ID) {
+      return; /* Read only */
+    }
+    if (s) {
+      int c = sim_context();
+
+      if (s->seen[c] != s->writes && ((value ^ old) & (old ^ s->was[c]))) {
+	sim_log("%s bits 0x%x put back after an interrupt changed them",
+		s->reg == &sim_syscon.PDRUNCFG ? "PDRUNCFG" : "SYSAHBCLKCTRL",
+		(value ^ old) & (old ^ s->was[c]));
+	lost++;
+      }
+      s->seen[c] = ++s->writes;
+      s->was[c] = value;
+    }
+    if (reg == &sim_syscon.SYSRSTSTAT) {
+      reg->value &= ~value; /* Write 1 to clear */
+      return;
+    }
+    reg->value = value;
+
+    if (reg == &sim_syscon.MAINCLKUEN && !(old & 1) && (value & 1)) {
+      active_mainclksel = sim_syscon.MAINCLKSEL.value;
+      update();
+    } else if (reg == &sim_syscon.SYSPLLCLKUEN && !(old & 1) && (value & 1)) {
+      active_syspllclksel = sim_syscon.SYSPLLCLKSEL.value;
+      update();
+    } else if (reg == &sim_syscon.SYSAHBCLKDIV || reg == &sim_syscon.SYSPLLCTRL ||
+	       reg == &sim_syscon.WDTOSCCTRL) {
+      update();
+    }
+  }
+
+  void update(void) {
+    uint32_t clock = sim_core_clock();
+    sim_peripheral* p;
+
+    if (clock == 0) {
+      sim_stop(1, "core clock stopped");
+    }
+    if (SIM_TICK_HZ % clock) {
+      sim_log("core clock %uHz isn't a whole number of ticks, timing will drift",
+	      clock);
+    }
+    if (SIM_TICK_HZ / clock == sim_cycle_time) {
+      return;
+    }
+
+    sim_cycle_time = SIM_TICK_HZ / clock;
+    for (p = sim_peripherals; p; p = p->next) {
+      p->clock_changed();
+    }
+  }
+  void summary(void) {
+    printf("SYSCON: %u clock and power changes lost to an interrupt\n", lost);
+  }
+
+ private:
+  sim_shared_reg* find_shared(sim_reg* reg) {
+    for (int i = 0; i < 2; i++) {
+      if (shared[i].reg == reg) return &shared[i];
+    }
+    return NULL;
+  }
+
+  sim_shared_reg shared[2];
+  uint32_t lost;
+};
+static sim_syscon_model syscon_model;
+
+/**
+ * The flash controller. A flash access takes FLASHTIM + 1 clocks, and
+ * each clock can be no faster than 20MHz (UM10398, 3 clocks up to
+ * 50MHz), so running faster than that stops the simulation.
+ */
+class sim_fmc_model : public sim_peripheral {
+ public:
+  sim_fmc_model() : sim_peripheral("FMC", &sim_fmc, sizeof(sim_fmc)) {
+    sim_fmc.FLASHCFG.value = 0x2; /* Reset value, 3 clocks */
+  }
+
+  void write(sim_reg* reg, uint32_t value) {
+    reg->value = value;
+    if (reg == &sim_fmc.FLASHCFG) {
+      check();
+    }
+  }
+  void clock_changed(void) {
+    check();
+  }
+
+ private:
+  void check(void) {
+    uint32_t clocks = (sim_fmc.FLASHCFG.value & 0x3) + 1;
+    uint32_t limit = clocks >= 3 ? 50000000 : clocks * 20000000;
+
+    if (sim_core_clock() > limit) {
+      sim_log("core clock %uHz with %u clock flash accesses",
+	      sim_core_clock(), clocks);
+      sim_stop(1, "flash too slow for the core clock");
+    }
+  }
+};
+static sim_fmc_model fmc_model;
+
+/**
+ * system_LPC11xx.c can't be built against our registers, so these do
+ * the same things.
+ */
+void SystemInit(void) {
+  /* Power up the system oscillator and run from it */
+  LPC_SYSCON->PDRUNCFG &= ~0x0020;
+  LPC_SYSCON->SYSOSCCTRL = 0x0;
+  for (uint32_t i = 0; i < 200; i++) { __NOP(); }
+
+  LPC_SYSCON->SYSPLLCLKSEL = 0x1;
+  LPC_SYSCON->SYSPLLCLKUEN = 0x0;
+  LPC_SYSCON->SYSPLLCLKUEN = 0x1;
+  LPC_SYSCON->MAINCLKSEL = 0x1;
+  LPC_SYSCON->MAINCLKUEN = 0x0;
+  LPC_SYSCON->MAINCLKUEN = 0x1;
+
+  /* Enable the clock to the I/O Configuration Block */
+  LPC_SYSCON->SYSAHBCLKCTRL |= (1 << 16);
+}
+void SystemCoreClockUpdate(void) {
+  SystemCoreClock = sim_core_clock();
+}
+
+/**
+ **************************
+ NVIC
+ *************************/
+
+static uint32_t nvic_enabled = 0;
+static uint32_t nvic_pending = 0;	/* Set in software */
+static uint8_t nvic_priority[32];
+static uint8_t systick_priority = 0;
+static int systick_pending = 0;
+static int primask = 0;
+/**
+ * The priority we're running at, 256 in thread mode
+ */
+static int current_priority = 256;
+
+/**
+ * Which of the contexts that can interrupt each other we're in
+ */
+static int sim_context(void) {
+  return (current_priority >= 256) ? SIM_CONTEXTS - 1 :
+    current_priority >> (8 - __NVIC_PRIO_BITS);
+}
+
+static uint32_t irq_count = 0;
+static uint32_t irq_counts[33];	/* SysTick last */
+static uint64_t irq_storm_time = 0;
+static uint32_t irq_storm_count = 0;
+
+/**
+ * Vectors, named as in startup_LPC11xx.c. The firmware's own
+ * handlers replace these.
+ */
+static void sim_default_handler(void) {
+  sim_stop(1, "unhandled interrupt");
+}
+#define SIM_HANDLER(name) \
+  void name(void) __attribute__ ((weak)); \
+  void name(void) { sim_default_handler(); }
+
+SIM_HANDLER(SysTick_Handler)
+SIM_HANDLER(WAKEUP_IRQHandler)
+SIM_HANDLER(CAN_IRQHandler)
+SIM_HANDLER(SSP1_IRQHandler)
+SIM_HANDLER(I2C_IRQHandler)
+SIM_HANDLER(TIMER16_0_IRQHandler)
+SIM_HANDLER(TIMER16_1_IRQHandler)
+SIM_HANDLER(TIMER32_0_IRQHandler)
+SIM_HANDLER(TIMER32_1_IRQHandler)
+SIM_HANDLER(SSP0_IRQHandler)
+SIM_HANDLER(UART_IRQHandler)
+SIM_HANDLER(ADC_IRQHandler)
+SIM_HANDLER(WDT_IRQHandler)
+SIM_HANDLER(BOD_IRQHandler)
+SIM_HANDLER(PIOINT3_IRQHandler)
+SIM_HANDLER(PIOINT2_IRQHandler)
+SIM_HANDLER(PIOINT1_IRQHandler)
+SIM_HANDLER(PIOINT0_IRQHandler)
+
+typedef void (*sim_vector)(void);
+
+static const sim_vector sim_vectors[32] = {
+  WAKEUP_IRQHandler, WAKEUP_IRQHandler, WAKEUP_IRQHandler, WAKEUP_IRQHandler,
+  WAKEUP_IRQHandler, WAKEUP_IRQHandler, WAKEUP_IRQHandler, WAKEUP_IRQHandler,
+  WAKEUP_IRQHandler, WAKEUP_IRQHandler, WAKEUP_IRQHandler, WAKEUP_IRQHandler,
+  WAKEUP_IRQHandler, CAN_IRQHandler, SSP1_IRQHandler, I2C_IRQHandler,
+  TIMER16_0_IRQHandler, TIMER16_1_IRQHandler, TIMER32_0_IRQHandler,
+  TIMER32_1_IRQHandler, SSP0_IRQHandler, UART_IRQHandler, NULL, NULL,
+  ADC_IRQHandler, WDT_IRQHandler, BOD_IRQHandler, NULL,
+  PIOINT3_IRQHandler, PIOINT2_IRQHandler, PIOINT1_IRQHandler,
+  PIOINT0_IRQHandler,
+};
+
+static const char* sim_irq_names[32] = {
+  "WAKEUP0", "WAKEUP1", "WAKEUP2", "WAKEUP3", "WAKEUP4", "WAKEUP5",
+  "WAKEUP6", "WAKEUP7", "WAKEUP8", "WAKEUP9", "WAKEUP10", "WAKEUP11",
+  "WAKEUP12", "CAN", "SSP1", "I2C", "TIMER16_0", "TIMER16_1", "TIMER32_0",
+  "TIMER32_1", "SSP0", "UART", NULL, NULL, "ADC", "WDT", "BOD", NULL,
+  "PIOINT3", "PIOINT2", "PIOINT1", "PIOINT0",
+};
+
+/**
+ * Returns the exception that would be taken next, ignoring PRIMASK,
+ * or -2 if there isn't one. SysTick is -1.
+ */
+static int sim_next_irq(void) {
+  uint32_t pending = nvic_enabled & (nvic_lines | nvic_pending);
+  int best = -2, best_priority = current_priority, i;
+
+  if (systick_pending && systick_priority < best_priority) {
+    best = -1; best_priority = systick_priority;
+  }
+  for (i = 0; pending; i++, pending >>= 1) {
+    if ((pending & 1) && nvic_priority[i] < best_priority) {
+      best = i; best_priority = nvic_priority[i];
+    }
+  }
+
+  return best;
+}
+static void sim_check_irq(void) {
+  int irq, saved_priority;
+
+  if (primask || !(systick_pending || (nvic_enabled & (nvic_lines | nvic_pending)))) {
+    return;
+  }
+
+  while ((irq = sim_next_irq()) != -2) {
+    if (sim_time != irq_storm_time) {
+      irq_storm_time = sim_time; irq_storm_count = 0;
+    } else if (++irq_storm_count > SIM_IRQ_STORM) {
+      sim_stop(1, "interrupt storm - a handler isn't clearing its source");
+    }
+
+    saved_priority = current_priority;
+    irq_count++;
+    irq_counts[irq < 0 ? 32 : irq]++;
+
+    if (irq == -1) {
+      systick_pending = 0;
+      current_priority = systick_priority;
+      SysTick_Handler();
+    } else {
+      nvic_pending &= ~(1UL << irq);
+      current_priority = nvic_priority[irq];
+      sim_vectors[irq]();
+    }
+
+    current_priority = saved_priority;
+    if (primask) break;
+  }
+}
+
+void NVIC_EnableIRQ(IRQn_Type IRQn) {
+  nvic_enabled |= (1UL << IRQn);
+  sim_check_irq();
+}
+void NVIC_DisableIRQ(IRQn_Type IRQn) {
+  nvic_enabled &= ~(1UL << IRQn);
+}
+uint32_t NVIC_GetPendingIRQ(IRQn_Type IRQn) {
+  return ((nvic_lines | nvic_pending) >> IRQn) & 1;
+}
+void NVIC_SetPendingIRQ(IRQn_Type IRQn) {
+  if (IRQn == SysTick_IRQn) {
+    systick_pending = 1;
+  } else {
+    nvic_pending |= (1UL << IRQn);
+  }
+  sim_check_irq();
+}
+void NVIC_ClearPendingIRQ(IRQn_Type IRQn) {
+  nvic_pending &= ~(1UL << IRQn);
+}
+void NVIC_SetPriority(IRQn_Type IRQn, uint32_t priority) {
+  uint8_t value = (priority << (8 - __NVIC_PRIO_BITS)) & 0xFF;
+
+  if (IRQn == SysTick_IRQn) {
+    systick_priority = value;
+  } else if (IRQn >= 0) {
+    nvic_priority[IRQn] = value;
+  }
+}
+uint32_t NVIC_GetPriority(IRQn_Type IRQn) {
+  if (IRQn == SysTick_IRQn) {
+    return systick_priority >> (8 - __NVIC_PRIO_BITS);
+  } else if (IRQn >= 0) {
+    return nvic_priority[IRQn] >> (8 - __NVIC_PRIO_BITS);
+  }
+  return 0;
+}
+void NVIC_SystemReset(void) {
+  sim_stop(2, "system reset");
+}
+
+void __enable_irq(void) {
+  primask = 0;
+  sim_check_irq();
+}
+void __disable_irq(void) {
+  primask = 1;
+}
+uint32_t __get_PRIMASK(void) {
+  return primask;
+}
+
+/**
+ * Sleeps until an interrupt that could preempt us is pending. Like
+ * the hardware this ignores PRIMASK, so the firmware can check its
+ * conditions with interrupts off and then sleep.
+ */
+void __WFI(void) {
+  uint64_t start = sim_time;
+  uint32_t count = irq_count;
+
+  while (sim_next_irq() == -2 && irq_count == count) {
+    if (sim_next_event == SIM_NEVER) {
+      sim_stop(1, "sleeping with nothing to wake us");
+    }
+    if (sim_next_event > sim_time) {
+      sim_time = sim_next_event;
+    }
+    sim_service();
+  }
+
+  sim_sleep_time += sim_time - start;
+}
+void __WFE(void) {
+  __WFI();
+}
+
+/**
+ **************************
+ SysTick
+ *************************/
+
+class sim_systick_model : public sim_peripheral {
+ public:
+  sim_systick_model() : sim_peripheral("SysTick", &sim_systick, sizeof(sim_systick)),
+			start(0), cycle(SIM_TICK_HZ / SIM_IRC_HZ), reload(0), ticks(0) {
+    sim_systick.CALIB.value = 0x4;
+  }
+
+  uint32_t read(sim_reg* reg) {
+    if (reg == &sim_systick.VAL) {
+      return value();
+    } else if (reg == &sim_systick.CTRL) {
+      uint32_t ctrl = reg->value;
+      reg->value &= ~SysTick_CTRL_COUNTFLAG_Msk; /* Cleared on read */
+      return ctrl;
+    }
+    return reg->value;
+  }
+  void write(sim_reg* reg, uint32_t value) {
+    if (reg == &sim_systick.VAL) {
+      /* Any write clears the counter, it reloads on the next cycle */
+      sim_systick.CTRL.value &= ~SysTick_CTRL_COUNTFLAG_Msk;
+      start = sim_time;
+      reload = sim_systick.LOAD.value;
+      reschedule();
+    } else if (reg == &sim_systick.CTRL) {
+      int was_enabled = enabled();
+      reg->value = (reg->value & SysTick_CTRL_COUNTFLAG_Msk) |
+	(value & ~SysTick_CTRL_COUNTFLAG_Msk);
+      if (!was_enabled && enabled()) {
+	start = sim_time;
+	reload = sim_systick.LOAD.value;
+      }
+      reschedule();
+    } else {
+      /* A new LOAD is only used from the next reload */
+      reg->value = value & SysTick_LOAD_RELOAD_Msk;
+    }
+  }
+  int pollable(sim_reg* reg) {
+    return reg != &sim_systick.VAL;
+  }
+
+  void event(void) {
+    start += period();
+    reload = sim_systick.LOAD.value;
+    sim_systick.CTRL.value |= SysTick_CTRL_COUNTFLAG_Msk;
+    if (sim_systick.CTRL.value & SysTick_CTRL_TICKINT_Msk) {
+      systick_pending = 1;
+    }
+    ticks++;
+    reschedule();
+  }
+  void clock_changed(void) {
+    /* Carry on from where the counter was */
+    if (enabled()) {
+      uint32_t val = value();
+      cycle = sim_cycle_time;
+      start = sim_time - ((reload - val) * cycle);
+      reschedule();
+    } else {
+      cycle = sim_cycle_time;
+    }
+  }
+  void summary(void) {
+    printf("SysTick: %u ticks\n", ticks);
+  }
+  /**
+   * Brings the next reload forward to now
+   */
+  void now(void) {
+    if (enabled() && reload && sim_time >= period()) {
+      start = sim_time - period();
+      reschedule();
+    }
+  }
+
+ private:
+  int enabled(void) {
+    return sim_systick.CTRL.value & SysTick_CTRL_ENABLE_Msk;
+  }
+  uint64_t period(void) {
+    return ((uint64_t)reload + 1) * cycle;
+  }
+  uint32_t value(void) {
+    if (!enabled()) return sim_systick.VAL.value;
+    uint64_t cycles = (sim_time - start) / cycle;
+    return reload - (cycles % (reload + 1));
+  }
+  void reschedule(void) {
+    if (enabled() && reload) {
+      schedule(start + period());
+    } else {
+      next_event = SIM_NEVER;
+    }
+  }
+
+  uint64_t start;
+  uint64_t cycle;
+  uint32_t reload;	/* The LOAD this count started from */
+  uint32_t ticks;
+};
+static sim_systick_model systick_model;
+
+/**
+ * The SCB keeps what's written to it, but the ICSR shows whether the
+ * SysTick is pending
+ */
+class sim_scb_model : public sim_peripheral {
+ public:
+  sim_scb_model() : sim_peripheral("SCB", &sim_scb, sizeof(sim_scb)) {}
+
+  uint32_t read(sim_reg* reg) {
+    if (reg == &sim_scb.ICSR) {
+      return (reg->value & ~SCB_ICSR_PENDSTSET_Msk) |
+	(systick_pending ? SCB_ICSR_PENDSTSET_Msk : 0);
+    }
+    return reg->value;
+  }
+  int pollable(sim_reg* reg) {
+    return reg != &sim_scb.ICSR;
+  }
+};
+static sim_scb_model scb_model;
+
+static void sim_systick_now(void) {
+  systick_model.now();
+}
+
+/**
+ * As CMSIS core_cm0.h. This sets the SysTick to the lowest priority,
+ * overriding anything set before it was called.
+ */
+uint32_t SysTick_Config(uint32_t ticks) {
+  if (ticks > SysTick_LOAD_RELOAD_Msk) return 1;
+
+  SysTick->LOAD = (ticks & SysTick_LOAD_RELOAD_Msk) - 1;
+  NVIC_SetPriority(SysTick_IRQn, (1 << __NVIC_PRIO_BITS) - 1);
+  SysTick->VAL = 0;
+  SysTick->CTRL = SysTick_CTRL_CLKSOURCE_Msk | SysTick_CTRL_TICKINT_Msk |
+    SysTick_CTRL_ENABLE_Msk;
+  return 0;
+}
+
+/**
+ **************************
+ Entry Point
+ *************************/
+
+int firmware_main(void);
+
+static void usage(const char* name) {
+  fprintf(stderr,
+	  "Usage: %s [options]\n"
+	  "  -d, --duration SECONDS  How long to fly for (default 10800)\n"
+	  "  -n, --nmea FILE         NMEA to feed the GPS UART (default generated)\n"
+	  "  -i, --imu FILE          IMU log to feed SSP1 (default none)\n"
+	  "  -s, --sd FILE           SD card image (default sim-card.img)\n"
+	  "  -f, --flight FILE       Altitude profile, lines of 'seconds,metres'\n"
+	  "  -r, --rtty FILE         Where to write decoded RTTY (default stdout)\n"
+	  "  -b, --baud BAUD         RTTY baud rate to start decoding at (default 50)\n"
+	  "  -w, --data-bits BITS    RTTY data bits, 5 for ITA2 (default 5)\n"
+	  "  -k, --i2c-stuck SECONDS Have a slave hold SDA low this often (default never)\n"
+	  "  -u, --ubx               The GPS is a u-blox at 9600 baud, for GPS_UBX\n"
+	  "  -x, --interleave        Tick the SysTick inside every clock and power\n"
+	  "                          register read-modify-write\n"
+	  "  -q, --quiet             Don't log events\n", name);
+}
+
+int main(int argc, char** argv) {
+  static const struct option options[] = {
+    { "duration",	required_argument,	NULL, 'd' },
+    { "nmea",		required_argument,	NULL, 'n' },
+    { "imu",		required_argument,	NULL, 'i' },
+    { "sd",		required_argument,	NULL, 's' },
+    { "flight",		required_argument,	NULL, 'f' },
+    { "rtty",		required_argument,	NULL, 'r' },
+    { "baud",		required_argument,	NULL, 'b' },
+    { "data-bits",	required_argument,	NULL, 'w' },
+    { "i2c-stuck",	required_argument,	NULL, 'k' },
+    { "ubx",		no_argument,		NULL, 'u' },
+    { "interleave",	no_argument,		NULL, 'x' },
+    { "quiet",		no_argument,		NULL, 'q' },
+    { "help",		no_argument,		NULL, 'h' },
+    { NULL, 0, NULL, 0 }
+  };
+  struct timespec host_start, host_end;
+  sim_peripheral* p;
+  int c;
+
+  while ((c = getopt_long(argc, argv, "d:n:i:s:f:r:b:w:k:uxqh", options, NULL)) != -1) {
+    switch (c) {
+      case 'd': sim_options.duration = atof(optarg); break;
+      case 'n': sim_options.nmea_file = optarg; break;
+      case 'i': sim_options.imu_file = optarg; break;
+      case 's': sim_options.sd_file = optarg; break;
+      case 'f': sim_options.flight_file = optarg; break;
+      case 'r': sim_options.rtty_file = optarg; break;
+      case 'b': sim_options.rtty_baud = atoi(optarg); break;
+      case 'w': sim_options.rtty_data_bits = atoi(optarg); break;
+      case 'k': sim_options.i2c_stuck = atof(optarg); break;
+      case 'u': sim_options.ubx = 1; break;
+      case 'x': sim_options.interleave = 1; break;
+      case 'q': sim_options.quiet = 1; break;
+      default: usage(argv[0]); return 1;
+    }
+  }
+  if (sim_options.duration <= 0 || sim_options.rtty_baud <= 0 ||
+      sim_options.rtty_data_bits < 5 || sim_options.rtty_data_bits > 8) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  sim_end_time = sim_from_seconds(sim_options.duration);
+  sim_next_event = sim_end_time;
+
+  flight_init(sim_options.flight_file);
+  sim_gpio_init();
+  sim_uart_init();
+  sim_ssp_init();
+  sim_i2c_init();
+  sim_adc_init();
+  sim_wdt_init();
+  sim_timer_init();
+
+  clock_gettime(CLOCK_MONOTONIC, &host_start);
+  if (setjmp(sim_exit) == 0) {
+    firmware_main();
+    sim_exit_code = 1;
+    sim_exit_reason = "main returned";
+  }
+  clock_gettime(CLOCK_MONOTONIC, &host_end);
+
+  double host = (host_end.tv_sec - host_start.tv_sec) +
+    (host_end.tv_nsec - host_start.tv_nsec) / 1e9;
+
+  fflush(stdout);
+  if (sim_exit_reason) {
+    fprintf(stderr, "[%10.3f] Stopped: %s\n", sim_seconds(), sim_exit_reason);
+  }
+
+  printf("\nSimulated %.1fs in %.2fs (%.0fx real time)\n",
+	 sim_seconds(), host, host > 0 ? sim_seconds() / host : 0);
+  printf("Asleep %.1f%% of the time, %u interrupts\n",
+	 sim_time ? 100.0 * sim_sleep_time / sim_time : 0, irq_count);
+  for (int i = 0; i < 33; i++) {
+    if (irq_counts[i]) {
+      printf("  %s %u\n", i == 32 ? "SysTick" : sim_irq_names[i], irq_counts[i]);
+    }
+  }
+  for (p = sim_peripherals; p; p = p->next) {
+    p->summary();
+  }
+  flight_summary();
+  for (p = sim_peripherals; p; p = p->next) {
+    if (p->gated_accesses) {
+      printf("WARNING: %u accesses to %s with its clock gated\n",
+	     p->gated_accesses, p->name);
+    }
+  }
+
+  return sim_exit_code;
+}
@@ -0,0 +1,198 @@
+/*
+ * Host-side simulator for the firmware
+ * Copyright (C) 2014  richard
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef SIM_H
+#define SIM_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include "LPC11xx.h"
+
+/**
+ * Time
+ * ----
+ * Simulated time is counted in ticks of SIM_TICK_HZ, which divides
+ * evenly into every core clock the PLL can make from a 12MHz crystal.
+ * sim_cycle_time is the length of one core clock cycle in ticks.
+ *
+ * Time only moves when the firmware touches a register, executes a
+ * __NOP() or sleeps in __WFI(). Plain C between register accesses
+ * costs nothing, so the simulator shows where the firmware waits on
+ * hardware but not how long its own arithmetic takes.
+ */
+#define SIM_TICK_HZ		288000000ULL
+#define SIM_NEVER		UINT64_MAX
+/**
+ * Core clock cycles charged for each register access
+ */
+#define SIM_ACCESS_CYCLES	3
+/**
+ * The crystal and the IRC both run at 12MHz
+ */
+#define SIM_XTAL_HZ		12000000
+#define SIM_IRC_HZ		12000000
+
+static inline void sim_advance(uint64_t ticks) {
+  sim_time += ticks;
+  if (sim_time >= sim_next_event) {
+    sim_service();
+  }
+}
+static inline double sim_seconds(void) {
+  return (double)sim_time / SIM_TICK_HZ;
+}
+static inline uint64_t sim_from_seconds(double seconds) {
+  return (uint64_t)(seconds * SIM_TICK_HZ);
+}
+
+/**
+ * Returns the core clock in Hz as set up in the SYSCON
+ */
+uint32_t sim_core_clock(void);
+/**
+ * Returns the length of one cycle of a peripheral clock with the
+ * given divider, or 0 if the divider stops the clock.
+ */
+uint64_t sim_pclk_time(uint32_t clkdiv);
+/**
+ * Returns the watchdog oscillator frequency in Hz
+ */
+uint32_t sim_wdt_osc(void);
+
+/**
+ * Log a message with the current simulated time
+ */
+void sim_log(const char* format, ...) __attribute__ ((format (printf, 1, 2)));
+/**
+ * Stop the simulation and exit with the given code
+ */
+void sim_stop(int code, const char* reason);
+
+/**
+ * Peripheral models
+ * -----------------
+ * Each model covers the registers of one peripheral structure and
+ * identifies them by address, so `reg == &LPC_UART->LSR` works.
+ * Registers a model doesn't handle behave as plain storage.
+ */
+class sim_peripheral {
+ public:
+  sim_peripheral(const char* name, void* base, size_t size,
+		 int irqn = -1, int clock_bit = -1);
+  virtual ~sim_peripheral() {}
+
+  virtual uint32_t read(sim_reg* reg) { return reg->value; }
+  virtual void write(sim_reg* reg, uint32_t value) { reg->value = value; }
+  /**
+   * Called when simulated time reaches next_event
+   */
+  virtual void event(void) {}
+  /**
+   * Called when the core clock changes
+   */
+  virtual void clock_changed(void) {}
+  /**
+   * Returns zero for registers that change without an event, which
+   * stops the simulator skipping ahead while they're polled
+   */
+  virtual int pollable(sim_reg* reg) { (void)reg; return 1; }
+  /**
+   * Called at the end to print statistics
+   */
+  virtual void summary(void) {}
+
+  /**
+   * Asks for event() to be called at the given time
+   */
+  void schedule(uint64_t at);
+  /**
+   * Sets the level of our interrupt line
+   */
+  void set_irq(int level);
+  /**
+   * Returns non-zero if our interface clock is running
+   */
+  int clocked(void);
+
+  const char* name;
+  char* base;
+  size_t size;
+  int irqn;
+  int clock_bit;
+  uint64_t next_event;
+  uint32_t gated_accesses;
+  sim_peripheral* next;
+};
+
+extern sim_peripheral* sim_peripherals;
+
+/**
+ * Pins
+ * ----
+ * Models that need to see GPIO outputs register a watcher. A model
+ * can hold a pin low, like a slave on an open drain bus, and the
+ * firmware reads the level of each pin.
+ */
+class sim_pin_watcher {
+ public:
+  virtual ~sim_pin_watcher() {}
+  virtual void pin_changed(int port, int pin, int level) = 0;
+};
+
+void sim_watch_pin(int port, int pin, sim_pin_watcher* watcher);
+int sim_pin_level(int port, int pin);
+void sim_pin_hold_low(int port, int pin, int low);
+
+/**
+ * Options
+ */
+struct sim_options {
+  double duration;		/* Seconds */
+  const char* nmea_file;	/* NMEA for the UART, NULL to generate */
+  const char* imu_file;		/* IMU log for SSP1, NULL for none */
+  const char* sd_file;		/* SD card image */
+  const char* flight_file;	/* Altitude profile, NULL for synthetic */
+  const char* rtty_file;	/* Decoded RTTY, NULL for stdout */
+  int rtty_baud;		/* To start with, it follows changes */
+  int rtty_data_bits;
+  double i2c_stuck;		/* Seconds between stuck buses, 0 for never */
+  int ubx;			/* The GPS is a u-blox, not the EM406 */
+  int interleave;		/* SysTick inside SYSCON read-modify-writes */
+  int quiet;
+};
+extern struct sim_options sim_options;
+
+/**
+ * Model construction, one per file
+ */
+void sim_gpio_init(void);
+void sim_uart_init(void);
+void sim_ssp_init(void);
+void sim_i2c_init(void);
+void sim_adc_init(void);
+void sim_wdt_init(void);
+void sim_timer_init(void);
+
+#endif /* SIM_H */
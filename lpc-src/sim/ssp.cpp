@@ -0,0 +1,554 @@
+/*
+ * SSP and SD card models for the simulator
+ * Copyright (C) 2014  richard
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * The two SSPs. SSP0 is the master for the SD card, SSP1 is a slave
+ * receiving frames from the IMU.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <deque>
+#include <string>
+#include "sim.h"
+
+#define FIFO_SIZE	8
+
+#define SR_TFE		(1 << 0)
+#define SR_TNF		(1 << 1)
+#define SR_RNE		(1 << 2)
+#define SR_RFF		(1 << 3)
+#define SR_BSY		(1 << 4)
+
+#define RIS_ROR		(1 << 0)
+#define RIS_RT		(1 << 1)
+#define RIS_RX		(1 << 2)
+#define RIS_TX		(1 << 3)
+
+#define CR1_SSE		(1 << 1)
+#define CR1_MS		(1 << 2)
+
+/**
+ * Something on the other end of the SPI bus
+ */
+class sim_spi_device {
+ public:
+  virtual ~sim_spi_device() {}
+  /**
+   * Master mode: swaps a frame with the device
+   */
+  virtual uint16_t exchange(uint16_t mosi) { (void)mosi; return 0xFF; }
+  /**
+   * Slave mode: returns when the device next sends a frame and what
+   * it is, or -1 if it never will
+   */
+  virtual int next(uint64_t* when) { (void)when; return -1; }
+};
+
+/**
+ * Both SSPs have the same registers, so this works on either.
+ */
+template <typename T>
+class sim_ssp_model : public sim_peripheral {
+ public:
+  sim_ssp_model(const char* name, T* ssp, int irqn, int clock_bit,
+		sim_reg* clkdiv, sim_spi_device* device) :
+    sim_peripheral(name, ssp, sizeof(*ssp), irqn, clock_bit),
+    ssp(ssp), clkdiv(clkdiv), device(device), busy(0), ris(0),
+    last_activity(0), timeout_armed(0), frames(0), overruns(0), lost(0), next_frame(0) {
+    ssp->SR.value = SR_TFE | SR_TNF;
+    queue_slave();
+  }
+
+  uint32_t read(sim_reg* reg) {
+    uint32_t value = reg->value;
+
+    if (reg == &ssp->DR) {
+      if (!rx.empty()) {
+	value = rx.front();
+	rx.pop_front();
+      } else {
+	value = 0;
+      }
+      activity();
+    } else if (reg == &ssp->SR) {
+      value = sr();
+    } else if (reg == &ssp->RIS) {
+      value = raw();
+    } else if (reg == &ssp->MIS) {
+      value = raw() & ssp->IMSC.value;
+    } else if (reg == &ssp->ICR) {
+      value = 0;
+    }
+
+    update();
+    return value;
+  }
+  void write(sim_reg* reg, uint32_t value) {
+    if (reg == &ssp->DR) {
+      if (tx.size() < FIFO_SIZE) {
+	tx.push_back(value & frame_mask());
+      }
+      start();
+    } else if (reg == &ssp->ICR) {
+      ris &= ~(value & (RIS_ROR | RIS_RT));
+    } else if (reg == &ssp->SR || reg == &ssp->RIS || reg == &ssp->MIS) {
+      /* Read only */
+    } else {
+      reg->value = value;
+      if (reg == &ssp->CR1) start();
+    }
+
+    update();
+  }
+
+  void event(void) {
+    if (timeout_armed && !rx.empty() && sim_time >= timeout()) {
+      ris |= RIS_RT;
+      timeout_armed = 0;
+    }
+    if (busy && sim_time >= busy_until) {
+      /* A master transfer finishes */
+      busy = 0;
+      receive(device->exchange(tx.front()));
+      tx.pop_front();
+      frames++;
+      start();
+    }
+    if (slave() && next_frame && sim_time >= next_frame) {
+      if (enabled() && clocked()) {
+	receive(slave_frame);
+	frames++;
+      } else {
+	lost++;
+      }
+      queue_slave();
+    }
+
+    update();
+  }
+
+  void summary(void) {
+    printf("%s: %u frames, %u overruns", name, frames, overruns);
+    if (lost) printf(", %u lost while disabled", lost);
+    printf("\n");
+  }
+
+ private:
+  int enabled(void) { return ssp->CR1.value & CR1_SSE; }
+  int slave(void) { return ssp->CR1.value & CR1_MS; }
+  uint16_t frame_mask(void) { return (2 << (ssp->CR0.value & 0xF)) - 1; }
+  int frame_bits(void) { return (ssp->CR0.value & 0xF) + 1; }
+
+  /**
+   * The length of one bit on the bus
+   */
+  uint64_t bit_time(void) {
+    uint32_t cpsr = ssp->CPSR.value & 0xFE;
+    uint32_t scr = (ssp->CR0.value >> 8) & 0xFF;
+    return sim_pclk_time(clkdiv->value) * (cpsr ? cpsr : 2) * (scr + 1);
+  }
+
+  /**
+   * Starts the next master transfer if we can
+   */
+  void start(void) {
+    if (busy || tx.empty() || !enabled() || slave()) return;
+
+    uint64_t bit = bit_time();
+    if (!bit || !clocked()) return; /* Stopped, it'll wait */
+
+    busy = 1;
+    busy_until = sim_time + bit * frame_bits();
+    reschedule();
+  }
+  void queue_slave(void) {
+    uint64_t when;
+    int frame = device->next(&when);
+
+    next_frame = (frame < 0) ? 0 : when;
+    slave_frame = frame;
+    reschedule();
+  }
+  void receive(uint16_t frame) {
+    if (rx.size() >= FIFO_SIZE) {
+      ris |= RIS_ROR;
+      overruns++;
+    } else {
+      rx.push_back(frame);
+    }
+    activity();
+  }
+  void activity(void) {
+    last_activity = sim_time;
+    timeout_armed = 1;
+  }
+
+  /**
+   * Receive timeout: something in the FIFO and nothing happening for
+   * 32 bit times. It's latched until cleared and only fires again
+   * after more activity.
+   */
+  uint64_t timeout(void) {
+    uint64_t bit = bit_time();
+    return last_activity + 32 * (bit ? bit : SIM_TICK_HZ / 1000000);
+  }
+  uint32_t raw(void) {
+    uint32_t r = ris & (RIS_ROR | RIS_RT);
+
+    if (rx.size() >= FIFO_SIZE / 2) r |= RIS_RX;
+    if (tx.size() <= FIFO_SIZE / 2) r |= RIS_TX;
+    return r;
+  }
+  uint32_t sr(void) {
+    uint32_t s = 0;
+
+    if (tx.empty()) s |= SR_TFE;
+    if (tx.size() < FIFO_SIZE) s |= SR_TNF;
+    if (!rx.empty()) s |= SR_RNE;
+    if (rx.size() >= FIFO_SIZE) s |= SR_RFF;
+    if (busy || !tx.empty()) s |= SR_BSY;
+    return s;
+  }
+  void reschedule(void) {
+    uint64_t at = SIM_NEVER;
+
+    if (busy) at = busy_until;
+    if (next_frame && next_frame < at) at = next_frame;
+    if (timeout_armed && !rx.empty() && timeout() < at) at = timeout();
+    schedule(at);
+  }
+  void update(void) {
+    set_irq(raw() & ssp->IMSC.value);
+    reschedule();
+  }
+
+  T* ssp;
+  sim_reg* clkdiv;
+  sim_spi_device* device;
+  std::deque<uint16_t> tx, rx;
+  int busy;
+  uint64_t busy_until;
+  uint32_t ris;
+  uint64_t last_activity;
+  int timeout_armed;
+  uint32_t frames, overruns, lost;
+  uint64_t next_frame;
+  uint16_t slave_frame;
+};
+
+/**
+ **************************
+ SD Card
+ *************************/
+
+/**
+ * An SDHC card in SPI mode, backed by an image file. A new image gets
+ * block 0 set up like a freshly prepared card, with the next free
+ * block as 1.
+ */
+#define SD_BLOCK		512
+#define SD_CAPACITY_BLOCKS	(4ULL * 1024 * 1024 * 2) /* 4GB */
+/**
+ * Bytes of 0xFF before a response (N_CR) and a read token (N_AC)
+ */
+#define SD_NCR			2
+#define SD_NAC			8
+/**
+ * How long the card takes to power up, and to program a block
+ */
+#define SD_INIT_TIME		0.05
+#define SD_WRITE_TIME		0.001
+
+#define SD_CS_PORT		0
+#define SD_CS_PIN		2
+
+class sim_sd_card : public sim_spi_device, public sim_pin_watcher {
+ public:
+  sim_sd_card(const char* filename) :
+    selected(0), cmd_length(0), idle(1), app_cmd(0), ready(0), init_start(0),
+    write_state(WRITE_NONE), busy_until(0), blocks_written(0), blocks_read(0) {
+
+    image = fopen(filename, "r+b");
+    if (!image) {
+      uint8_t block[SD_BLOCK] = { 1 }; /* next_block = 1 */
+
+      image = fopen(filename, "w+b");
+      if (!image) {
+	perror(filename);
+	exit(1);
+      }
+      fwrite(block, SD_BLOCK, 1, image);
+      sim_log("sd: created %s", filename);
+    }
+
+    sim_watch_pin(SD_CS_PORT, SD_CS_PIN, this);
+  }
+  ~sim_sd_card() {
+    fclose(image);
+  }
+
+  void pin_changed(int port, int pin, int level) {
+    (void)port; (void)pin;
+
+    /* The card carries on where it was when it's selected again, the
+       firmware deselects between a command and its data */
+    selected = !level;
+    if (!selected) cmd_length = 0;
+  }
+
+  uint16_t exchange(uint16_t mosi) {
+    uint8_t miso = 0xFF;
+
+    if (!selected) return 0xFF;
+
+    if (!response.empty()) {
+      miso = response.front();
+      response.pop_front();
+    } else if (write_state == WRITE_BUSY) {
+      if (sim_time < busy_until) return 0x00; /* Programming */
+      write_state = WRITE_NONE;
+    }
+
+    if (write_state == WRITE_TOKEN) {
+      if (mosi == 0xFE) {
+	write_state = WRITE_DATA; data_length = 0;
+      }
+    } else if (write_state == WRITE_DATA) {
+      data[data_length++] = mosi;
+      if (data_length == SD_BLOCK + 2) { /* And the CRC */
+	write_block();
+      }
+    } else if (cmd_length || (mosi & 0xC0) == 0x40) {
+      cmd[cmd_length++] = mosi;
+      if (cmd_length == 6) {
+	cmd_length = 0;
+	command();
+      }
+    }
+
+    return miso;
+  }
+
+  void summary(void) {
+    printf("SD: %u blocks written, %u read\n", blocks_written, blocks_read);
+  }
+
+ private:
+  enum { WRITE_NONE, WRITE_TOKEN, WRITE_DATA, WRITE_BUSY };
+
+  void r1(uint8_t value) {
+    for (int i = 0; i < SD_NCR; i++) response.push_back(0xFF);
+    response.push_back(value);
+  }
+  uint8_t status(void) {
+    return idle ? 0x01 : 0x00;
+  }
+  void data_block(const uint8_t* block, int length) {
+    for (int i = 0; i < SD_NAC; i++) response.push_back(0xFF);
+    response.push_back(0xFE);
+    for (int i = 0; i < length; i++) response.push_back(block[i]);
+    response.push_back(0xFF); response.push_back(0xFF); /* CRC */
+  }
+
+  void command(void) {
+    int index = cmd[0] & 0x3F;
+    uint32_t arg = (cmd[1] << 24) | (cmd[2] << 16) | (cmd[3] << 8) | cmd[4];
+    int acmd = app_cmd;
+
+    app_cmd = 0;
+
+    if (acmd && index == 41) { /* SD_SEND_OP_COND */
+      if (!init_start) init_start = sim_time;
+      if (sim_time >= init_start + sim_from_seconds(SD_INIT_TIME)) {
+	idle = 0; ready = 1;
+      }
+      r1(status());
+      return;
+    }
+
+    switch (index) {
+      case 0: /* GO_IDLE_STATE */
+	idle = 1; ready = 0; init_start = 0;
+	r1(0x01);
+	break;
+      case 8: /* SEND_IF_COND */
+	r1(status());
+	response.push_back(0x00); response.push_back(0x00);
+	response.push_back(arg >> 8 & 0xF); response.push_back(arg & 0xFF);
+	break;
+      case 55: /* APP_CMD */
+	app_cmd = 1;
+	r1(status());
+	break;
+      case 58: /* READ_OCR */
+	r1(status());
+	response.push_back(ready ? 0xC0 : 0x00); /* Powered up, SDHC */
+	response.push_back(0xFF); response.push_back(0x80);
+	response.push_back(0x00);
+	break;
+      case 9: { /* SEND_CSD */
+	uint8_t csd[16];
+	uint32_t c_size = SD_CAPACITY_BLOCKS / 1024 - 1;
+
+	memset(csd, 0, sizeof(csd));
+	csd[0] = 0x40;		/* CSD structure 1 */
+	csd[5] = 0x59;		/* READ_BL_LEN = 9 */
+	csd[7] = (c_size >> 16) & 0x3F;
+	csd[8] = (c_size >> 8) & 0xFF;
+	csd[9] = c_size & 0xFF;
+	csd[15] = 0x01;
+	r1(status());
+	data_block(csd, sizeof(csd));
+	break;
+      }
+      case 16: /* SET_BLOCKLEN */
+	r1(arg == SD_BLOCK ? status() : 0x40);
+	break;
+      case 17: { /* READ_SINGLE_BLOCK */
+	uint8_t block[SD_BLOCK];
+
+	if (idle || arg >= SD_CAPACITY_BLOCKS) { r1(0x20 | status()); break; }
+	memset(block, 0, sizeof(block));
+	fseek(image, (long)arg * SD_BLOCK, SEEK_SET);
+	if (fread(block, SD_BLOCK, 1, image) != 1) {
+	  clearerr(image); /* Past the end, reads as zero */
+	}
+	blocks_read++;
+	r1(0x00);
+	data_block(block, SD_BLOCK);
+	break;
+      }
+      case 24: /* WRITE_BLOCK */
+	if (idle || arg >= SD_CAPACITY_BLOCKS) { r1(0x20 | status()); break; }
+	write_address = arg;
+	write_state = WRITE_TOKEN;
+	r1(0x00);
+	break;
+      default:
+	r1(0x04 | status()); /* Illegal command */
+	break;
+    }
+  }
+
+  void write_block(void) {
+    fseek(image, (long)write_address * SD_BLOCK, SEEK_SET);
+    fwrite(data, SD_BLOCK, 1, image);
+    blocks_written++;
+
+    response.push_back(0x05); /* Data accepted */
+    write_state = WRITE_BUSY;
+    busy_until = sim_time + sim_from_seconds(SD_WRITE_TIME);
+  }
+
+  FILE* image;
+  int selected;
+  uint8_t cmd[6];
+  int cmd_length;
+  int idle, app_cmd, ready;
+  uint64_t init_start;
+  std::deque<uint8_t> response;
+  int write_state;
+  uint32_t write_address;
+  uint8_t data[SD_BLOCK + 2];
+  int data_length;
+  uint64_t busy_until;
+
+ public:
+  uint32_t blocks_written, blocks_read;
+};
+
+/**
+ **************************
+ IMU
+ *************************/
+
+/**
+ * Replays an IMU log, one line every IMU_PERIOD. The IMU clocks
+ * bytes out at IMU_SCK.
+ */
+#define IMU_PERIOD		0.02
+#define IMU_SCK			100000
+
+class sim_imu : public sim_spi_device {
+ public:
+  sim_imu(const char* filename) : file(NULL), line_start(0), index(0), lines(0) {
+    if (filename) {
+      file = fopen(filename, "r");
+      if (!file) {
+	perror(filename);
+	exit(1);
+      }
+    }
+  }
+
+  int next(uint64_t* when) {
+    if (!file) return -1;
+
+    if (index >= line.size()) {
+      char buffer[0x200];
+
+      if (!fgets(buffer, sizeof(buffer), file)) return -1;
+      line = buffer;
+      index = 0;
+      line_start = sim_from_seconds(++lines * IMU_PERIOD);
+    }
+
+    *when = line_start + (index * 8 * SIM_TICK_HZ / IMU_SCK);
+    if (*when < sim_time) *when = sim_time;
+    return (uint8_t)line[index++];
+  }
+
+ private:
+  FILE* file;
+  std::string line;
+  uint64_t line_start;
+  size_t index;
+  uint32_t lines;
+};
+
+static sim_sd_card* sd_card;
+
+/**
+ * Reports the SD card at the end
+ */
+class sim_sd_summary : public sim_peripheral {
+ public:
+  sim_sd_summary() : sim_peripheral("SD", NULL, 0) {}
+  void summary(void) {
+    sd_card->summary();
+    fflush(NULL);
+  }
+};
+
+void sim_ssp_init(void) {
+  sd_card = new sim_sd_card(sim_options.sd_file);
+
+  new sim_ssp_model<LPC_SPI0_TypeDef>("SSP0", &sim_spi0, SSP0_IRQn, 11,
+				      &sim_syscon.SSP0CLKDIV, sd_card);
+  new sim_ssp_model<LPC_SPI1_TypeDef>("SSP1", &sim_spi1, SSP1_IRQn, 18,
+				      &sim_syscon.SSP1CLKDIV,
+				      new sim_imu(sim_options.imu_file));
+  new sim_sd_summary();
+}
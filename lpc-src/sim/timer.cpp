@@ -0,0 +1,212 @@
+/*
+ * Counter-timer model for the simulator
+ * Copyright (C) 2014  richard
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+/**
+ * The 32-bit counter/timers. They count the core clock through the
+ * prescaler and interrupt, reset or stop on a match. Capture and the
+ * external match pins aren't modelled.
+ *
+ * The prescale counter counts up to PR, and the timer counter goes up
+ * on the clock after. If PR's written below where the prescale counter
+ * has got to, it carries on to 2^32 and round before the timer counter
+ * moves again, as the chip does.
+ */
+
+#include "sim.h"
+
+#define TCR_ENABLE	(1 << 0)
+#define TCR_RESET	(1 << 1)
+
+#define MCR_INTERRUPT(n)	(1 << (3 * (n)))
+#define MCR_RESET(n)		(1 << ((3 * (n)) + 1))
+#define MCR_STOP(n)		(1 << ((3 * (n)) + 2))
+
+/**
+ * Both 32-bit timers have the same layout
+ */
+typedef LPC_CT32B0_TypeDef sim_timer_regs;
+
+class sim_timer_model : public sim_peripheral {
+ public:
+  sim_timer_model(const char* name, sim_timer_regs* regs, int irqn, int clock_bit) :
+    sim_peripheral(name, regs, sizeof(sim_timer_regs), irqn, clock_bit),
+    regs(regs), start(0), base(0), prescale(0), cycle(SIM_TICK_HZ / SIM_IRC_HZ),
+    match_at(SIM_NEVER), matches(0), wraps(0) {}
+
+  uint32_t read(sim_reg* reg) {
+    if (reg == &regs->TC || reg == &regs->PC) {
+      advance(sim_time);
+      return (reg == &regs->TC) ? base : prescale;
+    }
+    return reg->value;
+  }
+  void write(sim_reg* reg, uint32_t value) {
+    /* Everything below moves the counter on from now */
+    advance(sim_time);
+
+    if (reg == &regs->IR) {
+      regs->IR.value &= ~value; /* Write 1 to clear */
+    } else if (reg == &regs->TCR) {
+      regs->TCR.value = value & (TCR_ENABLE | TCR_RESET);
+      if (value & TCR_RESET) {
+	base = 0;
+	prescale = 0;
+      }
+    } else if (reg == &regs->TC) {
+      base = value;
+    } else if (reg == &regs->PC) {
+      prescale = value;
+    } else if (reg == &regs->PR) {
+      if (counting() && prescale > value) wraps++;
+      reg->value = value;
+    } else if (reg == &regs->CR0) {
+      /* Read only */
+    } else {
+      reg->value = value;
+    }
+
+    set_irq(regs->IR.value != 0);
+    reschedule();
+  }
+  int pollable(sim_reg* reg) {
+    return reg != &regs->TC && reg != &regs->PC;
+  }
+
+  /**
+   * Time may have moved on past the match, so work from when it was
+   */
+  void event(void) {
+    uint32_t tc;
+
+    advance(match_at);
+    tc = base;
+
+    for (int n = 0; n < 4; n++) {
+      uint32_t mcr = regs->MCR.value;
+
+      if ((&regs->MR0)[n].value != tc) continue;
+
+      matches++;
+      if (mcr & MCR_INTERRUPT(n)) regs->IR.value |= (1 << n);
+      if (mcr & MCR_RESET(n)) base = 0;
+      if (mcr & MCR_STOP(n)) regs->TCR.value &= ~TCR_ENABLE;
+    }
+
+    set_irq(regs->IR.value != 0);
+    reschedule();
+  }
+  void clock_changed(void) {
+    advance(sim_time);
+    start = sim_time;
+    cycle = sim_cycle_time;
+    reschedule();
+  }
+  void summary(void) {
+    printf("%s: %u matches", name, matches);
+    if (wraps) printf(", PR set below the prescale counter %u times", wraps);
+    printf("\n");
+  }
+
+ private:
+  int counting(void) {
+    return (regs->TCR.value & (TCR_ENABLE | TCR_RESET)) == TCR_ENABLE;
+  }
+  /**
+   * Clocks until the timer counter has gone up by increments
+   */
+  uint64_t clocks_to(uint64_t increments) {
+    uint64_t pr = regs->PR.value;
+    uint64_t first;
+
+    if (increments == 0) return 0;
+    if (prescale <= pr) {
+      first = pr - prescale + 1;
+    } else {
+      first = (1ULL << 32) - prescale + pr + 1;
+    }
+    return first + ((increments - 1) * (pr + 1));
+  }
+  /**
+   * Moves both counters on to the given time, and start with them to
+   * the last clock before it
+   */
+  void advance(uint64_t to) {
+    uint64_t clocks, first, pr = regs->PR.value;
+
+    if (!counting() || to <= start) {
+      if (!counting() && to > start) start = to;
+      return;
+    }
+    clocks = (to - start) / cycle;
+    first = clocks_to(1);
+    if (clocks < first) {
+      prescale += (uint32_t)clocks;
+    } else {
+      base += (uint32_t)(1 + ((clocks - first) / (pr + 1)));
+      prescale = (uint32_t)((clocks - first) % (pr + 1));
+    }
+    start += clocks * cycle;
+  }
+  /**
+   * Schedules the next match. A match register that holds the count
+   * already, as it does straight after its match, is a full wrap away.
+   * The counters have been moved on to now.
+   */
+  void reschedule(void) {
+    uint64_t soonest = SIM_NEVER;
+    uint32_t tc = base;
+
+    if (counting()) {
+      for (int n = 0; n < 4; n++) {
+	uint32_t mask = MCR_INTERRUPT(n) | MCR_RESET(n) | MCR_STOP(n);
+	if (!(regs->MCR.value & mask)) continue;
+
+	uint64_t delta = (uint32_t)((&regs->MR0)[n].value - tc);
+	if (delta == 0) delta = 1ULL << 32;
+
+	uint64_t at = start + clocks_to(delta) * cycle;
+	if (at < soonest) soonest = at;
+      }
+    }
+    match_at = soonest;
+    schedule(soonest);
+  }
+
+  sim_timer_regs* regs;
+  /**
+   * The timer counter held base and the prescale counter prescale at
+   * start
+   */
+  uint64_t start;
+  uint32_t base, prescale;
+  uint64_t cycle;
+  uint64_t match_at;
+  uint32_t matches, wraps;
+};
+
+void sim_timer_init(void) {
+  new sim_timer_model("CT32B0", &sim_ct32b0, TIMER_32_0_IRQn, 9);
+  new sim_timer_model("CT32B1", (sim_timer_regs*)&sim_ct32b1, TIMER_32_1_IRQn, 10);
+}
@@ -0,0 +1,752 @@
+/*
+ * UART model for the simulator
+ * Copyright (C) 2014  richard
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * The UART, talking to the GPS. NMEA comes from a file or is made up
+ * from the flight model, one burst of sentences a second like a real
+ * receiver.
+ *
+ * With -u the GPS is a u-blox instead. It starts the same but at 9600
+ * baud, and takes UBX configuration from the firmware: the ports'
+ * protocols, the dynamic model, the rate, which messages to send and
+ * power save. It ACKs what it understands and sends NAV-PVTs if
+ * they're turned on. In the default portable model it stops making
+ * fixes above 12km.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <deque>
+#include <map>
+#include <string>
+#include "sim.h"
+#include "flight.h"
+
+#define FIFO_SIZE		16
+/**
+ * Receivers cope with about this much baud rate error
+ */
+#define BAUD_TOLERANCE		0.03
+
+/**
+ * Line status
+ */
+#define LSR_RDR			(1 << 0)
+#define LSR_OE			(1 << 1)
+#define LSR_FE			(1 << 3)
+#define LSR_THRE		(1 << 5)
+#define LSR_TEMT		(1 << 6)
+#define LSR_ERRORS		(0x1E)
+/**
+ * Interrupt identification
+ */
+#define IIR_NONE		0x01
+#define IIR_THRE		0x02
+#define IIR_RLS			0x06
+#define IIR_RDA			0x04
+#define IIR_CTI			0x0C
+#define IIR_FIFOS		0xC0
+
+/**
+ * UBX, written out here rather than taken from the firmware so the
+ * two are checked against each other
+ */
+#define UBX_NAV			0x01
+#define UBX_ACK			0x05
+#define UBX_CFG			0x06
+#define UBX_NMEA		0xF0
+#define UBX_PVT_LENGTH		92
+
+/**
+ * The GPS end of the wire
+ */
+class sim_gps {
+ public:
+  sim_gps() : file(NULL), pos(0), current_when(0), burst_when(0), second(0),
+	      ubx(sim_options.ubx), epoch_ms(0), epochs(0), rate_ms(1000),
+	      dyn_model(0), out_nmea(1), out_ubx(1), pvt_rate(0), power_save(0),
+	      pvts(0), sentences(0), lost_fixes(0), acks(0), naks(0),
+	      bad_checksums(0), ignored(0) {
+    static const uint8_t nmea_default[6] = { 1, 1, 1, 1, 1, 1 };
+
+    memcpy(nmea_rate, nmea_default, sizeof(nmea_rate));
+    if (sim_options.nmea_file) {
+      file = fopen(sim_options.nmea_file, "r");
+      if (!file) {
+	perror(sim_options.nmea_file);
+	exit(1);
+      }
+    }
+  }
+
+  int baud(void) {
+    return ubx ? 9600 : 4800;
+  }
+
+  /**
+   * Returns the next byte and when it wants sending, or -1 when
+   * there's nothing more. Replies go between bursts.
+   */
+  int next(uint64_t* when) {
+    if (pos >= current.size()) {
+      current.clear();
+      pos = 0;
+      current_when = 0;
+      if (!replies.empty()) {
+	current = replies.front();
+	replies.pop_front();
+      } else {
+	while (burst.empty()) {
+	  if (!fill()) return -1;
+	}
+	current.swap(burst);
+	current_when = burst_when;
+	burst_when = 0;
+      }
+    }
+
+    *when = pos ? 0 : current_when;
+    return (uint8_t)current[pos++];
+  }
+  /**
+   * Takes back the first byte of a burst that's still waiting for its
+   * time, so a reply can go ahead of it. Returns 0 if it's too late.
+   */
+  int unget(void) {
+    if (pos != 1 || !current_when) return 0;
+
+    burst.swap(current);
+    burst_when = current_when;
+    current.clear();
+    current_when = 0;
+    pos = 0;
+    return 1;
+  }
+
+  /**
+   * A byte from the firmware. Returns 1 if there's a reply to send.
+   */
+  int receive(uint8_t c) {
+    int replied = 0;
+
+    if (!ubx) {
+      ignored++;
+      return 0;
+    }
+
+    rx.push_back(c);
+    while (rx.size() >= 2) {
+      if ((uint8_t)rx[0] != 0xB5 || (uint8_t)rx[1] != 0x62) {
+	rx.erase(0, 1);
+	ignored++;
+	continue;
+      }
+      if (rx.size() < 6) break;
+
+      size_t length = (uint8_t)rx[4] | ((uint8_t)rx[5] << 8);
+      if (length > 512) {
+	rx.erase(0, 2);
+	bad_checksums++;
+	continue;
+      }
+      if (rx.size() < length + 8) break;
+
+      std::string body = rx.substr(2, length + 4);
+      std::string check = checksum(body);
+      if (rx.compare(length + 6, 2, check) != 0) {
+	rx.erase(0, 2);
+	bad_checksums++;
+	continue;
+      }
+      replied |= message(body[0], body[1],
+			 (const uint8_t*)body.data() + 4, length);
+      rx.erase(0, length + 8);
+    }
+
+    return replied;
+  }
+
+  void summary(void) {
+    static const char* models[] = {
+      "portable", "?", "stationary", "pedestrian", "automotive", "sea",
+      "airborne <1g", "airborne <2g", "airborne <4g"
+    };
+
+    if (!ubx) return;
+
+    printf("GPS: u-blox, %s model, a fix every %ums, power save %s\n",
+	   dyn_model < 9 ? models[dyn_model] : "?", rate_ms,
+	   power_save ? "on" : "off");
+    printf("GPS: %u NAV-PVT and %u NMEA sentences sent, %u fixes lost above"
+	   " %.0fm\n", pvts, sentences, lost_fixes, ceiling());
+    printf("GPS: %u configuration messages taken, %u refused, %u bad checksums,"
+	   " %u other bytes\n", acks, naks, bad_checksums, ignored);
+  }
+
+ private:
+  /**
+   * Each GGA starts a new second
+   */
+  int fill(void) {
+    char line[0x200];
+
+    if (file) {
+      if (!fgets(line, sizeof(line), file)) return 0;
+      burst_when = 0;
+      if (strncmp(line, "$GPGGA", 6) == 0) {
+	burst_when = sim_from_seconds(++second);
+      }
+      burst = line;
+      if (burst.size() && burst[burst.size()-1] == '\n' &&
+	  (burst.size() < 2 || burst[burst.size()-2] != '\r')) {
+	burst.insert(burst.size()-1, "\r");
+      }
+    } else {
+      if (!sending()) return 0;
+
+      do {
+	/* Catch up on the fixes while there was nothing to send */
+	do {
+	  epoch_ms += rate_ms;
+	  epochs++;
+	} while (sim_from_seconds(epoch_ms / 1000.0) < sim_time);
+	burst_when = sim_from_seconds(epoch_ms / 1000.0);
+	generate();
+      } while (burst.empty());
+    }
+
+    return 1;
+  }
+
+  /**
+   * Whether anything's turned on to send
+   */
+  int sending(void) {
+    if (out_nmea && (nmea_rate[0] || nmea_rate[2] || nmea_rate[4])) return 1;
+    return ubx && out_ubx && pvt_rate;
+  }
+  /**
+   * How high the dynamic model makes fixes
+   */
+  double ceiling(void) {
+    switch (dyn_model) {
+      case 0: return 12000;
+      case 2: case 3: return 9000;
+      case 4: return 6000;
+      case 5: return 500;
+      default: return 50000;
+    }
+  }
+
+  void sentence(const char* body) {
+    uint8_t checksum = 0;
+    char tail[8];
+
+    for (const char* c = body; *c; c++) checksum ^= *c;
+    snprintf(tail, sizeof(tail), "*%02X\r\n", checksum);
+    burst += std::string("$") + body + tail;
+    sentences++;
+  }
+  /**
+   * GGA, GSA and RMC. Only the GGA is used.
+   */
+  void generate(void) {
+    /* Where we'll be when this goes out */
+    const struct flight_state* f = flight_now();
+    int t = 36000 + epoch_ms / 1000; /* Launch at 10:00:00 */
+    char hhmmss[16], lat[32], lon[32], body[0x100];
+    double alat = fabs(f->lat), alon = fabs(f->lon);
+    int fix = !ubx || f->altitude <= ceiling();
+
+    if (!fix) lost_fixes++;
+
+    if (out_nmea) {
+      snprintf(hhmmss, sizeof(hhmmss), "%02d%02d%02d.%03u",
+	       (t / 3600) % 24, (t / 60) % 60, t % 60, epoch_ms % 1000);
+      snprintf(lat, sizeof(lat), "%02d%07.4f", (int)alat,
+	       (alat - (int)alat) * 60);
+      snprintf(lon, sizeof(lon), "%03d%07.4f", (int)alon,
+	       (alon - (int)alon) * 60);
+
+      if (!nmea_rate[0]) {
+	/* Turned off */
+      } else if (fix) {
+	snprintf(body, sizeof(body), "GPGGA,%s,%s,%c,%s,%c,1,09,1.0,%.1f,M,47.0,M,,0000",
+		 hhmmss, lat, f->lat < 0 ? 'S' : 'N', lon, f->lon < 0 ? 'W' : 'E',
+		 f->altitude);
+	sentence(body);
+      } else {
+	snprintf(body, sizeof(body), "GPGGA,%s,,,,,0,00,99.99,,,,,,", hhmmss);
+	sentence(body);
+      }
+      if (nmea_rate[2] && fix) {
+	sentence("GPGSA,A,3,02,04,05,09,12,17,25,29,30,,,,1.8,1.0,1.5");
+      }
+      if (nmea_rate[4] && fix) {
+	snprintf(body, sizeof(body), "GPRMC,%s,A,%s,%c,%s,%c,%.2f,90.00,010614,,",
+		 hhmmss, lat, f->lat < 0 ? 'S' : 'N', lon, f->lon < 0 ? 'W' : 'E',
+		 8.5 / 0.514);
+	sentence(body);
+      }
+    }
+
+    if (ubx && out_ubx && pvt_rate && epochs % pvt_rate == 0) {
+      nav_pvt(f, t, fix);
+    }
+  }
+
+  static void put32(uint8_t* p, uint32_t v) {
+    for (int i = 0; i < 4; i++) p[i] = v >> (8 * i);
+  }
+  static std::string checksum(const std::string& body) {
+    uint8_t a = 0, b = 0;
+
+    for (size_t i = 0; i < body.size(); i++) {
+      a += (uint8_t)body[i];
+      b += a;
+    }
+    return std::string(1, (char)a) + (char)b;
+  }
+  static std::string frame(uint8_t cls, uint8_t id, const uint8_t* payload,
+			   size_t length) {
+    std::string body;
+
+    body += (char)cls;
+    body += (char)id;
+    body += (char)(length & 0xFF);
+    body += (char)(length >> 8);
+    body.append((const char*)payload, length);
+    return std::string("\xB5\x62") + body + checksum(body);
+  }
+
+  void nav_pvt(const struct flight_state* f, int t, int fix) {
+    uint8_t p[UBX_PVT_LENGTH];
+
+    memset(p, 0, sizeof(p));
+    put32(p, 36000000 + epoch_ms);	/* iTOW, on a Sunday */
+    p[4] = 2014 & 0xFF; p[5] = 2014 >> 8; p[6] = 6; p[7] = 1;
+    p[8] = (t / 3600) % 24; p[9] = (t / 60) % 60; p[10] = t % 60;
+    p[11] = 0x07;			/* Date and time valid */
+    p[23] = fix ? 9 : 0;
+    if (fix) {
+      p[20] = 3;			/* 3D */
+      p[21] = 0x01;			/* gnssFixOK */
+      put32(p + 24, (int32_t)lround(f->lon * 1e7));
+      put32(p + 28, (int32_t)lround(f->lat * 1e7));
+      put32(p + 32, (int32_t)lround((f->altitude + 47) * 1000));
+      put32(p + 36, (int32_t)lround(f->altitude * 1000));
+    }
+    burst += frame(UBX_NAV, 0x07, p, sizeof(p));
+    pvts++;
+  }
+
+  /**
+   * Acts on a message from the firmware, returning 1 if it's answered
+   */
+  int message(uint8_t cls, uint8_t id, const uint8_t* p, size_t length) {
+    int ok = 1;
+
+    if (cls != UBX_CFG) return 0;
+
+    switch (id) {
+      case 0x00: /* CFG-PRT */
+	if (length != 20 || p[0] != 1) {
+	  ok = 0;
+	} else if ((uint32_t)(p[8] | (p[9] << 8) | (p[10] << 16)) != (uint32_t)baud()) {
+	  sim_log("GPS asked to change baud rate, which isn't modelled");
+	  ok = 0;
+	} else {
+	  out_ubx = p[14] & 1;
+	  out_nmea = (p[14] >> 1) & 1;
+	}
+	break;
+      case 0x24: /* CFG-NAV5 */
+	if (length != 36) {
+	  ok = 0;
+	} else if (p[0] & 1) {
+	  dyn_model = p[2];
+	}
+	break;
+      case 0x08: /* CFG-RATE */
+	if (length != 6 || (p[0] | (p[1] << 8)) < 50) {
+	  ok = 0;
+	} else {
+	  rate_ms = p[0] | (p[1] << 8);
+	}
+	break;
+      case 0x01: /* CFG-MSG, for this port or all six */
+	if (length != 3 && length != 8) {
+	  ok = 0;
+	} else {
+	  uint8_t rate = (length == 3) ? p[2] : p[3];
+	  if (p[0] == UBX_NAV && p[1] == 0x07) {
+	    pvt_rate = rate;
+	  } else if (p[0] == UBX_NMEA && p[1] < 6) {
+	    nmea_rate[p[1]] = rate;
+	  }
+	}
+	break;
+      case 0x11: /* CFG-RXM */
+	if (length != 2) {
+	  ok = 0;
+	} else {
+	  power_save = (p[1] == 1);
+	}
+	break;
+      default:
+	ok = 0;
+	break;
+    }
+
+    uint8_t ack[2] = { cls, id };
+    replies.push_back(frame(UBX_ACK, ok ? 0x01 : 0x00, ack, sizeof(ack)));
+    if (ok) acks++; else naks++;
+    return 1;
+  }
+
+  FILE* file;
+  std::string current, burst;
+  size_t pos;
+  uint64_t current_when, burst_when;
+  std::deque<std::string> replies;
+  std::string rx;
+  int second;
+
+  int ubx;
+  uint32_t epoch_ms, epochs, rate_ms;
+  uint8_t dyn_model, out_nmea, out_ubx, pvt_rate, power_save;
+  uint8_t nmea_rate[6];		/* GGA, GLL, GSA, GSV, RMC, VTG */
+  uint32_t pvts, sentences, lost_fixes;
+  uint32_t acks, naks, bad_checksums, ignored;
+};
+
+class sim_uart_model : public sim_peripheral {
+ public:
+  sim_uart_model() : sim_peripheral("UART", &sim_uart, sizeof(sim_uart),
+				    UART_IRQn, 12),
+		     rbr(0), byte(0), dll(0), dlm(0), fcr(0), lsr_errors(0),
+		     last_activity(0), next_byte(SIM_NEVER), char_start(0),
+		     counted_to(0), bits(0), rate(0), tx_byte(0),
+		     tx_done(SIM_NEVER), tx_rate(0), thre_pending(0), received(0),
+		     overruns(0), lost(0), garbled(0), sent(0), tx_overruns(0),
+		     tx_garbled(0), baud_warned(0) {
+    sim_uart.FDR.value = 0x10;
+    queue_next();
+    reschedule();
+  }
+
+  uint32_t read(sim_reg* reg) {
+    uint32_t value = reg->value;
+
+    if (reg == &sim_uart.RBR) {
+      if (dlab()) {
+	value = dll;
+      } else {
+	if (!fifo.empty()) {
+	  rbr = fifo.front();
+	  fifo.pop_front();
+	}
+	value = rbr;
+	last_activity = sim_time;
+	reschedule();
+      }
+    } else if (reg == &sim_uart.IER) {
+      value = dlab() ? dlm : sim_uart.IER.value;
+    } else if (reg == &sim_uart.IIR) {
+      value = iir();
+      if ((value & 0x0F) == IIR_THRE) thre_pending = 0; /* Cleared on read */
+    } else if (reg == &sim_uart.LSR) {
+      value = lsr();
+      lsr_errors = 0; /* Cleared on read */
+    }
+
+    update_irq();
+    return value;
+  }
+  void write(sim_reg* reg, uint32_t value) {
+    count_bits();
+
+    if (reg == &sim_uart.THR) {
+      if (dlab()) {
+	dll = value & 0xFF;
+      } else if (tx_fifo.size() >= FIFO_SIZE) {
+	tx_overruns++;
+      } else {
+	tx_fifo.push_back(value & 0xFF);
+	thre_pending = 0;
+	tx_start();
+      }
+    } else if (reg == &sim_uart.IER) {
+      if (dlab()) {
+	dlm = value & 0xFF;
+      } else {
+	sim_uart.IER.value = value & 0x307;
+      }
+    } else if (reg == &sim_uart.FCR) {
+      fcr = value;
+      if (value & (1 << 1)) fifo.clear(); /* RX FIFO reset */
+      if (value & (1 << 2)) tx_fifo.clear(); /* TX FIFO reset */
+    } else if (reg == &sim_uart.LSR || reg == &sim_uart.IIR) {
+      /* Read only */
+    } else {
+      reg->value = value;
+    }
+    rate = baud();
+
+    update_irq();
+  }
+  void event(void) {
+    if (sim_time >= next_byte) {
+      receive(byte);
+      queue_next();
+    }
+    if (sim_time >= tx_done) {
+      transmitted();
+    }
+    reschedule();
+    update_irq();
+  }
+
+  void clock_changed(void) {
+    count_bits();
+    rate = baud();
+  }
+
+  void summary(void) {
+    printf("UART: %u bytes received, %u overrun, %u lost to a stopped clock,"
+	   " %u garbled by the baud rate\n", received, overruns, lost, garbled);
+    if (sent || tx_overruns) {
+      printf("UART: %u bytes sent, %u overrun, %u garbled by the baud rate\n",
+	     sent, tx_overruns, tx_garbled);
+    }
+    gps.summary();
+    for (std::map<uint32_t, clock_stats>::iterator i = clocks.begin();
+	 i != clocks.end(); ++i) {
+      printf("UART at %uHz: %.0f baud, %.2f%% off, %u bytes\n", i->first,
+	     i->second.baud, 100 * fabs(i->second.baud - gps.baud()) / gps.baud(),
+	     i->second.bytes);
+    }
+  }
+
+ private:
+  int dlab(void) { return sim_uart.LCR.value & 0x80; }
+
+  /**
+   * The baud rate the firmware has set up
+   */
+  double baud(void) {
+    uint32_t clkdiv = sim_syscon.UARTCLKDIV.value & 0xFF;
+    uint32_t divisor = (dlm << 8) | dll;
+    uint32_t mulval = (sim_uart.FDR.value >> 4) & 0xF;
+    uint32_t divaddval = sim_uart.FDR.value & 0xF;
+
+    if (!clkdiv || !divisor || !mulval) return 0;
+
+    return (double)sim_core_clock() / clkdiv /
+      (16.0 * divisor * (1.0 + (double)divaddval / mulval));
+  }
+  /**
+   * Counts the bits our receiver has clocked through since the
+   * character started, at the rate that was set at the time. A
+   * character that straddles a clock change is received at the
+   * average rate across it, as the receiver samples each bit in turn.
+   */
+  void count_bits(void) {
+    uint64_t from = counted_to > char_start ? counted_to : char_start;
+
+    if (sim_time > from) {
+      bits += rate * (sim_time - from) / SIM_TICK_HZ;
+    }
+    counted_to = sim_time;
+  }
+  /**
+   * How long a character takes at the rate the GPS sends
+   */
+  uint64_t char_time(void) {
+    return SIM_TICK_HZ * 10 / gps.baud();
+  }
+
+  void receive(int c) {
+    double b;
+
+    count_bits();
+    b = bits * SIM_TICK_HZ / char_time();
+
+    if (!clocked() || b == 0) {
+      lost++;
+      return;
+    }
+
+    /* The rate each core clock gives */
+    clock_stats& s = clocks[sim_core_clock()];
+    s.baud = baud();
+    s.bytes++;
+
+    if (fabs(b - gps.baud()) / gps.baud() > BAUD_TOLERANCE) {
+      if (!baud_warned) {
+	sim_log("UART at %.0f baud, the GPS is at %d", b, gps.baud());
+	baud_warned = 1;
+      }
+      lsr_errors |= LSR_FE;
+      c ^= 0x5A;
+      garbled++;
+    }
+
+    if (fifo.size() >= FIFO_SIZE) {
+      lsr_errors |= LSR_OE;
+      overruns++;
+    } else {
+      fifo.push_back(c);
+      received++;
+    }
+    last_activity = sim_time;
+  }
+  void queue_next(void) {
+    uint64_t when;
+    int c = gps.next(&when);
+
+    if (c < 0) {
+      next_byte = SIM_NEVER;
+      return;
+    }
+
+    byte = c;
+    next_byte = sim_time + char_time();
+    if (when > next_byte) {
+      next_byte = when;
+    }
+    char_start = next_byte - char_time();
+    counted_to = sim_time;
+    bits = 0;
+  }
+
+  /**
+   * Moves the next byte from the Tx FIFO to the shift register, if
+   * it's free. THRE is when the FIFO empties.
+   */
+  void tx_start(void) {
+    if (tx_done != SIM_NEVER || tx_fifo.empty()) return;
+
+    tx_byte = tx_fifo.front();
+    tx_fifo.pop_front();
+    tx_rate = rate;
+    tx_done = sim_time + (tx_rate > 0 ? (uint64_t)(SIM_TICK_HZ * 10 / tx_rate) :
+			  char_time());
+    if (tx_fifo.empty()) thre_pending = 1;
+  }
+  /**
+   * A byte's reached the GPS. If it has a reply and isn't already
+   * sending, the reply goes ahead of the next burst.
+   */
+  void transmitted(void) {
+    int c = tx_byte;
+
+    tx_done = SIM_NEVER;
+    sent++;
+    if (!clocked() || fabs(tx_rate - gps.baud()) / gps.baud() > BAUD_TOLERANCE) {
+      c ^= 0x5A;
+      tx_garbled++;
+    }
+    if (gps.receive(c)) {
+      if (next_byte == SIM_NEVER) {
+	queue_next();
+      } else if (sim_time < char_start && gps.unget()) {
+	queue_next();
+      }
+    }
+    tx_start();
+  }
+
+  unsigned trigger_level(void) {
+    static const unsigned levels[4] = { 1, 4, 8, 14 };
+    return levels[(fcr >> 6) & 3];
+  }
+  /**
+   * The receive timeout fires after about 4 character times of quiet
+   */
+  int timed_out(void) {
+    return !fifo.empty() && sim_time >= last_activity + (4 * char_time());
+  }
+  uint32_t iir(void) {
+    uint32_t ier = sim_uart.IER.value;
+    uint32_t fifos = (fcr & 1) ? IIR_FIFOS : 0;
+
+    if ((ier & (1 << 2)) && lsr_errors) return fifos | IIR_RLS;
+    if (ier & (1 << 0)) {
+      if (fifo.size() >= trigger_level()) return fifos | IIR_RDA;
+      if (timed_out()) return fifos | IIR_CTI;
+    }
+    if ((ier & (1 << 1)) && thre_pending) return fifos | IIR_THRE;
+    return fifos | IIR_NONE;
+  }
+  uint32_t lsr(void) {
+    return (fifo.empty() ? 0 : LSR_RDR) | lsr_errors |
+      (tx_fifo.empty() ? LSR_THRE : 0) |
+      ((tx_fifo.empty() && tx_done == SIM_NEVER) ? LSR_TEMT : 0);
+  }
+  void update_irq(void) {
+    set_irq(!(iir() & IIR_NONE));
+  }
+  void reschedule(void) {
+    uint64_t at = next_byte;
+
+    if (!fifo.empty() && !timed_out() && last_activity + (4 * char_time()) < at) {
+      at = last_activity + (4 * char_time());
+    }
+    if (tx_done < at) {
+      at = tx_done;
+    }
+    schedule(at);
+  }
+
+  struct clock_stats {
+    clock_stats() : baud(0), bytes(0) {}
+    double baud;
+    uint32_t bytes;
+  };
+
+  sim_gps gps;
+  std::deque<uint8_t> fifo;
+  uint8_t rbr, byte;
+  uint32_t dll, dlm, fcr;
+  uint32_t lsr_errors;
+  uint64_t last_activity;
+  uint64_t next_byte;
+  uint64_t char_start, counted_to;
+  double bits, rate;
+  std::deque<uint8_t> tx_fifo;
+  uint8_t tx_byte;
+  uint64_t tx_done;
+  double tx_rate;
+  int thre_pending;
+  std::map<uint32_t, clock_stats> clocks;
+  uint32_t received, overruns, lost, garbled;
+  uint32_t sent, tx_overruns, tx_garbled;
+  int baud_warned;
+};
+
+void sim_uart_init(void) {
+  new sim_uart_model();
+}
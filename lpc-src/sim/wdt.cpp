@@ -0,0 +1,143 @@
+/*
+ * Watchdog model for the simulator
+ * Copyright (C) 2014  richard
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * The watchdog. It counts on its own clock, so gating its interface
+ * clock only stops the firmware feeding it.
+ */
+
+#include "sim.h"
+
+#define MOD_WDEN	(1 << 0)
+#define MOD_WDRESET	(1 << 1)
+#define MOD_WDTOF	(1 << 2)
+#define MOD_WDINT	(1 << 3)
+
+class sim_wdt_model : public sim_peripheral {
+ public:
+  sim_wdt_model() : sim_peripheral("WDT", &sim_wdt, sizeof(sim_wdt), WDT_IRQn, 15),
+		    running(0), fed(0), feed_state(0), feeds(0), closest(SIM_NEVER) {
+    sim_wdt.TC.value = 0xFF;
+    sim_wdt.TV.value = 0xFF;
+  }
+
+  uint32_t read(sim_reg* reg) {
+    if (reg == &sim_wdt.TV) {
+      if (!running) return sim_wdt.TV.value;
+      uint64_t period = wdt_period();
+      uint64_t elapsed = period ? (sim_time - fed) / period : 0;
+      return (elapsed >= sim_wdt.TC.value) ? 0 : sim_wdt.TC.value - elapsed;
+    }
+    return reg->value;
+  }
+  void write(sim_reg* reg, uint32_t value) {
+    if (reg == &sim_wdt.FEED) {
+      if (value == 0xAA) {
+	feed_state = 1;
+	return;
+      }
+      if (value == 0x55 && feed_state == 1) {
+	feed();
+      }
+      feed_state = 0;
+    } else if (reg == &sim_wdt.MOD) {
+      /* WDEN and WDRESET can only be set, WDTOF only cleared */
+      sim_wdt.MOD.value = (sim_wdt.MOD.value & (MOD_WDEN | MOD_WDRESET)) |
+	(value & (MOD_WDEN | MOD_WDRESET | MOD_WDINT)) |
+	(sim_wdt.MOD.value & value & MOD_WDTOF);
+    } else if (reg == &sim_wdt.TV) {
+      /* Read only */
+    } else {
+      reg->value = value;
+    }
+    feed_state = 0;
+  }
+  int pollable(sim_reg* reg) {
+    return reg != &sim_wdt.TV;
+  }
+
+  void event(void) {
+    if (sim_wdt.MOD.value & MOD_WDRESET) {
+      sim_stop(2, "watchdog reset");
+    }
+    sim_wdt.MOD.value |= MOD_WDTOF;
+    running = 0;
+    set_irq(1);
+  }
+
+  void summary(void) {
+    printf("WDT: %s, fed %u times", running ? "running" : "not running", feeds);
+    if (closest != SIM_NEVER) {
+      printf(", closest call %.3fs", (double)closest / SIM_TICK_HZ);
+    }
+    printf("\n");
+  }
+
+ private:
+  /**
+   * Ticks per watchdog count. The counter decrements every 4 cycles of
+   * the watchdog clock.
+   */
+  uint64_t wdt_period(void) {
+    uint32_t div = sim_syscon.WDTCLKDIV.value & 0xFF;
+    uint32_t clock;
+
+    switch (sim_syscon.WDTCLKSEL.value & 3) {
+      case 0: clock = SIM_IRC_HZ; break;
+      case 1: clock = sim_core_clock(); break;
+      default: clock = sim_wdt_osc(); break;
+    }
+    if (!div || !clock) return 0;
+
+    return 4 * SIM_TICK_HZ * div / clock;
+  }
+  void feed(void) {
+    uint64_t period = wdt_period();
+
+    if (!(sim_wdt.MOD.value & MOD_WDEN) || !period) return;
+
+    if (running) {
+      uint64_t margin = next_event - sim_time;
+      if (margin < closest) closest = margin;
+    }
+
+    running = 1;
+    fed = sim_time;
+    feeds++;
+    schedule(sim_time + period * (sim_wdt.TC.value & 0xFFFFFF));
+  }
+
+  int running;
+  uint64_t fed;
+  int feed_state;
+  uint32_t feeds;
+  /**
+   * The shortest time left on the clock at a feed
+   */
+  uint64_t closest;
+};
+
+void sim_wdt_init(void) {
+  new sim_wdt_model();
+}
@@ -7,6 +7,8 @@ src/wdt.c \
 src/rtty.c \
 src/pwrmon.c \
 src/main.c \
+src/idle.c \
+src/profile.c \
 src/gps.c \
 src/altitude.c \
 src/imu.c \
@@ -15,3 +17,14 @@ src/uart.c \
 src/sd.c \
 src/square.c \
 src/bmp085.c \
+src/control.c \
+src/estimator.c \
+src/fec.c \
+src/delta.c \
+src/phase.c \
+src/pool.c \
+src/stack.c \
+src/fmt.c \
+src/clock.c \
+src/persist.c \
+src/ubx.c \
@@ -23,6 +23,14 @@
  */
 
 #include "LPC11xx.h"
+#include "altitude.h"
+
+/**
+ * The firmware looks the altitude up in altitude_table.h, which is made
+ * from the formulas here by make -C tools tables. The tests check one
+ * against the other.
+ */
+#if defined(ALTITUDE_TEST) || defined(ALTITUDE_TABLE)
 
 #include <math.h>
 
@@ -104,20 +112,101 @@ double geopotential_altitude(double pr) {
 /**
  * Returns the geometric altitude in meters for a given pressure in Pascals
  */
-double pressure_to_altitude(int32_t pressure) {
-  double pr = (double)pressure;
+double geometric_altitude(double pr) {
   double height = geopotential_altitude(pr);
 
   return (height * (RE * 1000)) / ((RE * 1000) - height);
 }
 
+#endif
+
+#ifdef ALTITUDE_TABLE
+
+#include <stdio.h>
+
+/**
+ * The pressures in the table go down by the same ratio each time, from
+ * below the lowest ground to above the highest float. Each is a few
+ * meters out at most in the middle.
+ */
+#define ALTITUDE_TABLE_SIZE	128
+#define ALTITUDE_TABLE_HIGHEST	110000.0
+#define ALTITUDE_TABLE_LOWEST	100.0
+#define ALTITUDE_TABLE_PRESSURE(i)					\
+  (ALTITUDE_TABLE_HIGHEST *						\
+   pow(ALTITUDE_TABLE_LOWEST / ALTITUDE_TABLE_HIGHEST, (i) / (ALTITUDE_TABLE_SIZE - 1.0)))
+
+/**
+ * Prints altitude_table.h
+ */
+int main(void) {
+  int i;
+
+  printf("/* Made by make -C tools tables from src/altitude.c */\n\n");
+  printf("#ifndef ALTITUDE_TABLE_H\n#define ALTITUDE_TABLE_H\n\n");
+  printf("#define ALTITUDE_TABLE_SIZE\t%d\n\n", ALTITUDE_TABLE_SIZE);
+
+  printf("static const uint32_t altitude_table_pressure[ALTITUDE_TABLE_SIZE] = {");
+  for (i = 0; i < ALTITUDE_TABLE_SIZE; i++) {
+    printf("%s%.0f,", (i % 8) ? " " : "\n  ", ALTITUDE_TABLE_PRESSURE(i));
+  }
+  printf("\n};\n\n");
+
+  printf("static const int32_t altitude_table_decimetres[ALTITUDE_TABLE_SIZE] = {");
+  for (i = 0; i < ALTITUDE_TABLE_SIZE; i++) {
+    double pr = round(ALTITUDE_TABLE_PRESSURE(i));
+    printf("%s%.0f,", (i % 8) ? " " : "\n  ", round(geometric_altitude(pr) * 10));
+  }
+  printf("\n};\n\n");
+
+  printf("#endif /* ALTITUDE_TABLE_H */\n");
+
+  return 0;
+}
+
+#else
+
+#include "altitude_table.h"
+
+/**
+ * Returns the geometric altitude in meters for a given pressure in
+ * Pascals, in a straight line between the nearest two in the table.
+ * Outside the table it carries on from the end.
+ */
+double pressure_to_altitude(int32_t pressure) {
+  const uint32_t* pr = altitude_table_pressure;
+  const int32_t* alt = altitude_table_decimetres;
+  int low = 0, high = ALTITUDE_TABLE_SIZE - 1, mid;
+
+  /* Find the pressures either side, which go down */
+  while (high - low > 1) {
+    mid = (low + high) / 2;
+    if (pressure < (int32_t)pr[mid]) {
+      low = mid;
+    } else {
+      high = mid;
+    }
+  }
+
+  return (alt[low] + ((alt[high] - alt[low]) * ((int32_t)pr[low] - pressure)) /
+	  (int32_t)(pr[low] - pr[high])) / 10.0;
+}
+
+#endif
+
 #ifdef ALTITUDE_TEST
 
+#include <assert.h>
 #include <stdio.h>
 #include <stdlib.h>
 
 #define MAX_ERROR 10
 
+/**
+ * The most the table can be out from the formulas, meters
+ */
+#define MAX_TABLE_ERROR 4
+
 void altitude_test(double altitude, uint32_t pressure) {
   double test_altitude = pressure_to_altitude(pressure);
 
@@ -148,6 +237,15 @@ int main(void) {
   altitude_test(35000,   575);
   altitude_test(40000,   287);
 
+  printf("\nThe table against the formulas...\n\n");
+  double worst = 0; int32_t worst_pressure = 0, pr;
+  for (pr = 110000; pr >= 100; pr -= (pr > 10000) ? 7 : 1) {
+    double error = fabs(pressure_to_altitude(pr) - geometric_altitude(pr));
+    if (error > worst) { worst = error; worst_pressure = pr; }
+  }
+  printf("At most %.2fm out, at %dPa\n", worst, worst_pressure);
+  assert(worst < MAX_TABLE_ERROR);
+
   printf("\n*** DONE ***\n");
 }
 
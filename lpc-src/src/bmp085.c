@@ -37,6 +37,8 @@
 /**
  * BMP085 Registers
  */
+#define BMP085_CALIBRATION_REG	0xAA
+#define BMP085_CALIBRATION_SIZE	22
 #define BMP085_CONTROL_REG	0xF4
 #define BMP085_DATA_REG		0xF6
 /**
@@ -91,92 +93,89 @@ uint8_t oversampling(void) {
  * Implements a microsecond delay for use with the BMP085
  */
 void bmp085_delay_us(uint16_t microseconds) {
-  int32_t i = microseconds * 12;
+  int32_t i = microseconds * (SystemCoreClock / 1000000);
 
-  while(i--);
-}
-
-/**
- * Utility function to read a 16-bit register.
- */
-uint16_t read_16(char address) {
-  I2CWriteLength = 2;
-  I2CReadLength = 2;
-  I2CMasterBuffer[0] = BMP085_ADDRESS;
-  I2CMasterBuffer[1] = address;
-  I2CMasterBuffer[2] = BMP085_ADDRESS | RD_BIT;
-
-  if (i2c_engine() == I2CSTATE_ACK) { // All is well
-    return (I2CSlaveBuffer[0] << 8) | I2CSlaveBuffer[1];
+  while(i--) {
+    __NOP();
   }
-
-  return -1;
 }
 
 /**
  * Writes a command to the BMP085's control register.
  */
-uint8_t write_command(bmp085_command command) {
-  I2CWriteLength = 3;
-  I2CReadLength = 0;
-  I2CMasterBuffer[0] = BMP085_ADDRESS;
-  I2CMasterBuffer[1] = BMP085_CONTROL_REG;
-  I2CMasterBuffer[2] = command;
-
-  if (i2c_engine() == I2CSTATE_ACK) { // All is well
-    return 1;
+int write_command(bmp085_command command) {
+  uint8_t value = command;
+
+  if (i2c_write(BMP085_ADDRESS, BMP085_CONTROL_REG, &value, 1) == I2CSTATE_ACK) {
+    return 1; // All is well
   }
 
   return -1;
 }
 /**
- * Reads off the BMP085's calibration values.
+ * Reads off the BMP085's calibration values. They're in 11 registers
+ * one after the other, so they all come in one read, which saves ten
+ * addressing phases at boot.
  */
 void bmp085_get_cal_param(struct calibration *c) {
-  c->AC1 = read_16(0xAA);
-  c->AC2 = read_16(0xAC);
-  c->AC3 = read_16(0xAE);
-  c->AC4 = read_16(0xB0);
-  c->AC5 = read_16(0xB2);
-  c->AC6 = read_16(0xB4);
-  c->B1  = read_16(0xB6);
-  c->B2  = read_16(0xB8);
-  c->MB  = read_16(0xBA);
-  c->MC  = read_16(0xBC);
-  c->MD  = read_16(0xBE);
+  uint8_t b[BMP085_CALIBRATION_SIZE];
+  uint8_t i;
+
+  if (i2c_read(BMP085_ADDRESS, BMP085_CALIBRATION_REG, b,
+	       BMP085_CALIBRATION_SIZE) != I2CSTATE_ACK) { // All ones
+    for (i = 0; i < BMP085_CALIBRATION_SIZE; i++) {
+      b[i] = 0xFF;
+    }
+  }
+
+  c->AC1 = (b[0] << 8) | b[1];
+  c->AC2 = (b[2] << 8) | b[3];
+  c->AC3 = (b[4] << 8) | b[5];
+  c->AC4 = (b[6] << 8) | b[7];
+  c->AC5 = (b[8] << 8) | b[9];
+  c->AC6 = (b[10] << 8) | b[11];
+  c->B1  = (b[12] << 8) | b[13];
+  c->B2  = (b[14] << 8) | b[15];
+  c->MB  = (b[16] << 8) | b[17];
+  c->MC  = (b[18] << 8) | b[19];
+  c->MD  = (b[20] << 8) | b[21];
 }
 
 /**
  * Takes a temperature measurement and returns the uncompensated value.
+ * The pressure conversion's started in the same transaction as the
+ * temperature's read, so bmp085_get_up() has to follow.
  */
 int32_t bmp085_get_ut(void) {
+  uint8_t ut[2], command = PRESSURE_MODE;
+  struct i2c_transfer list[2] = {
+    { BMP085_ADDRESS, BMP085_DATA_REG, 0, 2, ut },
+    { BMP085_ADDRESS, BMP085_CONTROL_REG, 1, 1, &command }
+  };
+
   if (write_command(TEMPERATURE) == -1) {
     return -1; // Fail
   }
 
   bmp085_delay_us(TEMPERATURE_DELAY);
 
-  return read_16(BMP085_DATA_REG);
+  if (i2c_transfer(list, 2) != I2CSTATE_ACK) {
+    return -1; // Fail
+  }
+
+  return (ut[0] << 8) | ut[1];
 }
 /**
- * Takes a pressure measurement and returns the uncompenstated value.
+ * Returns the uncompensated pressure from the conversion started by
+ * bmp085_get_ut().
  */
 int32_t bmp085_get_up(void) {
-  if (write_command(PRESSURE_MODE) == -1) {
-    return -1; // Fail
-  }
+  uint8_t up[3];
 
   bmp085_delay_us(PRESSURE_DELAY);
 
-  I2CWriteLength = 2;
-  I2CReadLength = 3;
-  I2CMasterBuffer[0] = BMP085_ADDRESS;
-  I2CMasterBuffer[1] = BMP085_DATA_REG;
-  I2CMasterBuffer[2] = BMP085_ADDRESS | RD_BIT;
-
-  if (i2c_engine() == I2CSTATE_ACK) { // All is well
-    return ((I2CSlaveBuffer[0] << 16) | (I2CSlaveBuffer[1] << 8) |
-	    I2CSlaveBuffer[2]) >> (8 - oversampling());
+  if (i2c_read(BMP085_ADDRESS, BMP085_DATA_REG, up, 3) == I2CSTATE_ACK) {
+    return ((up[0] << 16) | (up[1] << 8) | up[2]) >> (8 - oversampling());
   }
 
   return -1;
@@ -246,7 +245,7 @@ int32_t bmp085_get_pressure(struct calibration *c, int32_t B5) {
 }
 
 struct barometer* get_barometer(void) {
-  int64_t B5;
+  int32_t B5;
 
   if (get_B5(&calibration, &B5) == -1) {
     // Invalid
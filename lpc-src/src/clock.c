@@ -0,0 +1,192 @@
+/*
+ * Switches the core between a slow and a fast clock
+ * Copyright (C) 2014  richard
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "LPC11xx.h"
+#include "clock.h"
+
+/**
+ * The flash configuration register isn't in LPC11xx.h. FLASHTIM is
+ * how many clocks a flash access takes, less one: 1 up to 20MHz, 2 up
+ * to 40MHz and 3 up to 50MHz (UM10398, Flash configuration register).
+ */
+#ifndef LPC_FLASHCFG
+#define LPC_FLASHCFG		(*(volatile uint32_t*)0x4003C010)
+#endif
+#define FLASHCFG_FLASHTIM	0x3
+
+#define PDRUNCFG_SYSOSC_PD	(1 << 5)
+#define PDRUNCFG_SYSPLL_PD	(1 << 7)
+
+/**
+ * The speed we're running at, and what to tell when it changes
+ */
+uint8_t clock_current = CLOCK_SLOW;
+volatile uint8_t clock_multiple = 1;
+clock_listener clock_listeners[CLOCK_LISTENERS];
+uint8_t clock_listener_count = 0;
+
+/**
+ * The main clock source and the PLL's only change when their update
+ * enable goes from 0 to 1
+ */
+static void clock_update_main(uint32_t source) {
+  LPC_SYSCON->MAINCLKSEL = source;
+  LPC_SYSCON->MAINCLKUEN = 0x0;
+  LPC_SYSCON->MAINCLKUEN = 0x1;
+  while (!(LPC_SYSCON->MAINCLKUEN & 0x1));
+}
+static void clock_update_pll(uint32_t source) {
+  LPC_SYSCON->SYSPLLCLKSEL = source;
+  LPC_SYSCON->SYSPLLCLKUEN = 0x0;
+  LPC_SYSCON->SYSPLLCLKUEN = 0x1;
+  while (!(LPC_SYSCON->SYSPLLCLKUEN & 0x1));
+}
+
+/**
+ * Starts the crystal and the PLL, and runs from the PLL. The flash
+ * slows down before the clock speeds up.
+ */
+static void clock_fast(void) {
+  uint32_t i;
+
+  clock_syscon(CLOCK_POWER, 0, PDRUNCFG_SYSOSC_PD);
+  for (i = 0; i < 200; i++) { __NOP(); } /* About 16µs, as SystemInit */
+  clock_update_pll(0x1); /* System oscillator */
+
+  LPC_SYSCON->SYSPLLCTRL = (CLOCK_PLL_MUL - 1) | (CLOCK_PLL_PSEL << 5);
+  clock_syscon(CLOCK_POWER, 0, PDRUNCFG_SYSPLL_PD);
+  while (!(LPC_SYSCON->SYSPLLSTAT & 0x1)); /* Locked */
+
+  LPC_FLASHCFG = (LPC_FLASHCFG & ~FLASHCFG_FLASHTIM) | 2;
+  LPC_SYSCON->SYSAHBCLKDIV = 1;
+  clock_update_main(0x3); /* PLL output */
+}
+/**
+ * Runs from the IRC, and powers the crystal and PLL down. The watchdog
+ * runs from the IRC too, so it's never affected.
+ */
+static void clock_slow(void) {
+  clock_update_main(0x0); /* IRC */
+  LPC_SYSCON->SYSAHBCLKDIV = CLOCK_SLOW_DIV;
+  LPC_FLASHCFG = (LPC_FLASHCFG & ~FLASHCFG_FLASHTIM) | 0;
+
+  clock_syscon(CLOCK_POWER, PDRUNCFG_SYSOSC_PD | PDRUNCFG_SYSPLL_PD, 0);
+}
+
+/**
+ * Converts a number of cycles from one clock to another. The clocks
+ * are all whole MHz.
+ */
+static uint32_t clock_convert(uint32_t cycles, uint32_t from, uint32_t to) {
+  return (cycles * (to / 1000000)) / (from / 1000000);
+}
+/**
+ * The SysTick counts core clock cycles. The rest of the current tick
+ * is converted to the new clock, and then whole ticks carry on from
+ * there, so no time's lost. Writing VAL clears it, and it reloads from
+ * LOAD on the next cycle.
+ */
+static void clock_systick(uint32_t from, uint32_t to) {
+  uint32_t left, load;
+
+  if (!(SysTick->CTRL & SysTick_CTRL_ENABLE_Msk)) return;
+
+  left = clock_convert(SysTick->VAL, from, to);
+  load = clock_convert(SysTick->LOAD + 1, from, to) - 1;
+
+  SysTick->LOAD = left ? left : 1;
+  SysTick->VAL = 0;
+  SysTick->LOAD = load;
+}
+
+/**
+ * Starts out slow. Call straight after SystemInit(), before any
+ * peripherals are set up.
+ */
+void clock_init(void) {
+  clock_slow();
+  clock_current = CLOCK_SLOW;
+  SystemCoreClockUpdate();
+  clock_multiple = CLOCK_FAST_HZ / SystemCoreClock;
+}
+/**
+ * Adds a peripheral to those told when the clock changes
+ */
+void clock_register(clock_listener listener) {
+  if (clock_listener_count < CLOCK_LISTENERS) {
+    clock_listeners[clock_listener_count++] = listener;
+  }
+}
+/**
+ * Switches speed. Everything on the core clock is set up again before
+ * interrupts come back on, so the UART and timers keep their rates.
+ */
+void clock_set(uint8_t speed) {
+  uint32_t from = SystemCoreClock;
+  uint8_t i;
+
+  if (speed == clock_current) return;
+
+  __disable_irq();
+
+  if (speed == CLOCK_FAST) {
+    clock_fast();
+  } else {
+    clock_slow();
+  }
+  clock_current = speed;
+  SystemCoreClockUpdate();
+  clock_multiple = CLOCK_FAST_HZ / SystemCoreClock;
+
+  clock_systick(from, SystemCoreClock);
+  for (i = 0; i < clock_listener_count; i++) {
+    clock_listeners[i]();
+  }
+
+  __enable_irq();
+}
+/**
+ * Sets and clears bits in SYSAHBCLKCTRL or PDRUNCFG. Interrupts turn
+ * their own blocks' clocks and power on and off too, so if one came
+ * between the read and the write here its change would be lost. They
+ * stay off for the read-modify-write, and only come back on if they
+ * were on before.
+ */
+void clock_syscon(uint8_t reg, uint32_t set, uint32_t clear) {
+  uint32_t primask = __get_PRIMASK();
+
+  __disable_irq();
+  if (reg == CLOCK_AHB) {
+    LPC_SYSCON->SYSAHBCLKCTRL = (LPC_SYSCON->SYSAHBCLKCTRL & ~clear) | set;
+  } else {
+    LPC_SYSCON->PDRUNCFG = (LPC_SYSCON->PDRUNCFG & ~clear) | set;
+  }
+  if (!primask) __enable_irq();
+}
+/**
+ * Returns CLOCK_SLOW or CLOCK_FAST
+ */
+uint8_t clock_speed(void) {
+  return clock_current;
+}
@@ -0,0 +1,82 @@
+/*
+ * Control logic for the cutdown, heater and GSM
+ * Copyright (C) 2014  richard
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "LPC11xx.h"
+#include "control.h"
+#include "cutdown_heat.h"
+#include "mbed.h"
+
+/**
+ * These decide when to cut down, so they're kept apart from main() to
+ * be run against simulated flights on the host (sim/control-mc).
+ */
+
+void control_gsm(double altitude) {
+  if (altitude < GSM_ON_BELOW_ALTITUDE && altitude != -1) {
+    MBED_ON();
+  } else {
+    MBED_OFF();
+  }
+}
+void control_cutdown(uint32_t ticks, double altitude) {
+  if ((ticks == 0 && altitude > MIN_CUTDOWN_ALTITUDE) ||
+      (altitude > CUTDOWN_CEILING && altitude != -1)) {
+
+    CUTDOWN_ON(); // Mechanical disconnect
+  } else {
+    CUTDOWN_OFF();
+  }
+}
+void control_heater(double internal_temperature) {
+  if (internal_temperature < HEATER_THRESHOLD && internal_temperature != -1) {
+    HEATER_ON();
+  } else {
+    HEATER_OFF();
+  }
+}
+
+/**
+ * Runs all the control logic on the altitude estimate and the
+ * barometer's temperature. Returns the altitude, or -1 if the estimate
+ * can't be trusted.
+ */
+double control_update(struct estimator* e, struct barometer* b,
+		      uint32_t ticks_until_cutdown) {
+  double alt;
+
+  if (estimator_valid(e)) {
+    alt = estimator_altitude(e) / 1000.0;
+  } else {
+    alt = -1;
+  }
+  if (!b->valid) {
+    b->temperature = -1;
+  }
+
+  control_gsm(alt);
+  control_cutdown(ticks_until_cutdown, alt);
+  control_heater(b->temperature);
+
+  return alt;
+}
@@ -0,0 +1,325 @@
+/*
+ * Delta compressed telemetry frames
+ * Copyright (C) 2014  richard
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <string.h>
+#include "delta.h"
+
+/**
+ * Each type is either text or a number, which is handled as a 32 bit
+ * integer so differences wrap the same way both ends.
+ */
+#define DELTA_KIND_frame_text	text
+#define DELTA_KIND_frame_time	number
+#define DELTA_KIND_int32_t	number
+#define DELTA_KIND_uint32_t	number
+#define DELTA_KIND_int16_t	number
+#define DELTA_KIND_uint16_t	number
+#define DELTA_KIND_uint8_t	number
+#define DELTA_OP(op, type)	DELTA_OP_(op, DELTA_KIND_##type)
+#define DELTA_OP_(op, kind)	DELTA_OP__(op, kind)
+#define DELTA_OP__(op, kind)	delta_##op##_##kind
+
+/**
+ * Keyframes are encoded as deltas from nothing
+ */
+static const struct frame delta_zero = { 0 };
+
+#define ZIGZAG(v)	(((uint32_t)(v) << 1) ^ (uint32_t)((int32_t)(v) >> 31))
+#define UNZIGZAG(u)	((uint32_t)((u) >> 1) ^ -(uint32_t)((u) & 1))
+
+static uint8_t* put_varint(uint8_t* p, uint32_t v) {
+  while (v >= 0x80) {
+    *p++ = v | 0x80; v >>= 7;
+  }
+  *p++ = v;
+  return p;
+}
+static const uint8_t* get_varint(const uint8_t* p, const uint8_t* end, uint32_t* v) {
+  int shift;
+
+  *v = 0;
+  for (shift = 0; p < end && shift < 35; shift += 7) {
+    *v |= (uint32_t)(*p & 0x7F) << shift;
+    if (!(*p++ & 0x80)) return p;
+  }
+  return NULL;
+}
+
+#define delta_changed_number(a, b)	((a) != (b))
+#define delta_changed_text(a, b)	strcmp(a, b)
+#define delta_put_number(p, a, b)	put_varint(p, ZIGZAG((uint32_t)(a) - (uint32_t)(b)))
+
+static uint8_t* delta_put_text(uint8_t* p, const char* a, const char* b) {
+  int i;
+  (void)b;
+
+  for (i = 0; i < FRAME_TEXT_MAX && a[i]; i++) *p++ = a[i];
+  *p++ = '\0';
+  return p;
+}
+
+/**
+ * The number of fields for where, which is how many bits the bitmap has
+ */
+static int delta_fields(uint8_t where) {
+  int fields = 0;
+
+#define DELTA_COUNT(name, type, scale, precision, w, phases, description) \
+  if ((w) & where) fields++;
+  FRAME_FIELDS(DELTA_COUNT)
+#undef DELTA_COUNT
+
+  return fields;
+}
+
+void delta_encoder_init(struct delta_encoder* e, uint8_t period, uint8_t where) {
+  memset(&e->key, 0, sizeof(e->key));
+  e->period = period;
+  e->since_key = period; // So the first is a keyframe
+  e->where = where;
+}
+
+/**
+ * Encodes the next frame. Returns the number of bytes, or 0 if it
+ * doesn't fit.
+ */
+int delta_encode(struct delta_encoder* e, const struct frame* f,
+		 uint8_t* data, int size) {
+  const struct frame* ref = &delta_zero;
+  uint8_t* p = data;
+  uint8_t* bitmap = NULL;
+  uint8_t key = (e->since_key >= e->period);
+  int field = 0;
+  struct frame sent;
+
+  if (size < DELTA_MAX) return 0;
+
+  /* Fields that aren't sent in this phase go as nothing */
+  if (!(e->where & FRAME_EVERY_PHASE)) {
+    sent = *f;
+#define DELTA_PHASE(name, type, scale, precision, w, phases, description) \
+    if (!(((phases) >> sent.phase) & 1)) memset(&sent.name, 0, sizeof(sent.name));
+    FRAME_FIELDS(DELTA_PHASE)
+#undef DELTA_PHASE
+    f = &sent;
+  }
+
+  if (key) {
+    *p++ = DELTA_KEY;
+  } else {
+    *p++ = DELTA_DELTA;
+    *p++ = e->key.sentence_id;
+    ref = &e->key;
+    bitmap = p;
+    p += (delta_fields(e->where) + 7) / 8;
+    memset(bitmap, 0, p - bitmap);
+  }
+
+#define DELTA_ENCODE(name, type, scale, precision, w, phases, description) \
+  if ((w) & e->where) {						\
+    if (key || DELTA_OP(changed, type)(f->name, ref->name)) {		\
+      if (bitmap) bitmap[field / 8] |= 1 << (field % 8);		\
+      p = DELTA_OP(put, type)(p, f->name, ref->name);			\
+    }									\
+    field++;								\
+  }
+  FRAME_FIELDS(DELTA_ENCODE)
+#undef DELTA_ENCODE
+
+  if (key) {
+    e->key = *f;
+    e->since_key = 0;
+  }
+  e->since_key++;
+
+  return p - data;
+}
+
+/**
+ * And back again
+ */
+#define DELTA_GET_NUMBER(type)						\
+  static const uint8_t* delta_get_##type(const uint8_t* p, const uint8_t* end, \
+					 type* v, type r) {		\
+    uint32_t u;								\
+    p = get_varint(p, end, &u);						\
+    if (p) *v = (uint32_t)r + UNZIGZAG(u);				\
+    return p;								\
+  }
+DELTA_GET_NUMBER(frame_time)
+DELTA_GET_NUMBER(int32_t)
+DELTA_GET_NUMBER(uint32_t)
+DELTA_GET_NUMBER(int16_t)
+DELTA_GET_NUMBER(uint16_t)
+DELTA_GET_NUMBER(uint8_t)
+
+static const uint8_t* delta_get_frame_text(const uint8_t* p, const uint8_t* end,
+				     frame_text* v, const char* r) {
+  int i;
+  (void)r;
+
+  for (i = 0; p < end && i <= FRAME_TEXT_MAX; i++) {
+    if (((*v)[i] = *p++) == '\0') return p;
+  }
+  return NULL;
+}
+
+void delta_decoder_init(struct delta_decoder* d, uint8_t where) {
+  memset(&d->key, 0, sizeof(d->key));
+  d->have_key = 0;
+  d->where = where;
+}
+
+/**
+ * Decodes a frame into f. Returns 0 on success, or -1 if it's broken
+ * or it's a delta and we don't have its keyframe.
+ */
+int delta_decode(struct delta_decoder* d, const uint8_t* data, int size,
+		 struct frame* f) {
+  const struct frame* ref = &delta_zero;
+  const uint8_t* p = data;
+  const uint8_t* end = data + size;
+  const uint8_t* bitmap = NULL;
+  struct frame out;
+  int field = 0;
+
+  if (size < 1) return -1;
+  if (*p == DELTA_KEY) {
+    p++;
+  } else if (*p == DELTA_DELTA && size >= 2) {
+    if (!d->have_key || p[1] != (uint8_t)d->key.sentence_id) return -1;
+    ref = &d->key;
+    bitmap = p + 2;
+    p = bitmap + ((delta_fields(d->where) + 7) / 8);
+    if (p > end) return -1;
+  } else {
+    return -1;
+  }
+
+  out = *ref;
+#define DELTA_DECODE(name, type, scale, precision, w, phases, description) \
+  if ((w) & d->where) {						\
+    if (!bitmap || (bitmap[field / 8] & (1 << (field % 8)))) {		\
+      p = delta_get_##type(p, end, &out.name, ref->name);		\
+      if (!p) return -1;						\
+    }									\
+    field++;								\
+  }
+  FRAME_FIELDS(DELTA_DECODE)
+#undef DELTA_DECODE
+
+  if (p != end) return -1;
+  if (!bitmap) {
+    d->key = out;
+    d->have_key = 1;
+  }
+  *f = out;
+  return 0;
+}
+
+#ifdef DELTA_TEST
+
+#include <stdio.h>
+
+int main(void) {
+  printf("*** DELTA_TEST ***\n\n");
+
+  struct delta_encoder e;
+  struct delta_decoder d;
+  struct frame f, out;
+  uint8_t data[DELTA_MAX];
+  int i, length, total = 0, decoded = 0;
+
+  delta_encoder_init(&e, DELTA_KEY_PERIOD, FRAME_RADIO | FRAME_SD | FRAME_EVERY_PHASE);
+  delta_decoder_init(&d, FRAME_RADIO | FRAME_SD);
+  memset(&f, 0, sizeof(f));
+  strcpy(f.callsign, "BUSEDS1");
+  f.latitude = 51456000; f.longitude = -2600000;
+  f.ticks_active = 0xFFFFFFF0;
+
+  for (i = 0; i < 100; i++) {
+    /* A slow climb, with some fields going the other way */
+    f.sentence_id = i;
+    f.time = 86390 + (i * 14);
+    f.latitude += 40; f.longitude -= 170;
+    f.altitude = 500 * i; f.ascent_rate = 5000 + ((i % 3) * 100);
+    f.external_temperature = 150 - (6 * i);
+    f.accel_z = (i & 1) ? -32768 : 32767;
+    f.ticks_active += 1000; // Wraps
+    if (i == 55) strcpy(f.callsign, "BUSEDS2");
+
+    length = delta_encode(&e, &f, data, sizeof(data));
+    total += length;
+    if (i == 0) printf("Keyframe %d bytes\n", length);
+    if (i == 1) printf("Delta %d bytes\n", length);
+
+    /* Lose every seventh delta, and a keyframe */
+    if ((i % 7 == 3 && i % DELTA_KEY_PERIOD) || i == 40) continue;
+
+    if (delta_decode(&d, data, length, &out) == 0) {
+      if (memcmp(&f, &out, sizeof(f))) {
+	printf("ERROR: Frame %d decoded wrong\n", i);
+	return 1;
+      }
+      decoded++;
+    } else if (i / 10 != 4) {
+      printf("ERROR: Frame %d not decoded\n", i);
+      return 1;
+    }
+    if (delta_decode(&d, data, length - 1, &out) == 0) {
+      printf("ERROR: Frame %d decoded short\n", i);
+      return 1;
+    }
+  }
+  printf("%d frames, %.1f bytes each, %d decoded\n", i, (double)total / i, decoded);
+
+  /* Only the fields for the phase */
+  delta_encoder_init(&e, DELTA_KEY_PERIOD, FRAME_RADIO);
+  delta_decoder_init(&d, FRAME_RADIO);
+  f.phase = PHASE_ASCENT;
+  length = delta_encode(&e, &f, data, sizeof(data));
+  if (delta_decode(&d, data, length, &out) ||
+      out.altitude != f.altitude || out.accel_z != 0) {
+    printf("ERROR: Ascent frame has the wrong fields\n");
+    return 1;
+  }
+  printf("Ascent keyframe %d bytes\n", length);
+
+  /* Every field at its longest fits exactly */
+  delta_encoder_init(&e, DELTA_KEY_PERIOD, FRAME_RADIO | FRAME_SD | FRAME_EVERY_PHASE);
+  memset(&f, 0, sizeof(f));
+  delta_encode(&e, &f, data, sizeof(data));
+  memset(&f, 0x80, sizeof(f));
+  length = delta_encode(&e, &f, data, sizeof(data));
+  if (length != DELTA_MAX || delta_encode(&e, &f, data, DELTA_MAX - 1) != 0) {
+    printf("ERROR: Longest delta is %d bytes, not %d\n", length, DELTA_MAX);
+    return 1;
+  }
+  printf("Longest delta %d bytes\n", length);
+
+  printf("\n*** DONE ***\n");
+  return 0;
+}
+
+#endif
@@ -24,6 +24,7 @@
 
 #include "LPC11xx.h"
 #include "sd.h"
+#include "disk_write.h"
 
 /**
  * The index of the next available block is stored in block 0
@@ -47,13 +48,32 @@ int set_next_block(uint32_t block) {
  * against the next available block.
  */
 int disk_write_next_block(const uint8_t *buffer, uint32_t length) {
+  struct disk_part part = { buffer, length };
+
+  return disk_write_next_block_parts(&part, 1);
+}
+/**
+ * The same, gathered from several buffers
+ */
+int disk_write_next_block_parts(const struct disk_part* parts, uint32_t count) {
   if (!next_block) { /* We need to grab the next block index */
     next_block = get_next_block();
   }
 
-  if (disk_write(buffer, length, next_block++) == 0) { // Success
+  if (disk_write_parts(parts, count, next_block++) == 0) { // Success
     return set_next_block(next_block); /* Write new position to card */
   }
 
   return 0; // Fail
 }
+
+/**
+ * The block the next write goes to, or 0 if it's still to be read from
+ * the card. A warm reset gives it back, so it isn't read again.
+ */
+uint32_t disk_write_head(void) {
+  return next_block;
+}
+void disk_write_resume(uint32_t block) {
+  next_block = block;
+}
@@ -0,0 +1,310 @@
+/*
+ * Barometric altitude estimator
+ * Copyright (C) 2014  richard
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "LPC11xx.h"
+#include <string.h>
+#include "estimator.h"
+#include "altitude.h"
+
+/**
+ **************************
+ Filter Parameters
+ *************************/
+
+/**
+ * How much of each residual goes into the altitude and the rate, out
+ * of 256. Critically damped: beta = alpha^2 / (2 - alpha).
+ */
+#define ESTIMATOR_ALPHA		64
+#define ESTIMATOR_BETA		9
+/**
+ * Readings further than this many spreads from the prediction are
+ * thrown away. The gate doubles for each reading thrown away in a row
+ * so the filter follows a real step, up to a limit.
+ */
+#define ESTIMATOR_GATE		4
+#define ESTIMATOR_MAX_REJECTS	6
+#define ESTIMATOR_MAX_GATE	5000000		/* mm */
+/**
+ * Limits on the spread, which tracks the sensor noise as it grows
+ * with altitude. The barometer only resolves a pascal, which is 8m at
+ * sea level.
+ */
+#define ESTIMATOR_MIN_SPREAD	5000		/* mm */
+#define ESTIMATOR_MAX_SPREAD	1000000		/* mm */
+/**
+ * Readings that have to agree before the estimate is trusted
+ */
+#define ESTIMATOR_SETTLE	3
+/**
+ * No balloon goes up or comes down faster than this
+ */
+#define ESTIMATOR_MAX_RATE	100000		/* mm/s */
+/**
+ * The estimate isn't trusted this long after the last good reading
+ */
+#define ESTIMATOR_TIMEOUT	30000		/* ms */
+/**
+ * Burst is when we've been falling faster than the rate, and are
+ * more than the drop below the highest point, for this many samples.
+ * Both grow with the spread so noise high up doesn't look like a burst.
+ */
+#define ESTIMATOR_BURST_RATE	-3000		/* mm/s */
+#define ESTIMATOR_BURST_DROP	200000		/* mm */
+#define ESTIMATOR_BURST_SAMPLES	10
+/**
+ * A GPS fix needs this many satellites to be used, and moves the bias
+ * by at most this much
+ */
+#define ESTIMATOR_GPS_SATELLITES 4
+#define ESTIMATOR_GPS_STEP	1000		/* mm */
+
+static int32_t clamp(int32_t value, int32_t limit) {
+  if (value > limit) return limit;
+  if (value < -limit) return -limit;
+  return value;
+}
+static int32_t absolute(int32_t value) {
+  return (value < 0) ? -value : value;
+}
+
+/**
+ * The barometric altitude in mm, or INT32_MIN for a nonsense pressure
+ */
+static int32_t measure(struct barometer* b) {
+  double altitude;
+
+  if (!b->valid || b->pressure <= 0) return INT32_MIN;
+
+  altitude = pressure_to_altitude(b->pressure);
+  if (altitude < -1000 || altitude > 100000) return INT32_MIN;
+
+  return (int32_t)(altitude * 1000);
+}
+
+/**
+ * Starts again from a single reading
+ */
+static void restart(struct estimator* e, int32_t measured) {
+  e->altitude = measured;
+  e->rate = 0;
+  e->spread = ESTIMATOR_MIN_SPREAD;
+  e->settled = 1;
+  e->rejects = 0;
+}
+
+void estimator_init(struct estimator* e) {
+  memset(e, 0, sizeof(struct estimator));
+  e->max_altitude = INT32_MIN;
+  e->since_accepted = ESTIMATOR_TIMEOUT + 1;
+}
+
+/**
+ * Takes a barometer reading dt ms after the last
+ */
+void estimator_update(struct estimator* e, struct barometer* b, uint32_t dt) {
+  int32_t measured, residual, gate;
+
+  if (dt == 0) return;
+
+  /* Predict */
+  e->altitude += (e->rate * (int32_t)dt) / 1000;
+  if (e->since_accepted <= ESTIMATOR_TIMEOUT) e->since_accepted += dt;
+
+  measured = measure(b);
+  if (measured == INT32_MIN) return;
+
+  if (e->settled == 0) {
+    restart(e, measured);
+    return;
+  }
+
+  /* Gate */
+  residual = measured - e->altitude;
+  gate = ESTIMATOR_GATE * e->spread;
+  if (e->settled < ESTIMATOR_SETTLE) {
+    /* We don't know the rate yet */
+    gate += (ESTIMATOR_MAX_RATE / 1000) * (int32_t)dt;
+  } else {
+    gate <<= e->rejects;
+  }
+  if (gate > ESTIMATOR_MAX_GATE) gate = ESTIMATOR_MAX_GATE;
+
+  if (absolute(residual) > gate) {
+    e->rejected++;
+    if (e->settled < ESTIMATOR_SETTLE) {
+      restart(e, measured);	/* It was the first reading that was bad */
+    } else if (e->rejects < ESTIMATOR_MAX_REJECTS) {
+      e->rejects++;
+    }
+    return;
+  }
+
+  /* Correct */
+  e->altitude += (residual * ESTIMATOR_ALPHA) / 256;
+  e->rate += (((residual * ESTIMATOR_BETA) / 256) * 1000) / (int32_t)dt;
+  e->rate = clamp(e->rate, ESTIMATOR_MAX_RATE);
+  e->spread += (absolute(residual) - e->spread) / 16;
+  if (e->spread < ESTIMATOR_MIN_SPREAD) e->spread = ESTIMATOR_MIN_SPREAD;
+  if (e->spread > ESTIMATOR_MAX_SPREAD) e->spread = ESTIMATOR_MAX_SPREAD;
+  e->rejects = 0;
+  e->since_accepted = 0;
+  if (e->settled < ESTIMATOR_SETTLE) {
+    e->settled++;
+    return;
+  }
+
+  /* Burst */
+  if (e->altitude > e->max_altitude) e->max_altitude = e->altitude;
+  if (e->rate < ESTIMATOR_BURST_RATE - (e->spread / 8) &&
+      e->max_altitude - e->altitude > ESTIMATOR_BURST_DROP + (2 * e->spread)) {
+    if (e->falling < ESTIMATOR_BURST_SAMPLES) e->falling++;
+    if (e->falling >= ESTIMATOR_BURST_SAMPLES) e->burst = 1;
+  } else {
+    e->falling = 0;
+  }
+}
+
+/**
+ * Moves the bias towards what the GPS says, if it has a fix. The
+ * first fix sets it. After that it only creeps, so a bad fix can't
+ * throw the altitude around.
+ */
+void estimator_gps(struct estimator* e, struct gps_data* gd) {
+  int32_t bias;
+
+  if (!estimator_valid(e)) return;
+  if (gd->satellites < ESTIMATOR_GPS_SATELLITES) return;
+  if (gd->altitude == 0 && gd->lat == 0 && gd->lon == 0) return; /* No fix */
+
+  bias = (gd->altitude * 1000) - e->altitude;
+
+  if (!e->have_bias) {
+    e->bias = bias;
+    e->have_bias = 1;
+  } else {
+    e->bias += clamp(bias - e->bias, ESTIMATOR_GPS_STEP);
+  }
+}
+
+/**
+ * Returns non-zero if the estimate can be trusted
+ */
+int estimator_valid(struct estimator* e) {
+  return e->settled >= ESTIMATOR_SETTLE &&
+    e->since_accepted <= ESTIMATOR_TIMEOUT;
+}
+/**
+ * Returns the altitude in mm, corrected by the GPS
+ */
+int32_t estimator_altitude(struct estimator* e) {
+  return e->altitude + e->bias;
+}
+/**
+ * Returns the vertical rate in mm/s, positive up
+ */
+int32_t estimator_rate(struct estimator* e) {
+  return e->rate;
+}
+
+#ifdef ESTIMATOR_TEST
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+/**
+ * Standard atmosphere below 11km
+ */
+int32_t test_pressure(double altitude) {
+  return (int32_t)(101325 * pow(1 - (altitude / 44330.8), 5.25588));
+}
+
+void check(int ok, const char* what) {
+  if (!ok) {
+    printf("\nERROR: %s\n", what);
+    exit(1);
+  }
+  printf("%s\n", what);
+}
+
+int main(void) {
+  struct estimator e;
+  struct barometer b = { 0, 0, 1 };
+  struct gps_data gd = { 51.5, -2.6, 0, 8 };
+  double altitude = 0;
+  int i;
+
+  printf("*** ESTIMATOR_TEST ***\n\n");
+
+  estimator_init(&e);
+  check(!estimator_valid(&e), "Not valid before any readings");
+
+  /* Climb at 5m/s, with a garbage reading every 50s */
+  for (i = 0; i < 600; i++) {
+    altitude += 5;
+    b.pressure = (i % 50 == 25) ? 30000 : test_pressure(altitude);
+    estimator_update(&e, &b, 1000);
+  }
+  printf("%dmm at %dmm/s, expected %dmm\n", estimator_altitude(&e),
+	 estimator_rate(&e), (int)(altitude * 1000));
+  check(estimator_valid(&e), "Valid while climbing");
+  check(abs(estimator_altitude(&e) - (int32_t)(altitude * 1000)) < 20000,
+	"Altitude within 20m");
+  check(abs(estimator_rate(&e) - 5000) < 500, "Rate within 0.5m/s");
+  check(e.rejected == 12, "Garbage readings thrown away");
+  check(!e.burst, "No burst while climbing");
+
+  /* GPS says we're 100m higher */
+  gd.altitude = altitude + 100;
+  estimator_gps(&e, &gd);
+  check(abs(estimator_altitude(&e) - (int32_t)(altitude * 1000) - 100000) < 20000,
+	"First GPS fix sets the bias");
+  gd.altitude = altitude + 5000;
+  estimator_gps(&e, &gd);
+  check(abs(estimator_altitude(&e) - (int32_t)(altitude * 1000) - 100000) < 25000,
+	"Bad GPS fix only creeps");
+
+  /* Burst, falling at 20m/s */
+  for (i = 0; i < 60; i++) {
+    altitude -= 20;
+    b.pressure = test_pressure(altitude);
+    estimator_update(&e, &b, 1000);
+  }
+  check(e.burst, "Burst seen");
+  check(abs(estimator_rate(&e) + 20000) < 2000, "Rate within 2m/s");
+
+  /* The barometer stops */
+  b.valid = 0;
+  for (i = 0; i < 31; i++) {
+    estimator_update(&e, &b, 1000);
+  }
+  check(!estimator_valid(&e), "Not valid once the barometer stops");
+
+  printf("\n*** DONE ***\n");
+
+  return 0;
+}
+
+#endif
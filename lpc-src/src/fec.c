@@ -0,0 +1,162 @@
+/*
+ * Convolutional coder and interleaver for the downlink
+ * Copyright (C) 2014  richard
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "LPC11xx.h"
+#include "fec.h"
+
+const uint8_t fec_table[1 << FEC_K] = {
+  0, 3, 2, 1, 0, 3, 2, 1, 3, 0, 1, 2, 3, 0, 1, 2,
+  3, 0, 1, 2, 3, 0, 1, 2, 0, 3, 2, 1, 0, 3, 2, 1,
+  1, 2, 3, 0, 1, 2, 3, 0, 2, 1, 0, 3, 2, 1, 0, 3,
+  2, 1, 0, 3, 2, 1, 0, 3, 1, 2, 3, 0, 1, 2, 3, 0,
+  3, 0, 1, 2, 3, 0, 1, 2, 0, 3, 2, 1, 0, 3, 2, 1,
+  0, 3, 2, 1, 0, 3, 2, 1, 3, 0, 1, 2, 3, 0, 1, 2,
+  2, 1, 0, 3, 2, 1, 0, 3, 1, 2, 3, 0, 1, 2, 3, 0,
+  1, 2, 3, 0, 1, 2, 3, 0, 2, 1, 0, 3, 2, 1, 0, 3,
+};
+
+static const uint8_t fec_sync[FEC_SYNC_SIZE] = FEC_SYNC;
+
+/**
+ * Returns byte i of the message with a zero byte in front of it and
+ * zeros after it, which is where the coder starts and how it's flushed
+ */
+static uint8_t fec_padded(const uint8_t* message, uint32_t length, uint32_t i) {
+  return (i >= 1 && i <= length) ? message[i - 1] : 0;
+}
+
+/**
+ * Returns coded bit c. Input bit k's window is bits k-6 to k, which
+ * is never more than two bytes of the padded message.
+ */
+static uint8_t fec_coded_bit(const uint8_t* message, uint32_t length, uint32_t c) {
+  uint32_t start = (c >> 1) + 2; // Bit k-6 in the padded message
+  uint32_t byte = start >> 3;
+  uint16_t pair = (fec_padded(message, length, byte) << 8) |
+    fec_padded(message, length, byte + 1);
+  uint8_t window = (pair >> (16 - FEC_K - (start & 7))) & ((1 << FEC_K) - 1);
+
+  return (fec_table[window] >> (c & 1)) & 1;
+}
+
+/**
+ * Returns byte i of the packet for a message. Each byte comes straight
+ * from the message, so a packet can be sent as it's encoded without a
+ * copy of it anywhere.
+ */
+uint8_t fec_packet_byte(const uint8_t* message, uint32_t length, uint32_t index) {
+  uint32_t coded = FEC_CODED_BITS(length);
+  uint32_t columns = FEC_SENT_BITS(length) / FEC_ROWS;
+  uint32_t i, b;
+  uint8_t byte = 0;
+
+  if (index < FEC_SYNC_SIZE) {
+    return fec_sync[index];
+  } else if (index < FEC_HEADER_SIZE) {
+    return length;
+  }
+
+  /* Sent bit i is row i % FEC_ROWS of column i / FEC_ROWS, MSB first */
+  i = (index - FEC_HEADER_SIZE) * 8;
+  for (b = 0; b < 8; b++, i++) {
+    uint32_t c = ((i % FEC_ROWS) * columns) + (i / FEC_ROWS);
+
+    byte <<= 1;
+    if (c < coded) {
+      byte |= fec_coded_bit(message, length, c);
+    }
+  }
+
+  return byte;
+}
+
+/**
+ * Encodes a message into a packet.
+ *
+ * Returns the length of the packet, or 0 if the message is too long
+ * or the packet won't fit.
+ */
+uint32_t fec_encode(const uint8_t* message, uint32_t length,
+		    uint8_t* packet, uint32_t size) {
+  uint32_t i;
+
+  if (length > FEC_MAX_MESSAGE || FEC_PACKET_SIZE(length) > size) {
+    return 0;
+  }
+
+  for (i = 0; i < FEC_PACKET_SIZE(length); i++) {
+    packet[i] = fec_packet_byte(message, length, i);
+  }
+
+  return FEC_PACKET_SIZE(length);
+}
+
+#ifdef FEC_TEST
+
+#include <stdio.h>
+#include <string.h>
+
+int main(void) {
+  printf("*** FEC_TEST ***\n\n");
+
+  /* The coder's impulse response is the two polynomials, newest first */
+  uint8_t one = 0x80, packet[FEC_PACKET_SIZE(FEC_MAX_MESSAGE)];
+  uint32_t length = fec_encode(&one, 1, packet, sizeof(packet));
+  uint32_t c, columns = FEC_SENT_BITS(1) / FEC_ROWS;
+  uint16_t a = 0, b = 0;
+
+  printf("1 byte: %u byte packet\n", length);
+  for (c = 0; c < 2 * FEC_K; c++) {
+    uint32_t i = ((c % columns) * FEC_ROWS) + (c / columns);
+    uint8_t bit = (packet[FEC_HEADER_SIZE + (i / 8)] >> (7 - (i % 8))) & 1;
+
+    if (c & 1) b |= bit << (c / 2); else a |= bit << (c / 2);
+  }
+  printf("Impulse response %02X %02X\n", a, b);
+  if (a != FEC_POLY_A || b != FEC_POLY_B || length != FEC_HEADER_SIZE + 4) {
+    printf("ERROR: Wrong code\n");
+    return 1;
+  }
+
+  /* A frame encodes to the size we expect and is flushed to zero */
+  const char* frame = "$$BUSEDS1,40,10:00:38,51.820803,-0.008398,185,9,"
+    "185.0,4.8,13.8,39.9,0,0,0,179,6.0,72#F203";
+  length = fec_encode((const uint8_t*)frame, strlen(frame), packet, sizeof(packet));
+  printf("%u byte frame: %u byte packet\n", (unsigned)strlen(frame), length);
+  if (length != FEC_PACKET_SIZE(strlen(frame)) ||
+      memcmp(packet, (uint8_t[])FEC_SYNC, FEC_SYNC_SIZE) ||
+      packet[FEC_SYNC_SIZE] != strlen(frame)) {
+    printf("ERROR: Bad packet\n");
+    return 1;
+  }
+  if (fec_encode((const uint8_t*)frame, strlen(frame), packet, length - 1)) {
+    printf("ERROR: Overran the packet\n");
+    return 1;
+  }
+
+  printf("\n*** DONE ***\n");
+  return 0;
+}
+
+#endif
@@ -0,0 +1,187 @@
+/*
+ * Numbers to and from text without stdio
+ * Copyright (C) 2014  richard
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "LPC11xx.h"
+#include <stddef.h>
+#include "fmt.h"
+
+/**
+ * Prints u with a decimal point precision places from the right, and
+ * at least one digit before it
+ */
+char* fmt_unsigned(char* p, uint32_t u, int precision) {
+  char digits[12];
+  int n = 0;
+
+  do {
+    digits[n++] = '0' + (u % 10); u /= 10;
+  } while (u || n <= precision);
+
+  while (n) {
+    *p++ = digits[--n];
+    if (n && n == precision) *p++ = '.';
+  }
+  return p;
+}
+/**
+ * The same signed, after dividing by divisor to the nearest
+ */
+char* fmt_signed(char* p, int32_t v, int32_t divisor, int precision) {
+  if (divisor > 1) {
+    v = (v + ((v < 0) ? -(divisor / 2) : (divisor / 2))) / divisor;
+  }
+  if (v < 0) {
+    *p++ = '-';
+    return fmt_unsigned(p, -(uint32_t)v, precision);
+  }
+  return fmt_unsigned(p, v, precision);
+}
+/**
+ * Prints the bottom digits of v in upper case hex
+ */
+char* fmt_hex(char* p, uint32_t v, int digits) {
+  static const char hex[] = "0123456789ABCDEF";
+
+  while (digits--) {
+    *p++ = hex[(v >> (digits * 4)) & 0xF];
+  }
+  return p;
+}
+
+/**
+ * Skips the white space before a number, which doesn't count towards
+ * its width
+ */
+static const char* skip_space(const char* p) {
+  while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n') p++;
+  return p;
+}
+static int hex_digit(char c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+const char* fmt_parse_int(const char* p, int width, int* value) {
+  const char* start;
+  int negative = 0, v = 0;
+
+  p = skip_space(p);
+  if (width == 0) width = -1;
+
+  if (*p == '-' || *p == '+') {
+    if (width == 1) return NULL;
+    negative = (*p++ == '-');
+    width--;
+  }
+  for (start = p; width && *p >= '0' && *p <= '9'; width--) {
+    v = (v * 10) + (*p++ - '0');
+  }
+  if (p == start) return NULL;
+
+  *value = negative ? -v : v;
+  return p;
+}
+const char* fmt_parse_hex(const char* p, int width, unsigned* value) {
+  const char* start;
+  unsigned v = 0;
+
+  p = skip_space(p);
+  if (width == 0) width = -1;
+
+  for (start = p; width && hex_digit(*p) >= 0; width--) {
+    v = (v << 4) | hex_digit(*p++);
+  }
+  if (p == start) return NULL;
+
+  *value = v;
+  return p;
+}
+
+#ifdef FMT_TEST
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Checks what a writer wrote
+ */
+#define CHECK(call, expected) do {					\
+    char out[20];							\
+    *call = '\0';							\
+    if (strcmp(out, expected)) {					\
+      printf("%s gave %s not %s\n", #call, out, expected); exit(1);	\
+    }									\
+  } while (0)
+
+int main(void) {
+  int i, value, count;
+  unsigned hex;
+  const char* p;
+
+  printf("*** FMT_TEST ***\n\n");
+
+  CHECK(fmt_unsigned(out, 0, 0), "0");
+  CHECK(fmt_unsigned(out, 4294967295U, 0), "4294967295");
+  CHECK(fmt_unsigned(out, 5, 2), "0.05");
+  CHECK(fmt_unsigned(out, 51804525, 6), "51.804525");
+  CHECK(fmt_signed(out, -2147483647 - 1, 1, 0), "-2147483648");
+  CHECK(fmt_signed(out, -551, 1, 1), "-55.1");
+  CHECK(fmt_signed(out, 5049, 100, 1), "5.0");
+  CHECK(fmt_signed(out, -5050, 100, 1), "-5.1");
+  CHECK(fmt_hex(out, 0x9C03, 4), "9C03");
+  CHECK(fmt_hex(out, 0xA, 4), "000A");
+
+  /* The readers match sscanf on what the GPS and IMU send */
+  static const char* numbers[] = {
+    "0", "123", "-45", "+7", "  12", "123456", "0059", "-", "x1", ",5", ""
+  };
+  for (i = 0; i < (int)(sizeof(numbers) / sizeof(numbers[0])); i++) {
+    int width;
+    for (width = 0; width <= 3; width++) {
+      int expect = -1;
+      char format[8];
+
+      if (width) snprintf(format, 8, "%%%dd", width); else strcpy(format, "%d");
+      count = sscanf(numbers[i], format, &expect);
+      value = -1;
+      p = fmt_parse_int(numbers[i], width, &value);
+      assert((p != NULL) == (count == 1));
+      assert(value == expect);
+    }
+  }
+  p = fmt_parse_hex("9c*", 2, &hex);
+  assert(p && *p == '*' && hex == 0x9C);
+  p = fmt_parse_hex("F1F", 2, &hex);
+  assert(p && *p == 'F' && hex == 0xF1);
+  assert(fmt_parse_hex("*", 2, &hex) == NULL);
+
+  printf("\n*** DONE ***\n");
+  return 0;
+}
+
+#endif
@@ -24,8 +24,9 @@
 
 #include "LPC11xx.h"
 #include <string.h>
-#include <stdio.h>
 #include "gps.h"
+#include "fmt.h"
+#include "uart.h"
 
 int access_flag = 0;
 
@@ -33,7 +34,7 @@ struct gps_data gps_data;
 struct gps_time gps_time;
 
 int check_gps_frame(char* frame) {
-  int checksum = 0, frame_checksum;
+  unsigned checksum = 0, frame_checksum = 0x100;
 
   /* Skip dollar preamble */
   while (*frame == '$') {
@@ -49,7 +50,7 @@ int check_gps_frame(char* frame) {
   frame++;
 
   /* Parse the frame checksum */
-  sscanf(frame, "%2x", &frame_checksum);
+  fmt_parse_hex(frame, 2, &frame_checksum);
 
   /* Debug */
   //printf("C = 0x%x, FC = 0x%x\n", checksum, frame_checksum);
@@ -57,14 +58,33 @@ int check_gps_frame(char* frame) {
   return (checksum == frame_checksum) ? 1 : 0;
 }
 
+/**
+ * Parses degrees and minutes, with the fraction of a minute after the
+ * decimal point. Returns NULL if any of it's missing.
+ */
+static const char* parse_degrees(const char* p, int degree_digits,
+				 int* degrees, int* minutes, int* fraction) {
+  p = fmt_parse_int(p, degree_digits, degrees);
+  if (p) p = fmt_parse_int(p, 2, minutes);
+  if (p && *p == '.') return fmt_parse_int(p + 1, 0, fraction);
+  return NULL;
+}
+/**
+ * Returns the start of the field after this one, or NULL if the
+ * sentence ends first
+ */
+static char* next_field(char* frame) {
+  frame = strchr(frame, ',');
+  return frame ? frame + 1 : NULL;
+}
 /**
  * Processes a single NMEA GPS frame.
  */
 int process_gps_frame(char* frame) {
-  int frac_seconds;
-  int lat_deg, lat_min, lat_frac_min;
-  int long_deg, long_min, long_frac_min;
-  int fi;
+  const char* p;
+  int lat_deg = 0, lat_min = 0, lat_frac_min = 0;
+  int long_deg = 0, long_min = 0, long_frac_min = 0;
+  int fi = 0;
 
   if (strncmp(frame, "$GPGGA", 6)) {
     return 1;			/* String starts wrong */
@@ -75,53 +95,54 @@ int process_gps_frame(char* frame) {
   }
 
   /* Next field */
-  frame = strchr(frame, ','); frame++;
+  if (!(frame = next_field(frame))) return 1;
   /* Time of day */
-  sscanf(frame, "%2d%2d%2d.%d", &gps_time.hours, &gps_time.minutes,
-	 &gps_time.seconds, &frac_seconds);
+  p = fmt_parse_int(frame, 2, &gps_time.hours);
+  if (p) p = fmt_parse_int(p, 2, &gps_time.minutes);
+  if (p) fmt_parse_int(p, 2, &gps_time.seconds);
 
   /* Next field */
-  frame = strchr(frame, ','); frame++;
+  if (!(frame = next_field(frame))) return 1;
   /* Latitude */
-  sscanf(frame, "%2d%2d.%d", &lat_deg, &lat_min, &lat_frac_min);
+  parse_degrees(frame, 2, &lat_deg, &lat_min, &lat_frac_min);
   gps_data.lat = lat_deg;
   gps_data.lat += (float)lat_min / 60;
   gps_data.lat += (float)lat_frac_min / (60 * 10000);
 
   /* Next field */
-  frame = strchr(frame, ','); frame++;
+  if (!(frame = next_field(frame))) return 1;
   if (frame[0] == 'S') gps_data.lat *= -1;
 
   /* Next field */
-  frame = strchr(frame, ','); frame++;
+  if (!(frame = next_field(frame))) return 1;
   /* Longitude */
-  sscanf(frame, "%3d%2d.%d", &long_deg, &long_min, &long_frac_min);
+  parse_degrees(frame, 3, &long_deg, &long_min, &long_frac_min);
   gps_data.lon = long_deg;
   gps_data.lon += (float)long_min / 60;
   gps_data.lon += (float)long_frac_min / (60 * 10000);
 
   /* Next field */
-  frame = strchr(frame, ','); frame++;
+  if (!(frame = next_field(frame))) return 1;
   if (frame[0] == 'W') gps_data.lon *= -1;
 
   /* Next field */
-  frame = strchr(frame, ','); frame++;
+  if (!(frame = next_field(frame))) return 1;
   /* Fix Indicator */
-  sscanf(frame, "%d", &fi);
+  fmt_parse_int(frame, 0, &fi);
 
   /* Next field */
-  frame = strchr(frame, ','); frame++;
+  if (!(frame = next_field(frame))) return 1;
   /* Satellites */
-  sscanf(frame, "%d", &gps_data.satellites);
+  fmt_parse_int(frame, 0, &gps_data.satellites);
 
   /* Next field */
-  frame = strchr(frame, ','); frame++;
+  if (!(frame = next_field(frame))) return 1;
   /* HDOP: IGNORE */
 
   /* Next field */
-  frame = strchr(frame, ','); frame++;
+  if (!(frame = next_field(frame))) return 1;
   /* Altitude */
-  sscanf(frame, "%d", &gps_data.altitude);
+  fmt_parse_int(frame, 0, &gps_data.altitude);
 
   if (fi == 0) { // No lock
     gps_data.lat = 0; gps_data.lon = 0;
@@ -143,6 +164,161 @@ void get_gps_time(struct gps_time* time) {
   access_flag = 0;		/* Clear the flag */
 }
 
+#ifdef GPS_UBX
+
+#if GPS_UBX_RATE_HZ < 1 || GPS_UBX_RATE_HZ > 5
+#error "GPS_UBX_RATE_HZ is 1 to 5"
+#endif
+#if defined(GPS_UBX_POWER_SAVE) && GPS_UBX_RATE_HZ != 1
+#error "GPS_UBX_POWER_SAVE needs GPS_UBX_RATE_HZ at 1"
+#endif
+
+/**
+ * UBX in and out on the UART at the same baud rate, which turns off
+ * every NMEA sentence
+ */
+static const uint8_t cfg_prt[] = {
+  1, 0, UBX_U16(0),		/* UART1 */
+  UBX_U32(0x08C0),		/* 8N1 */
+  UBX_U32(GPS_UBX_BAUD),
+  UBX_U16(0x0003),		/* In UBX and NMEA */
+  UBX_U16(0x0001),		/* Out UBX */
+  UBX_U16(0), UBX_U16(0)
+};
+/**
+ * The airborne <1g dynamic model, which still makes fixes above 12km.
+ * The default portable model gives up there. Only the model's changed.
+ */
+static const uint8_t cfg_nav5[36] = {
+  UBX_U16(0x0001),		/* Apply the dynamic model */
+  6,				/* Airborne <1g */
+};
+static const uint8_t cfg_rate[] = {
+  UBX_U16(1000 / GPS_UBX_RATE_HZ), /* ms */
+  UBX_U16(1),			/* A fix every measurement */
+  UBX_U16(1)			/* GPS time */
+};
+static const uint8_t cfg_msg_pvt[] = {
+  UBX_NAV, UBX_NAV_PVT, 1	/* Every fix */
+};
+#ifdef GPS_UBX_POWER_SAVE
+static const uint8_t cfg_rxm[] = {
+  8, 1				/* Power save */
+};
+#endif
+
+static const struct ubx_message gps_config[] = {
+  { UBX_CFG, UBX_CFG_PRT, sizeof(cfg_prt), cfg_prt },
+  { UBX_CFG, UBX_CFG_NAV5, sizeof(cfg_nav5), cfg_nav5 },
+  { UBX_CFG, UBX_CFG_RATE, sizeof(cfg_rate), cfg_rate },
+  { UBX_CFG, UBX_CFG_MSG, sizeof(cfg_msg_pvt), cfg_msg_pvt },
+#ifdef GPS_UBX_POWER_SAVE
+  { UBX_CFG, UBX_CFG_RXM, sizeof(cfg_rxm), cfg_rxm },
+#endif
+};
+#define GPS_CONFIG_COUNT	(sizeof(gps_config) / sizeof(gps_config[0]))
+#define GPS_CONFIG_ANSWERED	((1 << GPS_CONFIG_COUNT) - 1)
+
+/**
+ * Which configuration messages have been answered, one bit each, and
+ * whether a NAV-PVT came since the last gps_poll(). Both from the
+ * UART interrupt.
+ */
+volatile uint8_t gps_answered = 0;
+volatile uint8_t gps_pvt_seen = 0;
+uint8_t gps_quiet = 0;
+/**
+ * Configuration messages the receiver refused
+ */
+volatile uint8_t gps_refused = 0;
+
+/**
+ * An ACK or a NAK answers a configuration message. Sending one it's
+ * refused again won't help, so that's as good as an ACK.
+ */
+static void process_ack(const struct ubx_parser* p) {
+  uint8_t i;
+
+  if (p->length != 2) return;
+
+  for (i = 0; i < GPS_CONFIG_COUNT; i++) {
+    if (p->payload[0] == gps_config[i].cls && p->payload[1] == gps_config[i].id) {
+      gps_answered |= 1 << i;
+      if (p->id == UBX_ACK_NAK) gps_refused |= 1 << i;
+    }
+  }
+}
+/**
+ * The time, and the position if there's a 3D fix. Without one it's
+ * zeros, as with NMEA.
+ */
+static void process_nav_pvt(const uint8_t* pvt) {
+  uint8_t fix = pvt[UBX_PVT_FIX_TYPE];
+
+  if (pvt[UBX_PVT_VALID] & UBX_PVT_VALID_TIME) {
+    gps_time.hours = pvt[UBX_PVT_HOUR];
+    gps_time.minutes = pvt[UBX_PVT_MIN];
+    gps_time.seconds = pvt[UBX_PVT_SEC];
+  }
+
+  gps_data.satellites = pvt[UBX_PVT_NUM_SV];
+
+  if ((pvt[UBX_PVT_FLAGS] & UBX_PVT_FIX_OK) && (fix == 3 || fix == 4)) {
+    gps_data.lat = (int32_t)ubx_u32(pvt + UBX_PVT_LAT) * 1e-7;
+    gps_data.lon = (int32_t)ubx_u32(pvt + UBX_PVT_LON) * 1e-7;
+    gps_data.altitude = (int32_t)ubx_u32(pvt + UBX_PVT_HMSL) / 1000;
+  } else { // No lock
+    gps_data.lat = 0; gps_data.lon = 0;
+    gps_data.altitude = 0;
+  }
+
+  gps_pvt_seen = 1;
+}
+/**
+ * Processes a message from the parser, which has already checked it.
+ * Called from the UART interrupt.
+ */
+void process_ubx_message(const struct ubx_parser* p) {
+  if (p->cls == UBX_NAV && p->id == UBX_NAV_PVT &&
+      p->length >= UBX_PAYLOAD_KEPT) {
+    process_nav_pvt(p->payload);
+  } else if (p->cls == UBX_ACK) {
+    process_ack(p);
+  }
+}
+
+/**
+ * Call once a pass of the main loop. Sends the configuration until
+ * every message in it's been answered, and again if the NAV-PVTs
+ * stop, as the receiver forgets it all when it loses power.
+ */
+void gps_poll(void) {
+  if (gps_pvt_seen) {
+    gps_pvt_seen = 0;
+    gps_quiet = 0;
+  } else if (gps_quiet < GPS_UBX_TIMEOUT) {
+    gps_quiet++;
+  }
+
+  if (gps_quiet == GPS_UBX_TIMEOUT) {
+    gps_answered = 0;
+  }
+
+  if (gps_answered != GPS_CONFIG_ANSWERED && !uart_sending()) {
+    uart_send_ubx(gps_config, GPS_CONFIG_COUNT);
+  }
+}
+
+#else
+
+/**
+ * The EM406 needs no configuration
+ */
+void gps_poll(void) {
+}
+
+#endif
+
 #ifdef GPS_TEST
 
 // Test Dependancies
@@ -171,6 +347,125 @@ void delta_assert(double x, double y) {
   }
 }
 
+/**
+ * Wraps a sentence body in the $ and checksum
+ */
+void nmea_sentence(char* out, const char* body) {
+  unsigned checksum = 0;
+  const char* c;
+
+  for (c = body; *c; c++) checksum ^= *c;
+  sprintf(out, "$%s*%02X\r\n", body, checksum);
+}
+
+#ifdef GPS_UBX
+
+/**
+ * What the UART was asked to send
+ */
+int test_sent = 0, test_sending = 0;
+
+uint8_t uart_sending(void) {
+  return test_sending;
+}
+void uart_send_ubx(const struct ubx_message* list, uint8_t count) {
+  (void)list;
+  test_sent += count;
+}
+
+/**
+ * Frames a message and feeds it through the parser
+ */
+int test_ubx(uint8_t cls, uint8_t id, const uint8_t* payload, uint16_t length) {
+  struct ubx_message m = { cls, id, length, payload };
+  struct ubx_writer w;
+  struct ubx_parser p;
+  int c, messages = 0;
+
+  ubx_parser_init(&p);
+  ubx_writer_init(&w, &m, 1);
+  while ((c = ubx_writer_next(&w)) >= 0) {
+    if (ubx_parse(&p, c)) {
+      process_ubx_message(&p);
+      messages++;
+    }
+  }
+  return messages;
+}
+void test_ack(uint8_t id, uint8_t cfg_id) {
+  uint8_t ack[2] = { UBX_CFG, cfg_id };
+  assert(test_ubx(UBX_ACK, id, ack, sizeof(ack)) == 1);
+}
+
+void test_gps_ubx(void) {
+  uint8_t pvt[UBX_PVT_LENGTH] = { 0 };
+  int i;
+
+  printf("\nTesting UBX\n");
+
+  /* 10:13:10, a 3D fix at 24km */
+  pvt[UBX_PVT_HOUR] = 10; pvt[UBX_PVT_MIN] = 13; pvt[UBX_PVT_SEC] = 10;
+  pvt[UBX_PVT_VALID] = UBX_PVT_VALID_TIME;
+  pvt[UBX_PVT_FIX_TYPE] = 3;
+  pvt[UBX_PVT_FLAGS] = UBX_PVT_FIX_OK;
+  pvt[UBX_PVT_NUM_SV] = 11;
+  ubx_put_u32(pvt + UBX_PVT_LAT, 518005370);
+  ubx_put_u32(pvt + UBX_PVT_LON, (uint32_t)-1268000);
+  ubx_put_u32(pvt + UBX_PVT_HMSL, 24003999);
+  assert(test_ubx(UBX_NAV, UBX_NAV_PVT, pvt, sizeof(pvt)) == 1);
+  delta_assert(gps_data.lat, 51.800537);
+  delta_assert(gps_data.lon, -0.1268);
+  assert(gps_data.altitude == 24003 && gps_data.satellites == 11);
+  assert(gps_time.hours == 10 && gps_time.minutes == 13 && gps_time.seconds == 10);
+  printf("NAV-PVT: %f, %f, %dm\n", gps_data.lat, gps_data.lon, gps_data.altitude);
+
+  /* A u-blox 7's is shorter but the same as far as we read */
+  pvt[UBX_PVT_SEC] = 11;
+  assert(test_ubx(UBX_NAV, UBX_NAV_PVT, pvt, 84) == 1);
+  assert(gps_time.seconds == 11 && gps_data.altitude == 24003);
+
+  /* No fix is zeros, and a 2D fix isn't good enough */
+  pvt[UBX_PVT_FIX_TYPE] = 2;
+  assert(test_ubx(UBX_NAV, UBX_NAV_PVT, pvt, sizeof(pvt)) == 1);
+  assert(gps_data.lat == 0 && gps_data.lon == 0 && gps_data.altitude == 0);
+  pvt[UBX_PVT_FIX_TYPE] = 3;
+  pvt[UBX_PVT_FLAGS] = 0;
+  assert(test_ubx(UBX_NAV, UBX_NAV_PVT, pvt, sizeof(pvt)) == 1);
+  assert(gps_data.lat == 0 && gps_data.satellites == 11);
+
+  /* The configuration goes until it's all answered */
+  gps_poll();
+  assert(test_sent == GPS_CONFIG_COUNT);
+  test_ack(UBX_ACK_ACK, UBX_CFG_PRT);
+  test_ack(UBX_ACK_ACK, UBX_CFG_NAV5);
+  gps_poll();
+  assert(test_sent == 2 * GPS_CONFIG_COUNT);
+  test_ack(UBX_ACK_ACK, UBX_CFG_RATE);
+  test_ack(UBX_ACK_NAK, UBX_CFG_MSG);
+#ifdef GPS_UBX_POWER_SAVE
+  test_ack(UBX_ACK_ACK, UBX_CFG_RXM);
+#endif
+  assert(gps_answered == GPS_CONFIG_ANSWERED && gps_refused == 1 << 3);
+
+  /* Then it's quiet while the NAV-PVTs come */
+  for (i = 0; i < 2 * GPS_UBX_TIMEOUT; i++) {
+    assert(test_ubx(UBX_NAV, UBX_NAV_PVT, pvt, sizeof(pvt)) == 1);
+    gps_poll();
+  }
+  assert(test_sent == 2 * GPS_CONFIG_COUNT);
+
+  /* And again when they stop, but not while it's still sending */
+  test_sending = 1;
+  for (i = 0; i < GPS_UBX_TIMEOUT; i++) gps_poll();
+  assert(test_sent == 2 * GPS_CONFIG_COUNT && gps_answered == 0);
+  test_sending = 0;
+  gps_poll();
+  assert(test_sent == 3 * GPS_CONFIG_COUNT);
+  printf("Configuration sent %d times\n", test_sent / (int)GPS_CONFIG_COUNT);
+}
+
+#endif
+
 int main(void) {
   printf("*** GPS_TEST ***\n");
 
@@ -220,6 +515,22 @@ int main(void) {
     printf("Failed to load sample data\n");
   }
 
+  /* A whole sentence, and one that stops early but checks out */
+  char sentence[0x100];
+  nmea_sentence(sentence, "GPGGA,101310.000,5148.0322,N,00007.6080,W,1,09,1.0,24003.9,M,47.0,M,,0000");
+  assert(process_gps_frame(sentence) == 0);
+  delta_assert(gps_data.lat, 51.800537);
+  delta_assert(gps_data.lon, -0.1268);
+  assert(gps_data.altitude == 24003 && gps_data.satellites == 9);
+  nmea_sentence(sentence, "GPGGA,101311.000,5148.0322,N");
+  assert(process_gps_frame(sentence) == 1);
+  assert(gps_time.seconds == 11 && gps_data.altitude == 24003);
+  printf("\nTruncated sentence rejected\n");
+
+#ifdef GPS_UBX
+  test_gps_ubx();
+#endif
+
   printf("\n*** DONE ***\n");
 }
 
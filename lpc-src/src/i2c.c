@@ -18,6 +18,8 @@
  *****************************************************************************/
 #include "LPC11xx.h"
 #include "i2c.h"
+#include "profile.h"
+#include "clock.h"
 
 volatile uint32_t I2CMasterState = I2CSTATE_IDLE;
 
@@ -30,6 +32,72 @@ volatile uint32_t I2CWriteLength;
 volatile uint32_t RdIndex;
 volatile uint32_t WrIndex;
 
+/* Where reads go, I2CSlaveBuffer or a transfer's own buffer */
+volatile uint8_t* RdBuffer = I2CSlaveBuffer;
+/* The rest of a list of transfers, see i2c_transfer() */
+static const struct i2c_transfer* volatile TransferNext;
+static volatile uint8_t TransfersLeft;
+
+/* The SCL rate from i2c_set_speed() */
+static uint32_t SclHz;
+
+/* I2CMODE in the IOCON registers for PIO0_4 and PIO0_5 */
+#define IOCON_I2CMODE			(0x3 << 8)
+#define IOCON_I2CMODE_FAST_PLUS		(0x2 << 8)
+
+#define SCL_BIT				(1 << I2C_SCL_PIN)
+#define SDA_BIT				(1 << I2C_SDA_PIN)
+
+static uint32_t i2c_run(void);
+static uint32_t i2c_begin(void);
+
+/*****************************************************************************
+ ** Function name:		i2c_load
+ **
+ ** Descriptions:		Sets the buffers up for a transfer, as they
+ **				would be for i2c_engine()
+ **
+ *****************************************************************************/
+static void i2c_load(const struct i2c_transfer* t) {
+  uint8_t i;
+
+  I2CMasterBuffer[0] = t->address;
+  I2CMasterBuffer[1] = t->reg;
+  if (t->write) {
+    for (i = 0; i < t->length; i++) {
+      I2CMasterBuffer[2 + i] = t->buffer[i];
+    }
+    I2CWriteLength = 2 + t->length;
+    I2CReadLength = 0;
+  } else {
+    I2CMasterBuffer[2] = t->address | RD_BIT;
+    I2CWriteLength = 2;
+    I2CReadLength = t->length;
+  }
+  RdBuffer = t->buffer;
+  RdIndex = 0;
+  WrIndex = 0;
+}
+
+/*****************************************************************************
+ ** Function name:		i2c_done
+ **
+ ** Descriptions:		Called from the interrupt when a transfer's
+ **				finished. Starts the next one in the list
+ **				with a repeated START, or stops.
+ **
+ *****************************************************************************/
+static void i2c_done(void) {
+  if (TransfersLeft) {
+    TransfersLeft--;
+    i2c_load(TransferNext++);
+    LPC_I2C->CONSET = I2CONSET_STA;	/* Handled in state 0x10 */
+  } else {
+    I2CMasterState = I2CSTATE_ACK;
+    LPC_I2C->CONSET = I2CONSET_STO;	/* Set Stop flag */
+  }
+}
+
 /*****************************************************************************
  ** Function name:		I2C_IRQHandler
  **
@@ -41,6 +109,7 @@ volatile uint32_t WrIndex;
  *****************************************************************************/
 void I2C_IRQHandler(void) {
   uint8_t StatValue;
+  PROFILE_START(isr_start);
 
   /* this handler deals with master read and master write only */
   StatValue = LPC_I2C->STAT;
@@ -63,7 +132,9 @@ void I2C_IRQHandler(void) {
       /*
        * A repeated START condition has been transmitted.
        * Now a second, read, transaction follows so we
-       * initialize the read buffer.
+       * initialize the read buffer. Or it's the next
+       * transfer in a list, which i2c_done() has loaded,
+       * and this sends its SLA+W.
        */
       RdIndex = 0;
       /* Send SLA with R bit set, */
@@ -112,8 +183,7 @@ void I2C_IRQHandler(void) {
 	}
 	else
 	{
-	  I2CMasterState = I2CSTATE_ACK;
-	  LPC_I2C->CONSET = I2CONSET_STO;      /* Set Stop flag */
+	  i2c_done();
 	}
       }
       LPC_I2C->CONCLR = I2CONCLR_SIC;
@@ -179,7 +249,7 @@ void I2C_IRQHandler(void) {
        * Read the byte and check for more bytes to read.
        * Send a NOT ACK after the last byte is received
        */
-      I2CSlaveBuffer[RdIndex++] = LPC_I2C->DAT;
+      RdBuffer[RdIndex++] = LPC_I2C->DAT;
       if ( RdIndex < (I2CReadLength-1) )
       {
 	/* lmore bytes to follow: send an ACK after data is received */
@@ -198,11 +268,10 @@ void I2C_IRQHandler(void) {
        * Data byte has been received; NOT ACK has been returned.
        * This is the last byte to read.
        * Generate a STOP condition and flag the I2CEngine that the
-       * transaction is finished.
+       * transaction is finished, unless there's another in the list.
        */
-      I2CSlaveBuffer[RdIndex++] = LPC_I2C->DAT;
-      I2CMasterState = I2CSTATE_ACK;
-      LPC_I2C->CONSET = I2CONSET_STO;	/* Set Stop flag */
+      RdBuffer[RdIndex++] = LPC_I2C->DAT;
+      i2c_done();
       LPC_I2C->CONCLR = I2CONCLR_SIC;	/* Clear SI flag */
       break;
 
@@ -210,6 +279,8 @@ void I2C_IRQHandler(void) {
       LPC_I2C->CONCLR = I2CONCLR_SIC;
       break;
   }
+
+  PROFILE_END(PROFILE_ISR_I2C, isr_start);
   return;
 }
 
@@ -233,6 +304,7 @@ static uint32_t i2c_start(void) {
   while((I2CMasterState != I2CSTATE_PENDING) && (timeout < MAX_TIMEOUT))
   {
     timeout++;
+    __NOP();
   }
 
   return (timeout < MAX_TIMEOUT);
@@ -261,6 +333,62 @@ static uint32_t i2c_stop(void) {
   return (timeout < MAX_TIMEOUT);
 }
 
+/*****************************************************************************
+ ** Function name:	i2c_set_rate
+ **
+ ** Descriptions:	Sets SCLL and SCLH for the chosen speed from the
+ **			core clock. Neither can be less than 4.
+ **
+ *****************************************************************************/
+static void i2c_set_rate(void) {
+  uint32_t period = (SystemCoreClock + SclHz - 1) / SclHz;
+  uint32_t high = (SclHz > 100000) ? (period * 2) / 5 : period / 2;
+
+  if (high < 4) high = 4;
+  LPC_I2C->SCLH   = high;
+  LPC_I2C->SCLL   = (period - high < 4) ? 4 : period - high;
+}
+
+/*****************************************************************************
+ ** Function name:	i2c_clock_changed
+ **
+ ** Descriptions:	Sets the rate again for a new core clock, turning
+ **			the clock to the block on for long enough if
+ **			it's gated
+ **
+ *****************************************************************************/
+static void i2c_clock_changed(void) {
+  uint32_t gated = !(LPC_SYSCON->SYSAHBCLKCTRL & 0x20);
+
+  if (gated) clock_syscon(CLOCK_AHB, 0x20, 0);
+  i2c_set_rate();
+  if (gated) clock_syscon(CLOCK_AHB, 0, 0x20);
+}
+
+/*****************************************************************************
+ ** Function name:	i2c_set_speed
+ **
+ ** Descriptions:	Chooses 100kHz, 400kHz or Fast-mode Plus. Can
+ **			be called at any time between transactions.
+ **
+ ** parameters:		I2C_SPEED_STANDARD, I2C_SPEED_FAST or
+ **			I2C_SPEED_FAST_PLUS
+ **
+ *****************************************************************************/
+void i2c_set_speed(uint8_t speed) {
+  uint32_t mode = (speed == I2C_SPEED_FAST_PLUS) ? IOCON_I2CMODE_FAST_PLUS : 0;
+
+  switch (speed) {
+    case I2C_SPEED_STANDARD:	SclHz = 100000; break;
+    case I2C_SPEED_FAST_PLUS:	SclHz = 1000000; break;
+    default:			SclHz = 400000; break;
+  }
+
+  LPC_IOCON->PIO0_4 = (LPC_IOCON->PIO0_4 & ~IOCON_I2CMODE) | mode;
+  LPC_IOCON->PIO0_5 = (LPC_IOCON->PIO0_5 & ~IOCON_I2CMODE) | mode;
+  i2c_clock_changed();
+}
+
 /*****************************************************************************
  ** Function name:	I2CInit
  **
@@ -271,7 +399,7 @@ void i2c_init(void) {
   LPC_SYSCON->PRESETCTRL |= (0x1<<1);
 
   // Enable I2C clock
-  LPC_SYSCON->SYSAHBCLKCTRL |= 0x20;
+  clock_syscon(CLOCK_AHB, 0x20, 0);
 
   // Configure pin 0.4 for SCL
   LPC_IOCON->PIO0_4 &= ~0x3F;/*  I2C I/O config */
@@ -287,16 +415,12 @@ void i2c_init(void) {
     I2CONCLR_STAC |
     I2CONCLR_I2ENC;
 
+  // A slave might still be part way through a byte from before a reset
+  i2c_recover();
+
   // See p.128 for appropriate values for SCLL and SCLH
-#if I2C_FAST_MODE_PLUS
-  IOCON_PIO0_4 |= (IOCON_PIO0_4_I2CMODE_FASTPLUSI2C);
-  IOCON_PIO0_5 |= (IOCON_PIO0_5_I2CMODE_FASTPLUSI2C);
-  LPC_I2C->SCLL   = I2C_SCLL_HS_SCLL;
-  LPC_I2C->SCLH   = I2C_SCLH_HS_SCLH;
-#else
-  LPC_I2C->SCLL   = I2SCLL_SCLL;
-  LPC_I2C->SCLH   = I2SCLH_SCLH;
-#endif
+  i2c_set_speed(I2C_SPEED);
+  clock_register(i2c_clock_changed);
 
   /* Enable the I2C Interrupt */
   NVIC_SetPriority(I2C_IRQn, 1); // 2nd priority
@@ -305,6 +429,39 @@ void i2c_init(void) {
 
 }
 
+/*****************************************************************************
+ ** Function name:	i2c_clock_enable
+ **
+ ** Descriptions:	Turns the AHB clock to the I2C block back on
+ **			after i2c_clock_disable(). The registers keep
+ **			their values while the clock is off.
+ **
+ *****************************************************************************/
+void i2c_clock_enable(void) {
+  clock_syscon(CLOCK_AHB, 0x20, 0);
+}
+
+/*****************************************************************************
+ ** Function name:	i2c_clock_disable
+ **
+ ** Descriptions:	Turns off the AHB clock to the I2C block between
+ **			uses. Waits for a transfer from i2c_start_transfer()
+ **			to finish and for any STOP condition to go out on
+ **			the bus first.
+ **
+ *****************************************************************************/
+void i2c_clock_disable(void) {
+  uint32_t timeout = 0;
+
+  i2c_wait();
+  while((LPC_I2C->CONSET & I2CONSET_STO) && (timeout < MAX_TIMEOUT))
+  {
+    timeout++;
+  }
+
+  clock_syscon(CLOCK_AHB, 0, 0x20);
+}
+
 /*****************************************************************************
  ** Function name:	i2c_engine
  **
@@ -320,26 +477,225 @@ void i2c_init(void) {
  **
  *****************************************************************************/
 uint32_t i2c_engine(void) {
-  I2CMasterState = I2CSTATE_IDLE;
+  i2c_wait();
   RdIndex = 0;
   WrIndex = 0;
-  uint32_t timeout = 100*1000;
+  RdBuffer = I2CSlaveBuffer;
+  TransfersLeft = 0;
+
+  return i2c_run();
+}
+
+/*****************************************************************************
+ ** Function name:	i2c_transfer
+ **
+ ** Descriptions:	Runs a list of transfers as one transaction,
+ **			with a repeated START between each instead of
+ **			a STOP and a START. Reads go straight into
+ **			each transfer's buffer.
+ **
+ ** parameters:		The list and how many there are
+ ** Returned value:	As i2c_engine()
+ **
+ *****************************************************************************/
+uint32_t i2c_transfer(const struct i2c_transfer* list, uint8_t count) {
+  if (count == 0) return I2CSTATE_ACK;
+
+  i2c_wait();
+  i2c_load(list);
+  TransferNext = list + 1;
+  TransfersLeft = count - 1;
+
+  return i2c_run();
+}
+
+/*****************************************************************************
+ ** Function name:	i2c_start_transfer
+ **
+ ** Descriptions:	As i2c_transfer(), but returns once the START's
+ **			gone out and leaves the rest to the interrupt.
+ **			The list and its buffers have to stay put until
+ **			i2c_wait(). Anything else that uses the bus
+ **			waits for it first.
+ **
+ ** parameters:		The list and how many there are
+ ** Returned value:	I2CSTATE_PENDING if it's started, otherwise as
+ **			i2c_engine()
+ **
+ *****************************************************************************/
+uint32_t i2c_start_transfer(const struct i2c_transfer* list, uint8_t count) {
+  if (count == 0) return I2CSTATE_ACK;
+
+  i2c_wait();
+  i2c_load(list);
+  TransferNext = list + 1;
+  TransfersLeft = count - 1;
+
+  return i2c_begin();
+}
+
+/*****************************************************************************
+ ** Function name:	i2c_read, i2c_write
+ **
+ ** Descriptions:	Reads or writes length consecutive registers
+ **			starting at reg, in one burst
+ **
+ ** Returned value:	As i2c_engine()
+ **
+ *****************************************************************************/
+uint32_t i2c_read(uint8_t address, uint8_t reg, uint8_t* buffer,
+		  uint8_t length) {
+  struct i2c_transfer t = { address, reg, 0, length, buffer };
+
+  return i2c_transfer(&t, 1);
+}
+uint32_t i2c_write(uint8_t address, uint8_t reg, uint8_t* buffer,
+		   uint8_t length) {
+  struct i2c_transfer t = { address, reg, 1, length, buffer };
+
+  return i2c_transfer(&t, 1);
+}
+
+/*****************************************************************************
+ ** Function name:	i2c_recover_delay
+ **
+ ** Descriptions:	Half an SCL period at I2C_RECOVER_HZ, or more
+ **
+ *****************************************************************************/
+static void i2c_recover_delay(void) {
+  uint32_t i = SystemCoreClock / (2 * I2C_RECOVER_HZ);
+
+  while (i--) {
+    __NOP();
+  }
+}
+
+/*****************************************************************************
+ ** Function name:	i2c_recover
+ **
+ ** Descriptions:	Frees a bus that a slave's holding SDA low on.
+ **			The pins go over to GPIO, which on PIO0_4 and
+ **			PIO0_5 are open drain, and SCL's clocked until
+ **			the slave lets go of SDA. Then there's a STOP,
+ **			and the I2C block starts again from idle.
+ **
+ ** Returned value:	The number of clocks it took, 0 if the bus was
+ **			already free
+ **
+ *****************************************************************************/
+uint8_t i2c_recover(void) {
+  uint32_t func4 = LPC_IOCON->PIO0_4, func5 = LPC_IOCON->PIO0_5;
+  uint8_t clocks = 0;
+
+  LPC_I2C->CONCLR = I2CONCLR_AAC | I2CONCLR_SIC | I2CONCLR_STAC |
+    I2CONCLR_I2ENC;
+
+  /* Both released, and only SCL driven to start with. The masked
+     writes leave the RTTY on the same port alone. */
+  LPC_GPIO0->MASKED_ACCESS[SCL_BIT | SDA_BIT] = SCL_BIT | SDA_BIT;
+  LPC_GPIO0->DIR = (LPC_GPIO0->DIR & ~SDA_BIT) | SCL_BIT;
+  LPC_IOCON->PIO0_4 = func4 & ~0x07;
+  LPC_IOCON->PIO0_5 = func5 & ~0x07;
+
+  while (!(LPC_GPIO0->DATA & SDA_BIT) && clocks < I2C_RECOVER_CLOCKS) {
+    LPC_GPIO0->MASKED_ACCESS[SCL_BIT] = 0;
+    i2c_recover_delay();
+    LPC_GPIO0->MASKED_ACCESS[SCL_BIT] = SCL_BIT;
+    i2c_recover_delay();
+    clocks++;
+  }
+
+  if (clocks) {
+    /* STOP: SDA rises while SCL's high */
+    LPC_GPIO0->MASKED_ACCESS[SCL_BIT] = 0;
+    LPC_GPIO0->MASKED_ACCESS[SDA_BIT] = 0;
+    LPC_GPIO0->DIR |= SDA_BIT;
+    i2c_recover_delay();
+    LPC_GPIO0->MASKED_ACCESS[SCL_BIT] = SCL_BIT;
+    i2c_recover_delay();
+    LPC_GPIO0->MASKED_ACCESS[SDA_BIT] = SDA_BIT;
+    i2c_recover_delay();
+  }
+
+  LPC_GPIO0->DIR &= ~(SCL_BIT | SDA_BIT);
+  LPC_IOCON->PIO0_4 = func4;
+  LPC_IOCON->PIO0_5 = func5;
+
+  I2CMasterState = I2CSTATE_IDLE;
+  LPC_I2C->CONSET = I2CONSET_I2EN;
+
+  return clocks;
+}
+
+/*****************************************************************************
+ ** Function name:	i2c_begin
+ **
+ ** Descriptions:	Starts whatever's been loaded. If the bus doesn't
+ **			start it's stuck, so it's recovered for next time.
+ **
+ ** Returned value:	I2CSTATE_PENDING, or 0 if it didn't start
+ **
+ *****************************************************************************/
+static uint32_t i2c_begin(void) {
+  I2CMasterState = I2CSTATE_IDLE;
 
   if (!i2c_start()) { // Start failed
     i2c_stop();
+    i2c_recover();
     return 0; // Timeout: Idle
   }
 
+  return I2CSTATE_PENDING;
+}
+
+/*****************************************************************************
+ ** Function name:	i2c_wait
+ **
+ ** Descriptions:	Waits for a transfer that's been started to stop.
+ **			If it doesn't finish the bus is stuck, so it's
+ **			recovered for next time. Returns at once if
+ **			nothing's running.
+ **
+ ** Returned value:	As i2c_engine(), for the last transfer
+ **
+ *****************************************************************************/
+uint32_t i2c_wait(void) {
+  uint32_t timeout = 100*1000;
+
+  if (I2CMasterState != I2CSTATE_PENDING) {
+    return I2CMasterState;
+  }
+
   /* wait until the state is a terminal state */
-  while (I2CMasterState < 0x100 && timeout--);
+  while (I2CMasterState < 0x100 && timeout) {
+    timeout--;
+    __NOP();
+  }
 
   if (timeout > 0) { // We didn't timeout
+    if (I2CMasterState == I2CSTATE_ARB_LOSS) {
+      i2c_recover();
+      I2CMasterState = I2CSTATE_ARB_LOSS;
+    }
     return I2CMasterState;
   } else {
+    i2c_recover();
     return 1; // Timeout: Pending
   }
 }
 
+/*****************************************************************************
+ ** Function name:	i2c_run
+ **
+ ** Descriptions:	Runs whatever's been loaded from start to stop
+ **
+ *****************************************************************************/
+static uint32_t i2c_run(void) {
+  uint32_t state = i2c_begin();
+
+  return (state == I2CSTATE_PENDING) ? i2c_wait() : state;
+}
+
 /******************************************************************************
  **                            End Of File
  ******************************************************************************/
@@ -0,0 +1,157 @@
+/*
+ * Puts the processor to sleep when there's nothing to do
+ * Copyright (C) 2014  richard
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "LPC11xx.h"
+#include "idle.h"
+
+/**
+ * Sleep: The core clock stops until the next interrupt. Peripherals
+ * keep running, so the SysTick, UART and SSP all still wake us.
+ *
+ * Deep-sleep: Everything apart from the start logic stops. The only
+ * way out is an edge on one of the start logic pins (PIO0_0 - PIO1_0),
+ * so it is only used if one of these has been set up as a wakeup.
+ */
+
+/**
+ * Power down the BOD and watchdog oscillator in deep-sleep. (UM10398
+ * §3.5.39, the reserved bits must be written as ones)
+ */
+#define PDSLEEPCFG_VALUE	0x000018FF
+
+/**
+ * The mode we're in at the moment, sampled by the SysTick
+ */
+volatile enum idle_mode idle_mode = IDLE_ACTIVE;
+/**
+ * Ticks spent in each mode
+ */
+struct idle_residency idle_residency;
+/**
+ * Start logic pins that can wake us from deep-sleep
+ */
+uint32_t deep_sleep_wakeup = 0;
+
+/**
+ * Enables deep-sleep, waking on a rising edge on any of the given
+ * start logic pins (bit 0 = PIO0_0 ... bit 12 = PIO1_0).
+ */
+void idle_enable_deep_sleep(uint32_t start_logic_pins) {
+  deep_sleep_wakeup = start_logic_pins & 0x1FFF;
+
+  LPC_SYSCON->STARTAPRP0 |= deep_sleep_wakeup;	/* Rising edge */
+  LPC_SYSCON->STARTRSRP0CLR = deep_sleep_wakeup;	/* Clear anything pending */
+  LPC_SYSCON->STARTERP0 = deep_sleep_wakeup;
+}
+
+/**
+ * Enters deep-sleep. Must be called with interrupts disabled.
+ */
+static void idle_deep_sleep(void) {
+  uint32_t mainclksel = LPC_SYSCON->MAINCLKSEL;
+
+  /* Run from the IRC while we go down and come back up */
+  LPC_SYSCON->MAINCLKSEL = 0x0;
+  LPC_SYSCON->MAINCLKUEN = 0x0;
+  LPC_SYSCON->MAINCLKUEN = 0x1;
+
+  /* Power back up whatever is running now */
+  LPC_SYSCON->PDSLEEPCFG = PDSLEEPCFG_VALUE;
+  LPC_SYSCON->PDAWAKECFG = LPC_SYSCON->PDRUNCFG;
+  LPC_SYSCON->STARTRSRP0CLR = deep_sleep_wakeup;
+
+  LPC_PMU->PCON &= ~(1 << 1);	/* DPDEN = 0: Deep-sleep, not power-down */
+  SCB->SCR |= SCB_SCR_SLEEPDEEP_Msk;
+
+  __WFI();
+
+  SCB->SCR &= ~SCB_SCR_SLEEPDEEP_Msk;
+
+  /* Restore the main clock */
+  LPC_SYSCON->MAINCLKSEL = mainclksel;
+  LPC_SYSCON->MAINCLKUEN = 0x0;
+  LPC_SYSCON->MAINCLKUEN = 0x1;
+
+  idle_residency.ticks[IDLE_DEEP_SLEEP]++;
+}
+
+/**
+ * Sleeps until the runnable function says there's something to do.
+ *
+ * Interrupts are disabled while we check, so an interrupt that arrives
+ * between the check and the WFI still wakes us straight away. Most
+ * interrupts (the UART, I2C, ADC) don't give the main loop anything to
+ * do, so we go back to sleep after them.
+ */
+void idle_sleep(idle_runnable_func runnable, enum idle_mode mode) {
+  __disable_irq();
+
+  while (!runnable()) {
+    if (mode == IDLE_DEEP_SLEEP && deep_sleep_wakeup) {
+      idle_mode = IDLE_DEEP_SLEEP;
+      idle_deep_sleep();
+    } else {
+      idle_mode = IDLE_SLEEP;
+      SCB->SCR &= ~SCB_SCR_SLEEPDEEP_Msk;
+      __WFI();
+    }
+
+    /* Whatever woke us is serviced here, and counted as time asleep */
+    __enable_irq();
+    __disable_irq();
+  }
+
+  __enable_irq();
+
+  idle_mode = IDLE_ACTIVE;
+}
+
+/**
+ * Called from the SysTick.
+ */
+void idle_tick(void) {
+  idle_residency.ticks[idle_mode]++;
+}
+
+void get_idle_residency(struct idle_residency* residency) {
+  int i;
+
+  for (i = 0; i < IDLE_MODES; i++) {
+    residency->ticks[i] = idle_residency.ticks[i];
+  }
+}
+/**
+ * Returns the percentage of ticks spent asleep between two snapshots
+ * of the residency counters.
+ */
+int idle_percentage(struct idle_residency* now, struct idle_residency* then) {
+  uint32_t active = now->ticks[IDLE_ACTIVE] - then->ticks[IDLE_ACTIVE];
+  uint32_t asleep = now->ticks[IDLE_SLEEP] - then->ticks[IDLE_SLEEP];
+
+  if (active + asleep == 0) {
+    return 0;
+  }
+
+  return (asleep * 100) / (active + asleep);
+}
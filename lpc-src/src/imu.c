@@ -24,8 +24,8 @@
 
 #include "LPC11xx.h"
 #include <string.h>
-#include "stdio.h"
 #include "imu.h"
+#include "fmt.h"
 
 int imu_access_flag = 0;
 
@@ -45,17 +45,29 @@ float make_float_from_parts(int var_i, int var_f) {
  * two digits.
  */
 void process_imu_frame(uint8_t* data, uint16_t len) {
-  int count;
-  int roll_i, roll_f, pitch_i, pitch_f, yaw_i, yaw_f;
+  int roll_i = 0, roll_f = 0, pitch_i = 0, pitch_f = 0, yaw_i = 0, yaw_f = 0;
+
+  /* !ANG:%d.%d,%d.%d,%d.%d,AN:%d,%d,%d,%d,%d,%d,%d,%d,%d */
+  static const char* const separators[] = {
+    "!ANG:", ".", ",", ".", ",", ".", ",AN:", ",", ",", ",", ",", ",", ",", ",", ","
+  };
+  int* fields[] = {
+    &roll_i, &roll_f, &pitch_i, &pitch_f, &yaw_i, &yaw_f,// Angle
+    &imu_raw.gyro.x, &imu_raw.gyro.y, &imu_raw.gyro.z, // Gyroscope
+    &imu_raw.accel.x, &imu_raw.accel.y, &imu_raw.accel.z, // Accelerometer
+    &imu_raw.magneto.x, &imu_raw.magneto.y, &imu_raw.magneto.z // Magneto
+  };
+  const char* p = (const char*)data;
+  size_t i, n;
 
   if (!imu_access_flag) {		/* Check the flag isn't up */
 
-    count = sscanf((char*)data,
-		   "!ANG:%d.%d,%d.%d,%d.%d,AN:%d,%d,%d,%d,%d,%d,%d,%d,%d",
-		   &roll_i, &roll_f, &pitch_i, &pitch_f, &yaw_i, &yaw_f,// Angle
-		   &imu_raw.gyro.x, &imu_raw.gyro.y, &imu_raw.gyro.z, // Gyroscope
-		   &imu_raw.accel.x, &imu_raw.accel.y, &imu_raw.accel.z, // Accelerometer
-		   &imu_raw.magneto.x, &imu_raw.magneto.y, &imu_raw.magneto.z); // Magneto
+    /* As far as the frame matches */
+    for (i = 0; p && i < sizeof(fields) / sizeof(fields[0]); i++) {
+      n = strlen(separators[i]);
+      if (strncmp(p, separators[i], n)) break;
+      p = fmt_parse_int(p + n, 0, fields[i]);
+    }
 
     imu_angle.roll = make_float_from_parts(roll_i, roll_f);
     imu_angle.pitch = make_float_from_parts(pitch_i, pitch_f);
@@ -63,7 +75,6 @@ void process_imu_frame(uint8_t* data, uint16_t len) {
   }
 
   len++; // UNUSED
-  count++; // UNUSED
 }
 
 void get_imu_raw_data(struct imu_raw* data) {
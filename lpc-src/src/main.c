@@ -22,6 +22,7 @@
  * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
  */
 
+#include <stddef.h>
 #include "LPC11xx.h"
 #include "rtty.h"
 #include "i2c.h"
@@ -30,7 +31,6 @@
 #include "spi.h"
 #include "leds.h"
 #include "bmp085.h"
-#include "altitude.h"
 #include "cutdown_heat.h"
 #include "mbed.h"
 #include "sd.h"
@@ -41,6 +41,17 @@
 #include "protocol.h"
 #include "disk_write.h"
 #include "pwrmon.h"
+#include "idle.h"
+#include "profile.h"
+#include "control.h"
+#include "estimator.h"
+#include "fec.h"
+#include "delta.h"
+#include "phase.h"
+#include "pool.h"
+#include "stack.h"
+#include "clock.h"
+#include "persist.h"
 
 /**
 saydah **************************
@@ -52,29 +63,43 @@ saydah **************************
  */
 /*#define WATCHDOG_DISABLED*/
 /**
- * The number of minutes until the cutdown system activates
- * MAX = 2^32/60*RTTY_BAUD ~= 10^6
+ * The cutdown timer, altitudes and heater threshold are in control.h,
+ * and how often we transmit in each flight phase is in phase.h
  */
-#define CUTDOWN_TIME		180
 /**
- * The mBed is powered on below the given barometric altitude in
- * meters
- */
-#define GSM_ON_BELOW_ALTITUDE	1000
-/**
- * The altitude ceiling at which cutdown will occour (in meters)
+ * RTTY baud rate and framing, and the faster rate to switch to below
+ * the given altitude in meters on the way down, so more frames get
+ * through before landing. The ground station has to follow the change.
+ *
+ * Five data bits sends ITA2, which takes about 30% less time per frame
+ * than 8N2 ASCII.
  */
-#define CUTDOWN_CEILING		40000
+#define RTTY_BAUD		50
+#define RTTY_DATA_BITS		5
+#define RTTY_STOP_HALVES	RTTY_STOP_1_5
+#define RTTY_FAST_BAUD		300
+#define RTTY_FAST_BELOW_ALTITUDE 2000
 /**
- * The minimum barometric altitude in meters at which the balloon must
- * be for cutdown to occour.
+ * Send each frame as an FEC packet in binary 8N1 instead, which gets
+ * through a much worse link but takes 2.5 times as long. The ground
+ * station needs the decoder in tools/fecsim.c - Uncomment to enable
  */
-#define MIN_CUTDOWN_ALTITUDE	1000
+/*#define RTTY_FEC*/
+#ifdef RTTY_FEC
+#undef RTTY_DATA_BITS
+#undef RTTY_STOP_HALVES
+#define RTTY_DATA_BITS		8
+#define RTTY_STOP_HALVES	RTTY_STOP_1
+#endif
 /**
- * The threshold temperature for the heater to activate in °C
+ * With FEC, send delta compressed binary frames (delta.h) instead of
+ * the text, which are about a fifth of the size. The ground station
+ * needs a keyframe to decode the deltas after it - Uncomment to enable
  */
-#define HEATER_THRESHOLD	-30
-
+/*#define RTTY_DELTA*/
+#if defined(RTTY_DELTA) && !defined(RTTY_FEC)
+#error "RTTY_DELTA needs RTTY_FEC"
+#endif
 
 
 /**
@@ -83,13 +108,16 @@ saydah **************************
  *************************/
 
 /**
- * RTTY Baud Clock.
+ * The period at which the sensors are read and the control logic
+ * runs, in SysTick ticks. A new frame is also built whenever the RTTY
+ * goes idle and the phase's interval has passed.
  */
-#define RTTY_BAUD       	50
+#define CONTROL_PERIOD		SYSTICK_HZ
 /**
- * The maximum length of a single transmitter string
+ * The number of frames between each dump of the profile histograms
+ * to the SD card
  */
-#define TX_STRING_LENGTH	0x200
+#define PROFILE_DUMP_PERIOD	60
 
 /**
  **************************
@@ -97,49 +125,127 @@ saydah **************************
  *************************/
 
 int sd_good = 0;
-uint32_t ticks_until_cutdown = CUTDOWN_TIME * RTTY_BAUD * 60;
-float cutdown_voltage = 0;
+int sd_started = 0;		/* Not until the first sentence is on its way */
+int booted = 0;			/* The first sentence has gone to the radio */
+int boot_logged = 0;
+uint32_t ticks_until_cutdown = CUTDOWN_TIME * SYSTICK_HZ * 60;
+volatile int control_due = 1;
+uint32_t control_ticks = 0;
+volatile uint32_t uptime_ticks = 0;
+uint32_t frames_until_profile_dump = PROFILE_DUMP_PERIOD;
+struct estimator estimator;
+struct phase phase;
+uint32_t tx_ticks = 0;		/* When the last sentence started */
+uint32_t tx_interval_ticks = 0;
+int tx_now = 1;			/* Send the next sentence straight away */
 
 /**
  **************************
  System Control Logic
  *************************/
 
-void control_gsm(double altitude) {
-  if (altitude < GSM_ON_BELOW_ALTITUDE && altitude != -1) {
-    MBED_ON();
-  } else {
-    MBED_OFF();
-  }
+/**
+ * Returns non-zero if it's time to start another sentence
+ */
+int tx_due(void) {
+  return !rtty_active() &&
+    (tx_now || (uptime_ticks - tx_ticks) >= tx_interval_ticks);
 }
-void control_cutdown(uint32_t ticks, double altitude) {
-  if ((ticks == 0 && altitude > MIN_CUTDOWN_ALTITUDE) ||
-      (altitude > CUTDOWN_CEILING && altitude != -1)) {
 
-    CUTDOWN_ON(); // Mechanical disconnect
-  } else {
-    CUTDOWN_OFF();
-  }
+/**
+ * Returns non-zero if the main loop has something to do.
+ */
+int main_runnable(void) {
+  return control_due || tx_due();
 }
-void control_heater(double internal_temperature) {
-  if (internal_temperature < HEATER_THRESHOLD && internal_temperature != -1) {
-    HEATER_ON();
-  } else {
-    HEATER_OFF();
+
+/**
+ * Brings the SD card up. After a warm reset it's still set up, and we
+ * know where the log's got to.
+ */
+void start_card(uint8_t warm) {
+  sd_spi_clock_enable();
+  if (warm && resume_card(persist.card_unit) == 0) {
+    disk_write_resume(persist.next_block);
+    sd_good = 1;
+  } else if (initialise_card()) { // Initialised to something
+    if (disk_initialize() == 0) { // Disk initialisation was successful
+      sd_good = 1;
+    }
   }
+  sd_spi_clock_disable();
+
+  sd_started = 1;
+  PROFILE_BOOT(PROFILE_BOOT_SD);
 }
 
 /**
- * Called at the end of an ADC conversion
+ * Stores a sentence on the SD card with the extra fields and the ones
+ * it left out for its phase, which are built after it in its slot. The
+ * block's gathered from there so nothing's copied.
  */
-void pwrmon_callback(uint16_t adc_value) {
-  cutdown_voltage = adc_value * (6.6 / 1024);
+void log_frame(char* slot, int tx_length, struct frame* frame,
+	       struct imu_raw* ir, struct idle_residency* residency) {
+  struct disk_part parts[2];
+  struct pool_stats pool;
+  int extra_length;
+
+  /* How close we've come to running out of RAM */
+  pool_get_stats(&pool);
+  frame->stack_peak = stack_peak();
+  frame->pool_peak = pool.peak;
+  frame->resets = persist.resets;
+  frame->reset_cause = persist.history[0];
+
+  extra_length = communications_frame_add_extra(slot + tx_length,
+						RTTY_SLOT_SIZE - tx_length,
+						frame, ir, residency);
+  if (extra_length == 0) return;
+
+  parts[0].buffer = (uint8_t*)slot;
+  parts[0].length = tx_length - 2; // Without \n\0
+  parts[1].buffer = (uint8_t*)slot + tx_length;
+  parts[1].length = extra_length + 1; // Include null terminator
+
+  sd_spi_clock_enable();
+  PROFILE_START(sd_start);
+  disk_write_next_block_parts(parts, 2);
+  PROFILE_END(PROFILE_SD, sd_start);
+
+#ifndef PROFILE_DISABLED
+  /* Once the first sentence has gone to the radio, how long the boot
+     took */
+  if (booted && !boot_logged) {
+    uint8_t record[PROFILE_BOOT_SIZE];
+    boot_logged = 1;
+
+    parts[0].buffer = record;
+    parts[0].length = profile_boot_dump(record);
+    disk_write_next_block_parts(parts, 1);
+  }
+
+  /* Every so often, store the profile histograms too */
+  if (--frames_until_profile_dump == 0) {
+    uint8_t header[PROFILE_HEADER_SIZE];
+    frames_until_profile_dump = PROFILE_DUMP_PERIOD;
+
+    parts[0].buffer = header;
+    parts[0].length = profile_dump_header(header);
+    parts[1].buffer = (uint8_t*)profile_histograms;
+    parts[1].length = sizeof(profile_histograms);
+    disk_write_next_block_parts(parts, 2);
+  }
+#endif
+  sd_spi_clock_disable();
 }
 
 /**
  * Main system entry point
  */
 int main (void) {
+  /* Before anything's been on the stack but this */
+  stack_paint();
+
   SystemInit();
 
   /* Initialise Pins */
@@ -150,6 +256,14 @@ int main (void) {
 
   /* Update the value of SystemCoreClock */
   SystemCoreClockUpdate();
+  /* Run slow, before anything's set up from the clock */
+  clock_init();
+  /* Did we just come back from the watchdog? */
+  uint8_t warm = persist_boot();
+
+  /* Configure the SysTick, which times the rest of the boot */
+  SysTick_Config(SystemCoreClock / SYSTICK_HZ);
+  NVIC_SetPriority(SysTick_IRQn, 1); // Below the RTTY bit clock
 
   /* Initialise Interfaces */
   i2c_init();
@@ -157,93 +271,208 @@ int main (void) {
   sd_spi_init(); // SD
   uart_init(); // GPS
   pwrmon_init(); // ADC
+  PROFILE_BOOT(PROFILE_BOOT_INTERFACES);
 
   /* Initialise Sensors */
   init_barometer();
-
-  /* SD Card */
-  if (initialise_card()) { // Initialised to something
-    if (disk_initialize() == 0) { // Disk initialisation was successful
-      sd_good = 1;
-    }
+  init_thermometer(uptime_ticks);
+  estimator_init(&estimator);
+  phase_init(&phase);
+  PROFILE_BOOT(PROFILE_BOOT_SENSORS);
+
+  if (warm) {
+    /* Carry on with the countdown, the sentence IDs and the phase */
+    ticks_until_cutdown = persist.ticks_until_cutdown;
+    communications_resume_id(persist.sentence_id);
+    phase = persist.phase;
+    pwrmon_resume(persist.charge_used);
   }
 
+  /* Up, but for the SD card, which waits for the first sentence */
   GREEN_ON();
 
-  /* Configure the SysTick */
-  NVIC_SetPriority(SysTick_IRQn, 0); // Highest Priority Interrupt
-  SysTick_Config(SystemCoreClock / RTTY_BAUD);
+  /* RTTY */
+  rtty_set_format(RTTY_BAUD, RTTY_DATA_BITS, RTTY_STOP_HALVES);
+  communications_frame_charset((RTTY_DATA_BITS == 5) ? FRAME_BAUDOT : FRAME_ASCII);
 
   /* Watchdog - Disabled for debugging */
 #ifndef WATCHDOG_DISABLED
   init_watchdog();
 #endif
+  PROFILE_BOOT(PROFILE_BOOT_WATCHDOG);
 
   struct barometer* b;
   struct imu_raw ir;
   struct gps_data gd;
   struct gps_time gt;
   double alt, ext_temp;
+  char* slot; // Where the RTTY wants the next string built
   int tx_length; // The length of the built tx string
+  struct frame frame;
+  struct pwrmon_period power;
+#ifdef RTTY_DELTA
+  struct delta_encoder delta;
+
+  delta_encoder_init(&delta, DELTA_KEY_PERIOD, FRAME_RADIO);
+#endif
+  struct idle_residency residency, last_residency;
+  uint32_t ticks, last_ticks = 0, dt;
 
-  char tx_string[TX_STRING_LENGTH];
+  get_idle_residency(&last_residency);
 
   while (1) {
+    /* Sleep until it's time to do something */
+    idle_sleep(main_runnable, IDLE_SLEEP);
+    control_due = 0;
+    /* Fast while we build the frame and write the card */
+    clock_set(CLOCK_FAST);
+
     /* Grab Data */
-    pwrmon_start(pwrmon_callback);
+    i2c_clock_enable();
+    PROFILE_START(barometer_start);
     b = get_barometer();
+    PROFILE_END(PROFILE_BAROMETER, barometer_start);
+    PROFILE_START(temperature_start);
+    thermometer_update(uptime_ticks);
+    PROFILE_END(PROFILE_TEMPERATURE, temperature_start);
     get_imu_raw_data(&ir);
     get_gps_data(&gd);
     get_gps_time(&gt);
-    ext_temp = get_temperature();
-
-    /* Data Processing */
-    if (b->valid) {
-      alt = pressure_to_altitude(b->pressure);
-    } else {
-      alt = -1;
-      b->temperature = -1;
-    }
+    gps_poll(); // Configures a u-blox, see GPS_UBX
+    get_idle_residency(&residency);
+    pwrmon_period(&power);
+    i2c_clock_disable(); // Once the TMP102's done
+    ticks = uptime_ticks;
+    ext_temp = get_temperature(ticks);
 
     /* Act on the data */
-    control_gsm(alt);
-    control_cutdown(ticks_until_cutdown, alt);
-    control_heater(b->temperature);
+    dt = ((ticks - last_ticks) * 1000) / SYSTICK_HZ;
+    PROFILE_START(estimator_start);
+    estimator_update(&estimator, b, dt);
+    estimator_gps(&estimator, &gd);
+    PROFILE_END(PROFILE_ESTIMATOR, estimator_start);
+    alt = control_update(&estimator, b, ticks_until_cutdown);
+    if (phase_update(&phase, &estimator, &gd, dt)) {
+      tx_now = 1; // The new layout goes out at once
+    }
+    tx_interval_ticks = phase_interval(phase.phase) * SYSTICK_HZ;
+    last_ticks = ticks;
 
     /* Create a protocol string */
     int cutstat;
     if (ticks_until_cutdown == 0) {
       cutstat = -1;
     } else {
-      cutstat = ticks_until_cutdown / (RTTY_BAUD*60);
+      cutstat = ticks_until_cutdown / (SYSTICK_HZ*60);
+    }
+    fill_communications_frame(&frame, &gt, b, &gd, alt,
+			      estimator_rate(&estimator) / 1000.0,
+			      ext_temp, &ir,
+			      cutstat,  pwrmon_mean(&power, PWRMON_CUTDOWN) / 1000.0,
+			      idle_percentage(&residency, &last_residency));
+    phase_fill_frame(&phase, &frame);
+    pwrmon_fill_frame(&power, &frame);
+    last_residency = residency;
+
+    /* Faster RTTY on the way down, from the next string */
+    if (estimator.burst && alt != -1 && alt < RTTY_FAST_BELOW_ALTITUDE) {
+      rtty_set_format(RTTY_FAST_BAUD, RTTY_DATA_BITS, RTTY_STOP_HALVES);
+    } else {
+      rtty_set_format(RTTY_BAUD, RTTY_DATA_BITS, RTTY_STOP_HALVES);
+    }
+
+    /* Build the sentence with the fields for this phase in a slot, which
+       the radio sends and the SD card stores from */
+    slot = rtty_acquire();
+    PROFILE_START(frame_start);
+    tx_length = communications_frame_text(slot, RTTY_SLOT_SIZE, &frame, FRAME_RADIO);
+    PROFILE_END(PROFILE_FRAME, frame_start);
+    if (!booted) {
+      PROFILE_BOOT(PROFILE_BOOT_FRAME);
     }
-    tx_length = build_communications_frame(tx_string, TX_STRING_LENGTH,
-					   &gt, b, &gd, alt, ext_temp, &ir,
-					   cutstat,  cutdown_voltage);
 
-    /* Transmit - Quietly fails if another transmission is ongoing */
-    rtty_set_string(tx_string, tx_length);
+#if defined(RTTY_DELTA)
+    /* The compressed frame goes over the text, so store it first */
+    if (!sd_started) start_card(warm);
+    if (sd_good && tx_length) {
+      log_frame(slot, tx_length, &frame, &ir, &residency);
+    }
+    if (tx_due() && tx_length) {
+      tx_length = delta_encode(&delta, &frame, (uint8_t*)slot, RTTY_SLOT_SIZE);
+      if (rtty_commit(slot, tx_length, fec_packet_byte,
+		      FEC_PACKET_SIZE(tx_length)) == 0) {
+	if (!booted) {
+	  PROFILE_BOOT(PROFILE_BOOT_RTTY);
+	  booted = 1;
+	}
+	tx_ticks = ticks;
+	tx_now = 0;
+      }
+    }
+#else
+    /* Transmit */
+    if (tx_due() && tx_length) {
+#if defined(RTTY_FEC)
+      /* The frame without \n\0, packed as it's sent */
+      if (rtty_commit(slot, tx_length - 2, fec_packet_byte,
+		      FEC_PACKET_SIZE(tx_length - 2)) == 0) {
+#else
+      if (rtty_commit(slot, tx_length, NULL, 0) == 0) {
+#endif
+	if (!booted) {
+	  PROFILE_BOOT(PROFILE_BOOT_RTTY);
+	  booted = 1;
+	}
+	tx_ticks = ticks;
+	tx_now = 0;
+      }
+    }
 
-    /* Store */
-    if (sd_good) {
-      tx_length -= 2; // Remove \n\0
-      tx_length += communications_frame_add_extra(tx_string + tx_length,
-				     TX_STRING_LENGTH - tx_length, &ir);
+    /* The SD card comes up while the first sentence goes out */
+    if (!sd_started) start_card(warm);
 
-      disk_write_next_block((uint8_t*)tx_string, tx_length+1); // Include null terminator
+    /* Store every field, after the bytes being sent */
+    if (sd_good && tx_length) {
+      log_frame(slot, tx_length, &frame, &ir, &residency);
     }
+#endif
+
+    /* Keep what a reset shouldn't lose */
+    persist.ticks_until_cutdown = ticks_until_cutdown;
+    persist.sentence_id = communications_next_id();
+    persist.next_block = disk_write_head();
+    persist.card_unit = sd_good ? card_unit() : 0;
+    persist.phase = phase;
+    persist.charge_used = pwrmon_charge_used();
+    persist_save();
 
     /* Housekeeping */
     GREEN_TOGGLE();
     feed_watchdog();
+    clock_set(CLOCK_SLOW);
   }
 }
 
 extern void SysTick_Handler(void) {
-  /* Push RTTY bits */
-  rtty_tick();
+  /* Count ticks for the profile timestamps */
+  profile_tick();
+  PROFILE_START(isr_start);
+
+  /* Count where we're spending our time */
+  idle_tick();
+  /* Count ticks for the altitude estimator */
+  uptime_ticks++;
+  /* Wake the main loop */
+  if (++control_ticks >= CONTROL_PERIOD) {
+    control_ticks = 0;
+    control_due = 1;
+  }
+  /* Start the power monitor's scans */
+  pwrmon_tick();
   /* Countdown */
   if (ticks_until_cutdown) {
     ticks_until_cutdown--;
   }
+
+  PROFILE_END(PROFILE_ISR_SYSTICK, isr_start);
 }
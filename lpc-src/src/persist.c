@@ -0,0 +1,168 @@
+/*
+ * Flight state kept across resets
+ * Copyright (C) 2014  richard
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "LPC11xx.h"
+#include <stddef.h>
+#include <string.h>
+#include "persist.h"
+#include "protocol.h"
+
+/**
+ * The reset status register. Bits are cleared by writing 1s to them.
+ */
+#ifndef PERSIST_TEST
+#define PERSIST_STATUS()	LPC_SYSCON->SYSRSTSTAT
+#define PERSIST_CLEAR(bits)	LPC_SYSCON->SYSRSTSTAT = (bits)
+#else
+uint32_t persist_test_status;
+#define PERSIST_STATUS()	persist_test_status
+#define PERSIST_CLEAR(bits)	persist_test_status &= ~(bits)
+#endif
+
+/**
+ * Not cleared at startup, see chip/sections.ld
+ */
+struct persist persist __attribute__ ((section (".noinit")));
+
+/**
+ * The XMODEM CRC of everything before the CRC itself
+ */
+static uint16_t persist_crc(void) {
+  const uint8_t* p = (const uint8_t*)&persist;
+  uint16_t crc = 0xFFFF;
+  size_t i;
+
+  for (i = 0; i < offsetof(struct persist, crc); i++) {
+    crc = crc_xmodem_update(crc, p[i]);
+  }
+
+  return crc;
+}
+
+/**
+ * Call once at startup, before anything else touches persist. Adds the
+ * cause of this reset to the history, and returns 1 if the state from
+ * before it can be used or 0 if it's been cleared.
+ *
+ * Only a power-on reset always clears it. A brownout or the watchdog
+ * leaves the RAM as it was, and the CRC catches it if it wasn't.
+ */
+uint8_t persist_boot(void) {
+  uint32_t cause = PERSIST_STATUS();
+  uint8_t warm;
+
+  PERSIST_CLEAR(cause);
+
+  warm = !(cause & PERSIST_RESET_POR) &&
+    persist.magic == PERSIST_MAGIC && persist.crc == persist_crc();
+
+  if (!warm) {
+    memset(&persist, 0, sizeof(persist));
+    persist.magic = PERSIST_MAGIC;
+  } else if (persist.resets < 0xFF) {
+    persist.resets++;
+  }
+
+  memmove(&persist.history[1], &persist.history[0], PERSIST_HISTORY - 1);
+  persist.history[0] = cause;
+  persist.crc = persist_crc();
+
+  return warm;
+}
+/**
+ * Call after changing anything in persist, so it'll be trusted after
+ * a reset
+ */
+void persist_save(void) {
+  persist.crc = persist_crc();
+}
+
+#ifdef PERSIST_TEST
+
+#include <assert.h>
+#include <stdio.h>
+
+int main(void) {
+  printf("*** PERSIST_TEST ***\n\n");
+
+  /* Power on with whatever's in RAM */
+  memset(&persist, 0xA5, sizeof(persist));
+  persist_test_status = PERSIST_RESET_POR;
+  assert(persist_boot() == 0);
+  assert(persist_test_status == 0);
+  assert(persist.magic == PERSIST_MAGIC && persist.resets == 0);
+  assert(persist.ticks_until_cutdown == 0 && persist.phase.phase == 0);
+  assert(persist.history[0] == PERSIST_RESET_POR && persist.history[1] == 0);
+
+  /* The watchdog keeps what was saved */
+  persist.ticks_until_cutdown = 123456;
+  persist.sentence_id = 789;
+  persist.next_block = 42;
+  persist.phase.phase = 2;
+  persist.phase.latitude = 51500000;
+  persist_save();
+  persist_test_status = PERSIST_RESET_WDT;
+  assert(persist_boot() == 1);
+  assert(persist.ticks_until_cutdown == 123456 && persist.sentence_id == 789);
+  assert(persist.next_block == 42 && persist.phase.phase == 2);
+  assert(persist.phase.latitude == 51500000);
+  assert(persist.resets == 1);
+  assert(persist.history[0] == PERSIST_RESET_WDT &&
+	 persist.history[1] == PERSIST_RESET_POR);
+  printf("Warm reset: kept the state, %u reset\n", persist.resets);
+
+  /* And so does a brownout */
+  persist_test_status = PERSIST_RESET_BOD;
+  assert(persist_boot() == 1 && persist.resets == 2);
+
+  /* Anything that changed without a save isn't trusted */
+  persist.sentence_id++;
+  persist_test_status = PERSIST_RESET_WDT;
+  assert(persist_boot() == 0);
+  assert(persist.sentence_id == 0 && persist.resets == 0);
+  assert(persist.history[0] == PERSIST_RESET_WDT && persist.history[1] == 0);
+  printf("Changed without a save: cleared\n");
+
+  /* Power on clears it even when it's good */
+  persist.sentence_id = 5;
+  persist_save();
+  persist_test_status = PERSIST_RESET_POR | PERSIST_RESET_EXT;
+  assert(persist_boot() == 0 && persist.sentence_id == 0);
+
+  /* The history only goes back so far */
+  for (int i = 0; i < PERSIST_HISTORY + 2; i++) {
+    persist_test_status = (i & 1) ? PERSIST_RESET_WDT : PERSIST_RESET_EXT;
+    assert(persist_boot() == 1);
+  }
+  assert(persist.resets == PERSIST_HISTORY + 2);
+  assert(persist.history[0] == PERSIST_RESET_WDT &&
+	 persist.history[PERSIST_HISTORY - 1] == PERSIST_RESET_EXT);
+  printf("History: %u resets, newest cause 0x%02X\n",
+	 persist.resets, persist.history[0]);
+
+  printf("\n*** DONE ***\n");
+  return 0;
+}
+
+#endif
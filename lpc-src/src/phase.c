@@ -0,0 +1,334 @@
+/*
+ * Flight phase from the altitude and vertical rate
+ * Copyright (C) 2014  richard
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include "LPC11xx.h"
+#include <string.h>
+#include "phase.h"
+
+/**
+ **************************
+ Phase Parameters
+ *************************/
+
+/**
+ * Rates that count as going up, as staying level and as coming down
+ */
+#define PHASE_ASCENT_RATE	1500		/* mm/s */
+#define PHASE_LEVEL_RATE	1000		/* mm/s */
+#define PHASE_DESCENT_RATE	-3000		/* mm/s */
+/**
+ * We haven't launched until we're this far above the ground
+ */
+#define PHASE_LIFT		100000		/* mm */
+/**
+ * The first altitude we see is taken as the ground, unless it's above
+ * this. Then we've restarted in the air and take the ground as sea
+ * level.
+ */
+#define PHASE_LAUNCH_CEILING	2000000		/* mm */
+/**
+ * How long the next phase has to hold before we change to it
+ */
+static const uint32_t phase_dwell[PHASES] = {
+  0,				/* Ground, we never go back */
+  20000,			/* Ascent, ms */
+  60000,			/* Float */
+  5000,				/* Descent */
+  60000,			/* Landed */
+};
+/**
+ * A GPS fix needs this many satellites to be used. The rates from the
+ * fixes move this fraction of the way to each new one.
+ */
+#define PHASE_GPS_SATELLITES	4
+#define PHASE_GPS_FILTER	8
+/**
+ * Fixes further apart than this don't give a rate
+ */
+#define PHASE_FIX_TIMEOUT	10000		/* ms */
+
+static const uint32_t phase_intervals[PHASES] = {
+  PHASE_GROUND_INTERVAL,
+  PHASE_ASCENT_INTERVAL,
+  PHASE_FLOAT_INTERVAL,
+  PHASE_DESCENT_INTERVAL,
+  PHASE_LANDED_INTERVAL,
+};
+
+static int32_t absolute(int32_t value) {
+  return (value < 0) ? -value : value;
+}
+
+void phase_init(struct phase* p) {
+  memset(p, 0, sizeof(struct phase));
+  p->phase = p->candidate = PHASE_GROUND;
+}
+
+/**
+ * Moves the rates from the GPS towards what this fix says
+ */
+static void phase_fix(struct phase* p, struct gps_data* gd) {
+  int32_t latitude = (int32_t)(gd->lat * 1000000);
+  int32_t longitude = (int32_t)(gd->lon * 1000000);
+  int32_t altitude = gd->altitude * 1000;
+  int32_t ms = (int32_t)p->since_fix;
+
+  if (p->have_fix && ms > 0 && ms <= PHASE_FIX_TIMEOUT) {
+    p->gps_rate += (int32_t)((((int64_t)(altitude - p->gps_altitude) * 1000) / ms -
+			      p->gps_rate) / PHASE_GPS_FILTER);
+    p->drift_latitude += (int32_t)((((int64_t)(latitude - p->latitude) * 256000) / ms -
+				    p->drift_latitude) / PHASE_GPS_FILTER);
+    p->drift_longitude += (int32_t)((((int64_t)(longitude - p->longitude) * 256000) / ms -
+				     p->drift_longitude) / PHASE_GPS_FILTER);
+  }
+
+  p->latitude = latitude;
+  p->longitude = longitude;
+  p->gps_altitude = altitude;
+  p->since_fix = 0;
+  p->have_fix = 1;
+}
+
+/**
+ * The phase the altitude and rate say we're in now
+ */
+static uint8_t phase_next(struct phase* p, int burst) {
+  int flying = p->altitude > p->ground + PHASE_LIFT;
+  int rising = flying && p->rate > PHASE_ASCENT_RATE;
+  int falling = flying && (burst || p->rate < PHASE_DESCENT_RATE);
+  int level = absolute(p->rate) < PHASE_LEVEL_RATE;
+
+  switch (p->phase) {
+    case PHASE_GROUND:
+      if (rising) return PHASE_ASCENT;
+      break;
+    case PHASE_ASCENT:
+      if (falling) return PHASE_DESCENT;
+      if (level) return PHASE_FLOAT;
+      break;
+    case PHASE_FLOAT:
+      if (falling) return PHASE_DESCENT;
+      if (rising) return PHASE_ASCENT;
+      break;
+    case PHASE_DESCENT:
+      if (level) return PHASE_LANDED;
+      break;
+    case PHASE_LANDED:
+      /* Burst stays set, so only the rate takes us back */
+      if (flying && p->rate < PHASE_DESCENT_RATE) return PHASE_DESCENT;
+      break;
+  }
+  return p->phase;
+}
+
+/**
+ * Takes the latest altitude dt ms after the last. Returns non-zero
+ * if the phase changed.
+ */
+int phase_update(struct phase* p, struct estimator* e, struct gps_data* gd,
+		 uint32_t dt) {
+  uint8_t next;
+
+  p->since_fix += dt;
+  if (gd->satellites >= PHASE_GPS_SATELLITES &&
+      !(gd->altitude == 0 && gd->lat == 0 && gd->lon == 0)) {
+    phase_fix(p, gd);
+  }
+
+  /* The barometer if we can, otherwise the GPS */
+  if (estimator_valid(e)) {
+    p->altitude = estimator_altitude(e);
+    p->rate = estimator_rate(e);
+  } else if (p->have_fix && p->since_fix <= PHASE_FIX_TIMEOUT) {
+    p->altitude = p->gps_altitude;
+    p->rate = p->gps_rate;
+  } else {
+    return 0;			/* Nothing to go on, stay where we are */
+  }
+
+  if (!p->have_ground) {
+    p->ground = (p->altitude < PHASE_LAUNCH_CEILING) ? p->altitude : 0;
+    p->have_ground = 1;
+  } else if (p->phase == PHASE_GROUND && p->altitude < p->ground) {
+    p->ground = p->altitude;
+  }
+
+  next = phase_next(p, e->burst);
+  if (next != p->candidate) {
+    p->candidate = next;
+    p->dwell = 0;
+  } else if (next != p->phase) {
+    p->dwell += dt;
+    if (p->dwell >= phase_dwell[next]) {
+      p->phase = next;
+      p->dwell = 0;
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/**
+ * Sets the phase in a frame, and where we'll land if we're coming
+ * down. That's assuming we land as high as we launched, at the rate
+ * we're falling now and drifting as we are now, so it gets better the
+ * closer we get.
+ */
+void phase_fill_frame(struct phase* p, struct frame* f) {
+  int32_t seconds;
+
+  f->phase = p->phase;
+  f->landing_seconds = 0;
+  f->landing_latitude = p->latitude;
+  f->landing_longitude = p->longitude;
+
+  if (p->phase != PHASE_DESCENT || p->rate >= 0) return;
+
+  seconds = (p->altitude - p->ground) / -p->rate;
+  if (seconds < 0) seconds = 0;
+  if (seconds > UINT16_MAX) seconds = UINT16_MAX;
+
+  f->landing_seconds = seconds;
+  f->landing_latitude += (int32_t)(((int64_t)p->drift_latitude * seconds) / 256);
+  f->landing_longitude += (int32_t)(((int64_t)p->drift_longitude * seconds) / 256);
+}
+
+/**
+ * Returns the seconds between sentence starts in a phase
+ */
+uint32_t phase_interval(uint8_t phase) {
+  return (phase < PHASES) ? phase_intervals[phase] : 0;
+}
+
+#ifdef PHASE_TEST
+
+#include <stdio.h>
+#include <stdlib.h>
+
+void check(int ok, const char* what) {
+  if (!ok) {
+    printf("\nERROR: %s\n", what);
+    exit(1);
+  }
+  printf("%s\n", what);
+}
+
+/**
+ * A flight, flown one second at a time along a profile
+ */
+struct flight {
+  struct phase p;
+  struct estimator e;
+  struct gps_data gd;
+  double altitude;
+  int t, changed;
+};
+
+void fly(struct flight* fl, int seconds, double rate, double drift,
+	 int barometer) {
+  int i;
+
+  for (i = 0; i < seconds; i++, fl->t++) {
+    fl->altitude += rate;
+    fl->e.altitude = (int32_t)(fl->altitude * 1000);
+    fl->e.rate = (int32_t)(rate * 1000);
+    fl->e.since_accepted = barometer ? 0 : 1000000;
+    if (rate < -3) fl->e.burst = 1;
+    fl->gd.altitude = (int)fl->altitude;
+    fl->gd.lon += drift;
+
+    if (phase_update(&fl->p, &fl->e, &fl->gd, 1000)) {
+      printf("%5ds %6.0fm: phase %d\n", fl->t, fl->altitude, fl->p.phase);
+      fl->changed = fl->t;
+    }
+  }
+}
+
+#define DRIFT	0.0001		/* About 7m/s east */
+
+int main(void) {
+  struct flight fl;
+  struct frame f;
+  double landing_lon;
+
+  printf("*** PHASE_TEST ***\n\n");
+
+  memset(&fl, 0, sizeof(fl));
+  phase_init(&fl.p);
+  estimator_init(&fl.e);
+  fl.e.settled = 3;
+  fl.altitude = 150;
+  fl.gd.lat = 51.5; fl.gd.lon = -2.6; fl.gd.satellites = 8;
+
+  fly(&fl, 300, 0, 0, 1);
+  check(fl.p.phase == PHASE_GROUND, "Ground before launch");
+  check(fl.p.ground == 150000, "Ground altitude from the first reading");
+  fly(&fl, 15, 0.5, 0, 1);
+  check(fl.p.phase == PHASE_GROUND, "Slow drift isn't a launch");
+
+  fly(&fl, 4000, 5, DRIFT, 1);
+  check(fl.p.phase == PHASE_ASCENT, "Ascent");
+  check(fl.changed < 315 + 60, "Ascent within a minute of launch");
+
+  fly(&fl, 600, 0.2, DRIFT, 1);
+  check(fl.p.phase == PHASE_FLOAT, "Float");
+  fly(&fl, 15, 2, DRIFT, 1);
+  check(fl.p.phase == PHASE_FLOAT, "A gust isn't another ascent");
+
+  fly(&fl, 600, -10, DRIFT, 1);
+  check(fl.p.phase == PHASE_DESCENT, "Descent");
+
+  /* Halfway down, predict the landing */
+  phase_fill_frame(&fl.p, &f);
+  landing_lon = fl.gd.lon + (DRIFT * (fl.altitude - 150) / 10);
+  printf("Landing in %ds at %d, expected %d\n", f.landing_seconds,
+	 f.landing_longitude, (int)(landing_lon * 1000000));
+  check(f.phase == PHASE_DESCENT, "Frame has the phase");
+  check(abs((int)f.landing_seconds - (int)((fl.altitude - 150) / 10)) <= 2,
+	"Landing time within 2s");
+  check(abs(f.landing_longitude - (int32_t)(landing_lon * 1000000)) < 1000,
+	"Landing longitude within 0.001 degrees");
+
+  /* Down to the ground, where the barometer fails */
+  fly(&fl, (int)((fl.altitude - 150) / 10), -10, DRIFT, 1);
+  fly(&fl, 120, 0, 0, 0);
+  check(fl.p.phase == PHASE_LANDED, "Landed from the GPS alone");
+  phase_fill_frame(&fl.p, &f);
+  check(f.landing_seconds == 0, "No landing prediction once landed");
+
+  /* A GPS glitch of 3km in a second is 3e9 in mm/s x 1000 */
+  fl.gd.altitude += 3000;
+  phase_update(&fl.p, &fl.e, &fl.gd, 1000);
+  check(fl.p.gps_rate > 3000000 / PHASE_GPS_FILTER - 1000, "A 3km glitch doesn't overflow");
+
+  check(phase_interval(PHASE_ASCENT) == PHASE_ASCENT_INTERVAL &&
+	phase_interval(PHASE_LANDED) == PHASE_LANDED_INTERVAL, "Intervals");
+
+  printf("\n*** DONE ***\n");
+
+  return 0;
+}
+
+#endif
@@ -0,0 +1,143 @@
+/*
+ * Fixed size blocks from a shared arena
+ * Copyright (C) 2014  richard
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "LPC11xx.h"
+#include <stddef.h>
+#include "pool.h"
+
+/**
+ * Interrupts take and give back blocks too
+ */
+#ifndef POOL_TEST
+#define POOL_LOCK()		__disable_irq()
+#define POOL_UNLOCK()		__enable_irq()
+#else
+#define POOL_LOCK()
+#define POOL_UNLOCK()
+#endif
+
+/**
+ * The arena, word aligned, and a bit for each block that's in use
+ */
+uint32_t pool_arena[POOL_BLOCKS][POOL_BLOCK_SIZE / 4];
+uint32_t pool_used = 0;
+struct pool_stats pool_stats;
+
+/**
+ * Returns a block of POOL_BLOCK_SIZE bytes, or NULL if they're all in
+ * use.
+ */
+void* pool_alloc(void) {
+  void* block = NULL;
+  uint8_t i;
+
+  POOL_LOCK();
+  for (i = 0; i < POOL_BLOCKS; i++) {
+    if (!(pool_used & (1 << i))) {
+      pool_used |= (1 << i);
+      block = pool_arena[i];
+
+      if (++pool_stats.in_use > pool_stats.peak) {
+	pool_stats.peak = pool_stats.in_use;
+      }
+      break;
+    }
+  }
+  if (!block) {
+    pool_stats.failures++;
+  }
+  POOL_UNLOCK();
+
+  return block;
+}
+/**
+ * Gives a block back
+ */
+void pool_free(void* block) {
+  uint32_t i;
+
+  if (block == NULL) return;
+  i = ((uint32_t*)block - pool_arena[0]) / (POOL_BLOCK_SIZE / 4);
+  if (i >= POOL_BLOCKS) return;
+
+  POOL_LOCK();
+  if (pool_used & (1 << i)) {
+    pool_used &= ~(1 << i);
+    pool_stats.in_use--;
+  }
+  POOL_UNLOCK();
+}
+
+void pool_get_stats(struct pool_stats* stats) {
+  POOL_LOCK();
+  *stats = pool_stats;
+  POOL_UNLOCK();
+}
+
+#ifdef POOL_TEST
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+int main(void) {
+  void* blocks[POOL_BLOCKS];
+  struct pool_stats stats;
+  int i;
+
+  printf("*** POOL_TEST ***\n\n");
+
+  for (i = 0; i < POOL_BLOCKS; i++) {
+    blocks[i] = pool_alloc();
+    assert(blocks[i] != NULL);
+    assert(((uintptr_t)blocks[i] & 3) == 0);
+    memset(blocks[i], i, POOL_BLOCK_SIZE);
+  }
+  assert(pool_alloc() == NULL);
+
+  /* Each block is whole and apart from the others */
+  for (i = 0; i < POOL_BLOCKS; i++) {
+    assert(((uint8_t*)blocks[i])[0] == i);
+    assert(((uint8_t*)blocks[i])[POOL_BLOCK_SIZE - 1] == i);
+  }
+
+  /* A freed block is the next one out, and freeing twice does nothing */
+  pool_free(blocks[1]);
+  pool_free(blocks[1]);
+  pool_free(NULL);
+  assert(pool_alloc() == blocks[1]);
+  pool_free(blocks[0]);
+
+  pool_get_stats(&stats);
+  printf("%d in use, %d at most, %d failed\n", stats.in_use, stats.peak,
+	 stats.failures);
+  assert(stats.in_use == POOL_BLOCKS - 1);
+  assert(stats.peak == POOL_BLOCKS);
+  assert(stats.failures == 1);
+
+  printf("\n*** DONE ***\n");
+  return 0;
+}
+
+#endif
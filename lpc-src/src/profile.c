@@ -0,0 +1,295 @@
+/*
+ * Lightweight cycle-count profiling using the SysTick
+ * Copyright (C) 2014  richard
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "LPC11xx.h"
+#include <string.h>
+#include "profile.h"
+#include "clock.h"
+
+/**
+ * Timestamps are the number of SysTicks so far multiplied by the
+ * SysTick reload value, plus how far we are into the current tick.
+ * They're in cycles of the fast clock whatever speed we're running
+ * at, so durations that span a clock change still add up. They wrap
+ * every 2^32 cycles (~90 seconds at 48MHz) but the durations we
+ * measure are much shorter than that.
+ *
+ * If the SysTick interrupt can't run yet (in the CT32B0 interrupt or
+ * with interrupts disabled) when the counter reloads, the tick's
+ * pending in the ICSR and is counted from there. Only a tick missed
+ * altogether, with interrupts off for longer than a tick, is lost.
+ */
+
+/**
+ * SysTicks so far
+ */
+volatile uint32_t profile_ticks = 0;
+/**
+ * A histogram for each section
+ */
+struct profile_histogram profile_histograms[PROFILE_SECTIONS];
+/**
+ * When each stage of the boot finished
+ */
+uint32_t profile_boot[PROFILE_BOOT_STAGES];
+
+/**
+ * Called from the SysTick.
+ */
+void profile_tick(void) {
+  profile_ticks++;
+}
+
+#ifndef PROFILE_TEST
+#define PROFILE_VAL()		SysTick->VAL
+#define PROFILE_LOAD()		SysTick->LOAD
+#define PROFILE_PENDING()	(SCB->ICSR & SCB_ICSR_PENDSTSET_Msk)
+#else
+/**
+ * The SysTick as the test sets it up. VAL reads come from the list in
+ * turn, the last one repeated.
+ */
+uint32_t profile_test_val[2], profile_test_reads, profile_test_pending;
+volatile uint8_t clock_multiple = 4;
+static uint32_t profile_test_next_val(void) {
+  return profile_test_val[(profile_test_reads++ < 1) ? 0 : 1];
+}
+#define PROFILE_VAL()		profile_test_next_val()
+#define PROFILE_LOAD()		11999
+#define PROFILE_PENDING()	profile_test_pending
+#endif
+
+/**
+ * Returns the current time in fast clock cycles.
+ */
+uint32_t profile_now(void) {
+  uint32_t ticks, value, load, pending;
+
+  /* Re-read if the SysTick fired in between */
+  do {
+    ticks = profile_ticks;
+    value = PROFILE_VAL();
+    pending = 0;
+
+    /* A reload that's pending hasn't been counted yet. VAL's read
+       again so it's from after the reload too, unless it's 0 and the
+       reload's still to come. */
+    if (PROFILE_PENDING()) {
+      value = PROFILE_VAL();
+      pending = (value != 0);
+    }
+  } while (ticks != profile_ticks);
+  load = PROFILE_LOAD();
+
+  return (((ticks + pending) * (load + 1)) + (load - value)) * clock_multiple;
+}
+/**
+ * Records the time taken since start.
+ */
+void profile_record(enum profile_section section, uint32_t start) {
+  profile_add(section, profile_now() - start);
+}
+
+/**
+ * Returns the histogram bin for a duration.
+ */
+static uint8_t profile_bin(uint32_t cycles) {
+  uint8_t bin = 0;
+
+  cycles >>= PROFILE_BIN_SHIFT + 1;
+
+  while (cycles && bin < PROFILE_BINS - 1) {
+    cycles >>= 1; bin++;
+  }
+
+  return bin;
+}
+/**
+ * Adds a duration to a section's histogram.
+ */
+void profile_add(enum profile_section section, uint32_t cycles) {
+  struct profile_histogram* h = &profile_histograms[section];
+  uint8_t bin = profile_bin(cycles);
+
+  h->count++;
+  if (cycles > h->max) {
+    h->max = cycles;
+  }
+  if (h->bins[bin] < 0xFFFF) { /* Saturate */
+    h->bins[bin]++;
+  }
+}
+
+/**
+ * Writes a little-endian word
+ */
+static uint8_t* put_u32(uint8_t* b, uint32_t value) {
+  b[0] = value; b[1] = value >> 8; b[2] = value >> 16; b[3] = value >> 24;
+  return b + 4;
+}
+/**
+ * Writes the PROFILE_HEADER_SIZE bytes of header for a dump. Returns
+ * the number of bytes written.
+ */
+int profile_dump_header(uint8_t* header) {
+  uint8_t* b = header;
+
+  memcpy(b, PROFILE_MAGIC, 4); b += 4;
+  b = put_u32(b, profile_ticks);
+#ifndef PROFILE_TEST
+  b = put_u32(b, (SysTick->LOAD + 1) * clock_multiple);
+  b = put_u32(b, CLOCK_FAST_HZ);
+#else
+  b = put_u32(b, 240000);
+  b = put_u32(b, 12000000);
+#endif
+
+  return b - header;
+}
+/**
+ * Writes all the histograms into a buffer in the format described in
+ * profile.h, ready for the SD card. Returns the number of bytes
+ * written or 0 if the buffer is too small.
+ */
+int profile_dump(uint8_t* buffer, int length) {
+  uint8_t* b = buffer;
+  int s, i;
+
+  if (length < PROFILE_DUMP_SIZE) {
+    return 0;
+  }
+
+  b += profile_dump_header(b);
+
+  for (s = 0; s < PROFILE_SECTIONS; s++) {
+    b = put_u32(b, profile_histograms[s].count);
+    b = put_u32(b, profile_histograms[s].max);
+
+    for (i = 0; i < PROFILE_BINS; i++) {
+      *b++ = profile_histograms[s].bins[i];
+      *b++ = profile_histograms[s].bins[i] >> 8;
+    }
+  }
+
+  return b - buffer;
+}
+/**
+ * Writes the PROFILE_BOOT_SIZE byte boot record described in
+ * profile.h. Returns the number of bytes written.
+ */
+int profile_boot_dump(uint8_t* buffer) {
+  uint8_t* b = buffer;
+  int s;
+
+  memcpy(b, PROFILE_BOOT_MAGIC, 4); b += 4;
+  b = put_u32(b, CLOCK_FAST_HZ);
+  for (s = 0; s < PROFILE_BOOT_STAGES; s++) {
+    b = put_u32(b, profile_boot[s]);
+  }
+
+  return b - buffer;
+}
+
+#ifdef PROFILE_TEST
+
+#include <assert.h>
+#include <stdio.h>
+
+int main(void) {
+  printf("*** PROFILE_TEST ***\n\n");
+
+  /* Bin edges */
+  assert(profile_bin(0) == 0);
+  assert(profile_bin(127) == 0);
+  assert(profile_bin(128) == 1);
+  assert(profile_bin(255) == 1);
+  assert(profile_bin(256) == 2);
+  assert(profile_bin(0xFFFFFFFF) == PROFILE_BINS - 1);
+
+  profile_add(PROFILE_SD, 100000);
+  profile_add(PROFILE_SD, 200);
+  profile_add(PROFILE_CRC, 1000);
+
+  assert(profile_histograms[PROFILE_SD].count == 2);
+  assert(profile_histograms[PROFILE_SD].max == 100000);
+  assert(profile_histograms[PROFILE_SD].bins[1] == 1);
+  assert(profile_histograms[PROFILE_SD].bins[profile_bin(100000)] == 1);
+
+  uint8_t buffer[512];
+  int length = profile_dump(buffer, sizeof(buffer));
+
+  printf("Dump is %d bytes\n", length);
+  assert(length == PROFILE_DUMP_SIZE);
+  assert(memcmp(buffer, PROFILE_MAGIC, 4) == 0);
+  assert(profile_dump(buffer, PROFILE_DUMP_SIZE - 1) == 0);
+
+  /* The histograms can go to the card straight from memory */
+  assert(sizeof(struct profile_histogram) == PROFILE_RECORD_SIZE);
+  assert(profile_dump_header(buffer) == PROFILE_HEADER_SIZE);
+  assert(memcmp(buffer + PROFILE_HEADER_SIZE, profile_histograms,
+		sizeof(profile_histograms)) == 0);
+
+  /* The boot record */
+  profile_boot[PROFILE_BOOT_INTERFACES] = 0x12345678;
+  profile_boot[PROFILE_BOOT_SD] = 48000000;
+  assert(profile_boot_dump(buffer) == PROFILE_BOOT_SIZE);
+  assert(memcmp(buffer, PROFILE_BOOT_MAGIC, 4) == 0);
+  assert(buffer[8] == 0x78 && buffer[11] == 0x12);
+  assert(buffer[PROFILE_BOOT_SIZE - 4] == (48000000 & 0xFF));
+  printf("Boot record is %d bytes\n", PROFILE_BOOT_SIZE);
+
+  /* Timestamps, 12000 cycles a tick at a quarter of the fast clock */
+  uint32_t start;
+
+  profile_ticks = 5;
+  profile_test_val[0] = profile_test_val[1] = 11999 - 100;
+  profile_test_reads = 0;
+  assert(profile_now() == ((5 * 12000) + 100) * 4);
+
+  /* Across a reload that's pending, as in the CT32B0 interrupt */
+  profile_test_val[0] = profile_test_val[1] = 2;
+  profile_test_reads = 0;
+  start = profile_now();
+  profile_test_val[0] = profile_test_val[1] = 11990;
+  profile_test_reads = 0;
+  profile_test_pending = 1;
+  assert(profile_now() - start == 12 * 4);
+  profile_record(PROFILE_CRC, start);
+  assert(profile_histograms[PROFILE_CRC].max == 1000);
+
+  /* The reload pended between reading VAL and the ICSR */
+  profile_test_val[0] = 1; profile_test_val[1] = 11999;
+  profile_test_reads = 0;
+  assert(profile_now() - start == 3 * 4);
+
+  /* Pending as VAL gets to 0, and the reload's still to come */
+  profile_test_val[0] = profile_test_val[1] = 0;
+  profile_test_reads = 0;
+  assert(profile_now() - start == 2 * 4);
+  printf("Timestamps count a pending SysTick reload\n");
+
+  printf("\n*** DONE ***\n");
+}
+
+#endif
@@ -24,16 +24,36 @@
 
 #include "LPC11xx.h"
 #include <string.h>
-#include <stdio.h>
-#include <stdlib.h>
-#include <math.h>
 #include "protocol.h"
+#include "fmt.h"
 #include "bmp085.h"
 #include "gps.h"
 #include "imu.h"
+#include "idle.h"
+#include "profile.h"
 
 int sentence_id = 0;
 
+/**
+ * The ID the next sentence gets, and carrying on from one after a
+ * warm reset
+ */
+uint32_t communications_next_id(void) {
+  return sentence_id;
+}
+void communications_resume_id(uint32_t id) {
+  sentence_id = id;
+}
+char checksum_delimiter = '*';
+
+/**
+ * Selects the characters frames are built from. The fields are already
+ * digits, upper case letters and ',.-:$', which ITA2 has.
+ */
+void communications_frame_charset(enum frame_charset charset) {
+  checksum_delimiter = (charset == FRAME_BAUDOT) ? '#' : '*';
+}
+
 /**
  * CRC Function for the XMODEM protocol.
  * http://www.nongnu.org/avr-libc/user-manual/group__util__crc.html#gaca726c22a1900f9bad52594c8846115f
@@ -67,7 +87,7 @@ uint16_t crc_checksum(char *string)
   crc = 0xFFFF;
 
   // Calculate checksum ignoring the first two $s
-  for (i = 2; i < strlen(string); i++) {
+  for (i = 2; string[i]; i++) {
     c = string[i];
     crc = crc_xmodem_update(crc, c);
   }
@@ -76,89 +96,347 @@ uint16_t crc_checksum(char *string)
 }
 
 /**
- * Printing helper functions. From
- * http://ukhas.org.uk/guides:common_coding_errors_payload_testing
+ * Text for each type of field. Integers are printed with a decimal
+ * point precision places from the right, after dividing by the rest
+ * of their scale. The scale and precision are constants from
+ * FRAME_FIELDS, so each field gets its own straight line code.
+ */
+#define POW10(n)	((n) == 0 ? 1 : (n) == 1 ? 10 : (n) == 2 ? 100 :	\
+			 (n) == 3 ? 1000 : (n) == 4 ? 10000 :		\
+			 (n) == 5 ? 100000 : 1000000)
+
+static char* put_text(char* p, const char* text) {
+  int i;
+
+  for (i = 0; i < FRAME_TEXT_MAX && text[i]; i++) *p++ = text[i];
+  return p;
+}
+static char* put_time(char* p, frame_time t) {
+  uint32_t hours = t / 3600, minutes = (t / 60) % 60, seconds = t % 60;
+
+  *p++ = '0' + (hours / 10); *p++ = '0' + (hours % 10); *p++ = ':';
+  *p++ = '0' + (minutes / 10); *p++ = '0' + (minutes % 10); *p++ = ':';
+  *p++ = '0' + (seconds / 10); *p++ = '0' + (seconds % 10);
+  return p;
+}
+#define put_int32_t(p, v, divisor, precision)	fmt_signed(p, v, divisor, precision)
+#define put_int16_t(p, v, divisor, precision)	fmt_signed(p, v, divisor, precision)
+#define put_uint16_t(p, v, divisor, precision)	fmt_signed(p, v, divisor, precision)
+#define put_uint8_t(p, v, divisor, precision)	fmt_signed(p, v, divisor, precision)
+#define put_uint32_t(p, v, divisor, precision)	fmt_unsigned(p, v, precision)
+#define put_frame_text(p, v, divisor, precision) put_text(p, v)
+#define put_frame_time(p, v, divisor, precision) put_time(p, v)
+
+/**
+ * Whether a field's in the text. The phase is decoded before any field
+ * that depends on it.
+ */
+#define FRAME_IN_TEXT(w, phases)					\
+  ((w) == (where & (FRAME_RADIO | FRAME_SD)) &&				\
+   ((where & FRAME_EVERY_PHASE) ||					\
+    ((((phases) >> f->phase) & 1) == !(where & FRAME_OTHER_PHASES))))
+
+int frame_encode_text(char* string, int size, const struct frame* f, int where) {
+  char* p = string;
+  char* end = string + size;
+
+#define FRAME_ENCODE(name, type, scale, precision, w, phases, description) \
+  if (FRAME_IN_TEXT(w, phases)) {					\
+    if (end - p < FRAME_FIELD_MAX + 2) return 0;			\
+    p = put_##type(p, f->name, (scale) / POW10(precision), precision);	\
+    *p++ = ',';								\
+  }
+  FRAME_FIELDS(FRAME_ENCODE)
+#undef FRAME_ENCODE
+
+  if (p > string) p--; // Delete last comma
+  *p = '\0';
+  return p - string;
+}
+
+/**
+ * And back again, for the ground station. Each takes one field from p
+ * to end.
  */
-int print_six_dp(char* s, size_t n, double val) {
-  int i1 = val;
-  long i2 = labs(lround((val - i1) * 1000000));
+static int get_number(const char* p, const char* end, int64_t* value,
+		      int64_t divisor, int precision) {
+  int negative = 0, places = -1;
+  int64_t v = 0;
+
+  if (p < end && *p == '-') { negative = 1; p++; }
+  if (p == end) return -1;
+  for (; p < end; p++) {
+    if (*p == '.' && places < 0) {
+      places = 0;
+    } else if (*p >= '0' && *p <= '9' && v < 100000000000LL) {
+      if (places == precision) continue; // Any more are dropped
+      v = (v * 10) + (*p - '0');
+      if (places >= 0) places++;
+    } else {
+      return -1;
+    }
+  }
+  for (places = (places < 0) ? 0 : places; places < precision; places++) v *= 10;
 
-  // Edge case: increase magnitude of i1, set i2 = 0
-  if (i2 == 1000000) { i1 += (val > 0 ? 1 : -1); i2 = 0; }
+  *value = (negative ? -v : v) * divisor;
+  return 0;
+}
+#define FRAME_GET_INTEGER(type, min, max)				\
+  static int get_##type(const char* p, const char* end, type* v,	\
+			int64_t divisor, int precision) {		\
+    int64_t value;							\
+    if (get_number(p, end, &value, divisor, precision) ||		\
+	value < (min) || value > (max)) return -1;			\
+    *v = value;								\
+    return 0;								\
+  }
+FRAME_GET_INTEGER(int32_t, INT32_MIN, INT32_MAX)
+FRAME_GET_INTEGER(int16_t, INT16_MIN, INT16_MAX)
+FRAME_GET_INTEGER(uint32_t, 0, UINT32_MAX)
+FRAME_GET_INTEGER(uint16_t, 0, UINT16_MAX)
+FRAME_GET_INTEGER(uint8_t, 0, UINT8_MAX)
+
+static int get_frame_text(const char* p, const char* end, frame_text* v,
+			  int64_t divisor, int precision) {
+  (void)divisor; (void)precision;
+  if (end - p > FRAME_TEXT_MAX) return -1;
+  memcpy(*v, p, end - p);
+  (*v)[end - p] = '\0';
+  return 0;
+}
+static int get_frame_time(const char* p, const char* end, frame_time* v,
+			  int64_t divisor, int precision) {
+  int i, hms[3];
+  (void)divisor; (void)precision;
+
+  if (end - p != 8 || p[2] != ':' || p[5] != ':') return -1;
+  for (i = 0; i < 3; i++, p += 3) {
+    if (p[0] < '0' || p[0] > '9' || p[1] < '0' || p[1] > '9') return -1;
+    hms[i] = ((p[0] - '0') * 10) + (p[1] - '0');
+  }
+  if (hms[0] > 23 || hms[1] > 59 || hms[2] > 60) return -1;
 
-  return snprintf(s, n, "%s%li.%06li,", (val < 0 ? "-" : ""), labs(i1), i2);
+  *v = (hms[0] * 3600) + (hms[1] * 60) + hms[2];
+  return 0;
 }
-int print_one_dp(char* s, size_t n, double val) {
-  int i1 = val;
-  long i2 = labs(lround((val - i1) * 10));
 
-  // Edge case: increase magnitude of i1, set i2 = 0
-  if (i2 == 10) { i1 += (val > 0 ? 1 : -1); i2 = 0; }
+int frame_decode_text(const char* string, const char* end, struct frame* f,
+		      int where) {
+  const char* p = string;
+  int fields = 0;
+
+#define FRAME_DECODE(name, type, scale, precision, w, phases, description) \
+  if (FRAME_IN_TEXT(w, phases)) {					\
+    const char* e = p;							\
+    if (fields++ && (p == end || *p++ != ',')) return -1;		\
+    for (e = p; e < end && *e != ','; e++);				\
+    if (get_##type(p, e, &f->name, (scale) / POW10(precision),		\
+		   precision)) return -1;				\
+    p = e;								\
+  }
+  FRAME_FIELDS(FRAME_DECODE)
+#undef FRAME_DECODE
 
-  return snprintf(s, n, "%s%li.%01li,", (val < 0 ? "-" : ""), labs(i1), i2);
+  return (p == end) ? 0 : -1;
+}
+
+/**
+ * Binary frames, little endian. Text is null terminated and times are
+ * three bytes.
+ */
+static uint8_t* pack_bytes(uint8_t* p, uint32_t v, int bytes) {
+  while (bytes--) { *p++ = v; v >>= 8; }
+  return p;
+}
+static uint8_t* pack_text(uint8_t* p, const char* text) {
+  int i;
+
+  for (i = 0; i < FRAME_TEXT_MAX && text[i]; i++) *p++ = text[i];
+  *p++ = '\0';
+  return p;
+}
+#define pack_int32_t(p, v)	pack_bytes(p, v, 4)
+#define pack_uint32_t(p, v)	pack_bytes(p, v, 4)
+#define pack_int16_t(p, v)	pack_bytes(p, (uint16_t)(v), 2)
+#define pack_uint16_t(p, v)	pack_bytes(p, v, 2)
+#define pack_uint8_t(p, v)	pack_bytes(p, v, 1)
+#define pack_frame_time(p, v)	pack_bytes(p, v, 3)
+#define pack_frame_text(p, v)	pack_text(p, v)
+
+int frame_pack(uint8_t* data, int size, const struct frame* f, int where) {
+  uint8_t* p = data;
+  uint8_t* end = data + size;
+
+#define FRAME_PACK(name, type, scale, precision, w, phases, description) \
+  if ((w) & where) {							\
+    if (end - p < FRAME_FIELD_MAX) return 0;				\
+    p = pack_##type(p, f->name);					\
+  }
+  FRAME_FIELDS(FRAME_PACK)
+#undef FRAME_PACK
+
+  return p - data;
+}
+
+static uint32_t unpack_bytes(const uint8_t** p, int bytes) {
+  uint32_t v = 0;
+  int i;
+
+  for (i = 0; i < bytes; i++) v |= (uint32_t)*(*p)++ << (8 * i);
+  return v;
+}
+static int unpack_text(const uint8_t** p, const uint8_t* end, char* text) {
+  int i;
+
+  for (i = 0; *p < end && i <= FRAME_TEXT_MAX; i++) {
+    if ((text[i] = *(*p)++) == '\0') return 0;
+  }
+  return -1;
+}
+#define unpack_int32_t(p, end, v)	(*(v) = unpack_bytes(p, 4), 0)
+#define unpack_uint32_t(p, end, v)	(*(v) = unpack_bytes(p, 4), 0)
+#define unpack_int16_t(p, end, v)	(*(v) = unpack_bytes(p, 2), 0)
+#define unpack_uint16_t(p, end, v)	(*(v) = unpack_bytes(p, 2), 0)
+#define unpack_uint8_t(p, end, v)	(*(v) = unpack_bytes(p, 1), 0)
+#define unpack_frame_time(p, end, v)	(*(v) = unpack_bytes(p, 3), 0)
+#define unpack_frame_text(p, end, v)	unpack_text(p, end, *(v))
+
+/* The fewest bytes each can be */
+#define BYTES_int32_t		4
+#define BYTES_uint32_t		4
+#define BYTES_int16_t		2
+#define BYTES_uint16_t		2
+#define BYTES_uint8_t		1
+#define BYTES_frame_time	3
+#define BYTES_frame_text	1
+
+int frame_unpack(const uint8_t* data, int size, struct frame* f, int where) {
+  const uint8_t* p = data;
+  const uint8_t* end = data + size;
+
+#define FRAME_UNPACK(name, type, scale, precision, w, phases, description) \
+  if ((w) & where) {							\
+    if (end - p < BYTES_##type) return -1;				\
+    if (unpack_##type(&p, end, &f->name)) return -1;			\
+  }
+  FRAME_FIELDS(FRAME_UNPACK)
+#undef FRAME_UNPACK
+
+  return (p == end) ? 0 : -1;
+}
+
+/**
+ * Fills in the radio fields of a frame from the sensors
+ */
+void fill_communications_frame(struct frame* f, struct gps_time* gt,
+			       struct barometer* b, struct gps_data* gd,
+			       double b_altitude, double ascent_rate,
+			       double temperature,
+			       struct imu_raw* ir,
+			       int cutdown_minutes, float cutdown_voltage,
+			       int sleep_percentage)
+{
+  strcpy(f->callsign, CALLSIGN);
+  f->sentence_id = sentence_id++;
+  f->time = (gt->hours * 3600) + (gt->minutes * 60) + gt->seconds;
+  FRAME_SET(f, latitude, gd->lat);
+  FRAME_SET(f, longitude, gd->lon);
+  f->gps_altitude = gd->altitude;
+  f->satellites = gd->satellites;
+  FRAME_SET(f, altitude, b_altitude);
+  FRAME_SET(f, ascent_rate, ascent_rate);
+  FRAME_SET(f, external_temperature, temperature);
+  FRAME_SET(f, internal_temperature, b->temperature);
+  f->accel_x = ir->accel.x; f->accel_y = ir->accel.y; f->accel_z = ir->accel.z;
+  f->cutdown_minutes = cutdown_minutes;
+  FRAME_SET(f, cutdown_voltage, cutdown_voltage);
+  f->sleep_percentage = sleep_percentage;
 }
 
 /**
  * Builds a communctions frame compliant with the protocol described
- * at http://ukhas.org.uk/communication:protocol
+ * at http://ukhas.org.uk/communication:protocol, with the fields for
+ * the frame's phase or with FRAME_EVERY_PHASE all of them
  */
-int build_communications_frame(char* string, int string_size, struct gps_time* gt,
-			     struct barometer* b, struct gps_data* gd,
-			     double b_altitude, double temperature,
-			     struct imu_raw* ir,
-			     int cutdown_minutes, float cutdown_voltage)
+int communications_frame_text(char* string, int string_size, const struct frame* f,
+			      int where)
 {
   int print_size;
 
-  print_size = snprintf(string, string_size,
-			"$$%s,%d,%02d:%02d:%02d,",
-			CALLSIGN, sentence_id++,
-			gt->hours, gt->minutes, gt->seconds);
-  /* GPS */
-  print_size += print_six_dp(string + print_size, string_size - print_size,
-			     gd->lat);
-  print_size += print_six_dp(string + print_size, string_size - print_size,
-			     gd->lon);
-  print_size += snprintf(string + print_size, string_size - print_size,
-			 "%d,%d,", gd->altitude, gd->satellites);
-
-  /* Barometer & Temperature */
-  print_size += print_one_dp(string + print_size, string_size - print_size,
-			     b_altitude);
-  print_size += print_one_dp(string + print_size, string_size - print_size,
-			     temperature);
-  print_size += print_one_dp(string + print_size, string_size - print_size,
-			     b->temperature);
-
-  /* Acceleration */
-  print_size += snprintf(string + print_size, string_size - print_size,
-			 "%d,%d,%d,",
-			 ir->accel.x, ir->accel.y, ir->accel.z);
-  /* Cutdown */
-  print_size += snprintf(string + print_size, string_size - print_size,
-			 "%d,", cutdown_minutes);
-  print_size += print_one_dp(string + print_size, string_size - print_size,
-			     cutdown_voltage);
-  print_size--; string[print_size] = '\0';// Delete last comma
+  string[0] = string[1] = '$';
+  print_size = 2 + frame_encode_text(string + 2, string_size - 2, f,
+				     FRAME_RADIO | (where & FRAME_EVERY_PHASE));
 
   /* If the above print plus checksum will be truncated */
-  if (print_size >= (string_size - 7)) {
+  if (print_size == 2 || print_size >= (string_size - 7)) {
 #ifdef DEBUG
     while(1); // Assert
 #endif
   } else {                      /* Add checksum */
+    PROFILE_START(crc_start);
+    uint16_t crc = crc_checksum(string);
+    PROFILE_END(PROFILE_CRC, crc_start);
+
     /* Star + 4 Hex + \n + \0 */
-    print_size += sprintf(string + print_size, "*%04X\n", crc_checksum(string));
+    char* p = string + print_size;
+    *p++ = checksum_delimiter;
+    p = fmt_hex(p, crc, 4);
+    *p++ = '\n';
+    *p = '\0';
 
-    return print_size + 1; // +1 for null terminator
+    return print_size + 7; // Including the null terminator
   }
 
   return 0;
 }
-int communications_frame_add_extra(char* string, int string_length, struct imu_raw* ir) {
-  return snprintf(string, string_length, "*%d,%d,%d,%d,%d,%d\n",
-	   ir->gyro.x, ir->gyro.y, ir->gyro.z,
-	   ir->magneto.x, ir->magneto.y, ir->magneto.z);
+/**
+ * The same, as an ascent frame, for tools that don't track the phase
+ */
+int build_communications_frame(char* string, int string_size, struct gps_time* gt,
+			     struct barometer* b, struct gps_data* gd,
+			     double b_altitude, double ascent_rate,
+			     double temperature,
+			     struct imu_raw* ir,
+			     int cutdown_minutes, float cutdown_voltage,
+			     int sleep_percentage)
+{
+  struct frame f;
+
+  memset(&f, 0, sizeof(f));
+  fill_communications_frame(&f, gt, b, gd, b_altitude, ascent_rate, temperature,
+			    ir, cutdown_minutes, cutdown_voltage, sleep_percentage);
+  f.phase = PHASE_ASCENT;
+  return communications_frame_text(string, string_size, &f, FRAME_RADIO);
+}
+/**
+ * Builds what goes after the sentence on the SD card: a '*', the extra
+ * fields, another '*' and then the radio fields that the sentence left
+ * out for its phase. The extra fields are filled in to f.
+ *
+ * Returns the length without the null terminator, or 0 if it doesn't
+ * fit.
+ */
+int communications_frame_add_extra(char* string, int string_length, struct frame* f,
+				   struct imu_raw* ir, struct idle_residency* residency) {
+  int length;
+
+  f->gyro_x = ir->gyro.x; f->gyro_y = ir->gyro.y; f->gyro_z = ir->gyro.z;
+  f->magneto_x = ir->magneto.x; f->magneto_y = ir->magneto.y; f->magneto_z = ir->magneto.z;
+  f->ticks_active = residency->ticks[IDLE_ACTIVE];
+  f->ticks_asleep = residency->ticks[IDLE_SLEEP];
+  f->ticks_deep_sleep = residency->ticks[IDLE_DEEP_SLEEP];
+
+  if (string_length < 4) return 0;
+  string[0] = '*';
+  length = 1 + frame_encode_text(string + 1, string_length - 3, f, FRAME_SD);
+  if (length == 1) return 0;
+  string[length++] = '*';
+  length += frame_encode_text(string + length, string_length - length - 1, f,
+			      FRAME_RADIO | FRAME_OTHER_PHASES);
+  string[length++] = '\n';
+  string[length] = '\0';
+
+  return length;
 }
 
 #ifdef PROTOCOL_TEST
@@ -191,11 +469,108 @@ int main(int argc, char** argv) {
   gd.lat = 51.23445; gd.lon = -2.23554;
   gd.altitude = 2333; gd.satellites = 9;
   ir.accel.x = 100; ir.accel.y = 100; ir.accel.z = 100;
+  ir.gyro.x = 10; ir.gyro.y = 10; ir.gyro.z = 10;
+  ir.magneto.x = 200; ir.magneto.y = 200; ir.magneto.z = 200;
+
+  struct idle_residency residency = { { 1000, 3000, 0 } };
+  struct frame sd;
+  int length;
 
-  build_communications_frame(string, 1000, &gt, &b, &gd, 145.2, -0.2, &ir, 120, 5.6);
+  length = build_communications_frame(string, 1000, &gt, &b, &gd, 145.2, 5.1, -0.2, &ir,
+				      120, 5.6, 75);
 
   printf("%s", string);
 
+  memset(&sd, 0, sizeof(sd));
+  fill_communications_frame(&sd, &gt, &b, &gd, 145.2, 5.1, -0.2, &ir, 120, 5.6, 75);
+  sd.phase = PHASE_ASCENT;
+  FRAME_SET(&sd, battery_voltage, 3.95); FRAME_SET(&sd, battery_min, 3.9);
+  FRAME_SET(&sd, battery_max, 4.01); FRAME_SET(&sd, cutdown_min, 5.5);
+  sd.heater_current = 120; sd.heater_max = 180; sd.charge_used = 250;
+  sd.battery_charge = 87;
+  length -= 2; // Remove \n\0
+  length += communications_frame_add_extra(string + length, 1000 - length, &sd,
+					   &ir, &residency);
+  printf("%s", string);
+  assert(string[length - 1] == '\n' && string[length] == '\0');
+  assert(strstr(string, "*10,10,10,200,200,200,1000,3000,0,"
+		"3.95,3.90,4.01,5.50,120,180,250,0,0,0,0*100,100,100,87,75,"));
+  assert(communications_frame_add_extra(string, 20, &sd, &ir, &residency) == 0);
+
+  /* Nothing ITA2 doesn't have */
+  communications_frame_charset(FRAME_BAUDOT);
+  build_communications_frame(string, 1000, &gt, &b, &gd, 145.2, -5.1, -0.2, &ir,
+			     120, 5.6, 75);
+  printf("%s", string);
+  assert(strspn(string, "$ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789,.-:#\n") ==
+	 strlen(string));
+  communications_frame_charset(FRAME_ASCII);
+
+  /* Each field back out of the text and a binary frame */
+  struct frame f, text, binary;
+  uint8_t data[200];
+  memset(&f, 0, sizeof(f)); memset(&text, 0, sizeof(text));
+  memset(&binary, 0, sizeof(binary));
+  strcpy(f.callsign, CALLSIGN);
+  f.sentence_id = 1234; f.time = 86399;
+  FRAME_SET(&f, latitude, -51.234567); FRAME_SET(&f, longitude, 2.5);
+  f.gps_altitude = -20; f.satellites = 255;
+  FRAME_SET(&f, altitude, 30123.4); FRAME_SET(&f, ascent_rate, -0.5);
+  FRAME_SET(&f, external_temperature, -55.1); FRAME_SET(&f, internal_temperature, 0);
+  f.accel_x = -32768; f.accel_y = 32767; f.accel_z = 0;
+  f.cutdown_minutes = -1; FRAME_SET(&f, cutdown_voltage, 65.5); f.sleep_percentage = 100;
+  f.battery_charge = 100;
+  f.phase = PHASE_DESCENT; f.landing_seconds = 65535;
+  FRAME_SET(&f, landing_latitude, -51.3); FRAME_SET(&f, landing_longitude, 2.6);
+  f.gyro_x = 1; f.gyro_y = -2; f.gyro_z = 3;
+  f.magneto_x = 4; f.magneto_y = -5; f.magneto_z = 6;
+  f.ticks_active = 0xFFFFFFFF; f.ticks_asleep = 0; f.ticks_deep_sleep = 12345678;
+  FRAME_SET(&f, battery_voltage, 4.2); FRAME_SET(&f, battery_min, 0);
+  FRAME_SET(&f, battery_max, 65.53); FRAME_SET(&f, cutdown_min, 3.01);
+  f.heater_current = 65535; f.heater_max = 1; f.charge_used = 4000;
+  f.stack_peak = 2040; f.pool_peak = 12; f.resets = 3; f.reset_cause = 12;
+
+  length = frame_encode_text(string, 1000, &f, FRAME_RADIO | FRAME_EVERY_PHASE);
+  printf("%s\n", string);
+  assert(frame_decode_text(string, string + length, &text,
+			   FRAME_RADIO | FRAME_EVERY_PHASE) == 0);
+  length = frame_encode_text(string, 1000, &f, FRAME_SD);
+  printf("%s\n", string);
+  assert(frame_decode_text(string, string + length, &text, FRAME_SD) == 0);
+  assert(memcmp(&f, &text, sizeof(f)) == 0);
+  assert(frame_decode_text(string, string + length - 1, &text, FRAME_SD) == 0);
+  assert(text.reset_cause == 1);
+  assert(frame_decode_text(string, string + length, &text, FRAME_RADIO) != 0);
+
+  /* Each phase has its own fields, and the decoder follows */
+  for (f.phase = 0; f.phase < PHASES; f.phase++) {
+    struct frame phased;
+
+    memset(&phased, 0, sizeof(phased));
+    length = frame_encode_text(string, 1000, &f, FRAME_RADIO);
+    printf("Phase %d: %s\n", f.phase, string);
+    assert(frame_decode_text(string, string + length, &phased, FRAME_RADIO) == 0);
+    assert(phased.phase == f.phase && phased.sentence_id == f.sentence_id);
+    assert(phased.altitude == (((FRAME_FLYING >> f.phase) & 1) ? f.altitude : 0));
+    assert(phased.landing_seconds == ((f.phase == PHASE_DESCENT) ? 65535 : 0));
+
+    /* The SD card has the rest after it */
+    char every[200];
+    length = frame_encode_text(string, 1000, &f, FRAME_RADIO | FRAME_OTHER_PHASES);
+    assert(frame_decode_text(string, string + length, &phased,
+			     FRAME_RADIO | FRAME_OTHER_PHASES) == 0);
+    frame_encode_text(string, 1000, &phased, FRAME_RADIO | FRAME_EVERY_PHASE);
+    frame_encode_text(every, sizeof(every), &f, FRAME_RADIO | FRAME_EVERY_PHASE);
+    assert(strcmp(string, every) == 0);
+  }
+
+  length = frame_pack(data, sizeof(data), &f, FRAME_RADIO | FRAME_SD);
+  printf("%d bytes binary\n", length);
+  assert(frame_unpack(data, length, &binary, FRAME_RADIO | FRAME_SD) == 0);
+  assert(memcmp(&f, &binary, sizeof(f)) == 0);
+  assert(frame_unpack(data, length - 1, &binary, FRAME_RADIO | FRAME_SD) != 0);
+  assert(frame_pack(data, 20, &f, FRAME_RADIO | FRAME_SD) == 0);
+
   printf("\n*** DONE ***\n");
 }
 
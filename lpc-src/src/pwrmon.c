@@ -1,5 +1,5 @@
 /*
- * Reads the ADC pin, used to monitor cutdown voltage
+ * Watches the batteries and the heater current with the ADC
  * Copyright (C) 2013  Richard Meadows
  *
  * Permission is hereby granted, free of charge, to any person obtaining
@@ -22,80 +22,175 @@
  * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
  */
 
+#include <stddef.h>
+#include <string.h>
 #include "LPC11xx.h"
 #include "pwrmon.h"
+#include "control.h"
+#include "clock.h"
+#include "profile.h"
 
 /**
  * Cutdown Monitoring: P1[2] / AD3
+ * Main Battery: P1[10] / AD6
+ * Heater Current: P1[11] / AD7
+ *
+ * A scan's started from the SysTick with the ADC in burst mode, which
+ * converts each input in turn and interrupts after the last. The ADC
+ * is only powered while it's scanning. Burst mode can't be started by
+ * a timer match on this part, and the match outputs that can start a
+ * single conversion are on CT32B0, which is the RTTY's and stopped
+ * between sentences, and CT16B0, which isn't running.
  */
 
-#define NULL (void*)0
-
 enum {
   ADINT_FLAG =		0x00010000,
 };
 enum {
-  PWRMON_ENABLE =	1,
-  PWRMON_DISABLE =	0,
+  ADC_BURST =		(1 << 16),
+  ADC_CLOCK =		(1 << 13),	/* SYSAHBCLKCTRL */
+  ADC_PD =		(1 << 4),	/* PDRUNCFG */
 };
-enum {
-  PWRMON_ADC_CHANNEL =	3,
+/**
+ * The ADC input for each channel. The last one interrupts.
+ */
+static const uint8_t pwrmon_inputs[PWRMON_CHANNELS] = { 3, 6, 7 };
+#define PWRMON_INPUTS		((1 << 3) | (1 << 6) | (1 << 7))
+#define PWRMON_LAST_INPUT	7
+/**
+ * A full scale sample, in mV or mA
+ */
+static const uint16_t pwrmon_scale[PWRMON_CHANNELS] = {
+  PWRMON_CUTDOWN_MV, PWRMON_BATTERY_MV, PWRMON_HEATER_MA
 };
+/**
+ * The ADC clock, as it was with a 12MHz core clock divided by 8
+ */
+#define PWRMON_ADC_HZ		1500000
+
+#ifndef PWRMON_TEST
+#define PWRMON_LOCK()		NVIC_DisableIRQ(ADC_IRQn)
+#define PWRMON_UNLOCK()		NVIC_EnableIRQ(ADC_IRQn)
+#else
+#define PWRMON_LOCK()
+#define PWRMON_UNLOCK()
+#endif
+
+static uint8_t started, ticks;
+static volatile uint8_t scanning;
+/**
+ * Scans so far towards the next sample
+ */
+static uint16_t scan_sum[PWRMON_CHANNELS];
+static uint8_t scans;
+/**
+ * Samples since the last pwrmon_period(), and the last period that
+ * had any
+ */
+static struct pwrmon_period period, last;
+/**
+ * Charge used from the main battery in mA seconds, and the part of a
+ * second over in mA ticks
+ */
+static uint32_t charge_used, charge_ticks;
 
 /**
- * The callback we're going to call when the measurement completes.
+ * The ADC clock divider for the core clock now
+ */
+static uint32_t pwrmon_clkdiv(void) {
+  return ((SystemCoreClock / PWRMON_ADC_HZ) - 1) << 8;
+}
+/**
+ * Keeps the ADC clock under 4.5MHz if a scan's running when the core
+ * clock changes. Otherwise the next scan sets it.
  */
-pwrmon_done_func callback;
+static void pwrmon_clock_changed(void) {
+  if (scanning) {
+    LPC_ADC->CR = (LPC_ADC->CR & ~0xFF00) | pwrmon_clkdiv();
+  }
+}
 
 /**
- * Starts a measurement.
+ * Converts a sample to mV or mA
  */
-void pwrmon_start(pwrmon_done_func _callback) {
-  callback = _callback;
+static uint16_t pwrmon_units(uint32_t sample, uint8_t channel) {
+  return (sample * pwrmon_scale[channel]) / PWRMON_FULL_SCALE;
+}
+
+/**
+ * Called from the SysTick. Starts a scan every PWRMON_SCAN_TICKS.
+ */
+void pwrmon_tick(void) {
+  if (!started || ++ticks < PWRMON_SCAN_TICKS) return;
+  ticks = 0;
+  if (scanning) return;
+  scanning = 1;
 
   /* Disable the power down bit to the ADC block. */
-  LPC_SYSCON->PDRUNCFG &= ~(1 << 4);
+  clock_syscon(CLOCK_POWER, 0, ADC_PD);
 
   /* Enable AHB clock to the ADC. */
-  LPC_SYSCON->SYSAHBCLKCTRL |= (1 << 13);
-
-  /* Configure the IO Pins for AD3 */
-  LPC_IOCON->R_PIO1_2 &= ~0x9F; /* 0xx00000 - Mode R, No Pull Up/Down, Analogue Mode */
-  LPC_IOCON->R_PIO1_2 |= 0x02;  /* xxxxxx1x - Mode AD3 */
+  clock_syscon(CLOCK_AHB, ADC_CLOCK, 0);
 
-  /* Set the clock on the ADC Block  (must be < 4.5MHz) */
-  LPC_ADC->CR = ((8-1) << 8);	/* Divide PCLK by 8 */
+  /* Only interrupt on the last input, and convert them all in turn (the
+     ADC clock must be < 4.5MHz) */
+  LPC_ADC->INTEN = (1 << PWRMON_LAST_INPUT);
+  LPC_ADC->CR = PWRMON_INPUTS | pwrmon_clkdiv() | ADC_BURST;
+}
 
-  /* Enable Interrupts */
-  NVIC_SetPriority(ADC_IRQn, 2); // 3rd priority
-  NVIC_EnableIRQ(ADC_IRQn);
-  LPC_ADC->INTEN = (1 << PWRMON_ADC_CHANNEL);	/* Only interrupt on the selected channel */
+/**
+ * Adds a sample, in the same order as the channels
+ */
+void pwrmon_sample(const uint16_t* sample) {
+  uint8_t i;
 
-  LPC_ADC->CR &= 0xFFFFFF00; /* Clear the channel select bits */
-  LPC_ADC->CR |= (1 << 24) | (1 << PWRMON_ADC_CHANNEL); /* Trigger measurement */
+  for (i = 0; i < PWRMON_CHANNELS; i++) {
+    if (period.samples == 0 || sample[i] < period.min[i]) {
+      period.min[i] = sample[i];
+    }
+    if (sample[i] > period.max[i]) {
+      period.max[i] = sample[i];
+    }
+    period.sum[i] += sample[i];
+  }
+  period.samples++;
 }
 
 /**
- * Called when the measurement is done.
+ * Called when a scan is done.
  */
-void pwrmon_done(void) {
-  uint16_t adc_value;
-
-  /* Read the 10-bit value off the ADC */
-  adc_value = (LPC_ADC->DR[PWRMON_ADC_CHANNEL] >> 6) & 0x3FF;
+static void pwrmon_done(void) {
+  uint16_t scan[PWRMON_CHANNELS];
+  uint8_t i;
 
-  /* Disable the interrupt in the NVIC */
-  NVIC_DisableIRQ(ADC_IRQn);
+  /* Stop the burst, and read the 10-bit values off the ADC. If it had
+     gone round again, the conversion that's under way mustn't bring
+     us back here once the clock's off. */
+  LPC_ADC->CR &= ~ADC_BURST;
+  LPC_ADC->INTEN = 0;
+  for (i = 0; i < PWRMON_CHANNELS; i++) {
+    scan[i] = (LPC_ADC->DR[pwrmon_inputs[i]] >> 6) & 0x3FF;
+    scan_sum[i] += scan[i];
+  }
 
   /* Disable AHB clock to the ADC. */
-  LPC_SYSCON->SYSAHBCLKCTRL &= ~(1 << 13);
+  clock_syscon(CLOCK_AHB, 0, ADC_CLOCK);
 
   /* And power down the ADC. */
-  LPC_SYSCON->PDRUNCFG |= (1 << 4);
+  clock_syscon(CLOCK_POWER, ADC_PD, 0);
+  scanning = 0;
 
-  /* Make the callback */
-  if (callback != NULL) {
-    callback(adc_value);
+  if (++scans == PWRMON_OVERSAMPLE) {
+    pwrmon_sample(scan_sum);
+    memset(scan_sum, 0, sizeof(scan_sum));
+    scans = 0;
+  } else if (last.samples == 0 && period.samples == 0) {
+    /* Until the first sample's in, a scan stands in for one so the
+       first frame has something */
+    for (i = 0; i < PWRMON_CHANNELS; i++) {
+      scan[i] *= PWRMON_OVERSAMPLE;
+    }
+    pwrmon_sample(scan);
   }
 }
 /**
@@ -103,10 +198,12 @@ void pwrmon_done(void) {
  */
 void ADC_IRQHandler(void) {
   uint32_t adc_stat;
-  adc_stat = LPC_ADC->STAT; /* Reading the STAT register will clear the interrupt */
+  PROFILE_START(isr_start);
+
+  adc_stat = LPC_ADC->STAT; /* Reading the results will clear the interrupt */
 
   if (adc_stat & ADINT_FLAG) { /* A channel is done */
-    if ((adc_stat & 0xFF) & (1 << PWRMON_ADC_CHANNEL)) {
+    if ((adc_stat & 0xFF) & (1 << PWRMON_LAST_INPUT)) {
       pwrmon_done();
     } else {
       // Unknown ADC Channel Finished..
@@ -114,15 +211,180 @@ void ADC_IRQHandler(void) {
   } else {
     // Unknown ADC Interrupt
   }
+
+  PROFILE_END(PROFILE_ISR_ADC, isr_start);
+}
+
+/**
+ * Takes the samples since the last call, and counts the charge they
+ * used. If there aren't any yet it's the same period as last time.
+ */
+void pwrmon_period(struct pwrmon_period* p) {
+  uint32_t heater;
+  uint8_t taken = 0;
+
+  PWRMON_LOCK();
+  if (period.samples) {
+    last = period;
+    memset(&period, 0, sizeof(period));
+    taken = 1;
+  }
+  PWRMON_UNLOCK();
+
+  *p = last;
+  if (!taken) return;
+
+  /* mA for each sample, added up */
+  heater = ((uint64_t)p->sum[PWRMON_HEATER] * PWRMON_HEATER_MA) /
+    PWRMON_FULL_SCALE;
+  charge_ticks += (heater + (uint32_t)p->samples * PWRMON_BOARD_MA) *
+    PWRMON_SAMPLE_TICKS;
+  charge_used += charge_ticks / SYSTICK_HZ;
+  charge_ticks %= SYSTICK_HZ;
+}
+/**
+ * The mean of a period in mV or mA, or 0 if it's empty
+ */
+uint32_t pwrmon_mean(const struct pwrmon_period* p, uint8_t channel) {
+  if (p->samples == 0) return 0;
+
+  return pwrmon_units(p->sum[channel] / p->samples, channel);
+}
+
+/**
+ * The charge used from the main battery in mA seconds, and what's left
+ * as a percentage of PWRMON_CAPACITY_MAH
+ */
+uint32_t pwrmon_charge_used(void) {
+  return charge_used;
+}
+uint8_t pwrmon_charge(void) {
+  uint32_t used = charge_used / (PWRMON_CAPACITY_MAH * 36);
+
+  return (used < 100) ? 100 - used : 0;
+}
+
+/**
+ * Sets the frame's power fields from a period
+ */
+void pwrmon_fill_frame(const struct pwrmon_period* p, struct frame* f) {
+  f->battery_charge = pwrmon_charge();
+  f->battery_voltage = pwrmon_mean(p, PWRMON_BATTERY);
+  f->battery_min = pwrmon_units(p->min[PWRMON_BATTERY], PWRMON_BATTERY);
+  f->battery_max = pwrmon_units(p->max[PWRMON_BATTERY], PWRMON_BATTERY);
+  f->cutdown_min = pwrmon_units(p->min[PWRMON_CUTDOWN], PWRMON_CUTDOWN);
+  f->heater_current = pwrmon_mean(p, PWRMON_HEATER);
+  f->heater_max = pwrmon_units(p->max[PWRMON_HEATER], PWRMON_HEATER);
+  f->charge_used = charge_used / 3600;
 }
 
 /**
- * Initialisation.
+ * After a warm reset, carry on counting from where we were
+ */
+void pwrmon_resume(uint32_t used) {
+  charge_used = used;
+}
+
+/**
+ * Initialisation. The first scan's on the next SysTick.
  */
 void pwrmon_init(void) {
-  /* Set the callback to null */
-  callback = NULL;
+  /* Configure the IO Pins for AD3, AD6 and AD7 */
+  LPC_IOCON->R_PIO1_2 &= ~0x9F; /* 0xx00000 - Mode R, No Pull Up/Down, Analogue Mode */
+  LPC_IOCON->R_PIO1_2 |= 0x02;  /* xxxxxx1x - Mode AD3 */
+  LPC_IOCON->PIO1_10 &= ~0x9F;  /* 0xx00000 - Mode PIO, No Pull Up/Down, Analogue Mode */
+  LPC_IOCON->PIO1_10 |= 0x01;   /* xxxxxxx1 - Mode AD6 */
+  LPC_IOCON->PIO1_11 &= ~0x9F;
+  LPC_IOCON->PIO1_11 |= 0x01;   /* xxxxxxx1 - Mode AD7 */
+
+  clock_register(pwrmon_clock_changed);
+
+  /* Enable Interrupts */
+  NVIC_SetPriority(ADC_IRQn, 2); // 3rd priority
+  NVIC_EnableIRQ(ADC_IRQn);
+
+  ticks = PWRMON_SCAN_TICKS - 1;
+  started = 1;
 }
 
+#ifdef PWRMON_TEST
+
+#include <assert.h>
+#include <stdio.h>
+
+/**
+ * Only the calculations run, the rest just needs to link
+ */
+uint32_t SystemCoreClock = CLOCK_SLOW_HZ;
+void clock_register(clock_listener listener) {
+  (void)listener;
+}
+void clock_syscon(uint8_t reg, uint32_t set, uint32_t clear) {
+  (void)reg; (void)set; (void)clear;
+}
 
+int main(void) {
+  struct pwrmon_period p;
+  struct frame f;
+  uint16_t sample[PWRMON_CHANNELS];
+  int i;
+
+  printf("*** PWRMON_TEST ***\n\n");
+
+  /* Lowest, highest and mean of a period */
+  for (i = 1; i <= 3; i++) {
+    sample[PWRMON_CUTDOWN] = 4096 * i;
+    sample[PWRMON_BATTERY] = 12288 - 2048 * i;
+    sample[PWRMON_HEATER] = 0;
+    pwrmon_sample(sample);
+  }
+  pwrmon_period(&p);
+  assert(p.samples == 3);
+  assert(pwrmon_mean(&p, PWRMON_CUTDOWN) == 3300);
+  assert(pwrmon_units(p.min[PWRMON_CUTDOWN], PWRMON_CUTDOWN) == 1650);
+  assert(pwrmon_units(p.max[PWRMON_CUTDOWN], PWRMON_CUTDOWN) == 4950);
+  pwrmon_fill_frame(&p, &f);
+  assert(f.battery_voltage == 4950 && f.battery_min == 3712 &&
+	 f.battery_max == 6187);
+  printf("Cutdown %lumV, battery %umV (%u - %u)\n",
+	 (unsigned long)pwrmon_mean(&p, PWRMON_CUTDOWN), f.battery_voltage,
+	 f.battery_min, f.battery_max);
+
+  /* Until there are more samples it's the same one, counted once */
+  pwrmon_period(&p);
+  assert(p.samples == 3 && pwrmon_mean(&p, PWRMON_BATTERY) == 4950);
+  assert(charge_used * SYSTICK_HZ + charge_ticks ==
+	 3 * PWRMON_BOARD_MA * PWRMON_SAMPLE_TICKS);
+
+  /* An hour of the board alone, a few samples a period */
+  charge_used = charge_ticks = 0;
+  sample[PWRMON_HEATER] = 0;
+  for (i = 0; i < (3600 * SYSTICK_HZ) / PWRMON_SAMPLE_TICKS; i++) {
+    pwrmon_sample(sample);
+    if (i % 7 == 6) pwrmon_period(&p);
+  }
+  pwrmon_period(&p);
+  assert(pwrmon_charge_used() == PWRMON_BOARD_MA * 3600);
+  assert(pwrmon_charge() == 100 - (PWRMON_BOARD_MA * 100) / PWRMON_CAPACITY_MAH);
+
+  /* And with the heater on, 825mA */
+  sample[PWRMON_HEATER] = 4096;
+  for (i = 0; i < (3600 * SYSTICK_HZ) / PWRMON_SAMPLE_TICKS; i++) {
+    pwrmon_sample(sample);
+    if (i % 5 == 4) pwrmon_period(&p);
+  }
+  pwrmon_fill_frame(&p, &f);
+  assert(f.heater_current == 825 && f.heater_max == 825);
+  assert(f.charge_used == 2 * PWRMON_BOARD_MA + 825);
+  printf("Two hours: %umAh used, %u%% left\n", f.charge_used,
+	 f.battery_charge);
+
+  /* After a reset it carries on, and it doesn't go below empty */
+  pwrmon_resume(PWRMON_CAPACITY_MAH * 3600 + 1);
+  assert(pwrmon_charge() == 0);
+
+  printf("\n*** DONE ***\n");
+  return 0;
+}
 
+#endif
@@ -24,10 +24,19 @@
 
 #include "LPC11xx.h"
 #include <string.h>
+#include "rtty.h"
+#include "profile.h"
+#include "clock.h"
 
 /**
  * Interface to the physical world on P0[7] (Also red LED)
+ *
+ * The bit clock is CT32B0. It free-runs at RTTY_TIMER_HZ, prescaled
+ * from whatever the core clock is, and match 0 is moved on by one bit
+ * each interrupt, so the interrupt latency never adds up.
  */
+#define RTTY_TIMER_HZ		1000000
+
 #ifndef RTTY_TEST
 
 #define RTTY_PORT		LPC_GPIO0
@@ -38,121 +47,853 @@
 #define RTTY_SET(b)		RTTY_PORT->MASKED_ACCESS[1 << RTTY_PIN] = (b << RTTY_PIN)
 #define RTTY_NEXT()
 
+#define RTTY_TIMER		LPC_CT32B0
+#define RTTY_TIMER_CLOCK()	RTTY_TIMER_HZ
+#define RTTY_TIMER_NOW()	RTTY_TIMER->TC
+#define RTTY_TIMER_MATCH(t)	RTTY_TIMER->MR0 = (t)
+#define RTTY_TIMER_LAST()	RTTY_TIMER->MR0
+#define RTTY_LOCK()		__disable_irq()
+#define RTTY_UNLOCK()		__enable_irq()
+
 #else
 
 #include <stdio.h>
 #define RTTY_ACTIVATE()
 #define RTTY_DEACTIVATE()
-#define RTTY_SET(b)		printf("%d", b & 1)
-#define RTTY_NEXT()		printf("\n")
+#define RTTY_SET(b)		rtty_test_level = (b) & 1
+#define RTTY_NEXT()
+
+uint32_t rtty_test_level;
+
+uint32_t rtty_test_match, rtty_test_clock = 12000000;
+#define RTTY_TIMER_CLOCK()	rtty_test_clock
+#define RTTY_TIMER_NOW()	rtty_test_match
+#define RTTY_TIMER_MATCH(t)	rtty_test_match = (t)
+#define RTTY_TIMER_LAST()	rtty_test_match
+#define RTTY_LOCK()
+#define RTTY_UNLOCK()
 
 #endif
 
 /**
- * Formatting 8N2
+ * CT32B0 registers
  */
-#define ASCII_BITS	8
-#define BITS_PER_CHAR	11
+#define TCR_ENABLE		(1 << 0)
+#define TCR_RESET		(1 << 1)
+#define MCR_MR0I		(1 << 0)
+#define IR_MR0			(1 << 0)
+#define CT32B0_CLOCK		(1 << 9)
 
 /**
- * Output String
+ * The longest string that can be sent, after it's coded
  */
 #define RTTY_STRING_MAX	0x200
 
+#ifndef RTTY_PRERENDER_DISABLED
+/**
+ * Room for a string of RTTY_STRING_MAX characters at 8N2. A string is
+ * rendered in units of a bit, or of half a bit if the stop bits end
+ * half way through one, so long strings with 1.5 stop bits won't fit.
+ */
+#define RTTY_STREAM_WORDS	((RTTY_STRING_MAX * 11 + 31) / 32)
+#endif
+
+/**
+ * The format in use, and the one to use from the next string
+ */
+struct rtty_format rtty_format = { 50, 8, RTTY_STOP_2 };
+struct rtty_format rtty_next_format = { 50, 8, RTTY_STOP_2 };
+
+/**
+ * The fraction of a timer count left over, in units of 1 / (2 * baud)
+ */
+uint32_t rtty_fraction;
+
+/**
+ * Set while the timer is running
+ */
+volatile int rtty_running = 0;
+
+/**
+ * Frames are built in these, see rtty_acquire()
+ */
+char rtty_slots[RTTY_SLOTS][RTTY_SLOT_SIZE];
+
+#ifndef RTTY_PRERENDER_DISABLED
+
+/**
+ * Mark bits to send before each string
+ */
+uint8_t rtty_preamble = 0;
+
+/**
+ * Half bits per unit of the stream being sent, and the timer counts in
+ * a unit with the fraction left over
+ */
+uint8_t rtty_unit_halves;
+uint32_t rtty_unit;
+uint32_t rtty_unit_remainder;
+
+/**
+ * The rendered string, one unit per bit starting from the LSB of the
+ * first word. The interrupt sends unit rtty_stream_index next.
+ */
+uint32_t rtty_stream[RTTY_STREAM_WORDS];
+uint32_t rtty_stream_index;
+volatile uint32_t rtty_stream_length = 0;
+
+/**
+ * Returns 1 if we're currently outputting.
+ */
+int rtty_active(void) {
+  return (rtty_stream_index < rtty_stream_length);
+}
+
+#else
+
+/**
+ * Timer counts per half bit, and the fraction of a count left over
+ */
+uint32_t rtty_half_bit;
+uint32_t rtty_half_bit_remainder;
+
 /**
  * Where we currently are in the rtty output byte
  *
  * 0 = Start Bit
- * 1-8 = Data Bit
- * 10 = Stop Bit
- * 11 = Stop Bit
+ * 1 to data_bits = Data Bit
+ * data_bits + 1 onwards = Stop Bits
  */
 uint8_t rtty_phase;
+/**
+ * Half bits of stop left to send
+ */
+uint8_t rtty_stop_left;
 /**
  * Where we are in the current output string
  */
 uint32_t rtty_index;
 
 /**
- * Details of the string that is currently being output
+ * Details of the string that is currently being output, which is in
+ * one of the slots, and the character being sent from it
  */
-char rtty_string[RTTY_STRING_MAX];
-uint32_t rtty_string_length = 0;
+const char* rtty_string;
+uint32_t rtty_string_length;
+rtty_coder rtty_string_coder;
+volatile uint32_t rtty_sent_length = 0;
+uint8_t rtty_char;
 
 /**
  * Returns 1 if we're currently outputting.
  */
 int rtty_active(void) {
-  return (rtty_string_length > 0);
+  return (rtty_sent_length > 0);
+}
+
+#endif
+
+/**
+ * ITA2 with the US figures, which have '$' and '#'. The two shifts and
+ * the characters in both sets are the same in each.
+ */
+#define ITA2_FIGS		0x1B
+#define ITA2_LTRS		0x1F
+#define ITA2_UNKNOWN		0x19 /* '?' */
+
+static const char rtty_ita2_letters[32] = {
+  '\0', 'E', '\n', 'A', ' ', 'S', 'I', 'U',
+  '\r', 'D', 'R', 'J', 'N', 'F', 'C', 'K',
+  'T', 'Z', 'L', 'W', 'H', 'Y', 'P', 'Q',
+  'O', 'B', 'G', '\0', 'M', 'X', 'V', '\0'
+};
+static const char rtty_ita2_figures[32] = {
+  '\0', '3', '\n', '-', ' ', '\a', '8', '7',
+  '\r', '$', '4', '\'', ',', '!', ':', '(',
+  '5', '"', ')', '2', '#', '6', '0', '1',
+  '9', '?', '&', '\0', '.', '/', ';', '\0'
+};
+
+/**
+ * Encodes a character in ITA2 into codes[], with a shift first if the
+ * character isn't in the current set. Lower case is sent as upper case
+ * and anything else ITA2 doesn't have as '?'.
+ *
+ * Returns the number of codes, 1 or 2.
+ */
+uint8_t rtty_ita2_encode(char c, uint8_t* shift, uint8_t* codes) {
+  uint8_t code = ITA2_UNKNOWN, set = RTTY_ITA2_FIGURES, n = 0;
+  uint8_t i;
+
+  if (c >= 'a' && c <= 'z') c -= 'a' - 'A';
+
+  for (i = 0; i < 32; i++) {
+    if (rtty_ita2_letters[i] == c) {
+      code = i;
+      set = (rtty_ita2_figures[i] == c) ? RTTY_ITA2_UNSHIFTED : RTTY_ITA2_LETTERS;
+      break;
+    }
+    if (rtty_ita2_figures[i] == c) {
+      code = i; set = RTTY_ITA2_FIGURES;
+      break;
+    }
+  }
+
+  if (set != RTTY_ITA2_UNSHIFTED && set != *shift) {
+    codes[n++] = (set == RTTY_ITA2_FIGURES) ? ITA2_FIGS : ITA2_LTRS;
+    *shift = set;
+  }
+  codes[n++] = code;
+
+  return n;
+}
+/**
+ * Decodes an ITA2 code, following the shifts. Returns the character,
+ * or '\0' for a shift.
+ */
+char rtty_ita2_decode(uint8_t code, uint8_t* shift) {
+  code &= 0x1F;
+
+  if (code == ITA2_LTRS) {
+    *shift = RTTY_ITA2_LETTERS; return '\0';
+  } else if (code == ITA2_FIGS) {
+    *shift = RTTY_ITA2_FIGURES; return '\0';
+  }
+
+  return (*shift == RTTY_ITA2_FIGURES) ?
+    rtty_ita2_figures[code] : rtty_ita2_letters[code];
+}
+
+/**
+ * Returns non-zero if we can send at this baud rate
+ */
+static int rtty_baud_supported(uint32_t baud) {
+  switch (baud) {
+    case 50: case 75: case 100: case 300: case 600:
+      return 1;
+    default:
+      return 0;
+  }
+}
+
+/**
+ * Sets the format for the strings that follow. The one being sent
+ * carries on in the old format.
+ *
+ * Returns 0 on success or 1 if the format isn't supported.
+ */
+int rtty_set_format(uint32_t baud, uint8_t data_bits, uint8_t stop_halves) {
+  if (!rtty_baud_supported(baud)) return 1;
+  if (data_bits != 7 && data_bits != 8) {
+#ifndef RTTY_PRERENDER_DISABLED
+    if (data_bits != 5) return 1;
+#else
+    return 1; // ITA2 needs prerendering for its shifts
+#endif
+  }
+  if (stop_halves < RTTY_STOP_1 || stop_halves > RTTY_STOP_2) return 1;
+
+  rtty_next_format.baud = baud;
+  rtty_next_format.data_bits = data_bits;
+  rtty_next_format.stop_halves = stop_halves;
+
+  return 0;
+}
+/**
+ * Returns the format strings will be sent in from now on
+ */
+void rtty_get_format(struct rtty_format* format) {
+  *format = rtty_next_format;
+}
+
+/**
+ * Sets the number of mark bits sent before each string, which gives a
+ * receiver time to lock on after a pause or a change of baud rate.
+ *
+ * Returns 0 on success or 1 if strings aren't prerendered.
+ */
+int rtty_set_preamble(uint8_t bits) {
+#ifndef RTTY_PRERENDER_DISABLED
+  rtty_preamble = bits;
+  return 0;
+#else
+  return (bits != 0);
+#endif
+}
+
+#ifndef RTTY_PRERENDER_DISABLED
+/**
+ * Returns the number of timer counts in the next unit, carrying the
+ * fraction over. The remainder's less than 2 * baud so at most one
+ * count carries, which we add without a branch.
+ */
+static uint32_t rtty_next_unit(void) {
+  uint32_t per_count = 2 * rtty_format.baud;
+  uint32_t carry;
+
+  rtty_fraction += rtty_unit_remainder;
+  carry = (rtty_fraction >= per_count);
+  rtty_fraction -= -carry & per_count;
+
+  return rtty_unit + carry;
+}
+#else
+/**
+ * Returns the number of timer counts in the given number of half
+ * bits, carrying the fraction over to the next call.
+ */
+static uint32_t rtty_halves(uint8_t halves) {
+  uint32_t counts = rtty_half_bit * halves;
+  uint32_t per_count = 2 * rtty_format.baud;
+
+  rtty_fraction += rtty_half_bit_remainder * halves;
+  while (rtty_fraction >= per_count) {
+    rtty_fraction -= per_count;
+    counts++;
+  }
+
+  return counts;
+}
+#endif
+
+#ifndef RTTY_TEST
+/**
+ * Keeps the bit clock at RTTY_TIMER_HZ when the core clock changes.
+ * The prescale counter only wraps at 2^32, so if PR dropped below it
+ * the bit clock would stop for minutes. The timer's stopped while the
+ * prescaler changes, and the prescale counter carries the same part of
+ * a count across so the bit being sent keeps its length.
+ */
+static void rtty_clock_changed(void) {
+  uint32_t from, to, pc;
+
+  if (rtty_running) {
+    RTTY_TIMER->TCR = 0;
+    from = RTTY_TIMER->PR + 1;
+    to = SystemCoreClock / RTTY_TIMER_HZ;
+    pc = RTTY_TIMER->PC;
+
+    RTTY_TIMER->PR = to - 1;
+    RTTY_TIMER->PC = (pc < from) ? (pc * to) / from : 0;
+    RTTY_TIMER->TCR = TCR_ENABLE;
+  }
+}
+#endif
+
+/**
+ * Starts the bit clock, with the first match after the given counts
+ */
+static void rtty_timer_start(uint32_t first) {
+#ifndef RTTY_TEST
+  static uint8_t registered = 0;
+
+  if (!registered) {
+    clock_register(rtty_clock_changed);
+    registered = 1;
+  }
+  clock_syscon(CLOCK_AHB, CT32B0_CLOCK, 0);
+
+  RTTY_TIMER->TCR = TCR_RESET;
+  RTTY_TIMER->PR = (SystemCoreClock / RTTY_TIMER_HZ) - 1;
+  RTTY_TIMER->MCR = MCR_MR0I;
+  RTTY_TIMER->IR = IR_MR0;
+  RTTY_TIMER->MR0 = first;
+  RTTY_TIMER->TCR = TCR_ENABLE;
+
+  NVIC_SetPriority(TIMER_32_0_IRQn, 0); // Highest Priority Interrupt
+  NVIC_EnableIRQ(TIMER_32_0_IRQn);
+#else
+  RTTY_TIMER_MATCH(first);
+#endif
+  rtty_running = 1;
+}
+/**
+ * Stops the bit clock once the line's gone idle
+ */
+static void rtty_timer_stop(void) {
+#ifndef RTTY_TEST
+  NVIC_DisableIRQ(TIMER_32_0_IRQn);
+  RTTY_TIMER->TCR = 0;
+  RTTY_TIMER->IR = IR_MR0;
+
+  clock_syscon(CLOCK_AHB, 0, CT32B0_CLOCK);
+#endif
+  rtty_running = 0;
+}
+/**
+ * Moves the match on by the given counts, catching up if we've missed
+ * it
+ */
+static void rtty_timer_next(uint32_t counts) {
+  uint32_t next = RTTY_TIMER_LAST() + counts;
+
+  if ((int32_t)(next - RTTY_TIMER_NOW()) <= 0) {
+    next = RTTY_TIMER_NOW() + counts;
+  }
+  RTTY_TIMER_MATCH(next);
+}
+
+/**
+ * Moves the format on to the next one
+ */
+static void rtty_load_format(void) {
+  rtty_format = rtty_next_format;
+  rtty_fraction = 0;
+
+#ifndef RTTY_PRERENDER_DISABLED
+  /* Half bit units only if the stop bits need them */
+  rtty_unit_halves = (rtty_format.stop_halves & 1) ? 1 : 2;
+  rtty_unit = (RTTY_TIMER_CLOCK() * rtty_unit_halves) / (2 * rtty_format.baud);
+  rtty_unit_remainder =
+    (RTTY_TIMER_CLOCK() * rtty_unit_halves) % (2 * rtty_format.baud);
+#else
+  rtty_half_bit = RTTY_TIMER_CLOCK() / (2 * rtty_format.baud);
+  rtty_half_bit_remainder = RTTY_TIMER_CLOCK() % (2 * rtty_format.baud);
+#endif
+}
+
+/**
+ * Returns byte i of what's sent for a string
+ */
+static uint8_t rtty_byte(const char* string, uint32_t length, rtty_coder coder,
+			 uint32_t i) {
+  return coder ? coder((const uint8_t*)string, length, i) : (uint8_t)string[i];
+}
+
+#ifndef RTTY_PRERENDER_DISABLED
+
+/**
+ * Returns a slot to build the next string in. It's free again as soon
+ * as it's committed.
+ */
+char* rtty_acquire(void) {
+  return rtty_slots[0];
+}
+
+/**
+ * Appends up to 32 units to the stream
+ */
+static void rtty_render(uint32_t* length, uint32_t units, uint8_t count) {
+  uint32_t* word = &rtty_stream[*length >> 5];
+  uint32_t shift = *length & 31;
+
+  word[0] |= units << shift;
+  if (shift + count > 32) {
+    word[1] |= units >> (32 - shift);
+  }
+  *length += count;
+}
+/**
+ * Appends a bit of mark
+ */
+static void rtty_render_mark(uint32_t* length) {
+  uint8_t count = 2 / rtty_unit_halves;
+
+  rtty_render(length, (1 << count) - 1, count);
+}
+/**
+ * Appends a character with its start and stop bits
+ */
+static void rtty_render_char(uint32_t* length, char c) {
+  uint8_t units_per_bit = 2 / rtty_unit_halves;
+  uint8_t count = ((1 + rtty_format.data_bits) * units_per_bit) +
+    (rtty_format.stop_halves / rtty_unit_halves);
+  uint32_t bits, units = 0;
+  uint8_t u;
+
+  /* Start, data then mark */
+  bits = ((uint32_t)(c & ((1 << rtty_format.data_bits) - 1)) << 1) |
+    (0xFF << (1 + rtty_format.data_bits));
+
+  for (u = 0; u < count; u++) {
+    units |= ((bits >> (u / units_per_bit)) & 1) << u;
+  }
+
+  rtty_render(length, units, count);
+}
+
+/**
+ * Sends a string, rendering it in the format for the next string. With
+ * a coder coded_length bytes made from the string are sent instead.
+ * The string can be anywhere, it isn't needed once this returns.
+ *
+ * Returns 0 on success, 1 if a string is already active or 2 if the
+ * specified string was too long.
+ */
+int rtty_commit(const char* string, uint32_t length, rtty_coder coder,
+		uint32_t coded_length) {
+  uint32_t units_per_bit, units, characters, i;
+  uint8_t shift, codes[2], n, c, b;
+
+  if (!coder) coded_length = length;
+  if (coded_length > RTTY_STRING_MAX) return 2; // To long
+  if (rtty_active()) return 1; // Already active
+
+  /* Nothing reads the format until the stream's set below */
+  rtty_load_format();
+
+  /* ITA2 needs a code for each character and each shift */
+  characters = coded_length;
+  if (rtty_format.data_bits == 5) {
+    for (i = 0, shift = RTTY_ITA2_UNSHIFTED; i < coded_length; i++) {
+      characters += rtty_ita2_encode(rtty_byte(string, length, coder, i),
+				     &shift, codes) - 1;
+    }
+  }
+
+  units_per_bit = 2 / rtty_unit_halves;
+  units = (rtty_preamble * units_per_bit) +
+    (characters * ((1 + rtty_format.data_bits) * units_per_bit +
+		   rtty_format.stop_halves / rtty_unit_halves));
+  if (units > RTTY_STREAM_WORDS * 32) return 2; // Doesn't fit this format
+
+  // Render
+  memset(rtty_stream, 0, ((units + 31) / 32) * sizeof(uint32_t));
+  units = 0;
+  for (i = 0; i < rtty_preamble; i++) {
+    rtty_render_mark(&units);
+  }
+  for (i = 0, shift = RTTY_ITA2_UNSHIFTED; i < coded_length; i++) {
+    b = rtty_byte(string, length, coder, i);
+    if (rtty_format.data_bits == 5) {
+      n = rtty_ita2_encode(b, &shift, codes);
+      for (c = 0; c < n; c++) {
+	rtty_render_char(&units, codes[c]);
+      }
+    } else {
+      rtty_render_char(&units, b);
+    }
+  }
+
+  // The bit clock might be stopping
+  RTTY_LOCK();
+  rtty_stream_index = 0;
+  rtty_stream_length = units;
+  if (!rtty_running) {
+    RTTY_SET(1);
+    RTTY_ACTIVATE();
+    /* A bit of idle before the first unit */
+    uint32_t first = rtty_next_unit();
+    if (rtty_unit_halves == 1) first += rtty_next_unit();
+    rtty_timer_start(first);
+  } // Otherwise picked up at the end of the last unit
+  RTTY_UNLOCK();
+
+  return 0; // Success
+}
+/**
+ * Sends a string as it is
+ */
+int rtty_set_string(const char* string, uint32_t length) {
+  return rtty_commit(string, length, NULL, 0);
+}
+
+/**
+ * Called at the end of each unit, outputs the next one
+ */
+void rtty_tick(void) {
+  uint32_t index = rtty_stream_index;
+
+  if (index >= rtty_stream_length) { // The last unit's done
+    rtty_timer_stop();
+    return;
+  }
+
+  RTTY_SET(rtty_stream[index >> 5] >> (index & 31));
+  rtty_stream_index = index + 1;
+
+  rtty_timer_next(rtty_next_unit());
+}
+
+#else
+
+/**
+ * Returns a slot to build the next string in, the one that isn't being
+ * sent
+ */
+char* rtty_acquire(void) {
+  if (rtty_active() && rtty_string < rtty_slots[1]) {
+    return rtty_slots[1];
+  }
+  return rtty_slots[0];
 }
 
 /**
- * Sets an output string.
+ * Sends a string from a slot, which is busy until the string's been
+ * sent. With a coder coded_length bytes made from the string are sent
+ * instead, each as it's needed.
  *
  * Returns 0 on success, 1 if a string is already active or 2 if the
  * specified string was too long.
  */
-int rtty_set_string(char* string, uint32_t length) {
-  if (length > RTTY_STRING_MAX) return 2; // To long
+int rtty_commit(const char* string, uint32_t length, rtty_coder coder,
+		uint32_t coded_length) {
+  if (!coder) coded_length = length;
+  if (length > RTTY_SLOT_SIZE || coded_length > RTTY_STRING_MAX) return 2; // To long
 
   if (!rtty_active()) {
-    // Copy
-    memcpy(rtty_string, string, length);
+    rtty_string = string;
     rtty_string_length = length;
+    rtty_string_coder = coder;
     // Initialise
     rtty_index = 0;
     rtty_phase = 0;
 
+    // The bit clock might be stopping
+    RTTY_LOCK();
+    rtty_sent_length = coded_length;
+    if (!rtty_running) {
+      rtty_load_format();
+      rtty_timer_start(rtty_halves(2));
+    } // Otherwise picked up at the end of the last stop bit
+    RTTY_UNLOCK();
+
     return 0; // Success
   } else {
     return 1; // Already active
   }
 }
+/**
+ * Sends a copy of a string from anywhere
+ */
+int rtty_set_string(const char* string, uint32_t length) {
+  char* slot;
+
+  if (length > RTTY_SLOT_SIZE) return 2; // To long
+  if (rtty_active()) return 1; // Already active
+
+  slot = rtty_acquire();
+  memcpy(slot, string, length);
+  return rtty_commit(slot, length, NULL, 0);
+}
 
 /**
- * Called at the baud rate, outputs bits of rtty
+ * Called at the end of each bit, outputs the next bit of rtty
  */
 void rtty_tick(void) {
-  if (rtty_active()) {
-    RTTY_ACTIVATE();
+  uint8_t halves = 2;
+
+  if (!rtty_active()) { // The last stop bit's done
+    rtty_timer_stop();
+    return;
+  }
 
-    if (rtty_phase == 0) { // Start
-      // Low
-      RTTY_SET(0);
-    } else if (rtty_phase < ASCII_BITS + 1) {
-      // Data
-      RTTY_SET(rtty_string[rtty_index] >> (rtty_phase - 1));
-    } else if (rtty_phase < BITS_PER_CHAR) { // Stop
-      // High
-      RTTY_SET(1);
+  if (rtty_phase == 0) { // Start
+    if (rtty_index == 0) {
+      rtty_load_format(); // Between strings
     }
+    RTTY_ACTIVATE();
+    // Low
+    RTTY_SET(0);
+    rtty_stop_left = rtty_format.stop_halves;
+    // The character's made during its start bit
+    rtty_char = rtty_byte(rtty_string, rtty_string_length, rtty_string_coder,
+			  rtty_index);
+  } else if (rtty_phase < rtty_format.data_bits + 1) {
+    // Data
+    RTTY_SET(rtty_char >> (rtty_phase - 1));
+  } else { // Stop
+    // High
+    RTTY_SET(1);
+    if (rtty_stop_left < 2) halves = rtty_stop_left;
+    rtty_stop_left -= halves;
+  }
 
-    rtty_phase++;
+  rtty_phase++;
 
-    if (rtty_phase >= BITS_PER_CHAR) { // Next character
-      rtty_phase = 0; rtty_index++; RTTY_NEXT();
+  if (rtty_phase > rtty_format.data_bits && rtty_stop_left == 0) { // Next character
+    rtty_phase = 0; rtty_index++; RTTY_NEXT();
 
-      if (rtty_index >= rtty_string_length) { // All done, deactivate
-	rtty_string_length = 0; // Deactivate
-      }
+    if (rtty_index >= rtty_sent_length) { // All done, deactivate
+      rtty_sent_length = 0; // Deactivate
     }
-  } else {
-//    RTTY_DEACTIVATE();
   }
+
+  /* Next bit, catching up if we've missed the match */
+  rtty_timer_next(rtty_halves(halves));
+}
+
+#endif
+
+#ifndef RTTY_TEST
+/**
+ * Interrupt.
+ */
+void TIMER32_0_IRQHandler(void) {
+  PROFILE_START(isr_start);
+
+  RTTY_TIMER->IR = IR_MR0;
+  rtty_tick();
+
+  PROFILE_END(PROFILE_ISR_RTTY, isr_start);
 }
+#endif
 
 
 #ifdef RTTY_TEST
 
-int main() {
-  printf("*** RTTY_TEST ***\n\n");
+/**
+ * Runs the bit clock until the string that's been set is sent, putting
+ * the line level each half bit in levels. Returns the number of half
+ * bits.
+ */
+static uint32_t rtty_test_run(char* levels, uint32_t size) {
+  struct rtty_format format;
+  uint32_t half_bit, halves, n = 0, last;
+
+  rtty_get_format(&format);
+  half_bit = rtty_test_clock / (2 * format.baud);
 
-  rtty_set_string("RTTY", 4);
   while (rtty_active()) {
+    last = rtty_test_match;
     rtty_tick();
+
+    for (halves = (rtty_test_match - last) / half_bit; halves; halves--) {
+      if (n < size) levels[n++] = '0' + rtty_test_level;
+    }
   }
+  rtty_tick(); // Finish the last unit
+
+  return n;
+}
+/**
+ * Sends a string, printing the line level each half bit and a newline
+ * after each character. This is the same whether or not the string's
+ * prerendered.
+ */
+static void rtty_test_send(const char* string, uint32_t length) {
+  struct rtty_format format;
+  char levels[1000];
+  uint32_t character, n, i;
+
+  rtty_get_format(&format);
+  character = (2 * (1 + format.data_bits)) + format.stop_halves;
+
+  rtty_set_string(string, length);
+  n = rtty_test_run(levels, sizeof(levels));
+  for (i = 0; i < n; i++) {
+    printf("%c", levels[i]);
+    if ((i + 1) % character == 0) printf("\n");
+  }
+}
+/**
+ * Sends each character twice
+ */
+static uint8_t rtty_test_twice(const uint8_t* string, uint32_t length,
+			       uint32_t index) {
+  (void)length;
+  return string[index / 2];
+}
+
+int main() {
+  printf("*** RTTY_TEST ***\n\n");
+
+  rtty_test_send("RTTY", 4);
+
+  printf("\n7N1.5 at 75 baud, on a clock that doesn't divide\n");
+  rtty_test_clock = 12000001;
+  rtty_set_format(75, 7, RTTY_STOP_1_5);
+  rtty_test_send("RTTY", 4);
+
+  /* One bit of idle, then 4 x 9.5 bits, without the error adding up */
+  uint32_t expected = (uint64_t)78 * rtty_test_clock / 150;
+  printf("%u counts, expected %u\n", rtty_test_match, expected);
+  if (rtty_test_match != expected) {
+    printf("ERROR: Bit timing drifted\n");
+    return 1;
+  }
+
+  printf("\nITA2 round trip, and airtime against 8N2\n");
+  static const char* frames[] = {
+    "$$BUSEDS1,40,10:00:38,51.820803,-0.008398,185,9,185.0,4.8,13.8,39.9,0,0,0,179,6.0,72#F203\n",
+    "$$BUSEDS1,826,10:13:10,51.800537,0.079012,3945,9,3944.2,5.0,-10.7,23.4,0,0,0,166,6.0,90#1315\n",
+    "$$BUSEDS1,1645,10:26:00,51.779787,0.168473,1506,9,1505.6,-6.6,5.3,21.4,0,0,0,154,6.0,62#0993\n",
+  };
+  uint32_t f, i, n, c;
+
+  for (f = 0; f < sizeof(frames) / sizeof(frames[0]); f++) {
+    uint8_t encode_shift = RTTY_ITA2_UNSHIFTED, decode_shift = RTTY_ITA2_LETTERS;
+    uint8_t codes[2];
+    char decoded[200];
+    uint32_t length = strlen(frames[f]), total = 0, d = 0;
+
+    for (i = 0; i < length; i++) {
+      n = rtty_ita2_encode(frames[f][i], &encode_shift, codes);
+      for (c = 0; c < n; c++, total++) {
+	char ch = rtty_ita2_decode(codes[c], &decode_shift);
+	if (ch) decoded[d++] = ch;
+      }
+    }
+    decoded[d] = '\0';
+
+    if (strcmp(decoded, frames[f])) {
+      printf("ERROR: Decoded as %s", decoded);
+      return 1;
+    }
+
+    /* Bits on the air at 8N2 and 5N1.5, in half bits */
+    uint32_t ascii = length * 22, ita2 = total * 15;
+    printf("%u characters, %u codes: 8N2 %u.%u bits, 5N1.5 %u.%u bits, "
+	   "%u%% more frames\n", length, total, ascii / 2, (ascii % 2) * 5,
+	   ita2 / 2, (ita2 % 2) * 5, (100 * ascii / ita2) - 100);
+  }
+
+  /* A string built in a slot goes out through a coder the same as the
+     coded string set directly */
+  char direct[1000], coded[1000];
+  uint32_t direct_length, coded_length;
+  char* slot;
+
+  rtty_set_format(50, 8, RTTY_STOP_2);
+  rtty_set_string("RRTTYY", 6);
+  direct_length = rtty_test_run(direct, sizeof(direct));
+
+  slot = rtty_acquire();
+  memcpy(slot, "RTY", 3);
+  if (rtty_commit(slot, 3, rtty_test_twice, 6) != 0) {
+    printf("ERROR: Commit failed\n");
+    return 1;
+  }
+  if (RTTY_SLOTS > 1 && rtty_acquire() == slot) {
+    printf("ERROR: Slot handed out while it's sent\n");
+    return 1;
+  }
+  coded_length = rtty_test_run(coded, sizeof(coded));
+
+  if (coded_length != direct_length || memcmp(coded, direct, direct_length)) {
+    printf("ERROR: Coded string sent differently\n");
+    return 1;
+  }
+  if (rtty_acquire() != rtty_slots[0]) {
+    printf("ERROR: Slot not freed\n");
+    return 1;
+  }
+  printf("\nSent from a slot through a coder, %u half bits\n", coded_length);
+
+#ifndef RTTY_PRERENDER_DISABLED
+  /* ITA2 is rendered with its shifts */
+  rtty_set_format(50, 5, RTTY_STOP_1_5);
+  rtty_set_string("$1A", 3); // FIGS $ 1 LTRS A
+  if (rtty_stream_length != 5 * 15 || (rtty_stream[0] & 0x7FFF) != 0x7F3C) {
+    printf("ERROR: ITA2 not rendered\n");
+    return 1;
+  }
+  while (rtty_active()) rtty_tick();
+  rtty_tick();
+
+  /* A preamble is mark ahead of the first start bit */
+  rtty_set_format(50, 8, RTTY_STOP_2);
+  rtty_set_preamble(3);
+  rtty_set_string("R", 1);
+  if (rtty_stream_length != 3 + 11 || (rtty_stream[0] & 0xF) != 0x7) {
+    printf("ERROR: Preamble not rendered\n");
+    return 1;
+  }
+  rtty_set_preamble(0);
+#endif
 
   printf("\n*** DONE ***\n");
+  return 0;
 }
 
 #endif
@@ -118,6 +118,14 @@
 #include "sd_spi.h"
 
 #define SD_COMMAND_TIMEOUT 100
+/* Identification can run at up to 400kHz. The card takes as long as it
+   takes to come out of idle, so polling four times as fast needs four
+   times the tries for the same quarter second. */
+#define SD_INIT_HZ 400000
+#define SD_INIT_RETRIES 400
+/* More than a block, its CRC and the card's response */
+#define SD_RESUME_FLUSH 520
+#define SD_RESUME_TIMEOUT 0x10000
 
 #define SD_DBG             0
 
@@ -146,7 +154,7 @@ int _cmdx(int cmd, int arg);
 int _cmd58();
 int _cmd8();
 int _block_read(uint8_t *buffer, uint32_t length);
-int _block_write(const uint8_t*buffer, uint32_t length);
+int _block_write(const struct disk_part* parts, uint32_t count);
 static uint32_t ext_bits(unsigned char *data, int msb, int lsb);
 uint64_t _sd_sectors();
 
@@ -160,8 +168,8 @@ int cdv;
 int initialise_card(void) {
   uint8_t i;
 
-  /* Set to 100kHz for initialisation, and clock card with cs = 1 */
-  sd_spi_frequency(100000);
+  /* Set to 400kHz for initialisation, and clock card with cs = 1 */
+  sd_spi_frequency(SD_INIT_HZ);
   SD_SPI_DISABLE();
 
   for (i = 0; i < 16; i++) {
@@ -193,7 +201,7 @@ int initialise_card(void) {
 int initialise_card_v1(void) {
   uint32_t i;
 
-  for (i = 0; i < SD_COMMAND_TIMEOUT; i++) {
+  for (i = 0; i < SD_INIT_RETRIES; i++) {
     _cmd(55, 0);
     if (_cmd(41, 0) == 0) {
       cdv = 512;
@@ -209,7 +217,7 @@ int initialise_card_v1(void) {
 int initialise_card_v2(void) {
   uint32_t i;
 
-  for (i = 0; i < SD_COMMAND_TIMEOUT; i++) {
+  for (i = 0; i < SD_INIT_RETRIES; i++) {
 
     _cmd58();
     _cmd(55, 0);
@@ -236,12 +244,69 @@ int disk_initialize(void) {
   return 0;
 }
 
+/**
+ * Picks the card up again after a warm reset. It's still powered and
+ * set up from before, so it only has to finish whatever it was doing,
+ * which takes milliseconds instead of the initialisation at 400kHz.
+ * unit is what card_unit() returned before the reset. Returns 0 on
+ * success or 1 if the card needs initialising again.
+ */
+int resume_card(int unit) {
+  uint32_t i;
+
+  if (unit == 0) return 1;
+  sd_spi_frequency(1000000);
+
+  /* Clock out the rest of any block it was being sent, then wait while
+     it's busy. CRCs are off, so the card takes the 0xFF padding as data
+     and writes the block. It's at or after the log head saved before
+     the reset, so the log writes over it when it carries on from
+     there. */
+  SD_SPI_ENABLE();
+  for (i = 0; i < SD_RESUME_TIMEOUT; i++) {
+    if (sd_spi_xfer(0xFF) == 0xFF && i >= SD_RESUME_FLUSH) break;
+  }
+  SD_SPI_DISABLE();
+  sd_spi_xfer(0xFF);
+
+  /* A card that's lost its state doesn't answer, or is idle */
+  if (i == SD_RESUME_TIMEOUT || _cmd(16, 512) != 0) {
+    return 1;
+  }
+
+  cdv = unit;
+  _sectors = _sd_sectors();
+  return 0;
+}
+/**
+ * How blocks are addressed, 512 for bytes or 1 for blocks, or 0 if the
+ * card hasn't been initialised
+ */
+int card_unit(void) {
+  return cdv;
+}
+
 /**
  * Write up to 512 octets to a single block.
  * The `length` argument specifies the number of octets to write.
  * Returns 0 on success, 1 on failure.
  */
 int disk_write(const uint8_t *buffer, uint32_t length, uint64_t block_number) {
+  struct disk_part part = { buffer, length };
+
+  return disk_write_parts(&part, 1, block_number);
+}
+/**
+ * The same, with the block gathered from several buffers one after
+ * the other, so they don't have to be copied together first.
+ */
+int disk_write_parts(const struct disk_part* parts, uint32_t count,
+		     uint64_t block_number) {
+  uint32_t i, length = 0;
+
+  for (i = 0; i < count; i++) {
+    length += parts[i].length;
+  }
   if (length > 512) { return 0; } /* We can only write 512 octets or less */
   if (block_number > 0x007FFFFF) { return 0; } /* We don't support the 64-bit address space yet */
 
@@ -251,7 +316,7 @@ int disk_write(const uint8_t *buffer, uint32_t length, uint64_t block_number) {
   }
 
   /* Send the data block */
-  _block_write(buffer, length);
+  _block_write(parts, count);
   return 0;
 }
 /**
@@ -421,8 +486,8 @@ int _block_read(uint8_t *buffer, uint32_t length) {
   return 0;
 }
 
-int _block_write(const uint8_t* buffer, uint32_t length) {
-  uint32_t i;
+int _block_write(const struct disk_part* parts, uint32_t count) {
+  uint32_t i, p, length = 0;
 
   SD_SPI_ENABLE();
 
@@ -430,8 +495,11 @@ int _block_write(const uint8_t* buffer, uint32_t length) {
   sd_spi_xfer(0xFE);
 
   /* Write a full 512-octet block */
-  for (i = 0; i < length; i++) {
-    sd_spi_xfer(buffer[i]);
+  for (p = 0; p < count; p++) {
+    for (i = 0; i < parts[p].length; i++) {
+      sd_spi_xfer(parts[p].buffer[i]);
+    }
+    length += parts[p].length;
   }
   for (i = length; i < 512; i++) {
     sd_spi_xfer(0xFF);
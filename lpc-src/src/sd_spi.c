@@ -24,6 +24,7 @@
 
 #include "LPC11xx.h"
 #include "sd_spi.h"
+#include "clock.h"
 
 uint8_t sd_spi_xfer(uint8_t data) {
   LPC_SPI0->DR = data;
@@ -40,16 +41,53 @@ void sd_spi_flush(void) {
   }
 }
 /**
- * Sets the SPI frequency.
+ * The frequency we were asked for, kept so it can be set up again when
+ * the core clock changes
+ */
+static uint32_t sd_spi_hz = 100*1000;
+
+/**
+ * Sets the SPI frequency. The prescaler only goes to 254, so slow
+ * rates from a fast clock use the serial clock rate in CR0 as well.
  */
 void sd_spi_frequency(uint32_t frequency) {
   uint32_t div = SystemCoreClock / frequency;
+  uint32_t scr = 0;
+
+  sd_spi_hz = frequency;
 
   if (div >= 2) {
+    while (div / (scr + 1) > 0xFE) scr++;
+
     /* SSPCPSR clock prescale register, master mode, minimum divisor is 0x02 */
-    LPC_SPI0->CPSR = div & 0xFE;
+    LPC_SPI0->CPSR = (div / (scr + 1)) & 0xFE;
+    LPC_SPI0->CR0 = (LPC_SPI0->CR0 & 0xFF) | (scr << 8);
   }
 }
+/**
+ * Sets the frequency up again for a new core clock. The clock to the
+ * block might be gated, so it's turned on for long enough to do that.
+ */
+static void sd_spi_clock_changed(void) {
+  uint32_t gated = !(LPC_SYSCON->SYSAHBCLKCTRL & (1 << 11));
+
+  if (gated) clock_syscon(CLOCK_AHB, (1 << 11), 0);
+  sd_spi_frequency(sd_spi_hz);
+  if (gated) clock_syscon(CLOCK_AHB, 0, (1 << 11));
+}
+/**
+ * Gates the clock to the SSP0 block between uses. The SSP registers
+ * keep their values while the clock is off.
+ */
+void sd_spi_clock_enable(void) {
+  clock_syscon(CLOCK_AHB, (1 << 11), 0);
+}
+void sd_spi_clock_disable(void) {
+  /* Let the last frame finish */
+  while (LPC_SPI0->SR & SSPSR_BSY);
+
+  clock_syscon(CLOCK_AHB, 0, (1 << 11));
+}
 /**
  * Initialisation
  */
@@ -58,7 +96,7 @@ void sd_spi_init(void) {
   LPC_SYSCON->PRESETCTRL |= (1 << 0);
 
   /* Enable the clock to the module */
-  LPC_SYSCON->SYSAHBCLKCTRL |= (1 << 11);
+  clock_syscon(CLOCK_AHB, (1 << 11), 0);
   LPC_SYSCON->SSP0CLKDIV = 0x01; /* Full clock to the module */
 
   /*  SSP I/O configuration */
@@ -76,6 +114,7 @@ void sd_spi_init(void) {
 
   /* Initially 100kHz */
   sd_spi_frequency(100*1000);
+  clock_register(sd_spi_clock_changed);
 
   /* Master SSP Enabled */
   LPC_SPI0->CR1 = SSPCR1_SSE;
@@ -24,13 +24,18 @@
 
 #include "LPC11xx.h"
 #include "spi.h"
+#include "pool.h"
+#include "profile.h"
+#include "clock.h"
 
-#define SPI_BUFFER_LEN	0x100
+#define SPI_BUFFER_LEN	(POOL_BLOCK_SIZE - 1)
 
 /**
- * Buffer for received data.
+ * Buffer for received data, a block from the pool from the start of a
+ * frame until it's been processed. There's room for a null terminator
+ * after the frame.
  */
-uint8_t spi_buffer[SPI_BUFFER_LEN];
+uint8_t* spi_buffer = 0;
 uint16_t spi_buffer_index = 0;
 /**
  * A function that we call to have data processed.
@@ -87,7 +92,7 @@ void spi_init(spi_frame_func frame_processing_function) {
   LPC_SYSCON->PRESETCTRL |= (1 << 2);
 
   /* Enable the clock to the module */
-  LPC_SYSCON->SYSAHBCLKCTRL |= (1 << 18);
+  clock_syscon(CLOCK_AHB, (1 << 18), 0);
   LPC_SYSCON->SSP1CLKDIV = 0x01; /* Full clock to the module */
 
   /*  SSP I/O configuration */
@@ -123,6 +128,7 @@ void spi_init(spi_frame_func frame_processing_function) {
  */
 void SSP1_IRQHandler(void) {
   uint8_t data;
+  PROFILE_START(isr_start);
 
   /* Clear interrupts */
   LPC_SPI1->ICR |= 0x3;
@@ -134,11 +140,19 @@ void SSP1_IRQHandler(void) {
 
     if (data == '!') { // If started frame
       spi_buffer_index = 0;
+      if (!spi_buffer) {
+	spi_buffer = (uint8_t*)pool_alloc();
+      }
+    }
+    if (!spi_buffer) { // Not in a frame, or no room for it
+      continue;
     }
 
     spi_buffer[spi_buffer_index] = data;
 
     if (spi_buffer[spi_buffer_index] == '\n') { // End of frame
+      spi_buffer[spi_buffer_index+1] = '\0';
+
       /* Get the frame processed */
       if (frame_pr) {
 	frame_pr(spi_buffer, spi_buffer_index+1);
@@ -146,6 +160,8 @@ void SSP1_IRQHandler(void) {
 
       /* Setup for next rx */
       spi_buffer_index = 0;
+      pool_free(spi_buffer);
+      spi_buffer = 0;
     } else {
       spi_buffer_index++;
     }
@@ -154,4 +170,6 @@ void SSP1_IRQHandler(void) {
       spi_buffer_index = 0;
     }
   }
+
+  PROFILE_END(PROFILE_ISR_SSP1, isr_start);
 }
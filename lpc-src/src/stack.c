@@ -0,0 +1,112 @@
+/*
+ * Measures how deep the stack goes
+ * Copyright (C) 2014  richard
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "LPC11xx.h"
+#include "stack.h"
+
+/**
+ * Where the stack can go, from the linker script, and where it is now.
+ * The simulator runs the firmware on the host's stack, so it gives us
+ * a stand-in to paint instead.
+ */
+#if !defined(STACK_TEST) && !defined(STACK_BOTTOM)
+
+extern uint32_t __end__, __StackTop;
+#define STACK_BOTTOM		(&__end__)
+#define STACK_TOP		(&__StackTop)
+#define STACK_POINTER()		((uint32_t*)(uintptr_t)__get_MSP())
+
+#elif defined(STACK_TEST)
+
+uint32_t stack_test[256];
+uint32_t* stack_test_pointer = &stack_test[256];
+#define STACK_BOTTOM		(&stack_test[0])
+#define STACK_TOP		(&stack_test[256])
+#define STACK_POINTER()		stack_test_pointer
+
+#endif
+
+/**
+ * Leave a little below the stack pointer alone, for the interrupts
+ * that might come in while we're painting
+ */
+#define STACK_MARGIN_WORDS	16
+
+/**
+ * Paints everything below the stack, as early as possible
+ */
+void stack_paint(void) {
+  uint32_t* p = STACK_BOTTOM;
+  uint32_t* end = STACK_POINTER() - STACK_MARGIN_WORDS;
+
+  while (p < end) {
+    *p++ = STACK_PAINT;
+  }
+}
+/**
+ * Returns the most stack that's been used so far, in bytes
+ */
+uint32_t stack_peak(void) {
+  uint32_t* p = STACK_BOTTOM;
+
+  while (p < STACK_TOP && *p == STACK_PAINT) {
+    p++;
+  }
+
+  return (STACK_TOP - p) * 4;
+}
+/**
+ * Returns the room there is for the stack, in bytes
+ */
+uint32_t stack_size(void) {
+  return (STACK_TOP - STACK_BOTTOM) * 4;
+}
+
+#ifdef STACK_TEST
+
+#include <assert.h>
+#include <stdio.h>
+
+int main(void) {
+  printf("*** STACK_TEST ***\n\n");
+
+  /* main() has the top 64 bytes */
+  stack_test_pointer = &stack_test[240];
+  stack_paint();
+  assert(stack_test[0] == STACK_PAINT);
+  assert(stack_test[240 - STACK_MARGIN_WORDS - 1] == STACK_PAINT);
+  assert(stack_test[240 - STACK_MARGIN_WORDS] == 0);
+  assert(stack_peak() == (16 + STACK_MARGIN_WORDS) * 4);
+
+  /* Something goes deeper */
+  stack_test[100] = 0;
+  printf("%u of %u bytes used\n", stack_peak(), stack_size());
+  assert(stack_peak() == 156 * 4);
+  assert(stack_size() == 1024);
+
+  printf("\n*** DONE ***\n");
+  return 0;
+}
+
+#endif
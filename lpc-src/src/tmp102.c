@@ -23,6 +23,8 @@
  */
 
 #include "i2c.h"
+#include "control.h"
+#include "tmp102.h"
 
 /**
  * DATASHEET: https://www.sparkfun.com/datasheets/Sensors/Temperature/tmp102.pdf
@@ -39,8 +41,63 @@
 #define TMP102_CONTROL_REG	0x01
 
 /**
- * By default the TMP102 converts readings at 4Hz
+ * By default the TMP102 converts readings at 4Hz. Here it's shut down
+ * and does a one-shot conversion once a pass of the main loop instead,
+ * so a frame's temperature is from the start of the pass before. The
+ * read and the next conversion go out together while the main loop
+ * gets on with something else.
+ *
+ * Control register, MSB first. OS starts a one-shot when SD's set.
+ */
+#define TMP102_CONFIG_OS	0x80
+#define TMP102_CONFIG_SD	0x01
+#define TMP102_CONFIG_4HZ	0x80	/* Second byte, the rate if it's woken */
+#define TMP102_CONFIG_EM	0x10	/* Second byte */
+/**
+ * Extended mode gives 13 bits, up to 150°C instead of 128°C. The
+ * resolution's the same and so is the bottom of the range, -55°C, so
+ * it's off by default. The last bit of a reading says which it is.
+ */
+//#define TMP102_EXTENDED
+#ifdef TMP102_EXTENDED
+#define TMP102_MODE		(TMP102_CONFIG_4HZ | TMP102_CONFIG_EM)
+#else
+#define TMP102_MODE		TMP102_CONFIG_4HZ
+#endif
+#define TMP102_EM_FLAG		0x01
+/**
+ * A one-shot takes 26ms, 35ms at most
  */
+#define TMP102_CONVERSION_TICKS	((35 * SYSTICK_HZ + 999) / 1000)
+/**
+ * A reading older than this isn't used
+ */
+#define TMP102_STALE_TICKS	(5 * SYSTICK_HZ)
+
+static struct thermometer thermometer;
+
+static uint8_t result[2];
+static uint8_t shutdown[2] = { TMP102_CONFIG_SD, TMP102_MODE };
+static uint8_t one_shot[2] = { TMP102_CONFIG_SD | TMP102_CONFIG_OS, TMP102_MODE };
+
+/**
+ * Read the last conversion and start the next. init_list does the
+ * same, after shutting down from free running.
+ */
+static struct i2c_transfer next_list[2] = {
+  { TMP102_ADDRESS, TMP102_TEMPERATURE_REG, 0, 2, result },
+  { TMP102_ADDRESS, TMP102_CONTROL_REG, 1, 2, one_shot },
+};
+static struct i2c_transfer init_list[3] = {
+  { TMP102_ADDRESS, TMP102_TEMPERATURE_REG, 0, 2, result },
+  { TMP102_ADDRESS, TMP102_CONTROL_REG, 1, 2, shutdown },
+  { TMP102_ADDRESS, TMP102_CONTROL_REG, 1, 2, one_shot },
+};
+
+static uint8_t converting;	/* A one-shot's running */
+static uint32_t started;	/* When it started */
+static uint8_t reading;		/* next_list is on the bus */
+static uint32_t read_ticks;	/* When what it's reading started */
 
 /**
  * Processes a temperature value for the TMP102 into a dobule.
@@ -55,25 +112,96 @@ double process_temperature(int16_t value) {
   return (double)value * 0.0625;
 }
 /**
- * Gets the temperature from the TMP102
+ * Processes the temperature register, MSB first, into a double. It's
+ * 12 bits, or 13 in extended mode.
  */
-double get_temperature(void) {
+double tmp102_decode(uint8_t msb, uint8_t lsb) {
   int16_t value;
 
-  I2CWriteLength = 2;
-  I2CReadLength = 2;
-  I2CMasterBuffer[0] = TMP102_ADDRESS;
-  I2CMasterBuffer[1] = TMP102_TEMPERATURE_REG;
-  I2CMasterBuffer[2] = TMP102_ADDRESS | RD_BIT;
+  if (lsb & TMP102_EM_FLAG) {
+    /* Sign extension from 13-bit to 16-bit */
+    value = (msb << 5) | (lsb >> 3);
+    if (value & 0x1000) {
+      value |= 0xE000;
+    }
+    return (double)value * 0.0625;
+  }
 
-  if (i2c_engine() == I2CSTATE_ACK) { // All is well
-    /* 12 bit data, MSb first */
-    value = (I2CSlaveBuffer[0] << 4) | (I2CSlaveBuffer[1] >> 4);
+  return process_temperature((msb << 4) | (lsb >> 4));
+}
+/**
+ * Takes the reading it was free running with, and starts the first
+ * one-shot
+ */
+void init_thermometer(uint32_t now) {
+  converting = 0;
+  reading = 0;
+  thermometer.valid = 0;
+
+  if (i2c_transfer(init_list, 3) == I2CSTATE_ACK) {
+    thermometer.temperature = tmp102_decode(result[0], result[1]);
+    thermometer.ticks = now;
+    thermometer.valid = 1;
+    converting = 1;
+    started = now;
+  }
+}
+/**
+ * Call once a pass with the bus clocked. If the last conversion's done
+ * it's read, and the next one started, without waiting for the bus.
+ * Nothing else should use the bus until get_thermometer().
+ */
+void thermometer_update(uint32_t now) {
+  get_thermometer();
 
-    return process_temperature(value);
-  } else { // Fail
+  if (converting && (now - started) < TMP102_CONVERSION_TICKS) {
+    return; // Not done yet
+  }
+
+  /* Just start one if there's nothing to read */
+  if (i2c_start_transfer(converting ? next_list : next_list + 1,
+			 converting ? 2 : 1) == I2CSTATE_PENDING) {
+    reading = converting;
+    read_ticks = started;
+    converting = 1;
+    started = now;
+  } else {
+    converting = 0;
+  }
+}
+/**
+ * Gets the last reading from the TMP102, waiting for the bus if it's
+ * still coming in
+ */
+struct thermometer* get_thermometer(void) {
+  uint32_t state;
+
+  if (reading) {
+    reading = 0;
+    state = i2c_wait();
+
+    if (state == I2CSTATE_ACK) {
+      thermometer.temperature = tmp102_decode(result[0], result[1]);
+      thermometer.ticks = read_ticks;
+      thermometer.valid = 1;
+    } else {
+      converting = 0; // The one-shot might not have started
+    }
+  }
+
+  return &thermometer;
+}
+/**
+ * Gets the temperature, or -1000 if there's nothing recent
+ */
+double get_temperature(uint32_t now) {
+  struct thermometer* t = get_thermometer();
+
+  if (!t->valid || (now - t->ticks) > TMP102_STALE_TICKS) { // Fail
     return -1000;
   }
+
+  return t->temperature;
 }
 
 #ifdef TMP102_TEST
@@ -81,6 +209,19 @@ double get_temperature(void) {
 #include <assert.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include "clock.h"
+
+/**
+ * i2c.c is only linked for its symbols and never runs, so these just
+ * need to be here
+ */
+uint32_t SystemCoreClock = CLOCK_SLOW_HZ;
+void clock_register(clock_listener listener) {
+  (void)listener;
+}
+void clock_syscon(uint8_t reg, uint32_t set, uint32_t clear) {
+  (void)reg; (void)set; (void)clear;
+}
 
 /**
  * Performs a test of the conversion routine.
@@ -107,6 +248,17 @@ int main(void) {
   process_test(0xE70, -25);
   process_test(0xC90, -55);
 
+  /* Both formats, from Tables 5 and 4 */
+  assert(tmp102_decode(0xE7, 0x00) == -25);
+  assert(tmp102_decode(0xC9, 0x00) == -55);
+  assert(tmp102_decode(0x7F, 0xF0) == 127.9375);
+  assert(tmp102_decode(0x4B, 0x01) == 150);
+  assert(tmp102_decode(0x3E, 0x81) == 125);
+  assert(tmp102_decode(0xE4, 0x81) == -55);
+  assert(tmp102_decode(0xFF, 0xF9) == -0.0625);
+  printf("Extended 0x4B01 = %g°C, 0xE481 = %g°C\n",
+	 tmp102_decode(0x4B, 0x01), tmp102_decode(0xE4, 0x81));
+
   printf("\n*** DONE ***\n");
 }
 
@@ -26,21 +26,60 @@
 #include <string.h>
 #include "uart.h"
 #include "gps.h"
+#include "pool.h"
+#include "profile.h"
+#include "clock.h"
 
 /**
- * Recevies NMEA frames on P1[6] at 4800 baud.
+ * Recevies NMEA frames on P1[6] at 4800 baud, each into a block from
+ * the pool that's given back once it's been processed. There's room
+ * for a null terminator after the frame.
+ *
+ * With GPS_UBX it's UBX at GPS_UBX_BAUD instead, parsed as it comes
+ * in, and the configuration goes out on P1[7].
  */
+#ifdef GPS_UBX
+#define UART_BAUD		GPS_UBX_BAUD
+#else
+#define UART_BAUD		4800
+#endif
 
-#define MAX_NMEA_FRAME_SIZE	0x200
+#define MAX_NMEA_FRAME_SIZE	(POOL_BLOCK_SIZE - 1)
 
-char nmea_frame[MAX_NMEA_FRAME_SIZE];
+char* nmea_frame = NULL;
 
 #define START_CODE		'$'
 #define CHECKSUM_CODE		'*'
 #define CHECKSUM_LENGTH		2
 #define RX_FIFO_TRIGGER_LEVEL	14
+#define TX_FIFO_SIZE		16
+
+#define IER_RBR			(1 << 0)
+#define IER_THRE		(1 << 1)
+#define IER_RXL			(1 << 2)
+#define LSR_RDR			(1 << 0)
+#define LSR_THRE		(1 << 5)
+
+int in_index = -1, checksum_index; // Nothing until the first '$'
+
+#ifdef GPS_UBX
+
+struct ubx_parser ubx_parser;
+
+/**
+ * Called when a character can be read from the Rx FIFO.
+ */
+void rx_read(uint8_t number) {
+  uint8_t i;
+
+  for (i = 0; i < number; i++) {
+    if (ubx_parse(&ubx_parser, LPC_UART->RBR)) {
+      process_ubx_message(&ubx_parser);
+    }
+  }
+}
 
-int in_index, checksum_index;
+#else
 
 /**
  * Called when a character can be read from the Rx FIFO.
@@ -52,13 +91,19 @@ void rx_read(uint8_t number) {
     data = LPC_UART->RBR;
 
     if (data == START_CODE) {
+      if (!nmea_frame) {
+	nmea_frame = (char*)pool_alloc();
+      }
 
-
-      /* Start a new frame */
-      in_index = 0;
-      checksum_index = 0;
-      nmea_frame[in_index] = data;
-      in_index++;
+      if (nmea_frame) {
+	/* Start a new frame */
+	in_index = 0;
+	checksum_index = 0;
+	nmea_frame[in_index] = data;
+	in_index++;
+      } else { /* No room for it */
+	in_index = -1;
+      }
 
     } else if (in_index < MAX_NMEA_FRAME_SIZE && in_index >= 0) {
       /* Add a character to the current frame */
@@ -68,8 +113,12 @@ void rx_read(uint8_t number) {
       /* If we're in a checksum sequence */
       if (checksum_index) {
 	if (checksum_index++ == CHECKSUM_LENGTH) {
+	  nmea_frame[in_index] = '\0';
 	  process_gps_frame(nmea_frame);
 	  in_index = -1;
+
+	  pool_free(nmea_frame);
+	  nmea_frame = NULL;
 	}
       } else if (data == CHECKSUM_CODE) {
 	/* Otherwise look for the start of the checksum sequence */
@@ -79,16 +128,60 @@ void rx_read(uint8_t number) {
   }
 }
 
+#endif
+
+/**
+ * What's being sent, a byte at a time
+ */
+struct ubx_writer tx_writer;
+
+/**
+ * Fills the empty Tx FIFO, and turns the interrupt off once there's
+ * nothing left to send
+ */
+static void tx_fill(void) {
+  uint8_t i;
+  int c;
+
+  for (i = 0; i < TX_FIFO_SIZE; i++) {
+    if ((c = ubx_writer_next(&tx_writer)) < 0) {
+      LPC_UART->IER &= ~IER_THRE;
+      return;
+    }
+    LPC_UART->THR = c;
+  }
+}
+/**
+ * Starts sending a list of messages, which have to stay put until
+ * uart_sending() returns 0
+ */
+void uart_send_ubx(const struct ubx_message* list, uint8_t count) {
+  NVIC_DisableIRQ(UART_IRQn);
+  ubx_writer_init(&tx_writer, list, count);
+  LPC_UART->IER |= IER_THRE;
+  if (LPC_UART->LSR & LSR_THRE) {
+    tx_fill();
+  }
+  NVIC_EnableIRQ(UART_IRQn);
+}
+uint8_t uart_sending(void) {
+  return (LPC_UART->IER & IER_THRE) ? 1 : 0;
+}
+
 /**
  * UART interrupt.
  */
 extern void UART_IRQHandler(void) {
   uint8_t Dummy=Dummy, iir;
+  PROFILE_START(isr_start);
 
   /* While interrupt pending */
   while (!((iir = LPC_UART->IIR) & 1)) {
     /* Switch by interrupt source */
     switch((iir & (7 << 1)) >> 1) {
+      case 0x1:/* Tx FIFO Empty */
+	tx_fill();
+	break;
       case 0x3:/* Rx Line / Status Error*/
 	Dummy = LPC_UART->LSR;
 	break;
@@ -98,16 +191,37 @@ extern void UART_IRQHandler(void) {
 	break;
       case 0x6: /* Rx Data Character Timeout*/
 	/* Empty the Rx FIFO */
-	Dummy = LPC_UART->RBR;
-	rx_read(1);
+	while (LPC_UART->LSR & LSR_RDR) {
+	  rx_read(1);
+	}
 	break;
     }
   }
+
+  PROFILE_END(PROFILE_ISR_UART, isr_start);
 }
 
 /**
- * Initialises the UART at 9600 baud. The system core clock must be a
- * multiple of 125kHz.
+ * Sets the divisors for UART_BAUD from the core clock, which must be
+ * close to a multiple of 26 times it, 125kHz for 4800. This is called
+ * again whenever the clock changes.
+ */
+static void uart_set_baud(void) {
+  /* Baud Rate = (SysCClk) / (16*PCLK_DIV*1.625), and 16*1.625 = 26 */
+  /* 1.625 (DivAddVal = 5, MulVal = 8) */
+  int pclk_div = SystemCoreClock / (26 * UART_BAUD);
+
+  LPC_UART->LCR = 0x83;	/* 8-bit words, 1 stop bit, DL access */
+  /* Load the Divisor Latches */
+  LPC_UART->DLL = pclk_div & 0xFF;
+  LPC_UART->DLM = pclk_div >> 8;
+  /* Load the fractional divider */
+  LPC_UART->FDR = (8 << 4) | (5 << 0);
+  LPC_UART->LCR = 0x3; /* DLAB = 0 */
+}
+
+/**
+ * Initialises the UART at 4800 baud
  */
 void uart_init(void) {
 
@@ -117,27 +231,17 @@ void uart_init(void) {
   LPC_IOCON->PIO1_7 &= ~0x7;
   LPC_IOCON->PIO1_7 |= 0x1;
 
-  LPC_SYSCON->SYSAHBCLKCTRL |= (1 << 12);
+  clock_syscon(CLOCK_AHB, (1 << 12), 0);
   LPC_SYSCON->UARTCLKDIV = 1; /* Use the main clock for the UART */
 
 
   /* Configure UART */
-  LPC_UART->LCR = 0x83;	/* 8-bit words, 1 stop bit, DL access */
-
-  /* Baud Rate = (SysCClk) / (16*PCLK_DIV*1.625) = 125000 / 16*1.625 = 4800 */
-  /* 1.625 (DivAddVal = 5, MulVal = 8) */
-  int pclk_div = SystemCoreClock / 125000;
-  /* Load the Divisor Latches */
-  LPC_UART->DLL = pclk_div & 0xFF;
-  LPC_UART->DLM = pclk_div >> 8;
-  /* Load the fractional divider */
-  LPC_UART->FDR = (8 << 4) | (5 << 0);
-
-  LPC_UART->LCR = 0x3; /* DLAB = 0 */
+  uart_set_baud();
+  clock_register(uart_set_baud);
   LPC_UART->FCR |= (3 << 6) | (7 << 0);	/* FIFO Enable+Reset, RX Trig 3 */
 
   /* Configure Interrupts */
-  LPC_UART->IER |= (1 << 2) | (1 << 0); /* Enable the RBR and RXL interrupts */
+  LPC_UART->IER |= IER_RXL | IER_RBR; /* Enable the RBR and RXL interrupts */
 
   /* Enable the interrupt in the NVIC */
   NVIC_SetPriority(UART_IRQn, 1); /* 2nd highest priority*/
@@ -145,4 +249,7 @@ void uart_init(void) {
 
   /* Start the receiver waiting for the start of a packet */
   in_index = -1;
+#ifdef GPS_UBX
+  ubx_parser_init(&ubx_parser);
+#endif
 }
@@ -0,0 +1,318 @@
+/*
+ * The u-blox binary protocol
+ * Copyright (C) 2014  richard
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "LPC11xx.h"
+#include <string.h>
+#include "ubx.h"
+
+/**
+ * Parser states
+ */
+#define UBX_WAIT_SYNC_1		0
+#define UBX_WAIT_SYNC_2		1
+#define UBX_WAIT_CLASS		2
+#define UBX_WAIT_ID		3
+#define UBX_WAIT_LENGTH_LO	4
+#define UBX_WAIT_LENGTH_HI	5
+#define UBX_WAIT_PAYLOAD	6
+#define UBX_WAIT_CK_A		7
+#define UBX_WAIT_CK_B		8
+
+static void ubx_checksum(uint8_t* ck_a, uint8_t* ck_b, uint8_t c) {
+  *ck_a += c;
+  *ck_b += *ck_a;
+}
+
+void ubx_parser_init(struct ubx_parser* p) {
+  memset(p, 0, sizeof(*p));
+}
+/**
+ * Takes the next byte received. Returns 1 when it completes a message
+ * with a good checksum, which is in p until the next byte. Anything
+ * between messages, like NMEA before the receiver's configured, is
+ * skipped.
+ */
+uint8_t ubx_parse(struct ubx_parser* p, uint8_t c) {
+  switch (p->state) {
+    case UBX_WAIT_SYNC_1:
+      if (c == UBX_SYNC_1) p->state = UBX_WAIT_SYNC_2;
+      return 0;
+    case UBX_WAIT_SYNC_2:
+      if (c == UBX_SYNC_2) {
+	p->state = UBX_WAIT_CLASS;
+	p->ck_a = p->ck_b = 0;
+      } else if (c != UBX_SYNC_1) {
+	p->state = UBX_WAIT_SYNC_1;
+      }
+      return 0;
+    case UBX_WAIT_CLASS:
+      p->cls = c;
+      break;
+    case UBX_WAIT_ID:
+      p->id = c;
+      break;
+    case UBX_WAIT_LENGTH_LO:
+      p->length = c;
+      break;
+    case UBX_WAIT_LENGTH_HI:
+      p->length |= (uint16_t)c << 8;
+      p->index = 0;
+      if (p->length > UBX_MAX_LENGTH) {
+	p->state = UBX_WAIT_SYNC_1;
+	p->bad++;
+	return 0;
+      }
+      ubx_checksum(&p->ck_a, &p->ck_b, c);
+      p->state = p->length ? UBX_WAIT_PAYLOAD : UBX_WAIT_CK_A;
+      return 0;
+    case UBX_WAIT_PAYLOAD:
+      if (p->index < UBX_PAYLOAD_KEPT) p->payload[p->index] = c;
+      ubx_checksum(&p->ck_a, &p->ck_b, c);
+      if (++p->index == p->length) p->state = UBX_WAIT_CK_A;
+      return 0;
+    case UBX_WAIT_CK_A:
+      if (c == p->ck_a) {
+	p->state = UBX_WAIT_CK_B;
+      } else {
+	p->state = UBX_WAIT_SYNC_1;
+	p->bad++;
+      }
+      return 0;
+    case UBX_WAIT_CK_B:
+      p->state = UBX_WAIT_SYNC_1;
+      if (c == p->ck_b) {
+	p->good++;
+	return 1;
+      }
+      p->bad++;
+      return 0;
+    default:
+      p->state = UBX_WAIT_SYNC_1;
+      return 0;
+  }
+
+  /* The class, ID and the first byte of the length */
+  ubx_checksum(&p->ck_a, &p->ck_b, c);
+  p->state++;
+  return 0;
+}
+
+void ubx_writer_init(struct ubx_writer* w, const struct ubx_message* list,
+		     uint8_t count) {
+  w->list = list;
+  w->count = count;
+  w->index = 0;
+}
+/**
+ * Returns the next byte to send, or -1 when every message has gone.
+ * The checksum's worked out on the way, so the messages can be const.
+ */
+int ubx_writer_next(struct ubx_writer* w) {
+  const struct ubx_message* m;
+  uint16_t i;
+  uint8_t c;
+
+  if (!w->count) return -1;
+
+  m = w->list;
+  i = w->index++;
+
+  if (i == 0) {
+    w->ck_a = w->ck_b = 0;
+    return UBX_SYNC_1;
+  } else if (i == 1) {
+    return UBX_SYNC_2;
+  } else if (i == UBX_FRAME_SIZE(m->length) - 2) {
+    return w->ck_a;
+  } else if (i == UBX_FRAME_SIZE(m->length) - 1) {
+    /* On to the next message */
+    w->list++;
+    w->count--;
+    w->index = 0;
+    return w->ck_b;
+  }
+
+  switch (i) {
+    case 2: c = m->cls; break;
+    case 3: c = m->id; break;
+    case 4: c = m->length & 0xFF; break;
+    case 5: c = m->length >> 8; break;
+    default: c = m->payload[i - 6]; break;
+  }
+  ubx_checksum(&w->ck_a, &w->ck_b, c);
+
+  return c;
+}
+
+/**
+ * Little endian fields
+ */
+uint16_t ubx_u16(const uint8_t* p) {
+  return p[0] | ((uint16_t)p[1] << 8);
+}
+uint32_t ubx_u32(const uint8_t* p) {
+  return ubx_u16(p) | ((uint32_t)ubx_u16(p + 2) << 16);
+}
+void ubx_put_u16(uint8_t* p, uint16_t v) {
+  p[0] = v & 0xFF;
+  p[1] = v >> 8;
+}
+void ubx_put_u32(uint8_t* p, uint32_t v) {
+  ubx_put_u16(p, v & 0xFFFF);
+  ubx_put_u16(p + 2, v >> 16);
+}
+
+#ifdef UBX_TEST
+
+#include <assert.h>
+#include <stdio.h>
+
+/**
+ * Frames the messages into buf, returning the length
+ */
+static size_t write_all(uint8_t* buf, const struct ubx_message* list,
+			uint8_t count) {
+  struct ubx_writer w;
+  size_t n = 0;
+  int c;
+
+  ubx_writer_init(&w, list, count);
+  while ((c = ubx_writer_next(&w)) >= 0) buf[n++] = c;
+  return n;
+}
+static int parse_all(struct ubx_parser* p, const uint8_t* buf, size_t n) {
+  int messages = 0;
+
+  while (n--) messages += ubx_parse(p, *buf++);
+  return messages;
+}
+
+/**
+ * Feeds a stream, from tools/ubxgen for example, and checks the
+ * NAV-PVT times go up a period at a time, with gaps only where a
+ * message was corrupt
+ */
+static void test_stream(const char* name) {
+  FILE* fp = fopen(name, "rb");
+  struct ubx_parser p;
+  uint32_t pvts = 0, missing = 0, itow, last = 0, period = 0;
+  int c;
+
+  assert(fp);
+  ubx_parser_init(&p);
+  while ((c = getc(fp)) != EOF) {
+    if (!ubx_parse(&p, c) || p.cls != UBX_NAV || p.id != UBX_NAV_PVT) continue;
+
+    assert(p.length == UBX_PVT_LENGTH);
+    itow = ubx_u32(p.payload);
+    if (pvts == 1) period = itow - last;
+    if (pvts > 1) {
+      assert(itow > last && (itow - last) % period == 0);
+      missing += (itow - last) / period - 1;
+    }
+    last = itow;
+    pvts++;
+  }
+  fclose(fp);
+
+  printf("%s: %u NAV-PVT every %ums, %u missing, %u bad checksums\n",
+	 name, pvts, period, missing, p.bad);
+  assert(pvts > 2 && missing == p.bad);
+}
+
+int main(int argc, char** argv) {
+  static const uint8_t rate[] = { UBX_U16(200), UBX_U16(1), UBX_U16(1) };
+  static const struct ubx_message cfg[] = {
+    { UBX_CFG, UBX_CFG_RATE, sizeof(rate), rate },
+    { UBX_CFG, UBX_CFG_RXM, 0, NULL },
+  };
+  /* CFG-RATE for 5Hz, checksummed by hand */
+  static const uint8_t rate_frame[] = {
+    0xB5, 0x62, 0x06, 0x08, 0x06, 0x00, 0xC8, 0x00, 0x01, 0x00, 0x01, 0x00,
+    0xDE, 0x6A
+  };
+  uint8_t buf[0x200];
+  struct ubx_parser p;
+  size_t n, i;
+
+  printf("*** UBX_TEST ***\n\n");
+
+  /* The writer frames and checksums, and an empty payload is allowed */
+  n = write_all(buf, cfg, 2);
+  assert(n == sizeof(rate_frame) + UBX_FRAME_SIZE(0));
+  assert(memcmp(buf, rate_frame, sizeof(rate_frame)) == 0);
+
+  /* And the parser gets both back */
+  ubx_parser_init(&p);
+  for (i = 0; i < sizeof(rate_frame) - 1; i++) assert(!ubx_parse(&p, buf[i]));
+  assert(ubx_parse(&p, buf[i]));
+  assert(p.cls == UBX_CFG && p.id == UBX_CFG_RATE && p.length == 6);
+  assert(ubx_u16(p.payload) == 200);
+  assert(parse_all(&p, buf + i + 1, n - i - 1) == 1 && p.length == 0);
+  assert(p.good == 2 && p.bad == 0);
+  printf("CFG-RATE framed and parsed back\n");
+
+  /* Any one bit flipped is caught */
+  for (i = 0; i < sizeof(rate_frame) * 8; i++) {
+    memcpy(buf, rate_frame, sizeof(rate_frame));
+    buf[i / 8] ^= 1 << (i % 8);
+    ubx_parser_init(&p);
+    assert(parse_all(&p, buf, sizeof(rate_frame)) == 0);
+  }
+  printf("Every single flipped bit rejected\n");
+
+  /* It finds the sync again through NMEA and a repeated first byte */
+  memcpy(buf, "$GPGGA,,,,,,0,00,99.99,,,,,,*48\r\n\xB5", 34);
+  n = 34 + write_all(buf + 34, cfg, 1);
+  ubx_parser_init(&p);
+  assert(parse_all(&p, buf, n) == 1 && p.id == UBX_CFG_RATE);
+
+  /* A corrupt length is dropped at once */
+  memcpy(buf, rate_frame, sizeof(rate_frame));
+  buf[5] = 0x40;
+  n = sizeof(rate_frame) + write_all(buf + sizeof(rate_frame), cfg, 1);
+  ubx_parser_init(&p);
+  assert(parse_all(&p, buf, n) == 1 && p.bad == 1);
+  printf("Sync found again after NMEA and a bad length\n");
+
+  /* Only the start of a long payload is kept */
+  {
+    uint8_t pvt[UBX_PVT_LENGTH];
+    struct ubx_message m = { UBX_NAV, UBX_NAV_PVT, sizeof(pvt), pvt };
+
+    for (i = 0; i < sizeof(pvt); i++) pvt[i] = i;
+    n = write_all(buf, &m, 1);
+    ubx_parser_init(&p);
+    assert(parse_all(&p, buf, n) == 1 && p.length == UBX_PVT_LENGTH);
+    assert(p.payload[UBX_PAYLOAD_KEPT - 1] == UBX_PAYLOAD_KEPT - 1);
+    assert(ubx_u32(p.payload + UBX_PVT_HMSL) == 0x27262524);
+  }
+
+  if (argc > 1) test_stream(argv[1]);
+
+  printf("\n*** DONE ***\n");
+  return 0;
+}
+
+#endif
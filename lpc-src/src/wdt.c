@@ -27,6 +27,7 @@
  */
 
 #include "LPC11xx.h"
+#include "clock.h"
 
 /**
  * Runs the watchdog feed sequence if the wdt ahb bus is active
@@ -43,7 +44,7 @@ void feed_watchdog(void) {
  */
 void init_watchdog(void) {
   /* Enable interface clock */
-  LPC_SYSCON->SYSAHBCLKCTRL |= (1 << 15);
+  clock_syscon(CLOCK_AHB, (1 << 15), 0);
 
   LPC_SYSCON->WDTCLKSEL = 0x0; // Use IRC oscillator
   LPC_SYSCON->WDTCLKUEN = 1; // Switch Clock
@@ -57,9 +58,7 @@ void init_watchdog(void) {
   /* Lock on the watchdog */
   LPC_WDT->MOD |= 0x3; // WDEN = 1, WDRESET = 1
 
-  /* And feed to enable */
+  /* And feed to enable. Nothing else touches the watchdog, so there's
+     no need to wait for it to start before carrying on. */
   feed_watchdog();
-
-  /* Make sure feed sequence completed */
-  for (int i = 0; i < 0x80000; i++);
 }
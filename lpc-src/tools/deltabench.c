@@ -0,0 +1,194 @@
+/*
+ * Benchmarks delta compressed frames on recorded flights
+ * Copyright (C) 2014  richard
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * Usage: deltabench [-k period] [-l loss] [-s seed] [-v] log...
+ *
+ * Sends the sentences in receiver logs, for example the simulator's
+ * RTTY output from a whole flight, as delta compressed frames
+ * (delta.h), and reports how many bytes and how much airtime each
+ * frame takes against the ways we send them now:
+ *
+ *   ITA2		the text, 5N1.5
+ *   FEC text		the text in an FEC packet, 8N1
+ *   Delta		delta frames, 8N1
+ *   FEC delta		delta frames in FEC packets, 8N1
+ *
+ * Each frame is then lost with the given probability, and the rest
+ * decoded. Every frame that's decoded has to be the same as the one
+ * sent. A delta frame is lost with its keyframe. With -v the track
+ * that's decoded is printed as CSV.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include "rtty.h"
+#include "fec.h"
+#include "delta.h"
+#include "protocol.h"
+#include "telemetry.h"
+
+#define DELTABENCH_FRAMES	100000
+#define DELTABENCH_BAUD		50
+
+struct log {
+  struct frame* frames;
+  size_t count;
+};
+
+static int found(const struct telemetry* t, size_t offset, void* context) {
+  struct log* log = context;
+  (void)offset;
+
+  if (log->count == DELTABENCH_FRAMES) return 1;
+  log->frames[log->count++] = t->frame;
+  return 0;
+}
+
+/**
+ * Codes to send a sentence in ITA2, with the shift at the start
+ */
+static unsigned ita2_codes(const char* s) {
+  uint8_t shift = RTTY_ITA2_UNSHIFTED, codes[2];
+  unsigned count = 0;
+
+  for (; *s; s++) count += rtty_ita2_encode(*s, &shift, codes);
+  return count;
+}
+
+static double uniform(void) {
+  return rand() / (RAND_MAX + 1.0);
+}
+
+int main(int argc, char** argv) {
+  struct log log = { calloc(DELTABENCH_FRAMES, sizeof(struct frame)), 0 };
+  struct delta_encoder e;
+  struct delta_decoder d;
+  double loss = 0;
+  int period = DELTA_KEY_PERIOD, verbose = 0, c, n;
+  unsigned long text = 0, ita2 = 0, fec_text = 0, delta = 0, fec_delta = 0, keys = 0;
+  size_t i, sent = 0, decoded = 0;
+
+  while ((c = getopt(argc, argv, "k:l:s:v")) != -1) {
+    switch (c) {
+      case 'k': period = atoi(optarg); break;
+      case 'l': loss = atof(optarg); break;
+      case 's': srand(atoi(optarg)); break;
+      case 'v': verbose = 1; break;
+      default:
+	fprintf(stderr, "Usage: deltabench [-k period] [-l loss] [-s seed] [-v] log...\n");
+	return 1;
+    }
+  }
+  if (optind == argc || period < 1 || period > 255) {
+    fprintf(stderr, "Usage: deltabench [-k period] [-l loss] [-s seed] [-v] log...\n");
+    return 1;
+  }
+
+  /* The sentences with good checksums, in order */
+  for (n = optind; n < argc; n++) {
+    FILE* f = fopen(argv[n], "rb");
+    char* buffer;
+    long length;
+
+    if (!f) {
+      perror(argv[n]);
+      return 1;
+    }
+    fseek(f, 0, SEEK_END); length = ftell(f); rewind(f);
+    buffer = malloc(length + 1);
+    if (!buffer || fread(buffer, 1, length, f) != (size_t)length) return 1;
+    fclose(f);
+
+    telemetry_scan(buffer, length, 0, length, found, &log);
+    free(buffer);
+  }
+  if (log.count == 0) {
+    fprintf(stderr, "No sentences\n");
+    return 1;
+  }
+
+  delta_encoder_init(&e, period, FRAME_RADIO);
+  delta_decoder_init(&d, FRAME_RADIO);
+  communications_frame_charset(FRAME_BAUDOT);
+
+  for (i = 0; i < log.count; i++) {
+    char sentence[256];
+    uint8_t data[DELTA_MAX];
+    struct frame out;
+    int length, text_length;
+
+    /* As the firmware sends them now */
+    text_length = communications_frame_text(sentence, sizeof(sentence), &log.frames[i],
+					    FRAME_RADIO) - 1;
+    text += text_length;
+    ita2 += ita2_codes(sentence);
+    fec_text += FEC_PACKET_SIZE(text_length - 1); // Without the \n
+
+    /* Compressed */
+    length = delta_encode(&e, &log.frames[i], data, sizeof(data));
+    keys += (data[0] == DELTA_KEY);
+    delta += length;
+    fec_delta += FEC_PACKET_SIZE(length);
+
+    if (uniform() < loss) continue;
+    sent++;
+    if (delta_decode(&d, data, length, &out) == 0) {
+      if (memcmp(&out, &log.frames[i], sizeof(out))) {
+	fprintf(stderr, "ERROR: Frame %zu decoded wrong\n", i);
+	return 1;
+      }
+      decoded++;
+      if (verbose) {
+	frame_encode_text(sentence, sizeof(sentence), &out, FRAME_RADIO);
+	printf("%s\n", sentence);
+      }
+    }
+  }
+
+  /* Airtime per frame in seconds */
+  double frames = log.count;
+  double t_ita2 = (ita2 * 7.5) / frames / DELTABENCH_BAUD;
+  double t_fec_text = (fec_text * 10.0) / frames / DELTABENCH_BAUD;
+  double t_delta = (delta * 10.0) / frames / DELTABENCH_BAUD;
+  double t_fec_delta = (fec_delta * 10.0) / frames / DELTABENCH_BAUD;
+
+  fprintf(stderr, "%zu frames, a keyframe every %d, %lu keyframes\n",
+	  log.count, period, keys);
+  fprintf(stderr, "             bytes/frame  airtime at %d baud\n", DELTABENCH_BAUD);
+  fprintf(stderr, "ITA2         %8.1f  %8.2fs\n", text / frames, t_ita2);
+  fprintf(stderr, "FEC text     %8.1f  %8.2fs\n", fec_text / frames, t_fec_text);
+  fprintf(stderr, "Delta        %8.1f  %8.2fs  %3.0f%% less than ITA2\n",
+	  delta / frames, t_delta, 100 * (1 - (t_delta / t_ita2)));
+  fprintf(stderr, "FEC delta    %8.1f  %8.2fs  %3.0f%% less than FEC text\n",
+	  fec_delta / frames, t_fec_delta, 100 * (1 - (t_fec_delta / t_fec_text)));
+  fprintf(stderr, "%.0f%% lost: %zu of %zu received frames decoded\n",
+	  loss * 100, decoded, sent);
+
+  free(log.frames);
+  return 0;
+}
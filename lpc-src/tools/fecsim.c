@@ -0,0 +1,331 @@
+/*
+ * FEC channel simulator and decoder
+ * Copyright (C) 2014  richard
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * Usage: fecsim [-n sentences] [-e bit error rate] [-b burst rate]
+ *               [-l burst length] [-s seed] [file]
+ *        fecsim -r capture
+ *
+ * Sends sentences through a noisy channel twice, once as the ITA2
+ * RTTY we fly with and once as FEC packets (fec.h) at 8N1, and counts
+ * how many of each come out with a good checksum. The sentences are
+ * the lines starting '$$' in the file, for example the simulator's
+ * RTTY output, or a few real frames if there's no file.
+ *
+ * The channel flips each bit on the air with the given probability.
+ * Bursts start at the burst rate per bit and last for the given mean
+ * length, flipping half the bits in them. An ITA2 sentence is lost to
+ * any error, as a flipped start or stop bit loses the framing. A packet
+ * byte with a flipped start or stop bit is taken as garbage.
+ *
+ * Packets are decoded as a ground station would: the sync word is
+ * found with up to FECSIM_SYNC_ERRORS bits wrong, the length is a vote
+ * of its three copies, and the message comes out of a hard decision
+ * Viterbi decoder.
+ *
+ * With -r it's the ground station's decoder instead, printing the
+ * sentences in a capture of the bytes received.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+#include "fec.h"
+
+uint16_t crc_checksum(char *string);
+
+#define FECSIM_MAX_SENTENCES	10000
+#define FECSIM_SYNC_ERRORS	4
+#define FECSIM_STATES		(1 << (FEC_K - 1))
+#define FECSIM_MAX_STEPS	((8 * FEC_MAX_MESSAGE) + FEC_K - 1)
+
+static const char* default_sentences[] = {
+  "$$BUSEDS1,40,10:00:38,51.820803,-0.008398,185,9,185.0,4.8,13.8,39.9,0,0,0,179,6.0,72#F203",
+  "$$BUSEDS1,826,10:13:10,51.800537,0.079012,3945,9,3944.2,5.0,-10.7,23.4,0,0,0,166,6.0,90#1315",
+  "$$BUSEDS1,1645,10:26:00,51.779787,0.168473,1506,9,1505.6,-6.6,5.3,21.4,0,0,0,154,6.0,62#0993",
+};
+
+/**
+ * The channel
+ */
+double error_rate = 1e-3, burst_rate = 1e-4, burst_length = 20;
+int in_burst = 0;
+
+static double uniform(void) {
+  return (double)rand() / ((double)RAND_MAX + 1);
+}
+/**
+ * Returns 1 if the next bit on the air is flipped
+ */
+static int channel_flip(void) {
+  if (in_burst) {
+    if (uniform() < 1 / burst_length) in_burst = 0;
+  } else if (uniform() < burst_rate) {
+    in_burst = 1;
+  }
+
+  return uniform() < (in_burst ? 0.5 : error_rate);
+}
+
+/**
+ * Returns 1 if the sentence's checksum is right
+ */
+static int checksum_good(const char* sentence, size_t length) {
+  char text[FEC_MAX_MESSAGE + 1];
+  const char* delimiter;
+  unsigned crc;
+
+  if (length > FEC_MAX_MESSAGE || strncmp(sentence, "$$", 2)) return 0;
+  memcpy(text, sentence, length); text[length] = '\0';
+
+  delimiter = strpbrk(text, "*#");
+  if (!delimiter || sscanf(delimiter + 1, "%4X", &crc) != 1) return 0;
+  text[delimiter - text] = '\0';
+
+  return crc_checksum(text) == crc;
+}
+
+/**
+ * Sends a sentence as the flight RTTY, ITA2 5N1.5 with a code per
+ * character, one per change of shift and the newline. Returns 1 if it
+ * gets through.
+ */
+static int send_rtty(const char* sentence, uint32_t* airtime) {
+  uint32_t codes = 1, halves, i;
+  int figures = -1, good = 1;
+
+  for (i = 0; sentence[i]; i++, codes++) {
+    int is_figure = !isalpha((unsigned char)sentence[i]);
+    if (is_figure != figures) { codes++; figures = is_figure; }
+  }
+
+  halves = codes * 15;
+  *airtime += halves;
+  for (i = 0; i < (halves + 1) / 2; i++) {
+    if (channel_flip()) good = 0;
+  }
+
+  return good;
+}
+
+/**
+ * Finds the decoded path through the trellis. Returns the number of
+ * bit errors it had to correct.
+ */
+static uint32_t viterbi(const uint8_t* coded, uint32_t steps, uint8_t* message) {
+  static uint8_t decisions[FECSIM_MAX_STEPS][FECSIM_STATES];
+  uint32_t metric[FECSIM_STATES], next[FECSIM_STATES];
+  uint32_t k, s, u;
+
+  for (s = 0; s < FECSIM_STATES; s++) metric[s] = s ? UINT32_MAX / 2 : 0;
+
+  for (k = 0; k < steps; k++) {
+    for (s = 0; s < FECSIM_STATES; s++) next[s] = UINT32_MAX;
+
+    for (s = 0; s < FECSIM_STATES; s++) {
+      for (u = 0; u < 2; u++) {
+	uint8_t window = (s << 1) | u;
+	uint8_t expected = fec_table[window];
+	uint8_t to = window & (FECSIM_STATES - 1);
+	uint32_t m = metric[s] +
+	  ((expected & 1) != coded[2 * k]) + ((expected >> 1) != coded[(2 * k) + 1]);
+
+	if (m < next[to]) {
+	  next[to] = m;
+	  decisions[k][to] = s >> (FEC_K - 2); // The bit that falls out
+	}
+      }
+    }
+    memcpy(metric, next, sizeof(metric));
+  }
+
+  /* Flushed, so the path ends in state 0 */
+  for (k = steps, s = 0; k-- > 0; ) {
+    if (k < steps - (FEC_K - 1)) {
+      if (s & 1) message[k / 8] |= 0x80 >> (k % 8);
+      else message[k / 8] &= ~(0x80 >> (k % 8));
+    }
+    s = (s >> 1) | (decisions[k][s] << (FEC_K - 2));
+  }
+
+  return metric[0];
+}
+
+/**
+ * Decodes the first packet in the bytes received, setting where it
+ * ends. Returns the message length or -1 if there isn't one.
+ */
+static int decode_packet(const uint8_t* rx, uint32_t rx_length, uint8_t* message,
+			 uint32_t* end) {
+  static const uint8_t sync[FEC_SYNC_SIZE] = FEC_SYNC;
+  static uint8_t coded[2 * FECSIM_MAX_STEPS];
+  uint32_t start, i, b, errors;
+  uint8_t length;
+
+  /* Sync */
+  for (start = 0; start + FEC_HEADER_SIZE <= rx_length; start++) {
+    for (i = 0, errors = 0; i < FEC_SYNC_SIZE; i++) {
+      errors += __builtin_popcount(rx[start + i] ^ sync[i]);
+    }
+    if (errors <= FECSIM_SYNC_ERRORS) break;
+  }
+  if (start + FEC_HEADER_SIZE > rx_length) return -1;
+
+  /* Length, a bitwise vote */
+  const uint8_t* l = rx + start + FEC_SYNC_SIZE;
+  length = (l[0] & l[1]) | (l[0] & l[2]) | (l[1] & l[2]);
+  if (start + FEC_PACKET_SIZE(length) > rx_length) return -1;
+
+  /* Deinterleave */
+  uint32_t columns = FEC_SENT_BITS(length) / FEC_ROWS;
+  const uint8_t* body = rx + start + FEC_HEADER_SIZE;
+  for (i = 0; i < FEC_SENT_BITS(length); i++) {
+    b = ((i % FEC_ROWS) * columns) + (i / FEC_ROWS);
+    if (b < FEC_CODED_BITS(length)) {
+      coded[b] = (body[i / 8] >> (7 - (i % 8))) & 1;
+    }
+  }
+
+  viterbi(coded, (8 * length) + FEC_K - 1, message);
+  *end = start + FEC_PACKET_SIZE(length);
+  return length;
+}
+
+/**
+ * Sends a sentence as a packet at 8N1. Returns 1 if it gets through.
+ */
+static int send_fec(const char* sentence, uint32_t* airtime) {
+  static uint8_t packet[FEC_PACKET_SIZE(FEC_MAX_MESSAGE)];
+  uint8_t message[FEC_MAX_MESSAGE + 1];
+  uint32_t length, i, b, end;
+  int decoded;
+
+  length = fec_encode((const uint8_t*)sentence, strlen(sentence),
+		      packet, sizeof(packet));
+  if (!length) return 0;
+
+  for (i = 0; i < length; i++) {
+    int framing = channel_flip();
+    for (b = 0; b < 8; b++) {
+      if (channel_flip()) packet[i] ^= 1 << b;
+    }
+    if (channel_flip()) framing = 1;
+    if (framing) packet[i] = rand();
+  }
+  *airtime += 20 * length;
+
+  decoded = decode_packet(packet, length, message, &end);
+  return (decoded > 0) && checksum_good((char*)message, decoded);
+}
+
+/**
+ * Decodes every packet in a capture of the bytes received, printing
+ * the sentences and whether their checksums are good
+ */
+static int decode_capture(const char* filename) {
+  static uint8_t rx[1 << 20];
+  uint8_t message[FEC_MAX_MESSAGE + 1];
+  uint32_t rx_length, at = 0, end;
+  int length;
+  FILE* f = fopen(filename, "rb");
+
+  if (!f) { perror(filename); return 1; }
+  rx_length = fread(rx, 1, sizeof(rx), f);
+  fclose(f);
+
+  while ((length = decode_packet(rx + at, rx_length - at, message, &end)) >= 0) {
+    message[length] = '\0';
+    printf("%s %s\n", checksum_good((char*)message, length) ? "good" : "BAD ",
+	   (char*)message);
+    at += end;
+  }
+
+  return 0;
+}
+
+int main(int argc, char** argv) {
+  static char* sentences[FECSIM_MAX_SENTENCES];
+  uint32_t count = 0, n = 1000, seed = 1, i;
+  uint32_t rtty_good = 0, fec_good = 0, rtty_air = 0, fec_air = 0;
+  char line[1024];
+  int c;
+
+  while ((c = getopt(argc, argv, "n:e:b:l:s:r:")) != -1) {
+    switch (c) {
+      case 'r': return decode_capture(optarg);
+      case 'n': n = atoi(optarg); break;
+      case 'e': error_rate = atof(optarg); break;
+      case 'b': burst_rate = atof(optarg); break;
+      case 'l': burst_length = atof(optarg); break;
+      case 's': seed = atoi(optarg); break;
+      default:
+	fprintf(stderr, "Usage: %s [-n sentences] [-e bit error rate] "
+		"[-b burst rate] [-l burst length] [-s seed] [file]\n"
+		"       %s -r capture\n", argv[0], argv[0]);
+	return 1;
+    }
+  }
+
+  if (optind < argc) {
+    FILE* f = fopen(argv[optind], "r");
+    if (!f) { perror(argv[optind]); return 1; }
+
+    while (count < FECSIM_MAX_SENTENCES && fgets(line, sizeof(line), f)) {
+      line[strcspn(line, "\r\n")] = '\0';
+      if (!strncmp(line, "$$", 2) && strlen(line) <= FEC_MAX_MESSAGE &&
+	  checksum_good(line, strlen(line))) {
+	sentences[count++] = strdup(line);
+      }
+    }
+    fclose(f);
+  } else {
+    for (; count < sizeof(default_sentences) / sizeof(default_sentences[0]); count++) {
+      sentences[count] = (char*)default_sentences[count];
+    }
+  }
+  if (!count) {
+    fprintf(stderr, "No sentences with good checksums\n");
+    return 1;
+  }
+
+  srand(seed);
+  for (i = 0; i < n; i++) {
+    rtty_good += send_rtty(sentences[i % count], &rtty_air);
+    fec_good += send_fec(sentences[i % count], &fec_air);
+  }
+
+  printf("%u sentences, bit error rate %g, %g bursts per bit of %g bits\n",
+	 n, error_rate, burst_rate, burst_length);
+  printf("ITA2 RTTY:   %5u good (%5.1f%%), %6.1f bits each, %5.1f good per hour at 50 baud\n",
+	 rtty_good, 100.0 * rtty_good / n, rtty_air / (2.0 * n),
+	 rtty_good * 3600.0 * 50 / (rtty_air / 2.0));
+  printf("FEC packets: %5u good (%5.1f%%), %6.1f bits each, %5.1f good per hour at 50 baud\n",
+	 fec_good, 100.0 * fec_good / n, fec_air / (2.0 * n),
+	 fec_good * 3600.0 * 50 / (fec_air / 2.0));
+
+  return 0;
+}
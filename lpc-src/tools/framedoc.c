@@ -0,0 +1,130 @@
+/*
+ * Writes the frame field tables in the protocol document
+ * Copyright (C) 2014  richard
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * Usage: framedoc Communication-Protocol.md > new.md
+ *
+ * Fills in the field tables in the protocol document from FRAME_FIELDS
+ * in frame.h. Each table goes between a line '<!-- FRAME_RADIO -->' or
+ * '<!-- FRAME_SD -->' and a line '<!-- end -->', replacing whatever was
+ * there.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "frame.h"
+
+struct field {
+  const char* name;
+  const char* type;
+  long scale;
+  int precision, where, phases;
+  const char* description;
+};
+
+#define FRAME_DOC(name, type, scale, precision, where, phases, description) \
+  { #name, #type, scale, precision, where, phases, description },
+static const struct field fields[] = {
+  FRAME_FIELDS(FRAME_DOC)
+};
+#undef FRAME_DOC
+
+#define FIELDS	(sizeof(fields) / sizeof(fields[0]))
+
+static const char* phase_names[PHASES] = {
+  "ground", "ascent", "float", "descent", "landed"
+};
+
+static void print_phases(int phases) {
+  const char* separator = "";
+  int p;
+
+  if (phases == FRAME_ALWAYS) {
+    printf("always");
+    return;
+  }
+  for (p = 0; p < PHASES; p++) {
+    if (phases & (1 << p)) {
+      printf("%s%s", separator, phase_names[p]);
+      separator = ", ";
+    }
+  }
+}
+
+static void print_table(int where) {
+  size_t i;
+  int n = 0;
+
+  printf("| | Field | Sent | Text | Binary |\n");
+  printf("|-|-------|------|------|--------|\n");
+  for (i = 0; i < FIELDS; i++) {
+    const struct field* f = &fields[i];
+
+    if (f->where != where) continue;
+    printf("| %d | **%s** | ", ++n, f->description);
+    print_phases(f->phases);
+    printf(" | ");
+
+    if (!strcmp(f->type, "frame_text")) {
+      printf("text | null terminated |\n");
+    } else if (!strcmp(f->type, "frame_time")) {
+      printf("hh:mm:ss | seconds since midnight, 3 bytes |\n");
+    } else {
+      if (f->precision) {
+	printf("%d decimal place%s | ", f->precision, f->precision > 1 ? "s" : "");
+      } else {
+	printf("integer | ");
+      }
+      printf("%.*s", (int)strlen(f->type) - 2, f->type); // No '_t'
+      if (f->scale != 1) printf(", units x %ld", f->scale);
+      printf(" |\n");
+    }
+  }
+}
+
+int main(int argc, char** argv) {
+  char line[1024];
+  int skipping = 0;
+  FILE* in;
+
+  if (argc != 2 || !(in = fopen(argv[1], "r"))) {
+    fprintf(stderr, "Usage: framedoc Communication-Protocol.md > new.md\n");
+    return 1;
+  }
+
+  while (fgets(line, sizeof(line), in)) {
+    if (!strcmp(line, "<!-- end -->\n")) skipping = 0;
+    if (skipping) continue;
+
+    fputs(line, stdout);
+    if (!strcmp(line, "<!-- FRAME_RADIO -->\n")) {
+      print_table(FRAME_RADIO); skipping = 1;
+    } else if (!strcmp(line, "<!-- FRAME_SD -->\n")) {
+      print_table(FRAME_SD); skipping = 1;
+    }
+  }
+
+  fclose(in);
+  return 0;
+}
@@ -0,0 +1,182 @@
+/*
+ * Decodes profile histograms from an image of the SD card
+ * Copyright (C) 2014  richard
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * Usage: profdump [-a] <card image>
+ *
+ * The card image is a raw copy of the SD card, for example from
+ * `dd if=/dev/sdX of=card.img`. Every 512 byte block that starts with
+ * the profile magic is decoded. Only the last one is printed unless
+ * -a is given - the histograms are cumulative since reset.
+ *
+ * Blocks with the boot magic are decoded too, and every one of them is
+ * printed as each is a different boot.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include "profile.h"
+
+#define BLOCK_SIZE	512
+
+const char* section_names[PROFILE_SECTIONS] = PROFILE_SECTION_NAMES;
+const char* boot_names[PROFILE_BOOT_STAGES] = PROFILE_BOOT_NAMES;
+
+static uint32_t get_u32(const uint8_t* b) {
+  return b[0] | (b[1] << 8) | (b[2] << 16) | ((uint32_t)b[3] << 24);
+}
+static uint16_t get_u16(const uint8_t* b) {
+  return b[0] | (b[1] << 8);
+}
+
+/**
+ * The lower edge of a histogram bin in cycles
+ */
+static uint32_t bin_lower(int bin) {
+  return bin ? (1UL << (PROFILE_BIN_SHIFT + bin)) : 0;
+}
+
+/**
+ * Returns the upper edge of the bin the given fraction of samples
+ * falls under, in cycles. Never more than the maximum seen.
+ */
+static uint32_t percentile(struct profile_histogram* h, double fraction) {
+  uint32_t total = 0, target;
+  int i;
+
+  for (i = 0; i < PROFILE_BINS; i++) { total += h->bins[i]; }
+  target = (uint32_t)(total * fraction);
+  if (total == 0) { return 0; }
+
+  for (i = 0, total = 0; i < PROFILE_BINS - 1; i++) {
+    total += h->bins[i];
+    if (total > target) {
+      return (bin_lower(i + 1) < h->max) ? bin_lower(i + 1) : h->max;
+    }
+  }
+
+  return h->max;
+}
+
+void print_dump(uint32_t block, const uint8_t* b) {
+  uint32_t ticks = get_u32(b + 4);
+  uint32_t reload = get_u32(b + 8);
+  uint32_t clock = get_u32(b + 12);
+  double us = 1e6 / clock;
+  struct profile_histogram h;
+  int s, i;
+
+  printf("Block %u: %u ticks (%.1fs), %u cycles/tick, %uHz core\n",
+	 block, ticks, (double)ticks * reload / clock, reload, clock);
+  printf("%-12s %8s %10s %10s %10s  bins (<%u cycles, then x2)\n",
+	 "section", "count", "p50 us", "p99 us", "max us",
+	 bin_lower(1));
+
+  b += PROFILE_HEADER_SIZE;
+  for (s = 0; s < PROFILE_SECTIONS; s++, b += PROFILE_RECORD_SIZE) {
+    h.count = get_u32(b);
+    h.max = get_u32(b + 4);
+    for (i = 0; i < PROFILE_BINS; i++) {
+      h.bins[i] = get_u16(b + 8 + (2 * i));
+    }
+
+    printf("%-12s %8u %10.1f %10.1f %10.1f ", section_names[s], h.count,
+	   percentile(&h, 0.5) * us, percentile(&h, 0.99) * us, h.max * us);
+    for (i = 0; i < PROFILE_BINS; i++) {
+      printf(" %u", h.bins[i]);
+    }
+    printf("\n");
+  }
+  printf("\n");
+}
+
+/**
+ * Prints when each stage of a boot finished, and how long it took
+ */
+void print_boot(uint32_t block, const uint8_t* b) {
+  uint32_t clock = get_u32(b + 4);
+  double ms = 1e3 / clock, last = 0, at;
+  int s;
+
+  printf("Block %u: boot\n", block);
+  printf("%-12s %10s %10s\n", "stage", "at ms", "took ms");
+
+  b += 8;
+  for (s = 0; s < PROFILE_BOOT_STAGES; s++, b += 4) {
+    at = get_u32(b) * ms;
+    if (at == 0) {
+      printf("%-12s %10s\n", boot_names[s], "-");
+      continue;
+    }
+    printf("%-12s %10.1f %10.1f\n", boot_names[s], at, at - last);
+    last = at;
+  }
+  printf("\n");
+}
+
+int main(int argc, char** argv) {
+  uint8_t block[BLOCK_SIZE], last[BLOCK_SIZE];
+  uint32_t index = 0, last_index = 0;
+  int all = 0, found = 0, dumps = 0;
+  FILE* f;
+
+  if (argc == 3 && strcmp(argv[1], "-a") == 0) {
+    all = 1; argv++; argc--;
+  }
+  if (argc != 2) {
+    fprintf(stderr, "Usage: %s [-a] <card image>\n", argv[0]);
+    return 1;
+  }
+  if (!(f = fopen(argv[1], "rb"))) {
+    perror(argv[1]);
+    return 1;
+  }
+
+  for (index = 0; fread(block, BLOCK_SIZE, 1, f) == 1; index++) {
+    if (memcmp(block, PROFILE_MAGIC, 4) == 0) {
+      if (all) {
+	print_dump(index, block);
+      } else {
+	memcpy(last, block, BLOCK_SIZE);
+	last_index = index;
+      }
+      found++; dumps++;
+    } else if (memcmp(block, PROFILE_BOOT_MAGIC, 4) == 0) {
+      print_boot(index, block);
+      found++;
+    }
+  }
+  fclose(f);
+
+  if (!found) {
+    fprintf(stderr, "No profile records found\n");
+    return 1;
+  }
+  if (!all && dumps) {
+    print_dump(last_index, last);
+  }
+
+  return 0;
+}
@@ -0,0 +1,109 @@
+#!/bin/sh
+# Where the RAM goes, from the linker's map and gcc's stack usage files
+# Copyright (C) 2014  richard
+#
+# Permission is hereby granted, free of charge, to any person obtaining
+# a copy of this software and associated documentation files (the
+# "Software"), to deal in the Software without restriction, including
+# without limitation the rights to use, copy, modify, merge, publish,
+# distribute, sublicense, and/or sell copies of the Software, and to
+# permit persons to whom the Software is furnished to do so, subject to
+# the following conditions:
+#
+# The above copyright notice and this permission notice shall be
+# included in all copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+# EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+# MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+# NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+# LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+# OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+# WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+# Usage: ramreport.sh map ram-size [.su files]
+#
+# Prints the .data and .bss (with .noinit) of each module, the libraries together,
+# and its largest stack frame from -fstack-usage. What's left of
+# ram-size (8K or 8192) is for the stack, which the firmware measures
+# itself and stores on the SD card (stack_peak()). The makefile runs
+# this after linking, or on its own with
+#   make ram
+
+if [ $# -lt 2 ]; then
+    echo "Usage: $0 map ram-size [.su files]" >&2
+    exit 1
+fi
+
+MAP=$1; RAM=$2; shift 2
+
+# Largest frame for each source file, as file<tab>bytes
+FRAMES=$(cat /dev/null "$@" | awk -F '\t' '
+{
+    split($1, where, ":")
+    module = where[1]; sub(/.*\//, "", module); sub(/\.c$/, "", module)
+    if ($2 + 0 > frame[module]) frame[module] = $2 + 0
+}
+END { for (m in frame) print m "\t" frame[m] }')
+
+echo "$FRAMES" | awk -v ram="$RAM" '
+function hex(s,    i, v) {
+    v = 0
+    for (i = 3; i <= length(s); i++) {
+        v = v * 16 + index("0123456789abcdef", tolower(substr(s, i, 1))) - 1
+    }
+    return v
+}
+function module(file) {
+    if (file ~ /^\(/) return file
+    if (file ~ /\.a\(/) return "(libraries)"
+    sub(/.*\//, "", file); sub(/\.o$/, "", file)
+    return file
+}
+function add(file, size) {
+    m = module(file)
+    if (!(m in seen)) { seen[m] = 1; order[n++] = m }
+    if (section == ".data") data[m] += size; else bss[m] += size
+}
+FILENAME == "-" {
+    if (NF == 2) frame[$1] = $2
+    next
+}
+/^Linker script and memory map/ { mapped = 1; next }
+!mapped { next }
+/^[.A-Za-z_]/ {
+    section = $1
+    pending = ""
+    next
+}
+section != ".data" && section != ".bss" && section != ".noinit" { next }
+# An input section, with its address, size and object on this line or,
+# when the name is long, on the next
+$1 == "*fill*" {
+    if (NF >= 3) add("(padding)", hex($3))
+    next
+}
+/^ [.A-Z]/ {
+    if (NF == 1) { pending = $1; next }
+    if (NF >= 4 && $3 ~ /^0x/) add($4, hex($3))
+    next
+}
+pending != "" && /^  +0x/ {
+    if (NF >= 3 && $2 ~ /^0x/) add($3, hex($2))
+    pending = ""
+    next
+}
+END {
+    size = ram + 0
+    if (ram ~ /[kK]$/) size *= 1024
+
+    printf "%-20s %6s %6s %8s\n", "Module", ".data", ".bss", "Frame"
+    for (i = 0; i < n; i++) {
+        m = order[i]
+        if (data[m] + bss[m] == 0) continue
+        printf "%-20s %6d %6d %8s\n", m, data[m], bss[m], (m in frame) ? frame[m] : "-"
+        total_data += data[m]; total_bss += bss[m]
+    }
+    printf "%-20s %6d %6d\n", "Total", total_data, total_bss
+    printf "Stack: %d bytes of %d left\n", size - total_data - total_bss, size
+}' - "$MAP"
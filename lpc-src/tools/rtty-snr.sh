@@ -0,0 +1,47 @@
+#!/bin/sh
+# Sentences decoded against SNR, closing the loop from rtty_tick() to
+# the ground station's demodulator
+# Copyright (C) 2014  richard
+#
+# Permission is hereby granted, free of charge, to any person obtaining
+# a copy of this software and associated documentation files (the
+# "Software"), to deal in the Software without restriction, including
+# without limitation the rights to use, copy, modify, merge, publish,
+# distribute, sublicense, and/or sell copies of the Software, and to
+# permit persons to whom the Software is furnished to do so, subject to
+# the following conditions:
+#
+# The above copyright notice and this permission notice shall be
+# included in all copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+# EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+# MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+# NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+# LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+# OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+# WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+# Usage: rtty-snr.sh sentences [rttygen options]
+#
+# For example, with the simulator's RTTY and some drift:
+#   sim/hab-sim -q -d 1200 -r rtty.txt
+#   tools/rtty-snr.sh rtty.txt -d 0.5 -c 200
+
+if [ $# -lt 1 ]; then
+    echo "Usage: $0 sentences [rttygen options]" >&2
+    exit 1
+fi
+
+TOOLS=$(dirname "$0")
+SENTENCES=$1; shift
+WAV=$(mktemp /tmp/rtty-snr.XXXXXX)
+TOTAL=$(grep -c '^\$\$' "$SENTENCES")
+
+echo "SNR in 3kHz (dB)  Decoded"
+for SNR in 20 10 6 3 0 -3 -6; do
+    "$TOOLS/rttygen" -n $SNR "$@" "$WAV" "$SENTENCES" || break
+    printf "%16s  %d/%d\n" $SNR $("$TOOLS/rttydemod" -g "$WAV" | wc -l) $TOTAL
+done
+
+rm -f "$WAV"
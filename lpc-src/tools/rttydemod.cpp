@@ -0,0 +1,359 @@
+/*
+ * RTTY demodulator for the ground station
+ * Copyright (C) 2014  richard
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * Usage: rttydemod [options] input.wav
+ *
+ * Decodes RTTY from audio, like dl-fldigi would on the ground. A bank
+ * of decoders spread across the audio band each listen for the mark
+ * and space tones at their own frequency, so the signal doesn't have
+ * to be tuned in and can drift. The decoders run on as many threads
+ * as there are cores.
+ *
+ * Each decoder mixes both tones down and averages over half a bit.
+ * The difference in their power over the sum is a soft bit between -1
+ * (space) and +1 (mark). A start bit is the line falling below zero,
+ * and each bit is then sliced at its middle. The characters are
+ * printed from the decoder that was most sure of its bits, or with -g
+ * the sentences with good checksums from all of them.
+ *
+ *   -b BAUD       Baud rate (default 50)
+ *   -w BITS       Data bits, 5 for ITA2 (default 5)
+ *   -s SHIFT      Shift between the tones in Hz (default 425)
+ *   -l LOW        Lowest centre frequency to listen at (default 500)
+ *   -h HIGH       Highest centre frequency to listen at (default 2500)
+ *   -j THREADS    Threads to run the decoders on (default all cores)
+ *   -r RATE       The input is raw signed 16 bit PCM at this rate
+ *   -g            Print only sentences with good checksums
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <algorithm>
+#include <complex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+extern "C" {
+#include "rtty.h"
+uint16_t crc_checksum(char *string);
+}
+
+/**
+ * Decoders every eighth of the shift, which keeps each tone within
+ * the bandwidth of one of them
+ */
+#define DECODER_SPACING		8
+
+struct options {
+  double baud = 50, shift = 425, low = 500, high = 2500;
+  int data_bits = 5;
+};
+
+/**
+ * A decoded character, and when it ended in samples
+ */
+struct character {
+  char c;
+  size_t at;
+};
+
+/**
+ * A mixer and moving average for one tone
+ */
+class tone {
+ public:
+  tone(double frequency, double rate, size_t length) :
+    step(std::polar(1.0, -2 * M_PI * frequency / rate)), oscillator(1),
+    history(length), sum(0), index(0) {}
+
+  /**
+   * Returns the tone's power over the last window
+   */
+  double power(double sample) {
+    std::complex<double> mixed = sample * oscillator;
+
+    oscillator *= step;
+    oscillator /= std::abs(oscillator);
+
+    sum += mixed - history[index];
+    history[index] = mixed;
+    index = (index + 1) % history.size();
+
+    return std::norm(sum);
+  }
+
+ private:
+  std::complex<double> step, oscillator;
+  std::vector<std::complex<double> > history;
+  std::complex<double> sum;
+  size_t index;
+};
+
+/**
+ * One decoder of the bank
+ */
+class decoder {
+ public:
+  decoder(const options& o, double centre, double rate) :
+    o(o), rate(rate), bit(rate / o.baud),
+    mark(centre + (o.shift / 2), rate, lrint(bit / 2)),
+    space(centre - (o.shift / 2), rate, lrint(bit / 2)) {}
+
+  void run(const std::vector<double>& audio) {
+    std::vector<double> soft(audio.size());
+
+    for (size_t n = 0; n < audio.size(); n++) {
+      double m = mark.power(audio[n]), s = space.power(audio[n]);
+      soft[n] = (m + s > 0) ? (m - s) / (m + s) : 0;
+    }
+
+    slice(soft);
+  }
+
+  std::vector<character> characters;
+  double confidence = 0;	/* Sum of the soft bits' sizes */
+  size_t bits = 0;
+
+ private:
+  /**
+   * Waits for each start bit, then samples the middle of each bit
+   */
+  void slice(const std::vector<double>& soft) {
+    size_t n = 0, frame = o.data_bits + 2;
+    uint8_t shift = RTTY_ITA2_LETTERS;
+
+    while (n < soft.size()) {
+      /* Idle until the line drops */
+      if (soft[n] >= 0) { n++; continue; }
+
+      /* The window's half a bit long, so the edge was a quarter bit ago */
+      double start = n - (bit / 4);
+      double sure = 0;
+      unsigned byte = 0;
+      size_t i;
+      int good = 1;
+
+      if (lrint(start + ((frame - 0.25) * bit)) >= (long)soft.size()) break;
+      for (i = 0; i < frame; i++) {
+	double v = soft[lrint(start + ((i + 0.75) * bit))];
+
+	if (i == 0) {
+	  if (v >= 0) { good = 0; break; }  // Just noise
+	} else if (i <= (size_t)o.data_bits) {
+	  if (v > 0) byte |= 1 << (i - 1);
+	} else if (v < 0) {
+	  good = 0; // Framing error
+	}
+	sure += fabs(v);
+      }
+
+      if (i == 0 || (i == 1 && !good)) { n++; continue; }
+      confidence += sure; bits += frame;
+
+      if (good) {
+	char c = byte;
+	if (o.data_bits == 5) c = rtty_ita2_decode(byte, &shift);
+	if (c) characters.push_back({ c, n });
+      }
+
+      /* Look for the next start bit from the middle of the stop bit */
+      n = lrint(start + ((frame - 0.5) * bit));
+    }
+  }
+
+  const options& o;
+  double rate, bit;
+  tone mark, space;
+};
+
+static uint32_t get_u32(const uint8_t* b) {
+  return b[0] | (b[1] << 8) | (b[2] << 16) | ((uint32_t)b[3] << 24);
+}
+
+/**
+ * Reads 16 bit PCM, from a WAV file unless the rate's given. Stereo's
+ * mixed down.
+ */
+static int read_audio(const char* filename, double* rate,
+		      std::vector<double>& audio) {
+  FILE* f = fopen(filename, "rb");
+  std::vector<uint8_t> data;
+  uint8_t buffer[4096];
+  size_t n, offset = 0, length, channels = 1;
+
+  if (!f) { perror(filename); return 1; }
+  while ((n = fread(buffer, 1, sizeof(buffer), f)) > 0) {
+    data.insert(data.end(), buffer, buffer + n);
+  }
+  fclose(f);
+  length = data.size();
+
+  if (*rate == 0) {
+    if (data.size() < 12 || memcmp(&data[0], "RIFF", 4) || memcmp(&data[8], "WAVE", 4)) {
+      fprintf(stderr, "%s: Not a WAV file, give the rate for raw PCM\n", filename);
+      return 1;
+    }
+    for (offset = 12; offset + 8 <= data.size(); offset += 8 + get_u32(&data[offset + 4])) {
+      uint32_t size = get_u32(&data[offset + 4]);
+
+      if (!memcmp(&data[offset], "fmt ", 4)) {
+	if (data[offset + 8] != 1 || data[offset + 22] != 16) {
+	  fprintf(stderr, "%s: Only 16 bit PCM\n", filename);
+	  return 1;
+	}
+	channels = data[offset + 10];
+	*rate = get_u32(&data[offset + 12]);
+      } else if (!memcmp(&data[offset], "data", 4)) {
+	offset += 8;
+	length = std::min<size_t>(size, data.size() - offset);
+	break;
+      }
+    }
+    if (*rate == 0) {
+      fprintf(stderr, "%s: No format\n", filename);
+      return 1;
+    }
+  }
+
+  for (n = 0; n + (2 * channels) <= length; n += 2 * channels) {
+    double sample = 0;
+    for (size_t c = 0; c < channels; c++) {
+      sample += (int16_t)(data[offset + n + (2 * c)] | (data[offset + n + (2 * c) + 1] << 8));
+    }
+    audio.push_back(sample / (32768.0 * channels));
+  }
+
+  return 0;
+}
+
+/**
+ * Returns 1 if a sentence's checksum is good
+ */
+static int checksum_good(std::string sentence) {
+  size_t delimiter = sentence.find_first_of("*#");
+  unsigned crc;
+
+  if (sentence.compare(0, 2, "$$") || delimiter == std::string::npos ||
+      sscanf(sentence.c_str() + delimiter + 1, "%4X", &crc) != 1) {
+    return 0;
+  }
+  sentence.resize(delimiter);
+  std::vector<char> text(sentence.begin(), sentence.end());
+  text.push_back('\0');
+
+  return crc_checksum(&text[0]) == crc;
+}
+
+int main(int argc, char** argv) {
+  options o;
+  double rate = 0;
+  unsigned threads = std::thread::hardware_concurrency();
+  int good_only = 0, c;
+  std::vector<double> audio;
+
+  while ((c = getopt(argc, argv, "b:w:s:l:h:j:r:g")) != -1) {
+    switch (c) {
+      case 'b': o.baud = atof(optarg); break;
+      case 'w': o.data_bits = atoi(optarg); break;
+      case 's': o.shift = atof(optarg); break;
+      case 'l': o.low = atof(optarg); break;
+      case 'h': o.high = atof(optarg); break;
+      case 'j': threads = atoi(optarg); break;
+      case 'r': rate = atof(optarg); break;
+      case 'g': good_only = 1; break;
+      default: optind = argc; break;
+    }
+  }
+  if (optind != argc - 1 || o.data_bits < 5 || o.data_bits > 8 || o.baud <= 0) {
+    fprintf(stderr, "Usage: %s [-b baud] [-w data bits] [-s shift] [-l low] "
+	    "[-h high] [-j threads] [-r rate] [-g] input\n", argv[0]);
+    return 1;
+  }
+  if (read_audio(argv[optind], &rate, audio)) return 1;
+  if (threads < 1) threads = 1;
+
+  /* The bank */
+  std::vector<decoder*> bank;
+  for (double f = o.low; f <= o.high; f += o.shift / DECODER_SPACING) {
+    bank.push_back(new decoder(o, f, rate));
+  }
+
+  std::vector<std::thread> workers;
+  for (unsigned t = 0; t < threads; t++) {
+    workers.push_back(std::thread([&bank, &audio, t, threads]() {
+	  for (size_t d = t; d < bank.size(); d += threads) bank[d]->run(audio);
+	}));
+  }
+  for (size_t t = 0; t < workers.size(); t++) workers[t].join();
+
+  if (!good_only) {
+    decoder* best = bank[0];
+    for (size_t d = 1; d < bank.size(); d++) {
+      if (bank[d]->bits && (!best->bits ||
+			    bank[d]->confidence / bank[d]->bits >
+			    best->confidence / best->bits)) {
+	best = bank[d];
+      }
+    }
+    for (size_t i = 0; i < best->characters.size(); i++) {
+      putchar(best->characters[i].c);
+    }
+  } else {
+    /* Good sentences from every decoder, each once, in order */
+    std::vector<std::pair<size_t, std::string> > found;
+    std::set<std::string> seen;
+
+    for (size_t d = 0; d < bank.size(); d++) {
+      std::string line;
+      for (size_t i = 0; i < bank[d]->characters.size(); i++) {
+	const character& ch = bank[d]->characters[i];
+
+	if (ch.c == '$' && line.compare(0, 1, "$")) line.clear();
+	if (ch.c == '\n' || ch.c == '\r') {
+	  if (checksum_good(line) && seen.insert(line).second) {
+	    found.push_back(std::make_pair(ch.at, line));
+	  }
+	  line.clear();
+	} else {
+	  line += ch.c;
+	}
+      }
+    }
+
+    std::sort(found.begin(), found.end());
+    for (size_t i = 0; i < found.size(); i++) {
+      printf("%s\n", found[i].second.c_str());
+    }
+  }
+
+  for (size_t d = 0; d < bank.size(); d++) delete bank[d];
+  return 0;
+}
@@ -0,0 +1,222 @@
+/*
+ * Synthetic RTTY audio for testing the ground station
+ * Copyright (C) 2014  richard
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * Usage: rttygen [options] output.wav [sentences]
+ *
+ * Renders the audio a receiver would hear from the radio. The keying
+ * comes from the firmware's own rtty.c, built in its test mode, so the
+ * framing, ITA2 shifts and bit timing are what rtty_tick() would send.
+ * Each line starting '$$' in the sentences file is sent, or a few real
+ * frames if there isn't one, with some idle between them.
+ *
+ *   -b BAUD       Baud rate (default 50)
+ *   -w BITS       Data bits, 5 for ITA2 (default 5)
+ *   -t HALVES     Stop bits in half bits (default 3)
+ *   -s SHIFT      Shift between the tones in Hz (default 425)
+ *   -f FREQUENCY  Audio frequency half way between the tones (default 1500)
+ *   -n SNR        Signal to noise ratio in dB in 3kHz, none if not given
+ *   -d DRIFT      Tone drift in Hz per second (default 0)
+ *   -c PPM        Error in the transmitter's bit clock (default 0)
+ *   -r RATE       Sample rate (default 8000)
+ *   -e SEED       Noise seed (default 1)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <random>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include "rtty.h"
+extern uint32_t rtty_test_match, rtty_test_clock, rtty_test_level;
+}
+
+#define RTTYGEN_IDLE		0.5	/* Seconds of mark between sentences */
+#define RTTYGEN_NOISE_BANDWIDTH	3000.0
+
+static const char* default_sentences[] = {
+  "$$BUSEDS1,40,10:00:38,51.820803,-0.008398,185,9,185.0,4.8,13.8,39.9,0,0,0,179,6.0,72#F203\n",
+  "$$BUSEDS1,826,10:13:10,51.800537,0.079012,3945,9,3944.2,5.0,-10.7,23.4,0,0,0,166,6.0,90#1315\n",
+  "$$BUSEDS1,1645,10:26:00,51.779787,0.168473,1506,9,1505.6,-6.6,5.3,21.4,0,0,0,154,6.0,62#0993\n",
+};
+
+/**
+ * Phase continuous FSK, as the radio's FM modulator makes
+ */
+class fsk_writer {
+ public:
+  fsk_writer(double rate, double frequency, double shift, double drift) :
+    rate(rate), frequency(frequency), shift(shift), drift(drift),
+    phase(0), time(0) {}
+
+  /**
+   * Holds the line at the given level for a number of samples
+   */
+  void key(int level, double samples) {
+    end += samples;
+    while (time < end) {
+      double f = frequency + (drift * time / rate) + (level ? shift : -shift) / 2;
+      phase = fmod(phase + (2 * M_PI * f / rate), 2 * M_PI);
+      audio.push_back(sin(phase));
+      time++;
+    }
+  }
+
+  std::vector<double> audio;
+
+ private:
+  double rate, frequency, shift, drift, phase;
+  double time, end = 0;
+};
+
+static void put_u32(FILE* f, uint32_t v) {
+  uint8_t b[4] = { (uint8_t)v, (uint8_t)(v >> 8), (uint8_t)(v >> 16), (uint8_t)(v >> 24) };
+  fwrite(b, 1, 4, f);
+}
+static void put_u16(FILE* f, uint16_t v) {
+  uint8_t b[2] = { (uint8_t)v, (uint8_t)(v >> 8) };
+  fwrite(b, 1, 2, f);
+}
+
+/**
+ * Writes 16 bit mono PCM
+ */
+static int write_wav(const char* filename, const std::vector<double>& audio,
+		     uint32_t rate) {
+  FILE* f = fopen(filename, "wb");
+  double peak = 0;
+
+  if (!f) { perror(filename); return 1; }
+  for (size_t i = 0; i < audio.size(); i++) {
+    if (fabs(audio[i]) > peak) peak = fabs(audio[i]);
+  }
+
+  fwrite("RIFF", 1, 4, f); put_u32(f, 36 + (2 * audio.size()));
+  fwrite("WAVEfmt ", 1, 8, f); put_u32(f, 16);
+  put_u16(f, 1); put_u16(f, 1); put_u32(f, rate); put_u32(f, 2 * rate);
+  put_u16(f, 2); put_u16(f, 16);
+  fwrite("data", 1, 4, f); put_u32(f, 2 * audio.size());
+
+  for (size_t i = 0; i < audio.size(); i++) {
+    put_u16(f, (int16_t)lrint(32000 * audio[i] / peak));
+  }
+
+  fclose(f);
+  return 0;
+}
+
+int main(int argc, char** argv) {
+  double baud = 50, shift = 425, frequency = 1500, drift = 0, ppm = 0;
+  double snr = INFINITY, rate = 8000;
+  int data_bits = 5, stop_halves = RTTY_STOP_1_5, seed = 1, c;
+  std::vector<std::string> sentences;
+
+  while ((c = getopt(argc, argv, "b:w:t:s:f:n:d:c:r:e:")) != -1) {
+    switch (c) {
+      case 'b': baud = atof(optarg); break;
+      case 'w': data_bits = atoi(optarg); break;
+      case 't': stop_halves = atoi(optarg); break;
+      case 's': shift = atof(optarg); break;
+      case 'f': frequency = atof(optarg); break;
+      case 'n': snr = atof(optarg); break;
+      case 'd': drift = atof(optarg); break;
+      case 'c': ppm = atof(optarg); break;
+      case 'r': rate = atof(optarg); break;
+      case 'e': seed = atoi(optarg); break;
+      default: optind = argc + 1; break;
+    }
+  }
+  if (optind >= argc || optind + 2 < argc) {
+    fprintf(stderr, "Usage: %s [-b baud] [-w data bits] [-t stop halves] "
+	    "[-s shift] [-f frequency]\n"
+	    "       [-n snr] [-d drift] [-c ppm] [-r rate] [-e seed] "
+	    "output.wav [sentences]\n", argv[0]);
+    return 1;
+  }
+
+  if (optind + 1 < argc) {
+    FILE* f = fopen(argv[optind + 1], "r");
+    char line[1024];
+
+    if (!f) { perror(argv[optind + 1]); return 1; }
+    while (fgets(line, sizeof(line), f)) {
+      line[strcspn(line, "\r\n")] = '\0';
+      if (!strncmp(line, "$$", 2)) sentences.push_back(std::string(line) + "\n");
+    }
+    fclose(f);
+  } else {
+    for (size_t i = 0; i < sizeof(default_sentences) / sizeof(default_sentences[0]); i++) {
+      sentences.push_back(default_sentences[i]);
+    }
+  }
+
+  /* The firmware counts in samples. Its clock error stretches them. */
+  rtty_test_clock = lrint(rate);
+  if (rtty_set_format(lrint(baud), data_bits, stop_halves)) {
+    fprintf(stderr, "The firmware can't send %g baud with %d data bits "
+	    "and %d half stop bits\n", baud, data_bits, stop_halves);
+    return 1;
+  }
+  double stretch = rate / (rtty_test_clock * (1 + (ppm / 1e6)));
+  fsk_writer fsk(rate, frequency, shift, drift);
+
+  fsk.key(1, RTTYGEN_IDLE * rate);
+  for (size_t i = 0; i < sentences.size(); i++) {
+    std::vector<char> s(sentences[i].begin(), sentences[i].end());
+
+    if (rtty_set_string(&s[0], s.size())) {
+      fprintf(stderr, "Sentence %zu is too long\n", i);
+      continue;
+    }
+    fsk.key(1, rtty_test_match * stretch); // Idle before the first bit
+    while (rtty_active()) {
+      uint32_t last = rtty_test_match;
+      rtty_tick();
+      fsk.key(rtty_test_level, (rtty_test_match - last) * stretch);
+    }
+    rtty_tick(); // Stops the bit clock
+
+    fsk.key(1, RTTYGEN_IDLE * rate);
+  }
+
+  /* Noise over the whole band, scaled to the SNR in 3kHz */
+  if (!isinf(snr)) {
+    std::mt19937 generator(seed);
+    double signal = 0.5; // Power of a unit sine
+    double in_band = signal / pow(10, snr / 10);
+    std::normal_distribution<double> noise(0, sqrt(in_band * (rate / 2) /
+						   RTTYGEN_NOISE_BANDWIDTH));
+    for (size_t i = 0; i < fsk.audio.size(); i++) {
+      fsk.audio[i] += noise(generator);
+    }
+  }
+
+  return write_wav(argv[optind], fsk.audio, lrint(rate));
+}
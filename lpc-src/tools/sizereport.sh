@@ -0,0 +1,103 @@
+#!/bin/sh
+# Where the flash goes, from the linker's map
+# Copyright (C) 2014  richard
+#
+# Permission is hereby granted, free of charge, to any person obtaining
+# a copy of this software and associated documentation files (the
+# "Software"), to deal in the Software without restriction, including
+# without limitation the rights to use, copy, modify, merge, publish,
+# distribute, sublicense, and/or sell copies of the Software, and to
+# permit persons to whom the Software is furnished to do so, subject to
+# the following conditions:
+#
+# The above copyright notice and this permission notice shall be
+# included in all copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+# EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+# MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+# NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+# LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+# OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+# WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+# Usage: sizereport.sh map rom-size
+#
+# Prints the code, constants and initial values of .data that each
+# object and each library puts in the flash, biggest first, and how
+# much of rom-size (64K or 65536) is left. Library members are listed
+# under their library. The makefile runs this with
+#   make size-report
+
+if [ $# -lt 2 ]; then
+    echo "Usage: $0 map rom-size" >&2
+    exit 1
+fi
+
+awk -v rom="$2" '
+function hex(s,    i, v) {
+    v = 0
+    for (i = 3; i <= length(s); i++) {
+        v = v * 16 + index("0123456789abcdef", tolower(substr(s, i, 1))) - 1
+    }
+    return v
+}
+function owner(file) {
+    if (file ~ /^\(/) return file
+    if (file ~ /\.a\(/) { sub(/\(.*/, "", file); sub(/.*\//, "", file); return file }
+    sub(/.*\//, "", file)
+    return file
+}
+function add(name, file, size) {
+    if (size == 0) return
+    o = owner(file)
+    if (name ~ /^\.rodata/) constant[o] += size
+    else if (output == ".data") data[o] += size
+    else code[o] += size
+    total[o] += size
+}
+/^Linker script and memory map/ { mapped = 1; next }
+!mapped { next }
+/^[.A-Za-z_]/ {
+    output = $1
+    pending = ""
+    next
+}
+output != ".text" && output != ".ARM.extab" && output != ".ARM.exidx" && output != ".data" { next }
+$1 == "*fill*" {
+    if (NF >= 3) add("", "(padding)", hex($3))
+    next
+}
+# An input section, with its address, size and object on this line or,
+# when the name is long, on the next
+/^ [.A-Za-z]/ {
+    if (NF == 1) { pending = $1; next }
+    if (NF >= 4 && $3 ~ /^0x/) add($1, $4, hex($3))
+    next
+}
+pending != "" && /^  +0x/ {
+    if (NF >= 3 && $2 ~ /^0x/) add(pending, $3, hex($2))
+    pending = ""
+    next
+}
+END {
+    size = rom + 0
+    if (rom ~ /[kK]$/) size *= 1024
+
+    printf "%-24s %6s %6s %6s %6s\n", "Object", "Code", "Const", "Data", "Total"
+    # Biggest first
+    for (o in total) order[n++] = o
+    for (i = 1; i < n; i++) {
+        for (j = i; j > 0 && total[order[j]] > total[order[j - 1]]; j--) {
+            t = order[j]; order[j] = order[j - 1]; order[j - 1] = t
+        }
+    }
+    for (i = 0; i < n; i++) {
+        o = order[i]
+        printf "%-24s %6d %6d %6d %6d\n", o, code[o], constant[o], data[o], total[o]
+        all_code += code[o]; all_constant += constant[o]; all_data += data[o]
+    }
+    all = all_code + all_constant + all_data
+    printf "%-24s %6d %6d %6d %6d\n", "Total", all_code, all_constant, all_data, all
+    printf "Flash: %d bytes of %d used, %d left\n", all, size, size - all
+}' "$1"
@@ -0,0 +1,811 @@
+/*
+ * Merges telemetry from several receivers into one track
+ * Copyright (C) 2014  richard
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * Usage: telemagg [-f csv|geojson|kml] [-o file] [-w ms] source...
+ *        telemagg -L rate [-d seconds] [-r receivers] [-w ms] [-o file]
+ *
+ * Merges the sentences from several receivers as they come in, and
+ * writes each one once, in order of GPS time, as a track. A source is
+ * a file, '-' for stdin, or 'tcp:PORT' to listen on localhost for any
+ * number of receivers to connect and send what they decode.
+ *
+ * Each source has its own thread, which parses what it reads with
+ * telemetry.c and passes the good sentences to the output thread
+ * through a ring with one producer and one consumer. Nothing takes a
+ * lock, so a burst on one source doesn't hold up the others or the
+ * output. The output thread drops duplicates and holds each sentence
+ * for the window, so a copy from a slower receiver can still go out
+ * ahead of later sentences.
+ *
+ * With -L it's a load test instead: the receivers send a synthetic
+ * flight down pipes at the given sentences per second, in bursts,
+ * each hearing most of them, and it checks what comes out and reports
+ * the latency.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include "protocol.h"
+#include "telemetry.h"
+
+extern int sentence_id;
+
+#define TELEMAGG_RING		4096	/* Sentences, a power of two */
+#define TELEMAGG_BUFFER		4096	/* Bytes of a line not finished yet */
+#define TELEMAGG_CONNECTIONS	16	/* On each TCP source */
+#define TELEMAGG_WINDOW		250	/* ms */
+#define TELEMAGG_IDLE		200	/* us between looks at empty rings */
+#define TELEMAGG_LATENCY_MAX	60000	/* ms, the last bucket */
+#define TELEMAGG_SOURCES_MAX	32
+
+static double now(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + (ts.tv_nsec * 1e-9);
+}
+
+static volatile sig_atomic_t stopping = 0;
+
+static void stop(int signal) {
+  (void)signal;
+  stopping = 1;
+}
+
+/**
+ **************************
+ Rings
+ *************************/
+
+struct item {
+  struct telemetry t;
+  double arrived;
+  int64_t when;			/* GPS time with the days added, the output sets it */
+};
+
+/**
+ * The producer only writes tail and the consumer only writes head, each
+ * on its own cache line. The release store of one and the acquire load
+ * of it on the other side order the item copies around them.
+ */
+struct ring {
+  struct item items[TELEMAGG_RING];
+  size_t head __attribute__((aligned(64)));
+  size_t tail __attribute__((aligned(64)));
+};
+
+static int ring_push(struct ring* r, const struct item* item) {
+  size_t tail = r->tail;
+
+  if (tail - __atomic_load_n(&r->head, __ATOMIC_ACQUIRE) == TELEMAGG_RING) {
+    return 0;			/* Full */
+  }
+  r->items[tail & (TELEMAGG_RING - 1)] = *item;
+  __atomic_store_n(&r->tail, tail + 1, __ATOMIC_RELEASE);
+  return 1;
+}
+
+static int ring_pop(struct ring* r, struct item* item) {
+  size_t head = r->head;
+
+  if (head == __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE)) return 0;
+  *item = r->items[head & (TELEMAGG_RING - 1)];
+  __atomic_store_n(&r->head, head + 1, __ATOMIC_RELEASE);
+  return 1;
+}
+
+static size_t ring_depth(struct ring* r) {
+  return __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) -
+    __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+}
+
+/**
+ **************************
+ Sources
+ *************************/
+
+struct source {
+  const char* name;
+  int fd;			/* A file, stdin or a pipe */
+  int port;			/* Or a TCP port if fd is -1 */
+  pthread_t thread;
+  struct ring* ring;
+  int done;
+  /* Only the source's thread writes these */
+  size_t bytes, good, stalls, deepest;
+};
+
+/**
+ * What's been read of a stream that isn't a whole line yet
+ */
+struct reader {
+  char data[TELEMAGG_BUFFER];
+  size_t length;
+};
+
+static int push_sentence(const struct telemetry* t, size_t offset, void* context) {
+  struct source* s = context;
+  struct item item;
+  size_t depth;
+  (void)offset;
+
+  item.t = *t;
+  item.arrived = now();
+  item.when = 0;
+
+  /* A full ring only holds up this source */
+  while (!ring_push(s->ring, &item)) {
+    if (stopping) return 1;
+    s->stalls++;
+    sched_yield();
+  }
+  s->good++;
+  depth = ring_depth(s->ring);
+  if (depth > s->deepest) s->deepest = depth;
+  return 0;
+}
+
+/**
+ * Reads what's waiting on fd into r, and passes on the sentences in
+ * the lines that are finished. Returns the bytes read, 0 at the end
+ * or -1 on an error.
+ */
+static ssize_t read_lines(struct source* s, struct reader* r, int fd) {
+  ssize_t n = read(fd, r->data + r->length, sizeof(r->data) - r->length);
+  size_t end;
+
+  if (n <= 0) return (n < 0 && errno == EINTR) ? 1 : n;
+  s->bytes += n;
+  r->length += n;
+
+  /* Up to the end of the last line */
+  for (end = r->length; end > 0; end--) {
+    if (r->data[end - 1] == '\n' || r->data[end - 1] == '\r') break;
+  }
+  if (end == 0) {
+    if (r->length == sizeof(r->data)) r->length = 0; /* Just noise */
+    return n;
+  }
+
+  telemetry_scan(r->data, end, 0, end, push_sentence, s);
+  memmove(r->data, r->data + end, r->length - end);
+  r->length -= end;
+  return n;
+}
+
+static void* read_stream(void* context) {
+  struct source* s = context;
+  struct reader* r = calloc(1, sizeof(struct reader));
+
+  if (r) {
+    while (!stopping && read_lines(s, r, s->fd) > 0);
+    /* Whatever's left might be a sentence without a newline */
+    if (r->length < sizeof(r->data)) {
+      r->data[r->length] = '\n';
+      telemetry_scan(r->data, r->length + 1, 0, r->length + 1, push_sentence, s);
+    }
+    free(r);
+  }
+  if (s->fd != STDIN_FILENO) close(s->fd);
+
+  __atomic_store_n(&s->done, 1, __ATOMIC_RELEASE);
+  return NULL;
+}
+
+/**
+ * Listens on localhost, and takes the lines from each connection
+ */
+static void* read_tcp(void* context) {
+  struct source* s = context;
+  struct pollfd fds[1 + TELEMAGG_CONNECTIONS];
+  struct reader* readers = calloc(TELEMAGG_CONNECTIONS, sizeof(struct reader));
+  struct sockaddr_in address;
+  int listener = socket(AF_INET, SOCK_STREAM, 0);
+  int on = 1, i;
+
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_port = htons(s->port);
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+  if (!readers || listener < 0 ||
+      setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) ||
+      bind(listener, (struct sockaddr*)&address, sizeof(address)) ||
+      listen(listener, TELEMAGG_CONNECTIONS)) {
+    perror(s->name);
+    stopping = 1;
+    free(readers);
+    __atomic_store_n(&s->done, 1, __ATOMIC_RELEASE);
+    return NULL;
+  }
+
+  fds[0].fd = listener; fds[0].events = POLLIN;
+  for (i = 1; i <= TELEMAGG_CONNECTIONS; i++) {
+    fds[i].fd = -1; fds[i].events = POLLIN;
+  }
+
+  while (!stopping) {
+    if (poll(fds, 1 + TELEMAGG_CONNECTIONS, 100) <= 0) continue;
+
+    for (i = 1; i <= TELEMAGG_CONNECTIONS; i++) {
+      if (fds[i].fd >= 0 && fds[i].revents &&
+	  read_lines(s, &readers[i - 1], fds[i].fd) <= 0) {
+	close(fds[i].fd);
+	fds[i].fd = -1;
+      }
+    }
+    if (fds[0].revents & POLLIN) {
+      int connection = accept(listener, NULL, NULL);
+
+      for (i = 1; i <= TELEMAGG_CONNECTIONS && connection >= 0; i++) {
+	if (fds[i].fd < 0) {
+	  fds[i].fd = connection;
+	  readers[i - 1].length = 0;
+	  connection = -1;
+	}
+      }
+      if (connection >= 0) close(connection); /* No room */
+    }
+  }
+
+  for (i = 0; i <= TELEMAGG_CONNECTIONS; i++) {
+    if (fds[i].fd >= 0) close(fds[i].fd);
+  }
+  free(readers);
+  __atomic_store_n(&s->done, 1, __ATOMIC_RELEASE);
+  return NULL;
+}
+
+static int open_source(struct source* s, const char* name) {
+  memset(s, 0, sizeof(struct source));
+  s->name = name;
+  s->ring = calloc(1, sizeof(struct ring));
+  if (!s->ring) return -1;
+
+  if (!strncmp(name, "tcp:", 4)) {
+    s->fd = -1;
+    s->port = atoi(name + 4);
+    return (s->port > 0 && s->port < 65536) ? 0 : -1;
+  }
+  if (!strcmp(name, "-")) {
+    s->fd = STDIN_FILENO;
+    return 0;
+  }
+  s->fd = open(name, O_RDONLY);
+  return (s->fd < 0) ? -1 : 0;
+}
+
+/**
+ **************************
+ Output
+ *************************/
+
+static void csv_point(FILE* out, const struct telemetry* t, int first) {
+  char fields[256];
+  (void)first;
+
+  /* Every field, so the columns line up whatever the phase */
+  frame_encode_text(fields, sizeof(fields), &t->frame, FRAME_RADIO | FRAME_EVERY_PHASE);
+  fprintf(out, "%s,%04X\n", fields, t->crc);
+}
+
+static void geojson_start(FILE* out) {
+  fprintf(out, "{\"type\":\"FeatureCollection\",\"features\":[\n");
+}
+static void geojson_point(FILE* out, const struct telemetry* t, int first) {
+  const struct frame* f = &t->frame;
+
+  fprintf(out, "%s{\"type\":\"Feature\",\"geometry\":{\"type\":\"Point\","
+	  "\"coordinates\":[%.6f,%.6f,%d]},\"properties\":{\"callsign\":\"%s\","
+	  "\"id\":%u,\"time\":\"%02u:%02u:%02u\",\"phase\":%u}}\n",
+	  first ? "" : ",",
+	  (double)f->longitude / FRAME_SCALE_longitude,
+	  (double)f->latitude / FRAME_SCALE_latitude, f->gps_altitude,
+	  f->callsign, f->sentence_id,
+	  f->time / 3600, (f->time / 60) % 60, f->time % 60, f->phase);
+}
+static void geojson_end(FILE* out) {
+  fprintf(out, "]}\n");
+}
+
+static void kml_start(FILE* out) {
+  fprintf(out, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+	  "<kml xmlns=\"http://www.opengis.net/kml/2.2\"><Document>\n");
+}
+static void kml_point(FILE* out, const struct telemetry* t, int first) {
+  const struct frame* f = &t->frame;
+  (void)first;
+
+  fprintf(out, "<Placemark><name>%s %u</name>"
+	  "<description>%02u:%02u:%02u phase %u</description>"
+	  "<Point><altitudeMode>absolute</altitudeMode>"
+	  "<coordinates>%.6f,%.6f,%d</coordinates></Point></Placemark>\n",
+	  f->callsign, f->sentence_id,
+	  f->time / 3600, (f->time / 60) % 60, f->time % 60, f->phase,
+	  (double)f->longitude / FRAME_SCALE_longitude,
+	  (double)f->latitude / FRAME_SCALE_latitude, f->gps_altitude);
+}
+static void kml_end(FILE* out) {
+  fprintf(out, "</Document></kml>\n");
+}
+
+struct format {
+  const char* name;
+  void (*start)(FILE* out);
+  void (*point)(FILE* out, const struct telemetry* t, int first);
+  void (*end)(FILE* out);
+};
+
+static const struct format formats[] = {
+  { "csv", NULL, csv_point, NULL },
+  { "geojson", geojson_start, geojson_point, geojson_end },
+  { "kml", kml_start, kml_point, kml_end },
+};
+
+/**
+ * Sentences waiting out the window, a heap with the earliest first
+ */
+struct heap {
+  struct item* items;
+  size_t count, size;
+};
+
+static int earlier(const struct item* a, const struct item* b) {
+  if (a->when != b->when) return a->when < b->when;
+  return a->t.frame.sentence_id < b->t.frame.sentence_id;
+}
+
+static int heap_push(struct heap* h, const struct item* item) {
+  size_t i;
+
+  if (h->count == h->size) {
+    size_t size = h->size ? 2 * h->size : 1024;
+    struct item* items = realloc(h->items, size * sizeof(struct item));
+
+    if (!items) return -1;
+    h->items = items; h->size = size;
+  }
+
+  for (i = h->count++; i > 0; i = (i - 1) / 2) {
+    if (!earlier(item, &h->items[(i - 1) / 2])) break;
+    h->items[i] = h->items[(i - 1) / 2];
+  }
+  h->items[i] = *item;
+  return 0;
+}
+
+static void heap_pop(struct heap* h) {
+  struct item last = h->items[--h->count];
+  size_t i = 0, child;
+
+  while ((child = (2 * i) + 1) < h->count) {
+    if (child + 1 < h->count && earlier(&h->items[child + 1], &h->items[child])) {
+      child++;
+    }
+    if (!earlier(&h->items[child], &last)) break;
+    h->items[i] = h->items[child];
+    i = child;
+  }
+  h->items[i] = last;
+}
+
+struct output {
+  const struct format* format;
+  FILE* out;
+  double window;		/* s */
+  struct telemetry_dedup dedup;
+  struct heap held;
+  int64_t newest, last;		/* GPS time seen and written, s */
+  size_t received, duplicates, written, late;
+  uint32_t latency[TELEMAGG_LATENCY_MAX + 1]; /* ms */
+};
+
+/**
+ * Takes a sentence off a ring. The GPS time is the time of day, so the
+ * day is whichever puts it nearest the newest we've seen.
+ */
+static int take(struct output* o, struct item* item) {
+  int64_t when;
+
+  o->received++;
+  if (telemetry_dedup_add(&o->dedup, &item->t) != 1) {
+    o->duplicates++;
+    return 0;
+  }
+
+  when = ((o->newest / 86400) * 86400) + item->t.frame.time;
+  if (o->received > 1) {
+    if (when - o->newest > 43200) when -= 86400;
+    if (o->newest - when > 43200) when += 86400;
+  }
+  if (when > o->newest || o->received == 1) o->newest = when;
+  item->when = when;
+
+  return heap_push(&o->held, item);
+}
+
+/**
+ * Writes the sentences that have waited long enough, or all of them.
+ * Returns the number written.
+ */
+static size_t release(struct output* o, double t, int all) {
+  size_t count = 0;
+
+  while (o->held.count &&
+	 (all || t - o->held.items[0].arrived >= o->window)) {
+    const struct item* item = &o->held.items[0];
+    double ms = (now() - item->arrived) * 1e3;
+
+    if (o->written && item->when < o->last) o->late++;
+    o->last = item->when;
+
+    o->format->point(o->out, &item->t, o->written == 0);
+    o->written++;
+    o->latency[(ms < TELEMAGG_LATENCY_MAX) ? (int)ms : TELEMAGG_LATENCY_MAX]++;
+    heap_pop(&o->held);
+    count++;
+  }
+  if (count) fflush(o->out);
+  return count;
+}
+
+static double percentile(const struct output* o, double p) {
+  size_t target = (size_t)(p * (o->written - 1)), seen = 0;
+  int i;
+
+  for (i = 0; i <= TELEMAGG_LATENCY_MAX; i++) {
+    seen += o->latency[i];
+    if (seen > target) return i;
+  }
+  return TELEMAGG_LATENCY_MAX;
+}
+
+/**
+ * The output thread, until every source has finished or we're stopped
+ */
+static int merge(struct source* sources, int count, struct output* o) {
+  struct item item;
+  int n;
+
+  if (o->format->start) o->format->start(o->out);
+
+  while (1) {
+    int finished = 1;
+    size_t moved = 0;
+
+    for (n = 0; n < count; n++) {
+      /* Done is set after the last push, so look first */
+      int done = __atomic_load_n(&sources[n].done, __ATOMIC_ACQUIRE);
+
+      while (ring_pop(sources[n].ring, &item)) {
+	if (take(o, &item)) {
+	  fprintf(stderr, "Out of memory\n");
+	  return 1;
+	}
+	moved++;
+      }
+      if (!done) finished = 0;
+    }
+    release(o, now(), 0);
+
+    if (finished || stopping) break;
+    if (!moved) usleep(TELEMAGG_IDLE);
+  }
+
+  release(o, 0, 1);
+  if (o->format->end) o->format->end(o->out);
+  fflush(o->out);
+  return 0;
+}
+
+static void report(struct source* sources, int count, struct output* o,
+		   double elapsed) {
+  int n;
+
+  for (n = 0; n < count; n++) {
+    fprintf(stderr, "%-12s %9zu bytes %7zu sentences %6zu stalls, ring up to %zu\n",
+	    sources[n].name, sources[n].bytes, sources[n].good, sources[n].stalls,
+	    sources[n].deepest);
+  }
+  fprintf(stderr, "%zu received, %zu duplicates, %zu written, %zu out of order, "
+	  "%.1fs\n", o->received, o->duplicates, o->written, o->late, elapsed);
+  if (o->written) {
+    fprintf(stderr, "Latency %.0fms median, %.0fms 99%%, %.0fms max, %.0fms window\n",
+	    percentile(o, 0.5), percentile(o, 0.99), percentile(o, 1.0),
+	    o->window * 1e3);
+  }
+}
+
+static int start_sources(struct source* sources, int count) {
+  sigset_t blocked, old;
+  int n;
+
+  /* Only the output thread takes the signals */
+  sigemptyset(&blocked);
+  sigaddset(&blocked, SIGINT);
+  sigaddset(&blocked, SIGTERM);
+  pthread_sigmask(SIG_BLOCK, &blocked, &old);
+
+  for (n = 0; n < count; n++) {
+    if (pthread_create(&sources[n].thread, NULL,
+		       (sources[n].fd < 0) ? read_tcp : read_stream, &sources[n])) {
+      perror("pthread_create");
+      return 1;
+    }
+  }
+
+  pthread_sigmask(SIG_SETMASK, &old, NULL);
+  return 0;
+}
+
+/**
+ * Joins the sources that have finished. The rest are waiting on input
+ * that isn't coming, and go when we exit.
+ */
+static void stop_sources(struct source* sources, int count) {
+  int n;
+
+  for (n = 0; n < count; n++) {
+    if (__atomic_load_n(&sources[n].done, __ATOMIC_ACQUIRE)) {
+      pthread_join(sources[n].thread, NULL);
+    }
+  }
+}
+
+/**
+ **************************
+ Load Test
+ *************************/
+
+#define TELEMAGG_HEARD		90	/* % of sentences each receiver hears */
+#define TELEMAGG_BURST		0.05	/* s between each receiver's writes */
+
+struct receiver {
+  pthread_t thread;
+  int number, fd;
+  char** sentences;
+  size_t count;
+  double rate, start;
+  size_t heard;
+};
+
+/**
+ * Whether a receiver hears a sentence, the same every run
+ */
+static int hears(int receiver, size_t n) {
+  uint64_t h = ((uint64_t)receiver << 32) ^ n;
+
+  h *= 0x9E3779B97F4A7C15ULL;
+  h ^= h >> 29;
+  return (h % 100) < TELEMAGG_HEARD;
+}
+
+/**
+ * Writes the sentences it hears as they come due, a burst at a time,
+ * and a bit of noise between them
+ */
+static void* receive(void* context) {
+  struct receiver* r = context;
+  static const char noise[] = "RYRYRY $E5T\r\n";
+  char* burst = malloc(256 * (size_t)(r->rate * TELEMAGG_BURST + 2));
+  size_t n = 0;
+
+  while (burst && n < r->count) {
+    size_t due = (size_t)((now() - r->start) * r->rate), length = 0;
+
+    if (due > r->count) due = r->count;
+    for (; n < due; n++) {
+      if (!hears(r->number, n)) continue;
+      if (n % 7 == (size_t)r->number) {
+	memcpy(burst + length, noise, sizeof(noise) - 1);
+	length += sizeof(noise) - 1;
+      }
+      length += sprintf(burst + length, "%s", r->sentences[n]);
+      r->heard++;
+    }
+    if (length && write(r->fd, burst, length) != (ssize_t)length) break;
+    usleep(TELEMAGG_BURST * 1e6);
+  }
+
+  free(burst);
+  close(r->fd);
+  return NULL;
+}
+
+/**
+ * Builds a flight that climbs and drifts east, a sentence a second
+ * from half an hour before midnight so the time wraps
+ */
+static char** build_flight(size_t count) {
+  char** sentences = malloc(count * sizeof(char*));
+  struct barometer b = { 5.0, 50000, 1 };
+  struct imu_raw ir;
+  size_t n;
+
+  if (!sentences) return NULL;
+  memset(&ir, 0, sizeof(ir));
+  sentence_id = 0;
+  communications_frame_charset(FRAME_BAUDOT);
+
+  for (n = 0; n < count; n++) {
+    int seconds = (86400 - 1800 + n) % 86400;
+    struct gps_time gt = { seconds / 3600, (seconds / 60) % 60, seconds % 60 };
+    struct gps_data gd = { 51.45, -2.6 + (n * 0.00005), 100 + (n * 5) % 30000, 9 };
+    struct frame f;
+    char s[256];
+
+    memset(&f, 0, sizeof(f));
+    fill_communications_frame(&f, &gt, &b, &gd, gd.altitude, 5.0, -20.0, &ir,
+			      120, 6.0, 40);
+    f.phase = PHASE_ASCENT;
+    communications_frame_text(s, sizeof(s), &f, FRAME_RADIO);
+    if (!(sentences[n] = strdup(s))) return NULL;
+  }
+  return sentences;
+}
+
+static int load_test(double rate, double seconds, int receivers,
+		     struct output* o) {
+  struct source sources[TELEMAGG_SOURCES_MAX];
+  struct receiver rx[TELEMAGG_SOURCES_MAX];
+  size_t count = (size_t)(rate * seconds), heard = 0, n;
+  char** sentences = build_flight(count);
+  double start;
+  int r, failed = 0;
+
+  if (!sentences || count == 0) return 1;
+  for (n = 0; n < count; n++) {
+    for (r = 0; r < receivers; r++) {
+      if (hears(r, n)) { heard++; break; }
+    }
+  }
+  fprintf(stderr, "%zu sentences at %.0f/s to %d receivers, %zu heard by one at least\n",
+	  count, rate, receivers, heard);
+
+  start = now();
+  for (r = 0; r < receivers; r++) {
+    int fds[2];
+    char name[32];
+
+    if (pipe(fds)) {
+      perror("pipe");
+      return 1;
+    }
+    snprintf(name, sizeof(name), "receiver %d", r);
+    memset(&sources[r], 0, sizeof(struct source));
+    sources[r].name = strdup(name);
+    sources[r].fd = fds[0];
+    sources[r].ring = calloc(1, sizeof(struct ring));
+    if (!sources[r].ring) return 1;
+
+    rx[r].number = r; rx[r].fd = fds[1];
+    rx[r].sentences = sentences; rx[r].count = count;
+    rx[r].rate = rate; rx[r].start = start; rx[r].heard = 0;
+  }
+  if (start_sources(sources, receivers)) return 1;
+  for (r = 0; r < receivers; r++) {
+    if (pthread_create(&rx[r].thread, NULL, receive, &rx[r])) {
+      perror("pthread_create");
+      return 1;
+    }
+  }
+
+  failed = merge(sources, receivers, o);
+  for (r = 0; r < receivers; r++) pthread_join(rx[r].thread, NULL);
+  stop_sources(sources, receivers);
+  report(sources, receivers, o, now() - start);
+
+  if (o->written != heard) {
+    fprintf(stderr, "ERROR: %zu written, expected %zu\n", o->written, heard);
+    failed = 1;
+  }
+  if (o->late) {
+    fprintf(stderr, "ERROR: %zu written out of order\n", o->late);
+    failed = 1;
+  }
+
+  for (n = 0; n < count; n++) free(sentences[n]);
+  free(sentences);
+  return failed;
+}
+
+int main(int argc, char** argv) {
+  struct source sources[TELEMAGG_SOURCES_MAX];
+  static struct output o;
+  const char* output = NULL;
+  double rate = 0, seconds = 5, start;
+  int receivers = 3, count = 0, n, c, failed;
+
+  o.format = &formats[0];
+  o.window = TELEMAGG_WINDOW / 1e3;
+
+  while ((c = getopt(argc, argv, "f:o:w:L:d:r:")) != -1) {
+    switch (c) {
+      case 'f':
+	for (n = 0; n < (int)(sizeof(formats) / sizeof(formats[0])); n++) {
+	  if (!strcmp(optarg, formats[n].name)) o.format = &formats[n];
+	}
+	break;
+      case 'o': output = optarg; break;
+      case 'w': o.window = atof(optarg) / 1e3; break;
+      case 'L': rate = atof(optarg); break;
+      case 'd': seconds = atof(optarg); break;
+      case 'r': receivers = atoi(optarg); break;
+      default:
+	fprintf(stderr, "Usage: telemagg [-f csv|geojson|kml] [-o file] [-w ms] source...\n"
+		"       telemagg -L rate [-d seconds] [-r receivers] [-w ms] [-o file]\n");
+	return 1;
+    }
+  }
+
+  o.out = fopen(output ? output : (rate ? "/dev/null" : "/dev/stdout"), "w");
+  if (!o.out || telemetry_dedup_init(&o.dedup, 0)) {
+    perror(output);
+    return 1;
+  }
+  signal(SIGINT, stop);
+  signal(SIGTERM, stop);
+  signal(SIGPIPE, SIG_IGN);
+
+  if (rate) {
+    if (receivers < 1 || receivers > TELEMAGG_SOURCES_MAX) receivers = 3;
+    failed = load_test(rate, seconds, receivers, &o);
+  } else {
+    if (optind == argc || argc - optind > TELEMAGG_SOURCES_MAX) {
+      fprintf(stderr, "Between 1 and %d sources\n", TELEMAGG_SOURCES_MAX);
+      return 1;
+    }
+    for (n = optind; n < argc; n++) {
+      if (open_source(&sources[count++], argv[n])) {
+	perror(argv[n]);
+	return 1;
+      }
+    }
+
+    start = now();
+    if (start_sources(sources, count)) return 1;
+    failed = merge(sources, count, &o);
+    stop_sources(sources, count);
+    report(sources, count, &o, now() - start);
+  }
+
+  fclose(o.out);
+  telemetry_dedup_free(&o.dedup);
+  free(o.held.items);
+  return failed;
+}
@@ -0,0 +1,316 @@
+/*
+ * Ground station telemetry parser and deduplicator
+ * Copyright (C) 2014  richard
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "telemetry.h"
+
+/**
+ * Longest sentence we'll look for the end of
+ */
+#define TELEMETRY_SENTENCE_MAX	512
+
+int telemetry_simd = 1;
+
+/**
+ * CRC16 XMODEM as crc_checksum() in protocol.c, two bytes at a time.
+ * crc_table is one byte through the CRC, crc_table_2 is two.
+ */
+static uint16_t crc_table[256], crc_table_2[256];
+static pthread_once_t crc_once = PTHREAD_ONCE_INIT;
+
+static void crc_table_init(void) {
+  int i, b;
+
+  for (i = 0; i < 256; i++) {
+    uint16_t crc = i << 8;
+    for (b = 0; b < 8; b++) {
+      crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+    crc_table[i] = crc;
+  }
+  for (i = 0; i < 256; i++) {
+    crc_table_2[i] = (crc_table[i] << 8) ^ crc_table[crc_table[i] >> 8];
+  }
+}
+
+uint16_t telemetry_crc(const char* data, size_t length) {
+  uint16_t crc = 0xFFFF;
+  size_t i;
+
+  pthread_once(&crc_once, crc_table_init);
+  for (i = 0; i + 2 <= length; i += 2) {
+    uint16_t x = crc ^ (((uint8_t)data[i] << 8) | (uint8_t)data[i + 1]);
+    crc = crc_table_2[x >> 8] ^ crc_table[x & 0xFF];
+  }
+  for (; i < length; i++) {
+    crc = (crc << 8) ^ crc_table[(crc >> 8) ^ (uint8_t)data[i]];
+  }
+
+  return crc;
+}
+
+/**
+ * Returns the first of the three characters at or after p, or end
+ */
+static const char* find_any(const char* p, const char* end, char a, char b, char c) {
+#ifdef __SSE2__
+  if (telemetry_simd) {
+    __m128i va = _mm_set1_epi8(a), vb = _mm_set1_epi8(b), vc = _mm_set1_epi8(c);
+
+    for (; p + 16 <= end; p += 16) {
+      __m128i v = _mm_loadu_si128((const __m128i*)p);
+      int mask = _mm_movemask_epi8(_mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, va),
+							      _mm_cmpeq_epi8(v, vb)),
+						 _mm_cmpeq_epi8(v, vc)));
+      if (mask) return p + __builtin_ctz(mask);
+    }
+  }
+#endif
+  for (; p < end; p++) {
+    if (*p == a || *p == b || *p == c) return p;
+  }
+  return end;
+}
+
+/**
+ * Parses a sentence from its first '$' to the end of its checksum,
+ * which needs to be good.
+ *
+ * Returns 0 on success, or -1 if the sentence is broken.
+ */
+int telemetry_parse(const char* sentence, size_t length, struct telemetry* t) {
+  const char* end = sentence + length;
+  const char* delimiter;
+  unsigned crc = 0;
+  int i;
+
+  if (length < 8 || sentence[0] != '$' || sentence[1] != '$') return -1;
+
+  /* The checksum's after a '*', or a '#' in ITA2 */
+  delimiter = find_any(sentence + 2, end, '*', '#', '*');
+  if (end - delimiter < 5) return -1;
+  for (i = 1; i <= 4; i++) {
+    char c = delimiter[i];
+    crc <<= 4;
+    if (c >= '0' && c <= '9') crc |= c - '0';
+    else if (c >= 'A' && c <= 'F') crc |= c - 'A' + 10;
+    else if (c >= 'a' && c <= 'f') crc |= c - 'a' + 10;
+    else return -1;
+  }
+  if (telemetry_crc(sentence + 2, delimiter - (sentence + 2)) != crc) return -1;
+  t->crc = crc;
+
+  memset(&t->frame, 0, sizeof(t->frame)); // The SD fields aren't sent
+  return frame_decode_text(sentence + 2, delimiter, &t->frame, FRAME_RADIO);
+}
+
+/**
+ * Scans for sentences that start between from and to, which can run
+ * on to the end of the buffer. A '$$' always starts a new sentence, so
+ * one cut short by noise doesn't take the next one with it.
+ *
+ * Returns the number of good sentences.
+ */
+size_t telemetry_scan(const char* buffer, size_t length, size_t from, size_t to,
+		      telemetry_callback callback, void* context) {
+  const char* end = buffer + length;
+  const char* p = buffer + from;
+  struct telemetry t;
+  size_t good = 0;
+
+  while ((p = find_any(p, buffer + to, '$', '$', '$')) < buffer + to) {
+    const char* limit;
+    const char* stop;
+
+    if (p + 1 >= end || p[1] != '$') { p++; continue; }
+    while (p + 2 < end && p[2] == '$') p++; // The last two of a run
+
+    limit = (end - p > TELEMETRY_SENTENCE_MAX) ? p + TELEMETRY_SENTENCE_MAX : end;
+    stop = find_any(p + 2, limit, '\n', '\r', '$');
+
+    if (telemetry_parse(p, stop - p, &t) == 0) {
+      good++;
+      if (callback && callback(&t, p - buffer, context)) break;
+    }
+    p = stop;
+  }
+
+  return good;
+}
+
+/**
+ * The deduplicator, an open addressed set of 64 bit keys
+ */
+static uint64_t dedup_key(const struct telemetry* t) {
+  uint64_t h = 14695981039346656037ULL;
+  const char* c;
+
+  for (c = t->frame.callsign; *c; c++) {
+    h = (h ^ (uint8_t)*c) * 1099511628211ULL;
+  }
+  h ^= ((uint64_t)t->frame.sentence_id << 16) | t->crc;
+  h *= 0x9E3779B97F4A7C15ULL;
+  h ^= h >> 29;
+
+  return h ? h : 1;
+}
+
+int telemetry_dedup_init(struct telemetry_dedup* d, size_t expected) {
+  d->size = 1024;
+  while (d->size < 2 * expected) d->size *= 2;
+  d->count = 0;
+  d->keys = calloc(d->size, sizeof(uint64_t));
+
+  return d->keys ? 0 : -1;
+}
+
+static void dedup_insert(struct telemetry_dedup* d, uint64_t key) {
+  size_t i = key & (d->size - 1);
+
+  while (d->keys[i]) i = (i + 1) & (d->size - 1);
+  d->keys[i] = key;
+  d->count++;
+}
+
+/**
+ * Returns 1 if the sentence hasn't been seen before, 0 if it has or -1
+ * if we're out of memory
+ */
+int telemetry_dedup_add(struct telemetry_dedup* d, const struct telemetry* t) {
+  uint64_t key = dedup_key(t);
+  size_t i;
+
+  for (i = key & (d->size - 1); d->keys[i]; i = (i + 1) & (d->size - 1)) {
+    if (d->keys[i] == key) return 0;
+  }
+
+  if (2 * (d->count + 1) > d->size) { // Grow
+    struct telemetry_dedup bigger = { calloc(2 * d->size, sizeof(uint64_t)), 2 * d->size, 0 };
+
+    if (!bigger.keys) return -1;
+    for (i = 0; i < d->size; i++) {
+      if (d->keys[i]) dedup_insert(&bigger, d->keys[i]);
+    }
+    free(d->keys);
+    *d = bigger;
+  }
+
+  dedup_insert(d, key);
+  return 1;
+}
+
+void telemetry_dedup_free(struct telemetry_dedup* d) {
+  free(d->keys);
+  d->keys = NULL;
+}
+
+/**
+ * Lists of records
+ */
+static int list_add(struct telemetry_list* l, const struct telemetry* t) {
+  if (l->count == l->size) {
+    size_t size = l->size ? 2 * l->size : 1024;
+    struct telemetry* records = realloc(l->records, size * sizeof(struct telemetry));
+
+    if (!records) return -1;
+    l->records = records; l->size = size;
+  }
+  l->records[l->count++] = *t;
+  return 0;
+}
+
+void telemetry_list_free(struct telemetry_list* l) {
+  free(l->records);
+  l->records = NULL;
+  l->count = l->size = 0;
+}
+
+/**
+ * The parallel scan
+ */
+struct telemetry_chunk {
+  const char* buffer;
+  size_t length, from, to;
+  struct telemetry_list found;
+  size_t good;
+};
+
+static int chunk_found(const struct telemetry* t, size_t offset, void* context) {
+  (void)offset;
+  return list_add(&((struct telemetry_chunk*)context)->found, t);
+}
+static void* chunk_scan(void* context) {
+  struct telemetry_chunk* c = context;
+
+  c->good = telemetry_scan(c->buffer, c->length, c->from, c->to, chunk_found, c);
+  return NULL;
+}
+
+size_t telemetry_scan_parallel(const char* buffer, size_t length, int threads,
+			       struct telemetry_dedup* d,
+			       struct telemetry_list* unique) {
+  struct telemetry_chunk* chunks;
+  pthread_t* ids;
+  size_t good = 0, i;
+  int n;
+
+  if (threads < 1) threads = 1;
+  chunks = calloc(threads, sizeof(struct telemetry_chunk));
+  ids = calloc(threads, sizeof(pthread_t));
+  if (!chunks || !ids) { free(chunks); free(ids); return 0; }
+
+  for (n = 0; n < threads; n++) {
+    chunks[n].buffer = buffer;
+    chunks[n].length = length;
+    chunks[n].from = (length * n) / threads;
+    chunks[n].to = (length * (n + 1)) / threads;
+
+    if (n == 0 || pthread_create(&ids[n], NULL, chunk_scan, &chunks[n])) {
+      ids[n] = 0;
+    }
+  }
+  chunk_scan(&chunks[0]); // Ours, and any that didn't start
+  for (n = 1; n < threads; n++) {
+    if (ids[n]) pthread_join(ids[n], NULL); else chunk_scan(&chunks[n]);
+  }
+
+  /* In order, so the first copy of each is kept */
+  for (n = 0; n < threads; n++) {
+    for (i = 0; i < chunks[n].found.count; i++) {
+      if (telemetry_dedup_add(d, &chunks[n].found.records[i]) == 1) {
+	list_add(unique, &chunks[n].found.records[i]);
+      }
+    }
+    good += chunks[n].good;
+    telemetry_list_free(&chunks[n].found);
+  }
+
+  free(chunks); free(ids);
+  return good;
+}
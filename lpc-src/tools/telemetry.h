@@ -0,0 +1,90 @@
+/*
+ * Ground station telemetry parser and deduplicator
+ * Copyright (C) 2014  richard
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "frame.h"
+
+/**
+ * One sentence. The fields are the FRAME_RADIO ones in frame.h, so
+ * this needs protocol.c too.
+ */
+struct telemetry {
+  struct frame frame;
+  uint16_t crc;
+};
+
+/**
+ * Called for each sentence with a good checksum that parses, with the
+ * offset of its first '$' in the buffer. Return non-zero to stop.
+ */
+typedef int (*telemetry_callback)(const struct telemetry* t, size_t offset,
+				  void* context);
+
+/**
+ * Set to 0 to look for delimiters a byte at a time
+ */
+extern int telemetry_simd;
+
+uint16_t telemetry_crc(const char* data, size_t length);
+int telemetry_parse(const char* sentence, size_t length, struct telemetry* t);
+size_t telemetry_scan(const char* buffer, size_t length, size_t from, size_t to,
+		      telemetry_callback callback, void* context);
+
+/**
+ * Drops sentences already seen, from another receiver or further on
+ * in the same log. Sentences are the same if they have the same
+ * callsign, id and checksum, so ids that start again after a reset
+ * aren't lost.
+ */
+struct telemetry_dedup {
+  uint64_t* keys;		/* 0 is empty */
+  size_t size;			/* A power of two */
+  size_t count;
+};
+
+int telemetry_dedup_init(struct telemetry_dedup* d, size_t expected);
+int telemetry_dedup_add(struct telemetry_dedup* d, const struct telemetry* t);
+void telemetry_dedup_free(struct telemetry_dedup* d);
+
+/**
+ * Scans a buffer on several threads. Each thread takes the sentences
+ * that start in its share of the buffer, then they're passed through
+ * the deduplicator in order. Returns the number of good sentences, and
+ * the unique ones are appended to *unique.
+ */
+struct telemetry_list {
+  struct telemetry* records;
+  size_t count, size;
+};
+
+size_t telemetry_scan_parallel(const char* buffer, size_t length, int threads,
+			       struct telemetry_dedup* d,
+			       struct telemetry_list* unique);
+void telemetry_list_free(struct telemetry_list* l);
+
+#endif /* TELEMETRY_H */
@@ -0,0 +1,289 @@
+/*
+ * Parses and deduplicates telemetry from receiver logs
+ * Copyright (C) 2014  richard
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * Usage: telemparse [-j threads] log...
+ *        telemparse -B megabytes [-j threads] [-s seed]
+ *
+ * Pulls the sentences out of receiver logs (telemetry.h), however much
+ * noise is around them, and prints each one once as CSV no matter how
+ * many of the logs it's in. The counts go to stderr.
+ *
+ * With -B it's a benchmark instead, on a log of the given size built
+ * with the firmware's own build_communications_frame(). Each sentence
+ * is heard by TELEMPARSE_RECEIVERS receivers, each of which corrupts
+ * some of them and picks up noise between them. It checks the number
+ * of unique sentences that come out against the number that got
+ * through somewhere, and times the scan on one thread and on all of
+ * them, with and without SIMD.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "protocol.h"
+#include "telemetry.h"
+
+uint16_t crc_checksum(char *string);
+extern int sentence_id;
+
+#define TELEMPARSE_RECEIVERS	3
+#define TELEMPARSE_ERROR_RATE	0.0005	/* Per character */
+#define TELEMPARSE_NOISE_RATE	0.05	/* Per sentence */
+
+static void print_csv(const struct telemetry* t) {
+  char fields[256];
+
+  /* Every field, so the columns line up whatever the phase */
+  frame_encode_text(fields, sizeof(fields), &t->frame, FRAME_RADIO | FRAME_EVERY_PHASE);
+  printf("%s,%04X\n", fields, t->crc);
+}
+
+static double now(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + (ts.tv_nsec * 1e-9);
+}
+
+/**
+ * Parses the logs given on the command line
+ */
+static int parse_logs(int count, char** names, int threads) {
+  struct telemetry_dedup d;
+  struct telemetry_list unique = { NULL, 0, 0 };
+  size_t bytes = 0, good = 0, i;
+  double start = now();
+  int n;
+
+  if (telemetry_dedup_init(&d, 0)) return 1;
+
+  for (n = 0; n < count; n++) {
+    struct stat st;
+    const char* log;
+    int fd = open(names[n], O_RDONLY);
+
+    if (fd < 0 || fstat(fd, &st)) {
+      perror(names[n]);
+      return 1;
+    }
+    if (st.st_size == 0) { close(fd); continue; }
+
+    log = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (log == MAP_FAILED) {
+      perror(names[n]);
+      return 1;
+    }
+
+    good += telemetry_scan_parallel(log, st.st_size, threads, &d, &unique);
+    bytes += st.st_size;
+    munmap((void*)log, st.st_size);
+  }
+
+  for (i = 0; i < unique.count; i++) {
+    print_csv(&unique.records[i]);
+  }
+  fprintf(stderr, "%zu bytes in %d logs: %zu good sentences, %zu unique, %.1fms\n",
+	  bytes, count, good, unique.count, (now() - start) * 1e3);
+
+  telemetry_list_free(&unique);
+  telemetry_dedup_free(&d);
+  return 0;
+}
+
+/**
+ * A fast generator for the synthetic log
+ */
+static uint64_t rng_state = 1;
+
+static uint64_t rng(void) {
+  rng_state ^= rng_state << 13;
+  rng_state ^= rng_state >> 7;
+  rng_state ^= rng_state << 17;
+  return rng_state;
+}
+static double uniform(void) {
+  return (rng() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/**
+ * Builds a sentence from a flight that wanders about
+ */
+static int build_sentence(char* s, int size, int n) {
+  struct gps_time gt = { (n / 3600) % 24, (n / 60) % 60, n % 60 };
+  struct gps_data gd = { 51.45 + (uniform() * 0.5), -2.6 + uniform(),
+			 rng() % 30000, rng() % 13 };
+  struct barometer b = { 25.0 - (uniform() * 60), 101325, 1 };
+  struct imu_raw ir;
+
+  ir.accel.x = (rng() % 2000) - 1000;
+  ir.accel.y = (rng() % 2000) - 1000;
+  ir.accel.z = (rng() % 2000) - 1000;
+  communications_frame_charset((n & 1) ? FRAME_BAUDOT : FRAME_ASCII);
+
+  return build_communications_frame(s, size, &gt, &b, &gd,
+				    gd.altitude - 20.0, (uniform() * 10) - 5,
+				    -50 + (uniform() * 70), &ir,
+				    (int)(rng() % 180) - 1, uniform() * 9,
+				    rng() % 100) - 1;
+}
+
+/**
+ * Appends what one receiver heard of a sentence, and returns 1 if it
+ * heard it all
+ */
+static int receive(char* log, size_t* length, const char* s, int s_length) {
+  static const char noise[] = "$E5TT 0$$ RYRY\r\n";
+  int intact = 1, i;
+
+  if (uniform() < TELEMPARSE_NOISE_RATE) {
+    int count = rng() % (sizeof(noise) - 1);
+    memcpy(log + *length, noise, count);
+    *length += count;
+  }
+  for (i = 0; i < s_length; i++) {
+    char c = s[i];
+    if (uniform() < TELEMPARSE_ERROR_RATE) {
+      c = 0x20 + (rng() % 0x5F);
+      if (c != s[i]) intact = 0;
+    }
+    log[(*length)++] = c;
+  }
+
+  return intact;
+}
+
+static size_t run(const char* name, const char* log, size_t length, int threads,
+		  int simd, size_t* good) {
+  struct telemetry_dedup d;
+  struct telemetry_list unique = { NULL, 0, 0 };
+  double start, elapsed;
+  size_t count;
+
+  telemetry_simd = simd;
+  telemetry_dedup_init(&d, length / 128);
+
+  start = now();
+  *good = telemetry_scan_parallel(log, length, threads, &d, &unique);
+  elapsed = now() - start;
+
+  printf("%-10s %2d thread%s: %6.1fms, %5.2f GB/s\n", name, threads,
+	 threads == 1 ? " " : "s", elapsed * 1e3, length / elapsed / 1e9);
+
+  count = unique.count;
+  telemetry_list_free(&unique);
+  telemetry_dedup_free(&d);
+  return count;
+}
+
+static int benchmark(size_t megabytes, int threads) {
+  size_t size = megabytes << 20, length[TELEMPARSE_RECEIVERS] = { 0 };
+  size_t sentences = 0, heard = 0, total = 0, good, unique, i;
+  char* logs[TELEMPARSE_RECEIVERS];
+  char* log = malloc(size + 1024);
+  char s[256];
+  int r;
+
+  if (!log) return 1;
+  for (r = 0; r < TELEMPARSE_RECEIVERS; r++) {
+    logs[r] = malloc((size / TELEMPARSE_RECEIVERS) + 1024);
+    if (!logs[r]) return 1;
+  }
+
+  /* Build the receivers' logs, then put them one after the other */
+  sentence_id = 0;
+  while (length[0] + 256 < size / TELEMPARSE_RECEIVERS) {
+    int s_length = build_sentence(s, sizeof(s), sentences);
+    int intact = 0;
+
+    if (sentences < 1000 &&
+	telemetry_crc(s + 2, s_length - 8) != strtoul(s + s_length - 5, NULL, 16)) {
+      fprintf(stderr, "CRC mismatch: %s", s);
+      return 1;
+    }
+    for (r = 0; r < TELEMPARSE_RECEIVERS; r++) {
+      intact |= receive(logs[r], &length[r], s, s_length);
+    }
+    heard += intact;
+    sentences++;
+  }
+  for (r = 0; r < TELEMPARSE_RECEIVERS; r++) {
+    memcpy(log + total, logs[r], length[r]);
+    total += length[r];
+    free(logs[r]);
+  }
+
+  printf("%zu sentences, %d receivers, %.1fMB: %zu heard intact somewhere\n",
+	 sentences, TELEMPARSE_RECEIVERS, total / 1048576.0, heard);
+
+  for (i = 0; i < 4; i++) {
+    int n = (i & 1) ? threads : 1;
+    int simd = !(i & 2);
+
+    if (n == 1 && (i & 1)) continue;
+    unique = run(simd ? "SIMD" : "Scalar", log, total, n, simd, &good);
+    if (unique != heard) {
+      /* A corrupted copy gets past the CRC about once in 65536 */
+      printf("  %zu good, %zu unique, expected %zu\n", good, unique, heard);
+    }
+  }
+
+  free(log);
+  return 0;
+}
+
+int main(int argc, char** argv) {
+  int threads = sysconf(_SC_NPROCESSORS_ONLN);
+  size_t megabytes = 0;
+  int c;
+
+  while ((c = getopt(argc, argv, "j:B:s:")) != -1) {
+    switch (c) {
+      case 'j': threads = atoi(optarg); break;
+      case 'B': megabytes = atoi(optarg); break;
+      case 's': rng_state = strtoull(optarg, NULL, 0) | 1; break;
+      default:
+	fprintf(stderr, "Usage: telemparse [-j threads] log...\n"
+		"       telemparse -B megabytes [-j threads] [-s seed]\n");
+	return 1;
+    }
+  }
+  if (threads < 1) threads = 1;
+
+  if (megabytes) {
+    return benchmark(megabytes, threads);
+  }
+  if (optind == argc) {
+    fprintf(stderr, "No logs\n");
+    return 1;
+  }
+  return parse_logs(argc - optind, argv + optind, threads);
+}
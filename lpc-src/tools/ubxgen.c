@@ -0,0 +1,163 @@
+/*
+ * UBX stream generator
+ * Copyright (C) 2014  richard
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * Usage: ubxgen [-d seconds] [-r rate] [-e N] [-n] [-p] > stream
+ *
+ * Writes the NAV-PVTs a u-blox receiver would send on a climb at 5m/s
+ * from the launch site, drifting east, framed by the firmware's own
+ * writer in src/ubx.c. The rate is in fixes a second, 1 to 5.
+ *
+ * -e flips a bit in the payload of every Nth NAV-PVT, which the
+ * checksum should catch. -n puts a GGA in front of each second's
+ * fixes, as from a receiver that still has NMEA turned on. -p gives
+ * no fix above 12km, as the default portable dynamic model does.
+ *
+ * test/Makefile feeds a stream through the firmware's parser with
+ * ubx-test.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include "ubx.h"
+
+#define UBXGEN_LAT		51.821773
+#define UBXGEN_LON		-0.012583
+#define UBXGEN_ASCENT		5.0	/* m/s */
+#define UBXGEN_DRIFT		8.5	/* m/s east */
+#define UBXGEN_START		36000	/* 10:00:00 */
+#define UBXGEN_PORTABLE_MAX	12000	/* m */
+
+/**
+ * Frames the message, then flips the given bit of the payload if it's
+ * not negative
+ */
+static void write_message(uint8_t cls, uint8_t id, const uint8_t* payload,
+			  uint16_t length, int flip) {
+  struct ubx_message m = { cls, id, length, payload };
+  struct ubx_writer w;
+  uint8_t frame[UBX_FRAME_SIZE(UBX_MAX_LENGTH)];
+  size_t n = 0;
+  int c;
+
+  ubx_writer_init(&w, &m, 1);
+  while ((c = ubx_writer_next(&w)) >= 0) frame[n++] = c;
+  if (flip >= 0) frame[6 + (flip / 8) % length] ^= 1 << (flip % 8);
+  fwrite(frame, 1, n, stdout);
+}
+
+static void write_gga(uint32_t t, int fix, double lat, double lon, double alt) {
+  char body[128];
+  unsigned checksum = 0;
+  char* c;
+
+  if (fix) {
+    snprintf(body, sizeof(body),
+	     "GPGGA,%02u%02u%02u.00,%02d%08.5f,N,%03d%08.5f,%c,1,09,1.0,%.1f,M,47.0,M,,",
+	     t / 3600 % 24, t / 60 % 60, t % 60, (int)lat, (lat - (int)lat) * 60,
+	     (int)fabs(lon), (fabs(lon) - (int)fabs(lon)) * 60,
+	     lon < 0 ? 'W' : 'E', alt);
+  } else {
+    snprintf(body, sizeof(body), "GPGGA,%02u%02u%02u.00,,,,,0,00,99.99,,,,,,",
+	     t / 3600 % 24, t / 60 % 60, t % 60);
+  }
+  for (c = body; *c; c++) checksum ^= *c;
+  printf("$%s*%02X\r\n", body, checksum);
+}
+
+int main(int argc, char** argv) {
+  uint8_t pvt[UBX_PVT_LENGTH];
+  double duration = 600, t, alt, lat, lon;
+  uint32_t rate = 1, every = 0, i, n, corrupted = 0, ms, s;
+  int nmea = 0, portable = 0, fix, flip, c;
+
+  while ((c = getopt(argc, argv, "d:r:e:np")) != -1) {
+    switch (c) {
+      case 'd': duration = atof(optarg); break;
+      case 'r': rate = atoi(optarg); break;
+      case 'e': every = atoi(optarg); break;
+      case 'n': nmea = 1; break;
+      case 'p': portable = 1; break;
+      default:
+	fprintf(stderr, "Usage: %s [-d seconds] [-r rate] [-e N] [-n] [-p]\n",
+		argv[0]);
+	return 1;
+    }
+  }
+  if (rate < 1 || rate > 5 || duration <= 0) {
+    fprintf(stderr, "The rate is 1 to 5 fixes a second\n");
+    return 1;
+  }
+
+  n = duration * rate;
+  for (i = 0; i < n; i++) {
+    ms = i * (1000 / rate);
+    t = ms / 1000.0;
+    s = UBXGEN_START + ms / 1000;
+    alt = UBXGEN_ASCENT * t;
+    lat = UBXGEN_LAT;
+    lon = UBXGEN_LON + UBXGEN_DRIFT * t / (111320.0 * cos(lat * M_PI / 180));
+    fix = !portable || alt <= UBXGEN_PORTABLE_MAX;
+
+    if (nmea && ms % 1000 == 0) write_gga(s, fix, lat, lon, alt);
+
+    memset(pvt, 0, sizeof(pvt));
+    ubx_put_u32(pvt, (UBXGEN_START * 1000) + ms); /* iTOW, on a Sunday */
+    ubx_put_u16(pvt + 4, 2014);
+    pvt[6] = 6; pvt[7] = 1;
+    pvt[UBX_PVT_HOUR] = s / 3600 % 24;
+    pvt[UBX_PVT_MIN] = s / 60 % 60;
+    pvt[UBX_PVT_SEC] = s % 60;
+    pvt[UBX_PVT_VALID] = 0x07;	/* Date, time, fully resolved */
+    pvt[UBX_PVT_NUM_SV] = 9;
+    if (fix) {
+      pvt[UBX_PVT_FIX_TYPE] = 3;
+      pvt[UBX_PVT_FLAGS] = UBX_PVT_FIX_OK;
+      ubx_put_u32(pvt + UBX_PVT_LON, (int32_t)lround(lon * 1e7));
+      ubx_put_u32(pvt + UBX_PVT_LAT, (int32_t)lround(lat * 1e7));
+      ubx_put_u32(pvt + UBX_PVT_HEIGHT, (int32_t)lround((alt + 47) * 1000));
+      ubx_put_u32(pvt + UBX_PVT_HMSL, (int32_t)lround(alt * 1000));
+      ubx_put_u32(pvt + 52, (int32_t)lround(UBXGEN_DRIFT * 1000)); /* velE */
+      ubx_put_u32(pvt + 56, (int32_t)lround(-UBXGEN_ASCENT * 1000)); /* velD */
+      ubx_put_u16(pvt + 76, 150);	/* pDOP 1.5 */
+    }
+
+    /* Not the last, so the gap before the next shows */
+    flip = -1;
+    if (every && i % every == every - 1 && i + 1 < n) {
+      flip = i * 13;
+      corrupted++;
+    }
+
+    write_message(UBX_NAV, UBX_NAV_PVT, pvt, sizeof(pvt), flip);
+  }
+
+  fprintf(stderr, "%u NAV-PVT at %uHz, %u corrupt%s\n", n, rate, corrupted,
+	  nmea ? ", with GGAs" : "");
+  return 0;
+}